@@ -29,6 +29,11 @@ extern "C"	{
 */
 typedef struct _cdk CDK;
 
+/*! <summary>struct</summary>
+	A request sent with <a href="#CDKSendRequestAsync">CDKSendRequestAsync</a>, whose answer may not be received yet.
+*/
+typedef struct _CDKRequest CDKRequest;
+
 /*!
 	Unable to access on the certificate revocation list
 */
@@ -74,12 +79,20 @@ typedef void (*PCDKTRACEFUNCTION)(CDK* pCDK, uint8_t level, const char* strTrace
 
 /*!
 	Static function that sets the <a href="#PCDKTRACEFUNCTION">trace callback</a>.<br/>
-	It is highly recommended to set the trace callback on application startup.
+	It is highly recommended to set the trace callback on application startup.<br/>
+	The previous callback is not called any more once this function returns, so that its user data can be freed : it must not be called from the trace callback.
 	@param[in] traceFunction a pointer to the callback function
 	@param[in] pUser callback user data
 */
 void CDK_API CDKSetTraceFunction(PCDKTRACEFUNCTION traceFunction, void* pUser);
 
+/*!
+	Static function that sets the maximum level of the traces handed to the <a href="#PCDKTRACEFUNCTION">trace callback</a>.<br/>
+	The traces above this level are discarded before they are formatted, so that they cost nothing.
+	@param[in] level maximum trace level : 0 (no trace) to 8 (DEBUG, the default)
+*/
+void CDK_API CDKSetTraceLevel(uint8_t level);
+
 /*!
 	Returns the object's last error
 	@param[in] pCDKObject the object : can be a <a href="#CDK">CDK</a> instance, or any other class of the CDK.
@@ -267,6 +280,14 @@ void CDK_API CDKSetMaxQueueSize(CDK* pCDK, uint32_t uMax);
 */
 int32_t CDK_API CDKWaitForNewMessage(CDK* pCDK, uint32_t uTimeout);
 
+/*!
+	Returns a file descriptor that is readable as long as the queue of the CDK is not empty, to wait with poll, select or epoll.<br/>
+	This is the descriptor of the queue currently used by the CDK (<a href="#CDKQueueGetReadyFd">CDKQueueGetReadyFd</a>) : it changes with <a href="#CDKSetQueue">CDKSetQueue</a>.
+	@param[in] pCDK CDK instance
+	@returns the file descriptor, or -1 in case of failure. Use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int CDK_API CDKGetReadyFd(CDK* pCDK);
+
 /*!
 	Returns the current size of the queue : the number of messages received, to be read by the application.
 	@param[in] pCDK CDK instance
@@ -291,6 +312,89 @@ CDKMsg CDK_API * CDKPopMessage(CDK* pCDK);
 */
 CDKMsg CDK_API * CDKSendRequest(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs);
 
+/*! <summary>callback</summary>
+
+	Callback called when the answer of a request sent with <a href="#CDKSendRequestCallback">CDKSendRequestCallback</a> is received,
+	or when the request fails. It is called from the connection thread of the CDK, and should return quickly.
+	@param[in] pCDK Pointer to the CDK instance
+	@param[in] pAnswer the answered message (has to be destroyed by the application), or NULL if the request timed out or the connection was lost
+	@param[in] pUser User data
+*/
+typedef void (*PCDKREQUESTCALLBACK) (CDK* pCDK, CDKMsg* pAnswer, void* pUser);
+
+/*!
+	Sends a message to the equipment without waiting for the answer : the <a href="#PCDKREQUESTCALLBACK">request callback</a> is called
+	exactly once, with the answer or with NULL. Many requests can be in flight on the same CDK instance.<br/>
+	Timeouts are checked by the connection thread, at least every 100 ms.<br/>
+	The sent message must be destroyed by the application, it can be destroyed as soon as this function returns.
+	@param[in] pCDK CDK instance
+	@param[in] pMsgToSend the message to be sent (has to be destroyed by the application)
+	@param[in] uTimeoutMs timeout for the request, in milliseconds
+	@param[in] callback the callback called with the answer
+	@param[in] pUser callback user data
+	@returns CDK_OK if the request has been sent, CDK_FAIL otherwise (the callback is then not called, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details)
+*/
+int32_t CDK_API CDKSendRequestCallback(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs, PCDKREQUESTCALLBACK callback, void* pUser);
+
+/*!
+	Sends a message to the equipment without waiting for the answer, and returns a handle on the request.
+	Many requests can be in flight on the same CDK instance : sending a request to every equipment and then waiting
+	for all the answers takes about one round trip.<br/>
+	The sent message must be destroyed by the application, it can be destroyed as soon as this function returns.
+	@param[in] pCDK CDK instance
+	@param[in] pMsgToSend the message to be sent (has to be destroyed by the application)
+	@param[in] uTimeoutMs timeout for the request, in milliseconds
+	@param[in] pUser user data, returned by <a href="#CDKRequestGetUserData">CDKRequestGetUserData</a>
+	@returns the request (has to be destroyed with <a href="#CDKRequestDestroy">CDKRequestDestroy</a>), or NULL if it could not be sent (use <a href="#CDKGetLastError">CDKGetLastError</a> for more details)
+*/
+CDKRequest CDK_API * CDKSendRequestAsync(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs, void* pUser);
+
+/*!
+	Sends a message to the equipment without waiting for the answer. The answer is pushed in a completion queue, with pUser as
+	<a href="#CDKMsgSetUserData">user data</a> and the CDK instance as <a href="#CDKMsgGetCDK">source</a>.
+	If the request times out or the connection is lost, a message without root element is pushed instead.<br/>
+	The sent message must be destroyed by the application, it can be destroyed as soon as this function returns.
+	@param[in] pCDK CDK instance
+	@param[in] pMsgToSend the message to be sent (has to be destroyed by the application)
+	@param[in] uTimeoutMs timeout for the request, in milliseconds
+	@param[in] pQueue the completion queue. It must not be destroyed while requests are in flight.
+	@param[in] pUser user data of the message pushed in the queue
+	@returns CDK_OK if the request has been sent, CDK_FAIL otherwise (nothing is then pushed, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details)
+*/
+int32_t CDK_API CDKSendRequestToQueue(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs, CDKQueue* pQueue, void* pUser);
+
+/*!
+	Blocks until the request is complete (answered, timed out or failed), or the timeout is reached.
+	@param[in] pRequest the request
+	@param[in] uTimeout the timeout in ms
+	@returns CDK_OK if the request is complete, CDK_FAIL if the timeout has been reached
+*/
+int32_t CDK_API CDKRequestWait(CDKRequest* pRequest, uint32_t uTimeout);
+
+/*!
+	Tells whether the request is complete, without blocking.
+	@returns 1 if the request is complete, 0 otherwise
+*/
+int32_t CDK_API CDKRequestIsComplete(CDKRequest* pRequest);
+
+/*!
+	Takes the answer of a complete request. The message is then owned by the application and has to be destroyed by it.
+	@param[in] pRequest the request
+	@returns the answer, or NULL if the request is not complete, failed, or if the answer has already been taken
+*/
+CDKMsg CDK_API * CDKRequestTakeAnswer(CDKRequest* pRequest);
+
+/*!
+	Returns the user data given to <a href="#CDKSendRequestAsync">CDKSendRequestAsync</a>
+*/
+void CDK_API * CDKRequestGetUserData(CDKRequest* pRequest);
+
+/*!
+	Destroys a request handle. If the request is not complete, its answer will be destroyed when it is received.
+	@param[in] pRequest the request
+*/
+void CDK_API CDKRequestDestroy(CDKRequest* pRequest);
+
 /*!
 	Sends a message to the equipment on the asynchronous connection.<br/>
 	The sent message must be destroyed by the application.
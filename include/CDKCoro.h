@@ -0,0 +1,505 @@
+/*! \file
+
+CDKCoro : C++20 coroutine facade over the CDK.<br/>
+A single <a href="#cdk::Executor">cdk::Executor</a> thread drives any number of coroutines : it waits on the
+<a href="#CDKGetReadyFd">ready fds</a> of the CDK queues with epoll, and resumes the coroutines whose requests are answered
+by the <a href="#PCDKREQUESTCALLBACK">request callbacks</a>. No thread is blocked by a request or by an empty queue.
+
+\code
+cdk::Task<> Poll(cdk::Executor& executor, cdk::Client& client, CDKMsg* pRequest)
+{
+	for (;;)
+	{
+		cdk::Msg answer = co_await client.request(pRequest, 2000);
+		cdk::Msg read = co_await client.next_message();
+		co_await executor.sleep_for(std::chrono::seconds(10));
+	}
+}
+\endcode
+
+This header only uses the public API. It requires C++20, and Linux for epoll.<br/>
+The executor must outlive its coroutines, and the CDK instances must be unbound before the executor is destroyed.
+
+*/
+
+#ifndef CDKCORO_H
+#define CDKCORO_H
+
+#if __cplusplus < 202002L
+#error "CDKCoro.h requires C++20"
+#endif
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKQueue.h"
+
+namespace cdk
+{
+
+/*!
+	Destroys a message with <a href="#CDKMsgDestroy">CDKMsgDestroy</a>
+*/
+struct MsgDeleter
+{
+	void operator()(CDKMsg* pMsg) const { CDKMsgDestroy(pMsg); }
+};
+
+/*!
+	A message owned by the application
+*/
+typedef std::unique_ptr<CDKMsg, MsgDeleter> Msg;
+
+template <typename T = void>
+class Task;
+
+namespace detail
+{
+	struct PromiseBase
+	{
+		/*! coroutine awaiting this one, resumed when this one is finished */
+		std::coroutine_handle<> continuation;
+		std::exception_ptr exception;
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept { return false; }
+			template <typename P>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+			{
+				std::coroutine_handle<> continuation = handle.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() noexcept {}
+		};
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void unhandled_exception() { exception = std::current_exception(); }
+	};
+
+	template <typename T>
+	struct Promise : PromiseBase
+	{
+		T value{};
+
+		Task<T> get_return_object();
+		void return_value(T newValue) { value = std::move(newValue); }
+	};
+
+	template <>
+	struct Promise<void> : PromiseBase
+	{
+		Task<void> get_return_object();
+		void return_void() {}
+	};
+}
+
+/*!
+	A lazy coroutine returning a T. It starts when it is awaited, and resumes its caller when it is finished.
+*/
+template <typename T>
+class Task
+{
+public:
+	typedef detail::Promise<T> promise_type;
+
+	Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (handle)
+				handle.destroy();
+			handle = std::exchange(other.handle, {});
+		}
+		return *this;
+	}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+	{
+		handle.promise().continuation = caller;
+		return handle;
+	}
+	T await_resume()
+	{
+		if (handle.promise().exception)
+			std::rethrow_exception(handle.promise().exception);
+		if constexpr (!std::is_void_v<T>)
+			return std::move(handle.promise().value);
+	}
+
+private:
+	friend promise_type;
+	explicit Task(std::coroutine_handle<promise_type> newHandle) : handle(newHandle) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+inline Task<T> detail::Promise<T>::get_return_object()
+{
+	return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::Promise<void>::get_return_object()
+{
+	return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+/*!
+	Single threaded executor : runs the coroutines given to <a href="#cdk::Executor::spawn">spawn</a> until they are all finished.
+	Only <a href="#cdk::Executor::post">post</a> and <a href="#cdk::Executor::stop">stop</a> can be called from another thread.
+*/
+class Executor
+{
+public:
+	Executor()
+	{
+		iEpoll = epoll_create1(EPOLL_CLOEXEC);
+		iWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = iWakeFd;
+		epoll_ctl(iEpoll, EPOLL_CTL_ADD, iWakeFd, &event);
+	}
+
+	/*!
+		Destroys the coroutines that are not finished
+	*/
+	~Executor()
+	{
+		std::unordered_set<void*> remaining;
+		remaining.swap(tasks);
+		for (void* pAddress : remaining)
+			std::coroutine_handle<>::from_address(pAddress).destroy();
+		close(iWakeFd);
+		close(iEpoll);
+	}
+
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+	/*!
+		Starts a coroutine. It runs on the next iteration of <a href="#cdk::Executor::run">run</a>.
+	*/
+	void spawn(Task<> task)
+	{
+		Detached detached = RunDetached(std::move(task));
+		detached.handle.promise().pExecutor = this;
+		tasks.insert(detached.handle.address());
+		ready.push_back(detached.handle);
+	}
+
+	/*!
+		Runs the coroutines until they are all finished, or until <a href="#cdk::Executor::stop">stop</a> is called
+	*/
+	void run()
+	{
+		bStop = false;
+		std::vector<epoll_event> events(64);
+		while (!bStop && !tasks.empty())
+		{
+			TakePosted();
+			while (!ready.empty() && !bStop)
+			{
+				std::coroutine_handle<> handle = ready.front();
+				ready.pop_front();
+				handle.resume();
+			}
+			if (bStop || tasks.empty())
+				break;
+			FireTimers();
+			if (!ready.empty())
+				continue;
+
+			int iTimeout = -1;
+			if (!timers.empty())
+			{
+				auto delay = timers.top().deadline - std::chrono::steady_clock::now();
+				iTimeout = (int)std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(delay).count());
+			}
+			int iCount = epoll_wait(iEpoll, events.data(), (int)events.size(), iTimeout);
+			for (int i = 0; i < iCount; i++)
+			{
+				int iFd = events[i].data.fd;
+				if (iFd == iWakeFd)
+				{
+					uint64_t uValue;
+					ssize_t iRead = read(iWakeFd, &uValue, sizeof(uValue));
+					(void)iRead;
+					continue;
+				}
+				auto it = fdWaiters.find(iFd);
+				if (it == fdWaiters.end())
+					continue;
+				for (std::coroutine_handle<> handle : it->second)
+					ready.push_back(handle);
+				fdWaiters.erase(it);
+				epoll_ctl(iEpoll, EPOLL_CTL_DEL, iFd, nullptr);
+			}
+		}
+	}
+
+	/*!
+		Makes <a href="#cdk::Executor::run">run</a> return. Thread safe.
+	*/
+	void stop()
+	{
+		bStop = true;
+		Wake();
+	}
+
+	/*!
+		Resumes a suspended coroutine on the executor thread. Thread safe.
+	*/
+	void post(std::coroutine_handle<> handle)
+	{
+		{
+			std::lock_guard<std::mutex> lock(postedMutex);
+			posted.push_back(handle);
+		}
+		Wake();
+	}
+
+	/*!
+		Awaitable resuming the coroutine when a file descriptor is readable
+	*/
+	auto readable(int iFd)
+	{
+		struct Awaiter
+		{
+			Executor* pExecutor;
+			int iFd;
+
+			bool await_ready() const noexcept { return false; }
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				std::vector<std::coroutine_handle<>>& waiters = pExecutor->fdWaiters[iFd];
+				if (waiters.empty())
+				{
+					epoll_event event = {};
+					event.events = EPOLLIN;
+					event.data.fd = iFd;
+					if (epoll_ctl(pExecutor->iEpoll, EPOLL_CTL_ADD, iFd, &event) != 0)
+					{
+						pExecutor->fdWaiters.erase(iFd);
+						return false;
+					}
+				}
+				waiters.push_back(handle);
+				return true;
+			}
+			void await_resume() const noexcept {}
+		};
+		return Awaiter{ this, iFd };
+	}
+
+	/*!
+		Awaitable resuming the coroutine after a delay
+	*/
+	auto sleep_for(std::chrono::steady_clock::duration delay)
+	{
+		struct Awaiter
+		{
+			Executor* pExecutor;
+			std::chrono::steady_clock::time_point deadline;
+
+			bool await_ready() const noexcept { return deadline <= std::chrono::steady_clock::now(); }
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				pExecutor->timers.push(Timer{ deadline, pExecutor->uNextTimer++, handle });
+			}
+			void await_resume() const noexcept {}
+		};
+		return Awaiter{ this, std::chrono::steady_clock::now() + delay };
+	}
+
+	/*!
+		Number of coroutines started by <a href="#cdk::Executor::spawn">spawn</a> and not finished yet
+	*/
+	size_t size() const { return tasks.size(); }
+
+private:
+	/*! root of a spawned coroutine : destroys itself when finished */
+	struct Detached
+	{
+		struct promise_type
+		{
+			Executor* pExecutor = nullptr;
+
+			~promise_type()
+			{
+				if (pExecutor)
+					pExecutor->tasks.erase(std::coroutine_handle<promise_type>::from_promise(*this).address());
+			}
+			Detached get_return_object() { return Detached{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	struct Timer
+	{
+		std::chrono::steady_clock::time_point deadline;
+		/*! timers with the same deadline fire in order */
+		uint64_t uSequence;
+		std::coroutine_handle<> handle;
+
+		bool operator>(const Timer& other) const
+		{
+			return deadline != other.deadline ? deadline > other.deadline : uSequence > other.uSequence;
+		}
+	};
+
+	static Detached RunDetached(Task<> task)
+	{
+		co_await task;
+	}
+
+	void Wake()
+	{
+		uint64_t uValue = 1;
+		ssize_t iWritten = write(iWakeFd, &uValue, sizeof(uValue));
+		(void)iWritten;
+	}
+
+	void TakePosted()
+	{
+		std::lock_guard<std::mutex> lock(postedMutex);
+		for (std::coroutine_handle<> handle : posted)
+			ready.push_back(handle);
+		posted.clear();
+	}
+
+	void FireTimers()
+	{
+		auto now = std::chrono::steady_clock::now();
+		while (!timers.empty() && timers.top().deadline <= now)
+		{
+			ready.push_back(timers.top().handle);
+			timers.pop();
+		}
+	}
+
+	int iEpoll = -1;
+	int iWakeFd = -1;
+	std::atomic<bool> bStop{false};
+	/*! frames of the spawned coroutines that are not finished */
+	std::unordered_set<void*> tasks;
+	std::deque<std::coroutine_handle<>> ready;
+	std::unordered_map<int, std::vector<std::coroutine_handle<>>> fdWaiters;
+	std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+	uint64_t uNextTimer = 0;
+
+	std::mutex postedMutex;
+	std::vector<std::coroutine_handle<>> posted;
+};
+
+/*!
+	Awaitable sending a request with <a href="#CDKSendRequestCallback">CDKSendRequestCallback</a>.
+	Gives the answer, or an empty message if the request failed (use <a href="#CDKGetLastError">CDKGetLastError</a> on the CDK if it could not be sent).
+*/
+class RequestAwaiter
+{
+public:
+	RequestAwaiter(Executor& executor, CDK* pCDK, CDKMsg* pMsg, uint32_t uTimeoutMs)
+		: pExecutor(&executor), pCDK(pCDK), pMsg(pMsg), uTimeoutMs(uTimeoutMs)
+	{
+	}
+
+	bool await_ready() const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<> newHandle)
+	{
+		handle = newHandle;
+		// on failure, the coroutine goes on at once without answer
+		return CDKSendRequestCallback(pCDK, pMsg, uTimeoutMs, OnAnswer, this) == CDK_OK;
+	}
+	Msg await_resume() noexcept { return Msg(pAnswer); }
+
+private:
+	static void OnAnswer(CDK*, CDKMsg* pAnswer, void* pUser)
+	{
+		RequestAwaiter* pAwaiter = (RequestAwaiter*)pUser;
+		pAwaiter->pAnswer = pAnswer;
+		pAwaiter->pExecutor->post(pAwaiter->handle);
+	}
+
+	Executor* pExecutor;
+	CDK* pCDK;
+	CDKMsg* pMsg;
+	uint32_t uTimeoutMs;
+	std::coroutine_handle<> handle;
+	CDKMsg* pAnswer = nullptr;
+};
+
+/*!
+	A CDK instance driven by an executor. The CDK stays owned by the application, and the client must outlive its coroutines.
+*/
+class Client
+{
+public:
+	Client(Executor& executor, CDK* pCDK) : pExecutor(&executor), pCDK(pCDK) {}
+
+	CDK* get() const { return pCDK; }
+
+	/*!
+		Waits for the next message of the queue of the CDK, without blocking the executor.
+		Gives an empty message if the ready fd of the queue cannot be created.
+	*/
+	Task<Msg> next_message()
+	{
+		for (;;)
+		{
+			if (CDKMsg* pMsg = CDKPopMessage(pCDK))
+				co_return Msg(pMsg);
+			int iFd = CDKGetReadyFd(pCDK);
+			if (iFd < 0)
+				co_return Msg();
+			co_await pExecutor->readable(iFd);
+		}
+	}
+
+	/*!
+		Sends a request and waits for its answer, without blocking the executor. The message stays owned by the caller.
+	*/
+	RequestAwaiter request(CDKMsg* pMsg, uint32_t uTimeoutMs) { return RequestAwaiter(*pExecutor, pCDK, pMsg, uTimeoutMs); }
+
+private:
+	Executor* pExecutor;
+	CDK* pCDK;
+};
+
+}
+
+#endif //CDKCORO_H
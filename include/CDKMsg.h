@@ -31,6 +31,22 @@ typedef struct  _CDKMsg CDKMsg;
 */
 typedef struct  _CDKMsgElement CDKMsgElement;
 
+/*! <summary>struct</summary>
+
+    An exported message, held in a reusable buffer
+*/
+typedef struct  _CDKMsgExportBuffer CDKMsgExportBuffer;
+
+/*! <summary>struct</summary>
+
+    A piece of an exported message
+*/
+typedef struct
+{
+	const uint8_t* pData;
+	uint32_t uSize;
+} CDKMsgSegment;
+
 /*! <summary>callback</summary>
 
     Callback called when <a href="#CDKMsgExport">CDKMsgExport</a> is executed
@@ -76,6 +92,22 @@ int32_t CDK_API CDKMsgStringEqual(const char* str1, const char* str2);
 */
 CDKMsg CDK_API * CDKMsgCreate();
 
+/*!
+	Sets the number of CDKMsg, and of CDKMsgElement, kept by every thread for reuse.<br/>
+	Destroyed messages and elements are cleared and kept in a pool of the destroying thread, and reused by the next
+	<a href="#CDKMsgCreate">CDKMsgCreate</a> and <a href="#CDKMsgElementCreate">CDKMsgElementCreate</a>, so that steady traffic does not use the heap.
+	Threads share the objects they do not need through a common depot, holding up to 16 times this size.<br/>
+	The default size is 256. 0 disables the pools.
+	@param[in] uSize the number of objects of each kind kept per thread
+*/
+void CDK_API CDKMsgSetPoolSize(uint32_t uSize);
+
+/*!
+	Returns the number of CDKMsg, and of CDKMsgElement, kept by every thread for reuse
+	@returns the pool size, as set by <a href="#CDKMsgSetPoolSize">CDKMsgSetPoolSize</a>
+*/
+uint32_t CDK_API CDKMsgGetPoolSize();
+
 /*!
 	Returns the read-only state of a CDKMsg. When a CDKMsg is read-only, it is possible to use <a href="#CDKMsgAddRef">CDKMsgAddRef</a>.
 	@param[in] pMsg CDKMsg	
@@ -156,6 +188,58 @@ int32_t CDK_API CDKMsgImport(CDKMsg* pMsg, PCDKMSGIMPORTCALLBACK importCallback,
 */
 int32_t CDK_API CDKMsgExportToBinaryArray(CDKMsg* pMsg, uint8_t* pBuffer, uint32_t uBufferSize);
 
+/*!
+	Returns the exact size of the exported message, without exporting it : the size of the buffer
+	<a href="#CDKMsgExportToBinaryArray">CDKMsgExportToBinaryArray</a> needs.
+	@param[in] pMsg The message
+	@returns the size of the exported message, 0 if pMsg is NULL
+*/
+uint32_t CDK_API CDKMsgGetExportSize(CDKMsg* pMsg);
+
+/*!
+	Exports a message in a buffer taken from a per-thread pool, sized for the message. <br/>
+	The buffers keep their memory when they are destroyed, so that steady exports do not use the heap.
+	@param[in] pMsg The message to export
+	@returns the buffer, to be destroyed with <a href="#CDKMsgExportBufferDestroy">CDKMsgExportBufferDestroy</a>, or NULL on failure
+*/
+CDKMsgExportBuffer CDK_API * CDKMsgExportToBuffer(CDKMsg* pMsg);
+
+/*!
+	Exports a message as a list of segments (scatter-gather), in a buffer taken from a per-thread pool. <br/>
+	The structure of the message and the small contents are written in the buffer, but contents and attribute values of at least
+	uMinSegmentSize bytes are not copied : their segments point into the message. Write the segments in order with writev or sendmsg.<br/>
+	If the message is read-only, the buffer holds a reference on it (<a href="#CDKMsgAddRef">CDKMsgAddRef</a>) until it is destroyed.
+	Otherwise the message must not be modified or destroyed before the buffer.
+	@param[in] pMsg The message to export
+	@param[in] uMinSegmentSize minimum size of the data left in the message, 0 for 4096
+	@returns the buffer, to be destroyed with <a href="#CDKMsgExportBufferDestroy">CDKMsgExportBufferDestroy</a>, or NULL on failure
+*/
+CDKMsgExportBuffer CDK_API * CDKMsgExportToSegments(CDKMsg* pMsg, uint32_t uMinSegmentSize);
+
+/*!
+	Returns the size of an exported message : the sum of the sizes of its segments
+*/
+uint32_t CDK_API CDKMsgExportBufferGetSize(CDKMsgExportBuffer* pBuffer);
+
+/*!
+	Returns the exported message of a buffer filled by <a href="#CDKMsgExportToBuffer">CDKMsgExportToBuffer</a>
+	@returns the exported message, of <a href="#CDKMsgExportBufferGetSize">CDKMsgExportBufferGetSize</a> bytes, or NULL if the message has been exported as several segments
+*/
+const uint8_t CDK_API * CDKMsgExportBufferGetData(CDKMsgExportBuffer* pBuffer);
+
+/*!
+	Returns the segments of an exported message. A buffer filled by <a href="#CDKMsgExportToBuffer">CDKMsgExportToBuffer</a> has a single segment.
+	@param[in] pBuffer the buffer
+	@param[out] ppSegments receives the segments, valid until the buffer is destroyed
+	@returns the number of segments
+*/
+uint32_t CDK_API CDKMsgExportBufferGetSegments(CDKMsgExportBuffer* pBuffer, const CDKMsgSegment** ppSegments);
+
+/*!
+	Gives a buffer back to the pool of the calling thread. The buffer may be destroyed by another thread than the one that filled it.
+*/
+void CDK_API CDKMsgExportBufferDestroy(CDKMsgExportBuffer* pBuffer);
+
 /*!
 	Imports a message from a binary buffer. <br/>
 	The message must have been previously created with CDKMsgCreate. The message has to be destroyed by the application.
@@ -324,6 +408,14 @@ uint32_t CDK_API CDKMsgElementAttributeCount(CDKMsgElement* pElement);
 */
 const char CDK_API * CDKMsgElementAttributeName( CDKMsgElement* pElement, uint32_t uIndex );
 
+/*!
+	Returns an attribute's value by its index, to go through the attributes without looking each of them up by name
+	@param[in] pElement The element
+	@param[in] uIndex The index of the attribute, as for <a href="#CDKMsgElementAttributeName">CDKMsgElementAttributeName</a>
+	@returns The attribute value in UTF-8, or NULL if the index is invalid
+*/
+const char CDK_API * CDKMsgElementAttributeValueAt( CDKMsgElement* pElement, uint32_t uIndex );
+
 /*!
 	Returns an attribute's value
 	@param[in] pElement The element
@@ -47,12 +47,20 @@ typedef int32_t (*PCDKPLATEFINGERPRINTMATCHERSAVEDICTIONARYFUNCTION)(CDKPlateFin
 
 /*!
 	Static function that sets the <a href="#PCDKPLATEFINGERPRINTMATCHERTRACEFUNCTION">trace callback</a>.<br/>
-	It is highly recommended to set the trace callback on application startup.
+	It is highly recommended to set the trace callback on application startup.<br/>
+	The previous callback is not called any more once this function returns, so that its user data can be freed : it must not be called from the trace callback.
 	@param[in] traceFunction a pointer to the callback function
 	@param[in] pUser callback user data
 */
 void CDK_API CDKPlateFingerprintMatcherSetTraceFunction(PCDKPLATEFINGERPRINTMATCHERTRACEFUNCTION traceFunction, void* pUser);
 	
+/*!
+	Static function that sets the maximum level of the traces handed to the <a href="#PCDKPLATEFINGERPRINTMATCHERTRACEFUNCTION">trace callback</a>.<br/>
+	The traces above this level are discarded before they are formatted.
+	@param[in] level maximum trace level : 0 (no trace) to 8 (DEBUG, the default)
+*/
+void CDK_API CDKPlateFingerprintMatcherSetTraceLevel(uint8_t level);
+
 /*!
 	Creates a CDKPlateFingerprintMatcher
 	@returns a new matcher
@@ -93,7 +101,8 @@ int32_t CDK_API CDKPlateFingerprintMatcherStart(CDKPlateFingerprintMatcher* pMat
 
 	
 /*!
-Compares 2 fingerprints, and says if they are the same
+Compares 2 fingerprints, and says if they are the same.<br/>
+A matcher can be shared by several threads, every call taking the lock of its learning state : for parallel comparisons, use one matcher per thread, all given the same dictionary.
 @param[in] pMatcher the matcher
 @param[in] pBuffer1 binary data containing the first fingerprint to compare
 @param[in] uSize1 first fingerprint size
@@ -19,6 +19,19 @@ typedef struct _CDKQueue CDKQueue;
 
 #include "CDKMsg.h"
 
+/*!
+	Overflow policy : a message pushed in a full queue is dropped (default)
+*/
+#define CDK_QUEUE_DROP_NEWEST 0
+/*!
+	Overflow policy : the oldest queued message is dropped to make room for the new one
+*/
+#define CDK_QUEUE_DROP_OLDEST 1
+/*!
+	Overflow policy : the producer waits for room in the queue, up to a timeout, and then drops the new message
+*/
+#define CDK_QUEUE_BLOCK 2
+
 /*! <summary>callback</summary>
 
     Callback called when there is something to be read in the queue. Note that you should not pop messages inside this callback.<br/>
@@ -34,6 +47,16 @@ typedef void (*PCDKQUEUENEWMESSAGECALLBACK) (CDKQueue* pQueue, void* pUser);
 */
 CDKQueue CDK_API * CDKQueueCreate();
 
+/*!
+	Creates a lock-free CDK queue instance : a bounded ring shared by many producers, without any lock on the push and pop paths.<br/>
+	Threads only sleep in the wait functions, and blocked producers with the <a href="#CDK_QUEUE_BLOCK">CDK_QUEUE_BLOCK</a> policy.<br/>
+	The capacity is fixed : <a href="#CDKQueueSetMaxQueueSize">CDKQueueSetMaxQueueSize</a> has no effect on such a queue.
+	Use <a href="#CDKQueueDestroy">CDKQueueDestroy</a> to destroy it.
+	@param[in] uCapacity maximum queue size, rounded up to a power of 2
+	@returns the created CDK queue instance or NULL if there was an error
+*/
+CDKQueue CDK_API * CDKQueueCreateLockFree(uint32_t uCapacity);
+
 /*!
 	Destroys a CDK queue instance. Note that a queue cannot be destroyed if a CDK instance uses it.
 	@param[in] pQueue CDK Queue instance
@@ -58,19 +81,39 @@ void CDK_API CDKQueueSetNewMessageCallback(CDKQueue* pQueue, PCDKQUEUENEWMESSAGE
 uint32_t CDK_API CDKQueueGetMessageDrops(CDKQueue* pQueue);
 
 /*!
-	Resets the count of message drops.
+	Resets the count of message drops, including the counts per producer.
 	@param[in] pQueue CDK Queue instance
 */
 void CDK_API CDKQueueResetMessageDrops(CDKQueue* pQueue);
 
 /*!
-	Returns the maximum queue size. If a message is received while the queue is full, it will be dropped.
+	Returns the number of messages of a producer dropped since the last <a href="#CDKQueueResetMessageDrops">CDKQueueResetMessageDrops</a>.<br/>
+	The producer of a message is the CDK instance that received it (<a href="#CDKMsgGetCDK">CDKMsgGetCDK</a>).
+	The drops of a CDK instance are forgotten when it stops using the queue (<a href="#CDKSetQueue">CDKSetQueue</a>) or is destroyed.
+	With the <a href="#CDK_QUEUE_DROP_OLDEST">CDK_QUEUE_DROP_OLDEST</a> policy, a drop is counted for the producer of the evicted message.
+	@param[in] pQueue CDK Queue instance
+	@param[in] pProducer the CDK instance, or NULL for the messages pushed by the application
+	@returns the number of messages dropped
+*/
+uint32_t CDK_API CDKQueueGetProducerDrops(CDKQueue* pQueue, CDK* pProducer);
+
+/*!
+	Changes what happens when a message is pushed in a full queue. Default policy is <a href="#CDK_QUEUE_DROP_NEWEST">CDK_QUEUE_DROP_NEWEST</a>.
+	@param[in] pQueue CDK Queue instance
+	@param[in] uPolicy <a href="#CDK_QUEUE_DROP_NEWEST">CDK_QUEUE_DROP_NEWEST</a>, <a href="#CDK_QUEUE_DROP_OLDEST">CDK_QUEUE_DROP_OLDEST</a> or <a href="#CDK_QUEUE_BLOCK">CDK_QUEUE_BLOCK</a>
+	@param[in] uBlockTimeout with <a href="#CDK_QUEUE_BLOCK">CDK_QUEUE_BLOCK</a>, maximum time a producer waits for room, in ms
+	@returns CDK_OK on success, CDK_FAIL if the policy is unknown
+*/
+int32_t CDK_API CDKQueueSetOverflowPolicy(CDKQueue* pQueue, uint32_t uPolicy, uint32_t uBlockTimeout);
+
+/*!
+	Returns the maximum queue size. If a message is received while the queue is full, the <a href="#CDKQueueSetOverflowPolicy">overflow policy</a> applies.
 	@param[in] pQueue CDK Queue instance
 	@returns the maximum queue size
 */
 uint32_t CDK_API CDKQueueGetMaxQueueSize(CDKQueue* pQueue);
 /*!
-	Changes the maximum queue size. Default value is 128.
+	Changes the maximum queue size. Default value is 128. Has no effect on a <a href="#CDKQueueCreateLockFree">lock-free queue</a>.
 	@param[in] pQueue CDK Queue instance
 	@param[in] uMax the new maximum queue size
 */
@@ -84,6 +127,16 @@ void CDK_API CDKQueueSetMaxQueueSize(CDKQueue* pQueue, uint32_t uMax);
 */
 int32_t CDK_API CDKQueueWaitForNewMessage(CDKQueue* pQueue, uint32_t uTimeout);
 
+/*!
+	Returns a file descriptor that is readable as long as the queue is not empty, to wait for many queues, sockets and timers
+	in a single poll, select or epoll loop. It becomes readable when a message is pushed in an empty queue, and is reset
+	by the pop that leaves the queue empty : once it is readable, pop messages until <a href="#CDKQueuePopMessage">CDKQueuePopMessage</a> returns NULL.<br/>
+	The descriptor is created by the first call and owned by the queue : it must not be read, written or closed by the application.
+	@param[in] pQueue CDK Queue instance
+	@returns the file descriptor, or -1 in case of failure. Use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int CDK_API CDKQueueGetReadyFd(CDKQueue* pQueue);
+
 /*!
 	Returns the current size of the queue : the number of messages received, to be read by the application.
 	@param[in] pQueue CDK Queue instance
@@ -96,7 +149,7 @@ uint32_t CDK_API CDKQueueGetQueueSize(CDKQueue* pQueue);
 	Note that if the message could not be push, it is NOT owned by the queue, and then must be destroyed by the application
 	@param[in] pQueue CDK Queue instance
 	@param[in] pMsg the message to queue
-	@returns CDK_OK on success. CDK_FAIL if the queue is full
+	@returns CDK_OK on success. CDK_FAIL if the queue is full, according to its <a href="#CDKQueueSetOverflowPolicy">overflow policy</a>
 */
 int32_t CDK_API CDKQueuePushMessage(CDKQueue* pQueue, CDKMsg* pMsg);
 
@@ -107,6 +160,27 @@ int32_t CDK_API CDKQueuePushMessage(CDKQueue* pQueue, CDKMsg* pMsg);
 */
 CDKMsg CDK_API * CDKQueuePopMessage(CDKQueue* pQueue);
 
+/*!
+	Takes up to uMax of the oldest messages from the queue, in a single critical section. The messages are then owned by the application and have to be destroyed by it.
+	@param[in] pQueue CDK Queue instance
+	@param[out] ppMsgs array receiving the messages taken, oldest first
+	@param[in] uMax size of ppMsgs
+	@returns the number of messages taken, 0 if there is no message in the queue.
+*/
+uint32_t CDK_API CDKQueuePopMessages(CDKQueue* pQueue, CDKMsg** ppMsgs, uint32_t uMax);
+
+/*!
+	Blocks until a batch of messages is ready, or the timeout is reached.<br/>
+	A batch is ready when at least uCount messages are queued, when the queue is full, or when the oldest queued message has waited for uMaxLatency ms.<br/>
+	Threads waiting on the same queue may use different uCount.
+	@param[in] pQueue CDK Queue instance
+	@param[in] uCount number of messages that makes a batch
+	@param[in] uMaxLatency maximum time a message waits for its batch to be complete, in ms
+	@param[in] uTimeout the timeout in ms
+	@returns CDK_OK if there is at least one message in the queue, or CDK_FAIL if the timeout has been reached with an empty queue.
+*/
+int32_t CDK_API CDKQueueWaitForNewMessages(CDKQueue* pQueue, uint32_t uCount, uint32_t uMaxLatency, uint32_t uTimeout);
+
 #ifdef __cplusplus
 }
 #endif
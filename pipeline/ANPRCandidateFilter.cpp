@@ -0,0 +1,423 @@
+/*! \file
+
+ANPRCandidateFilter : blocking index over fingerprint q-grams.
+
+Every indexed read has a sequence number, and the posting list of a q-gram holds the sequence numbers of the reads
+having it, in insertion order. Expired reads leave stale numbers at the front of the posting lists : they are skipped
+by the queries, and removed once they outnumber the live ones.<br/>
+A query counts the shared q-grams of every read found in the posting lists of its own q-grams, so that its cost
+depends on the reads sharing q-grams with it rather than on the size of the index.
+
+*/
+
+#include <algorithm>
+#include <new>
+#include <shared_mutex>
+#include <unordered_set>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRCandidateFilter.h"
+
+/*!
+	Maximum number of q-grams of a fingerprint : the counters of the shared q-grams are 16 bits
+*/
+#define ANPR_CANDIDATE_FILTER_MAX_GRAMS 65535
+
+struct ANPRCandidateFilterEntry
+{
+	uint64_t uId;
+	int64_t iTimestampUs;
+	uint32_t uSensor;
+	uint32_t uGrams;
+	std::vector<uint8_t> fingerprint;
+};
+
+struct _anprcandidatefilter : CDKObject
+{
+	ANPRCandidateFilterConfig config;
+
+	/*! shared by the queries, exclusive for the changes */
+	std::shared_mutex mutex;
+	/*! indexed reads, in insertion order : the read of sequence number uFirstSeq + i is entries[i] */
+	std::deque<ANPRCandidateFilterEntry> entries;
+	uint64_t uFirstSeq = 0;
+	std::unordered_map<uint32_t, std::vector<uint64_t>> postings;
+	uint64_t uLivePostings = 0;
+	uint64_t uStalePostings = 0;
+	/*! from sensor << 32 | to sensor */
+	std::unordered_set<uint64_t> routes;
+};
+
+/*!
+	Shared q-gram counters of a query, per thread : indexed by the read position, and cleared after every query
+*/
+struct ANPRCandidateFilterScratch
+{
+	std::vector<uint16_t> shared;
+	std::vector<uint32_t> touched;
+};
+
+static thread_local ANPRCandidateFilterScratch t_scratch;
+
+/*!
+	Distinct q-grams of a fingerprint. A fingerprint shorter than a q-gram is a single q-gram.
+*/
+static void ANPRCandidateFilterGrams(uint32_t uGramSize, const uint8_t* pBuffer, uint32_t uSize, std::vector<uint32_t>& grams)
+{
+	grams.clear();
+	uint32_t uLength = std::min(uGramSize, uSize);
+	for (uint32_t i = 0; i + uLength <= uSize; i++)
+	{
+		uint32_t uGram = uLength;
+		for (uint32_t j = 0; j < uLength; j++)
+			uGram = (uGram << 8) | pBuffer[i + j];
+		grams.push_back(uGram);
+		if (uLength < uGramSize)
+			break;
+	}
+	std::sort(grams.begin(), grams.end());
+	grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+}
+
+static bool ANPRCandidateFilterCheckRead(ANPRCandidateFilter* pFilter, const ANPRCandidateRead* pRead)
+{
+	if (!pRead || !pRead->pBuffer || !pRead->uSize || pRead->uSize > ANPR_CANDIDATE_FILTER_MAX_GRAMS)
+	{
+		CDKSetLastError(pFilter, "invalid read");
+		return false;
+	}
+	return true;
+}
+
+/*!
+	Time window and route of a pair, the lock being held
+*/
+static bool ANPRCandidateFilterEligible(ANPRCandidateFilter* pFilter, const ANPRCandidateFilterEntry& entry, const ANPRCandidateRead* pQuery)
+{
+	if (pFilter->config.iMaxDelayUs)
+	{
+		int64_t iDelayUs = pQuery->iTimestampUs - entry.iTimestampUs;
+		if (iDelayUs < pFilter->config.iMinDelayUs || iDelayUs > pFilter->config.iMaxDelayUs)
+			return false;
+	}
+	return pFilter->routes.empty() || pFilter->routes.count((uint64_t)entry.uSensor << 32 | pQuery->uSensor);
+}
+
+/*!
+	Counts the q-grams shared by a query and the indexed reads into t_scratch, the lock being held
+*/
+static void ANPRCandidateFilterCount(ANPRCandidateFilter* pFilter, const ANPRCandidateRead* pQuery)
+{
+	static thread_local std::vector<uint32_t> grams;
+	ANPRCandidateFilterGrams(pFilter->config.uGramSize, pQuery->pBuffer, pQuery->uSize, grams);
+	ANPRCandidateFilterScratch& scratch = t_scratch;
+	if (scratch.shared.size() < pFilter->entries.size())
+		scratch.shared.resize(pFilter->entries.size());
+	scratch.touched.clear();
+	for (uint32_t uGram : grams)
+	{
+		auto found = pFilter->postings.find(uGram);
+		if (found == pFilter->postings.end())
+			continue;
+		const std::vector<uint64_t>& posting = found->second;
+		// the stale numbers are at the front
+		auto live = posting.front() >= pFilter->uFirstSeq ? posting.begin() : std::lower_bound(posting.begin(), posting.end(), pFilter->uFirstSeq);
+		for (; live != posting.end(); ++live)
+		{
+			uint32_t uIndex = (uint32_t)(*live - pFilter->uFirstSeq);
+			if (scratch.shared[uIndex]++ == 0)
+				scratch.touched.push_back(uIndex);
+		}
+	}
+}
+
+static void ANPRCandidateFilterClear()
+{
+	ANPRCandidateFilterScratch& scratch = t_scratch;
+	for (uint32_t uIndex : scratch.touched)
+		scratch.shared[uIndex] = 0;
+	scratch.touched.clear();
+}
+
+void ANPRCandidateFilterDefaultConfig(ANPRCandidateFilterConfig* pConfig)
+{
+	pConfig->uGramSize = 2;
+	pConfig->uMinSharedGrams = 4;
+	pConfig->iMinDelayUs = 0;
+	pConfig->iMaxDelayUs = 0;
+}
+
+ANPRCandidateFilter* ANPRCandidateFilterCreate(const ANPRCandidateFilterConfig* pConfig)
+{
+	ANPRCandidateFilter* pFilter = new (std::nothrow) ANPRCandidateFilter();
+	if (!pFilter)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pFilter->config = *pConfig;
+	else
+		ANPRCandidateFilterDefaultConfig(&pFilter->config);
+	pFilter->config.uGramSize = std::min(std::max(pFilter->config.uGramSize, 1u), 4u);
+	pFilter->config.uMinSharedGrams = std::max(pFilter->config.uMinSharedGrams, 1u);
+	return pFilter;
+}
+
+void ANPRCandidateFilterDestroy(ANPRCandidateFilter* pFilter)
+{
+	delete pFilter;
+}
+
+int32_t ANPRCandidateFilterAddRoute(ANPRCandidateFilter* pFilter, uint32_t uFromSensor, uint32_t uToSensor)
+{
+	if (!pFilter)
+		return CDK_FAIL;
+	std::unique_lock<std::shared_mutex> lock(pFilter->mutex);
+	try
+	{
+		pFilter->routes.insert((uint64_t)uFromSensor << 32 | uToSensor);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pFilter, "out of memory");
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+int32_t ANPRCandidateFilterInsert(ANPRCandidateFilter* pFilter, const ANPRCandidateRead* pRead)
+{
+	if (!pFilter)
+		return CDK_FAIL;
+	if (!ANPRCandidateFilterCheckRead(pFilter, pRead))
+		return CDK_FAIL;
+	try
+	{
+		// split before taking the lock
+		std::vector<uint32_t> grams;
+		ANPRCandidateFilterGrams(pFilter->config.uGramSize, pRead->pBuffer, pRead->uSize, grams);
+		ANPRCandidateFilterEntry entry = { pRead->uId, pRead->iTimestampUs, pRead->uSensor, (uint32_t)grams.size(),
+			std::vector<uint8_t>(pRead->pBuffer, pRead->pBuffer + pRead->uSize) };
+
+		std::unique_lock<std::shared_mutex> lock(pFilter->mutex);
+		uint64_t uSeq = pFilter->uFirstSeq + pFilter->entries.size();
+		pFilter->entries.push_back(std::move(entry));
+		for (uint32_t uGram : grams)
+			pFilter->postings[uGram].push_back(uSeq);
+		pFilter->uLivePostings += grams.size();
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pFilter, "out of memory");
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+uint64_t ANPRCandidateFilterExpire(ANPRCandidateFilter* pFilter, int64_t iBeforeUs)
+{
+	if (!pFilter)
+		return 0;
+	std::unique_lock<std::shared_mutex> lock(pFilter->mutex);
+	uint64_t uExpired = 0;
+	while (!pFilter->entries.empty() && pFilter->entries.front().iTimestampUs < iBeforeUs)
+	{
+		pFilter->uLivePostings -= pFilter->entries.front().uGrams;
+		pFilter->uStalePostings += pFilter->entries.front().uGrams;
+		pFilter->entries.pop_front();
+		pFilter->uFirstSeq++;
+		uExpired++;
+	}
+	if (pFilter->uStalePostings > pFilter->uLivePostings)
+	{
+		for (auto posting = pFilter->postings.begin(); posting != pFilter->postings.end();)
+		{
+			std::vector<uint64_t>& seqs = posting->second;
+			seqs.erase(seqs.begin(), std::lower_bound(seqs.begin(), seqs.end(), pFilter->uFirstSeq));
+			posting = seqs.empty() ? pFilter->postings.erase(posting) : std::next(posting);
+		}
+		pFilter->uStalePostings = 0;
+	}
+	return uExpired;
+}
+
+int64_t ANPRCandidateFilterQuery(ANPRCandidateFilter* pFilter, const ANPRCandidateRead* pQuery, ANPRCandidate* pCandidates, uint64_t uMaxCandidates)
+{
+	if (!pFilter)
+		return -1;
+	if (!ANPRCandidateFilterCheckRead(pFilter, pQuery))
+		return -1;
+	if (uMaxCandidates && !pCandidates)
+	{
+		CDKSetLastError(pFilter, "a candidate array is required");
+		return -1;
+	}
+	std::shared_lock<std::shared_mutex> lock(pFilter->mutex);
+	static thread_local std::vector<ANPRCandidate> candidates;
+	try
+	{
+		ANPRCandidateFilterCount(pFilter, pQuery);
+		candidates.clear();
+		for (uint32_t uIndex : t_scratch.touched)
+		{
+			uint32_t uShared = t_scratch.shared[uIndex];
+			const ANPRCandidateFilterEntry& entry = pFilter->entries[uIndex];
+			if (uShared < pFilter->config.uMinSharedGrams || !ANPRCandidateFilterEligible(pFilter, entry, pQuery))
+				continue;
+			candidates.push_back({ { entry.uId, entry.iTimestampUs, entry.uSensor, entry.fingerprint.data(), (uint32_t)entry.fingerprint.size() }, uShared });
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		ANPRCandidateFilterClear();
+		CDKSetLastError(pFilter, "out of memory");
+		return -1;
+	}
+	ANPRCandidateFilterClear();
+	uint64_t uCount = std::min<uint64_t>(uMaxCandidates, candidates.size());
+	std::partial_sort(candidates.begin(), candidates.begin() + uCount, candidates.end(), [](const ANPRCandidate& a, const ANPRCandidate& b) {
+		return a.uSharedGrams != b.uSharedGrams ? a.uSharedGrams > b.uSharedGrams : a.read.iTimestampUs > b.read.iTimestampUs;
+	});
+	std::copy(candidates.begin(), candidates.begin() + uCount, pCandidates);
+	return (int64_t)candidates.size();
+}
+
+/*!
+	Metrics of a minimum number of shared q-grams, from the histograms of the shared q-grams of all the pairs and of the matching pairs
+*/
+static void ANPRCandidateFilterMetricsOf(const std::vector<uint64_t>& pairs, const std::vector<uint64_t>& matches, uint64_t uQueries,
+	uint32_t uMinSharedGrams, ANPRCandidateFilterMetrics* pMetrics)
+{
+	*pMetrics = {};
+	pMetrics->uQueries = uQueries;
+	pMetrics->uMinSharedGrams = uMinSharedGrams;
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		pMetrics->uPairs += pairs[i];
+		pMetrics->uMatches += matches[i];
+		if (i >= uMinSharedGrams)
+		{
+			pMetrics->uCandidates += pairs[i];
+			pMetrics->uMatchesFound += matches[i];
+		}
+	}
+	pMetrics->dRecall = pMetrics->uMatches ? (double)pMetrics->uMatchesFound / (double)pMetrics->uMatches : 1.0;
+	pMetrics->dPrecision = pMetrics->uCandidates ? (double)pMetrics->uMatchesFound / (double)pMetrics->uCandidates : 1.0;
+	pMetrics->dReduction = pMetrics->uPairs ? 1.0 - (double)pMetrics->uCandidates / (double)pMetrics->uPairs : 0.0;
+}
+
+/*!
+	Compares every query to every eligible indexed read with the exact matcher, and builds the histograms of the shared
+	q-grams of all the pairs and of the matching pairs, the lock being held
+*/
+static void ANPRCandidateFilterHistograms(ANPRCandidateFilter* pFilter, CDKPlateFingerprintMatcher* pMatcher, const ANPRCandidateRead* pQueries,
+	uint32_t uQueries, std::vector<uint64_t>& pairs, std::vector<uint64_t>& matches)
+{
+	for (uint32_t q = 0; q < uQueries; q++)
+	{
+		const ANPRCandidateRead* pQuery = &pQueries[q];
+		if (!pQuery->pBuffer || !pQuery->uSize || pQuery->uSize > ANPR_CANDIDATE_FILTER_MAX_GRAMS)
+			continue;
+		ANPRCandidateFilterCount(pFilter, pQuery);
+		for (size_t i = 0; i < pFilter->entries.size(); i++)
+		{
+			const ANPRCandidateFilterEntry& entry = pFilter->entries[i];
+			if (!ANPRCandidateFilterEligible(pFilter, entry, pQuery))
+				continue;
+			uint32_t uShared = t_scratch.shared[i];
+			if (uShared >= pairs.size())
+			{
+				pairs.resize(uShared + 1);
+				matches.resize(uShared + 1);
+			}
+			pairs[uShared]++;
+			if (CDKPlateFingerprintMatch(pMatcher, pQuery->pBuffer, pQuery->uSize, entry.fingerprint.data(), (uint32_t)entry.fingerprint.size()) > 0)
+				matches[uShared]++;
+		}
+		ANPRCandidateFilterClear();
+	}
+}
+
+int32_t ANPRCandidateFilterEvaluate(ANPRCandidateFilter* pFilter, CDKPlateFingerprintMatcher* pMatcher, const ANPRCandidateRead* pQueries,
+	uint32_t uQueries, ANPRCandidateFilterMetrics* pMetrics)
+{
+	if (!pFilter)
+		return CDK_FAIL;
+	if (!pMatcher || (uQueries && !pQueries) || !pMetrics)
+	{
+		CDKSetLastError(pFilter, "a matcher, queries and metrics are required");
+		return CDK_FAIL;
+	}
+	std::vector<uint64_t> pairs;
+	std::vector<uint64_t> matches;
+	std::shared_lock<std::shared_mutex> lock(pFilter->mutex);
+	try
+	{
+		ANPRCandidateFilterHistograms(pFilter, pMatcher, pQueries, uQueries, pairs, matches);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ANPRCandidateFilterClear();
+		CDKSetLastError(pFilter, "out of memory");
+		return CDK_FAIL;
+	}
+	ANPRCandidateFilterMetricsOf(pairs, matches, uQueries, pFilter->config.uMinSharedGrams, pMetrics);
+	return CDK_OK;
+}
+
+int32_t ANPRCandidateFilterCalibrate(ANPRCandidateFilter* pFilter, CDKPlateFingerprintMatcher* pMatcher, const ANPRCandidateRead* pQueries,
+	uint32_t uQueries, double dRecallTarget, ANPRCandidateFilterMetrics* pMetrics)
+{
+	if (!pFilter)
+		return CDK_FAIL;
+	if (!pMatcher || (uQueries && !pQueries))
+	{
+		CDKSetLastError(pFilter, "a matcher and queries are required");
+		return CDK_FAIL;
+	}
+	std::vector<uint64_t> pairs;
+	std::vector<uint64_t> matches;
+	{
+		std::shared_lock<std::shared_mutex> lock(pFilter->mutex);
+		try
+		{
+			ANPRCandidateFilterHistograms(pFilter, pMatcher, pQueries, uQueries, pairs, matches);
+		}
+		catch (const std::bad_alloc&)
+		{
+			ANPRCandidateFilterClear();
+			CDKSetLastError(pFilter, "out of memory");
+			return CDK_FAIL;
+		}
+	}
+
+	// the recall only decreases when the minimum rises
+	ANPRCandidateFilterMetrics metrics;
+	uint32_t uMinSharedGrams = 1;
+	ANPRCandidateFilterMetricsOf(pairs, matches, uQueries, uMinSharedGrams, &metrics);
+	for (uint32_t uTry = 2; uTry < pairs.size(); uTry++)
+	{
+		ANPRCandidateFilterMetrics tried;
+		ANPRCandidateFilterMetricsOf(pairs, matches, uQueries, uTry, &tried);
+		if (tried.dRecall < dRecallTarget)
+			break;
+		uMinSharedGrams = uTry;
+		metrics = tried;
+	}
+	{
+		std::unique_lock<std::shared_mutex> lock(pFilter->mutex);
+		pFilter->config.uMinSharedGrams = uMinSharedGrams;
+	}
+	if (pMetrics)
+		*pMetrics = metrics;
+	return CDK_OK;
+}
+
+uint64_t ANPRCandidateFilterGetReadCount(ANPRCandidateFilter* pFilter)
+{
+	if (!pFilter)
+		return 0;
+	std::shared_lock<std::shared_mutex> lock(pFilter->mutex);
+	return pFilter->entries.size();
+}
@@ -0,0 +1,192 @@
+/*! \file
+
+ANPRCandidateFilter : blocking index sending only plausible pairs of reads to the exact fingerprint matcher.<br/>
+The fingerprints of the indexed reads are split in q-grams : runs of q consecutive symbols. An OCR confusion or a
+damaged symbol only changes the q-grams that contain it, so that two reads of the same plate still share most of
+their q-grams, while reads of different plates share few. A query returns the indexed reads sharing at least a
+minimum number of q-grams with its fingerprint, that were read within a time window before it, on a sensor from which
+the sensor of the query can be reached.<br/>
+The minimum number of shared q-grams trades the comparisons saved against the matching pairs lost :
+<a href="#ANPRCandidateFilterEvaluate">ANPRCandidateFilterEvaluate</a> measures both against a
+<a href="#CDKPlateFingerprintMatcher">CDKPlateFingerprintMatcher</a>, and
+<a href="#ANPRCandidateFilterCalibrate">ANPRCandidateFilterCalibrate</a> sets the highest minimum that keeps a recall target.
+
+*/
+
+#ifndef ANPRCANDIDATEFILTER_H
+#define ANPRCANDIDATEFILTER_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "CDKPlateFingerprintMatcher.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A candidate filter
+*/
+typedef struct _anprcandidatefilter ANPRCandidateFilter;
+
+/*! <summary>struct</summary>
+	Configuration of a candidate filter
+*/
+typedef struct
+{
+	/*! symbols of a q-gram, from 1 to 4 */
+	uint32_t uGramSize;
+	/*! q-grams an indexed read must share with a query to be a candidate, at least 1 */
+	uint32_t uMinSharedGrams;
+	/*! minimum time from an indexed read to a query, in us. Can be negative for indexed reads after the query */
+	int64_t iMinDelayUs;
+	/*! maximum time from an indexed read to a query, in us. 0 for no time window */
+	int64_t iMaxDelayUs;
+} ANPRCandidateFilterConfig;
+
+/*! <summary>struct</summary>
+	A read of a candidate filter : an indexed read, or a query
+*/
+typedef struct
+{
+	/*! identifier of the read, for instance the journal record */
+	uint64_t uId;
+	/*! time of the read, in us */
+	int64_t iTimestampUs;
+	/*! sensor of the read, see <a href="#ANPRCandidateFilterAddRoute">ANPRCandidateFilterAddRoute</a> */
+	uint32_t uSensor;
+	/*! fingerprint */
+	const uint8_t* pBuffer;
+	/*! fingerprint size */
+	uint32_t uSize;
+} ANPRCandidateRead;
+
+/*! <summary>struct</summary>
+	A candidate returned by a query
+*/
+typedef struct
+{
+	/*! the indexed read. Its fingerprint is a copy held by the filter until the read is expired */
+	ANPRCandidateRead read;
+	/*! q-grams shared with the query */
+	uint32_t uSharedGrams;
+} ANPRCandidate;
+
+/*! <summary>struct</summary>
+	Quality of a candidate filter against the exact matcher, on a set of queries
+*/
+typedef struct
+{
+	/*! queries evaluated */
+	uint64_t uQueries;
+	/*! pairs of a query and an indexed read in its time window and on a route : the comparisons without the filter */
+	uint64_t uPairs;
+	/*! pairs returned as candidates : the comparisons with the filter */
+	uint64_t uCandidates;
+	/*! pairs matched by the exact matcher */
+	uint64_t uMatches;
+	/*! pairs matched by the exact matcher and returned as candidates */
+	uint64_t uMatchesFound;
+	/*! uMatchesFound / uMatches, 1 if there is no match */
+	double dRecall;
+	/*! uMatchesFound / uCandidates, 1 if there is no candidate */
+	double dPrecision;
+	/*! 1 - uCandidates / uPairs : the part of the comparisons saved */
+	double dReduction;
+	/*! minimum number of shared q-grams evaluated */
+	uint32_t uMinSharedGrams;
+} ANPRCandidateFilterMetrics;
+
+/*!
+	Fills a configuration with default values : 2 symbols q-grams, 4 shared q-grams, no time window
+*/
+void ANPRCandidateFilterDefaultConfig(ANPRCandidateFilterConfig* pConfig);
+
+/*!
+	Creates a candidate filter. Use <a href="#ANPRCandidateFilterDestroy">ANPRCandidateFilterDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@returns the filter, or NULL on failure
+*/
+ANPRCandidateFilter* ANPRCandidateFilterCreate(const ANPRCandidateFilterConfig* pConfig);
+
+/*!
+	Destroys a candidate filter
+*/
+void ANPRCandidateFilterDestroy(ANPRCandidateFilter* pFilter);
+
+/*!
+	Declares that the vehicles read by a sensor can then be read by another one, for instance from an entry lane to an
+	exit lane. Once a route is declared, a query only returns the reads of the sensors with a route to its sensor.
+	@param[in] pFilter the filter
+	@param[in] uFromSensor sensor of the indexed reads
+	@param[in] uToSensor sensor of the queries
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRCandidateFilterAddRoute(ANPRCandidateFilter* pFilter, uint32_t uFromSensor, uint32_t uToSensor);
+
+/*!
+	Indexes a read. The reads are expected in the order of their times : expiry removes the oldest insertions first.<br/>
+	Can be called from any thread.
+	@param[in] pFilter the filter
+	@param[in] pRead the read. Its fingerprint is copied
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRCandidateFilterInsert(ANPRCandidateFilter* pFilter, const ANPRCandidateRead* pRead);
+
+/*!
+	Expires the reads before a time, from the oldest insertion up to the first read at or after that time
+	@param[in] pFilter the filter
+	@param[in] iBeforeUs time, in us
+	@returns the number of reads expired
+*/
+uint64_t ANPRCandidateFilterExpire(ANPRCandidateFilter* pFilter, int64_t iBeforeUs);
+
+/*!
+	Returns the indexed reads that could match a read.<br/>
+	Can be called from any thread, concurrently with other queries.
+	@param[in] pFilter the filter
+	@param[in] pQuery the read searched. uId is not used
+	@param[out] pCandidates candidates, from the most shared q-grams down. Can be NULL if uMaxCandidates is 0
+	@param[in] uMaxCandidates size of pCandidates : the candidates after the first uMaxCandidates are counted but not returned
+	@returns the number of candidates, or -1 on failure
+*/
+int64_t ANPRCandidateFilterQuery(ANPRCandidateFilter* pFilter, const ANPRCandidateRead* pQuery, ANPRCandidate* pCandidates, uint64_t uMaxCandidates);
+
+/*!
+	Measures the recall and the precision of the filter : every query is compared with the exact matcher to every
+	indexed read in its time window and on a route, and the matching pairs are checked against the candidates.
+	@param[in] pFilter the filter
+	@param[in] pMatcher the exact matcher, started
+	@param[in] pQueries sample of queries
+	@param[in] uQueries number of queries
+	@param[out] pMetrics quality of the filter with its current minimum number of shared q-grams
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRCandidateFilterEvaluate(ANPRCandidateFilter* pFilter, CDKPlateFingerprintMatcher* pMatcher, const ANPRCandidateRead* pQueries,
+	uint32_t uQueries, ANPRCandidateFilterMetrics* pMetrics);
+
+/*!
+	Sets the highest minimum number of shared q-grams whose recall on a sample of queries reaches a target, see
+	<a href="#ANPRCandidateFilterEvaluate">ANPRCandidateFilterEvaluate</a>
+	@param[in] pFilter the filter
+	@param[in] pMatcher the exact matcher, started
+	@param[in] pQueries sample of queries
+	@param[in] uQueries number of queries
+	@param[in] dRecallTarget recall to reach, for instance 0.99
+	@param[out] pMetrics quality of the filter with the minimum set. Can be NULL
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRCandidateFilterCalibrate(ANPRCandidateFilter* pFilter, CDKPlateFingerprintMatcher* pMatcher, const ANPRCandidateRead* pQueries,
+	uint32_t uQueries, double dRecallTarget, ANPRCandidateFilterMetrics* pMetrics);
+
+/*!
+	Returns the number of indexed reads
+*/
+uint64_t ANPRCandidateFilterGetReadCount(ANPRCandidateFilter* pFilter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRCANDIDATEFILTER_H
@@ -0,0 +1,634 @@
+/*! \file
+
+ANPRDedup : de-duplication of the plate reads of a site.
+
+The time buckets are a ring covering the window : bucket i holds, in its own hash table, the keys of the passages
+whose last read is in bucket i. When a passage gets a read in a later bucket, it is indexed again in that bucket and
+its entries in the previous one become stale : an entry is only followed when the passage is still in the bucket of
+the entry, and its text is checked, so that stale entries never need to be removed. Closing a bucket closes the
+passages it still holds and clears its table at once.<br/>
+A passage is indexed by the normalized text of its first read, and of its last read when they differ. With a text
+distance of 1, the texts with one character deleted are indexed too : two texts differing by one substitution,
+insertion or deletion share one of these keys, and the candidates found are checked with the exact edit distance.
+
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRDedup.h"
+
+/*!
+	Initial size of the key table of a bucket
+*/
+#define ANPR_DEDUP_MIN_KEYS 64
+
+struct ANPRDedupOpenPassage
+{
+	bool bOpen = false;
+	/*! bucket holding the passage */
+	int64_t iBucket = 0;
+	std::chrono::steady_clock::time_point pushed;
+	/*! best read */
+	CDKMsg* pMsg = nullptr;
+	ANPRDedupPassage passage;
+	/*! normalized text of the first read : the key of the passage */
+	char strText[ANPR_PLATE_READ_MAX_PLATE];
+	/*! normalized text of the last read */
+	char strLastText[ANPR_PLATE_READ_MAX_PLATE];
+	/*! fingerprint of the best read with a fingerprint */
+	std::vector<uint8_t> fingerprint;
+};
+
+struct ANPRDedupKey
+{
+	/*! 0 for an empty entry */
+	uint64_t uHash;
+	uint32_t uSlot;
+};
+
+struct ANPRDedupBucket
+{
+	/*! INT64_MIN when the bucket is closed */
+	int64_t iIndex = INT64_MIN;
+	/*! passages moved to the bucket, in order */
+	std::vector<uint32_t> slots;
+	/*! cursor of the forced closes in slots */
+	size_t uFirst = 0;
+	/*! open addressing table of the keys, at most half full : a hash can have several entries */
+	std::vector<ANPRDedupKey> keys;
+	size_t uKeys = 0;
+};
+
+/*!
+	A closed passage, handed to the callback once the lock is released
+*/
+struct ANPRDedupEvent
+{
+	CDKMsg* pMsg;
+	ANPRDedupPassage passage;
+};
+
+struct _anprdedup : CDKObject
+{
+	ANPRDedupConfig config;
+	const ANPRPlateReadSchema* pSchema = nullptr;
+	ANPRPlateReadSchema* pOwnedSchema = nullptr;
+	CDKPlateFingerprintMatcher* pMatcher = nullptr;
+	PANPRDEDUPPASSAGECALLBACK passageCallback = nullptr;
+	void* pUser = nullptr;
+
+	std::mutex mutex;
+	std::vector<ANPRDedupOpenPassage> passages;
+	std::vector<uint32_t> freeSlots;
+	std::vector<ANPRDedupBucket> buckets;
+	/*! bucket of the time of the stage, INT64_MIN before the first read */
+	int64_t iClockBucket = INT64_MIN;
+
+	uint64_t uReads = 0;
+	uint64_t uPassages = 0;
+	uint64_t uDuplicates = 0;
+	uint64_t uConfirmed = 0;
+	uint64_t uComparisons = 0;
+	uint64_t uForced = 0;
+	uint64_t uLatencySumUs = 0;
+	uint64_t uLatencyMaxUs = 0;
+};
+
+static void ANPRDedupInsertKey(ANPRDedupBucket& bucket, uint64_t uHash, uint32_t uSlot)
+{
+	if ((bucket.uKeys + 1) * 2 > bucket.keys.size())
+	{
+		std::vector<ANPRDedupKey> keys(std::max<size_t>(bucket.keys.size() * 2, ANPR_DEDUP_MIN_KEYS), ANPRDedupKey{ 0, 0 });
+		std::swap(keys, bucket.keys);
+		bucket.uKeys = 0;
+		for (const ANPRDedupKey& key : keys)
+			if (key.uHash)
+				ANPRDedupInsertKey(bucket, key.uHash, key.uSlot);
+	}
+	size_t uMask = bucket.keys.size() - 1;
+	size_t i = (size_t)(uHash ^ (uHash >> 32)) & uMask;
+	while (bucket.keys[i].uHash)
+		i = (i + 1) & uMask;
+	bucket.keys[i] = { uHash, uSlot };
+	bucket.uKeys++;
+}
+
+/*!
+	Calls f(uSlot) for every entry of a hash
+*/
+template <typename F>
+static void ANPRDedupFindKey(const ANPRDedupBucket& bucket, uint64_t uHash, const F& f)
+{
+	if (bucket.uKeys == 0)
+		return;
+	size_t uMask = bucket.keys.size() - 1;
+	for (size_t i = (size_t)(uHash ^ (uHash >> 32)) & uMask; bucket.keys[i].uHash; i = (i + 1) & uMask)
+		if (bucket.keys[i].uHash == uHash)
+			f(bucket.keys[i].uSlot);
+}
+
+static int64_t ANPRDedupFloorDiv(int64_t iValue, int64_t iDivisor)
+{
+	int64_t iQuotient = iValue / iDivisor;
+	return (iValue % iDivisor < 0) ? iQuotient - 1 : iQuotient;
+}
+
+static ANPRDedupBucket& ANPRDedupGetBucket(ANPRDedup* pDedup, int64_t iIndex)
+{
+	int64_t iSize = (int64_t)pDedup->buckets.size();
+	return pDedup->buckets[(size_t)(((iIndex % iSize) + iSize) % iSize)];
+}
+
+/*!
+	Moves a passage to a bucket of the window
+*/
+static void ANPRDedupMove(ANPRDedup* pDedup, uint32_t uSlot, int64_t iIndex)
+{
+	ANPRDedupBucket& bucket = ANPRDedupGetBucket(pDedup, iIndex);
+	// the buckets before the window are closed : the slot of a bucket of the window is either its own or free
+	bucket.iIndex = iIndex;
+	bucket.slots.push_back(uSlot);
+	pDedup->passages[uSlot].iBucket = iIndex;
+}
+
+/*!
+	Indexes a passage by a text in its bucket
+*/
+static void ANPRDedupIndex(ANPRDedup* pDedup, uint32_t uSlot, const char* strText)
+{
+	ANPRDedupBucket& bucket = ANPRDedupGetBucket(pDedup, pDedup->passages[uSlot].iBucket);
+	uint64_t keys[ANPR_PLATE_READ_MAX_PLATE];
+	uint32_t uKeys = ANPRPlateReadTextKeys(strText, pDedup->config.uMaxTextDistance, keys, ANPR_PLATE_READ_MAX_PLATE);
+	for (uint32_t k = 0; k < uKeys; k++)
+		ANPRDedupInsertKey(bucket, keys[k], uSlot);
+}
+
+/*!
+	Adds the passage element to a read and queues its event
+*/
+static void ANPRDedupEmit(ANPRDedup* pDedup, CDKMsg* pMsg, const ANPRDedupPassage& passage, std::vector<ANPRDedupEvent>& events)
+{
+	CDKMsgElement* pRoot = CDKMsgChild(pMsg);
+	CDKMsgElement* pElement = pRoot ? CDKMsgElementCreate("passage") : nullptr;
+	if (pElement)
+	{
+		CDKMsgElementSetAttributeUInt(pElement, "reads", passage.uReads);
+		CDKMsgElementSetAttributeUInt(pElement, "confirmed", passage.uConfirmed);
+		CDKMsgElementSetAttributeUInt(pElement, "lanes", passage.uLanes);
+		CDKMsgElementSetAttributeInt64(pElement, "firstTimestampUs", passage.iFirstTimestampUs);
+		CDKMsgElementSetAttributeInt64(pElement, "lastTimestampUs", passage.iLastTimestampUs);
+		if (CDKMsgElementAddChild(pRoot, pElement) != CDK_OK)
+			CDKMsgElementDestroy(pElement);
+	}
+	uint64_t uLatencyUs = (uint64_t)std::max<int64_t>(passage.iLatencyUs, 0);
+	pDedup->uPassages++;
+	pDedup->uLatencySumUs += uLatencyUs;
+	pDedup->uLatencyMaxUs = std::max(pDedup->uLatencyMaxUs, uLatencyUs);
+	events.push_back({ pMsg, passage });
+}
+
+static void ANPRDedupClose(ANPRDedup* pDedup, uint32_t uSlot, std::vector<ANPRDedupEvent>& events)
+{
+	ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+	open.passage.iLatencyUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - open.pushed).count();
+	ANPRDedupEmit(pDedup, open.pMsg, open.passage, events);
+	open.pMsg = nullptr;
+	open.bOpen = false;
+	pDedup->freeSlots.push_back(uSlot);
+}
+
+/*!
+	Closes the passages still held by a bucket, and clears it
+*/
+static uint32_t ANPRDedupCloseBucket(ANPRDedup* pDedup, ANPRDedupBucket& bucket, std::vector<ANPRDedupEvent>& events)
+{
+	uint32_t uClosed = 0;
+	for (size_t i = bucket.uFirst; i < bucket.slots.size(); i++)
+	{
+		uint32_t uSlot = bucket.slots[i];
+		const ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+		if (open.bOpen && open.iBucket == bucket.iIndex)
+		{
+			ANPRDedupClose(pDedup, uSlot, events);
+			uClosed++;
+		}
+	}
+	bucket.slots.clear();
+	bucket.uFirst = 0;
+	if (bucket.uKeys)
+		std::fill(bucket.keys.begin(), bucket.keys.end(), ANPRDedupKey{ 0, 0 });
+	bucket.uKeys = 0;
+	bucket.iIndex = INT64_MIN;
+	return uClosed;
+}
+
+/*!
+	Advances the time of the stage to a bucket, closing the buckets leaving the window
+*/
+static uint32_t ANPRDedupAdvance(ANPRDedup* pDedup, int64_t iBucket, std::vector<ANPRDedupEvent>& events)
+{
+	if (pDedup->iClockBucket == INT64_MIN)
+	{
+		pDedup->iClockBucket = iBucket;
+		return 0;
+	}
+	if (iBucket <= pDedup->iClockBucket)
+		return 0;
+	int64_t iSize = (int64_t)pDedup->buckets.size();
+	// the open buckets are the last iSize ones, the ones before iBucket - iSize + 1 leave the window
+	int64_t iLast = std::min(iBucket - iSize, pDedup->iClockBucket);
+	uint32_t uClosed = 0;
+	for (int64_t i = pDedup->iClockBucket - iSize + 1; i <= iLast; i++)
+	{
+		ANPRDedupBucket& bucket = ANPRDedupGetBucket(pDedup, i);
+		if (bucket.iIndex == i)
+			uClosed += ANPRDedupCloseBucket(pDedup, bucket, events);
+	}
+	pDedup->iClockBucket = iBucket;
+	return uClosed;
+}
+
+/*!
+	Closes the oldest open passage, to make room for a new one
+*/
+static void ANPRDedupCloseOldest(ANPRDedup* pDedup, std::vector<ANPRDedupEvent>& events)
+{
+	int64_t iSize = (int64_t)pDedup->buckets.size();
+	for (int64_t i = pDedup->iClockBucket - iSize + 1; i <= pDedup->iClockBucket; i++)
+	{
+		ANPRDedupBucket& bucket = ANPRDedupGetBucket(pDedup, i);
+		if (bucket.iIndex != i)
+			continue;
+		while (bucket.uFirst < bucket.slots.size())
+		{
+			uint32_t uSlot = bucket.slots[bucket.uFirst++];
+			const ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+			if (open.bOpen && open.iBucket == i)
+			{
+				ANPRDedupClose(pDedup, uSlot, events);
+				pDedup->uForced++;
+				return;
+			}
+		}
+	}
+}
+
+static bool ANPRDedupLaneMatches(const ANPRDedup* pDedup, const ANPRDedupOpenPassage& open, const ANPRPlateRead& read)
+{
+	if (!(read.uFields & (1u << ANPR_PLATE_READ_LANE)) || read.uLane >= 32 || open.passage.uLanes == 0)
+		return true;
+	uint64_t uGap = pDedup->config.uMaxLaneGap;
+	uint64_t uLow = read.uLane > uGap ? read.uLane - uGap : 0;
+	uint64_t uHigh = std::min<uint64_t>(read.uLane + uGap, 31);
+	uint64_t uMask = ((2ull << uHigh) - 1) & ~((1ull << uLow) - 1);
+	return (open.passage.uLanes & uMask) != 0;
+}
+
+static bool ANPRDedupTimeMatches(const ANPRDedup* pDedup, const ANPRDedupOpenPassage& open, int64_t iTimestampUs)
+{
+	return iTimestampUs <= open.passage.iLastTimestampUs + pDedup->config.iWindowUs
+		&& iTimestampUs >= open.passage.iFirstTimestampUs - pDedup->config.iWindowUs;
+}
+
+/*!
+	Finds the open passage of a read
+	@param[out] pbConfirmed set if the passage was confirmed by the fingerprint matcher
+	@returns the slot of the passage, or UINT32_MAX
+*/
+static uint32_t ANPRDedupFind(ANPRDedup* pDedup, const ANPRPlateRead& read, const char* strText, bool* pbConfirmed)
+{
+	int64_t iSize = (int64_t)pDedup->buckets.size();
+	uint64_t keys[ANPR_PLATE_READ_MAX_PLATE];
+	uint32_t uKeys = ANPRPlateReadTextKeys(strText, pDedup->config.uMaxTextDistance, keys, ANPR_PLATE_READ_MAX_PLATE);
+
+	// identical texts, the most recent passage first
+	uint32_t uFound = UINT32_MAX;
+	for (int64_t i = pDedup->iClockBucket; i > pDedup->iClockBucket - iSize && uFound == UINT32_MAX; i--)
+	{
+		ANPRDedupBucket& bucket = ANPRDedupGetBucket(pDedup, i);
+		if (bucket.iIndex != i)
+			continue;
+		ANPRDedupFindKey(bucket, keys[0], [&](uint32_t uSlot) {
+			const ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+			if (!open.bOpen || open.iBucket != i)
+				return;
+			if (strcmp(open.strText, strText) != 0 && strcmp(open.strLastText, strText) != 0)
+				return;
+			if (!ANPRDedupTimeMatches(pDedup, open, read.iTimestampUs) || !ANPRDedupLaneMatches(pDedup, open, read))
+				return;
+			if (uFound == UINT32_MAX || open.passage.iLastTimestampUs > pDedup->passages[uFound].passage.iLastTimestampUs)
+				uFound = uSlot;
+		});
+	}
+	*pbConfirmed = false;
+	if (uFound != UINT32_MAX || uKeys == 1 || !pDedup->pMatcher || !read.pFingerprint || read.uFingerprintSize == 0)
+		return uFound;
+
+	// texts one character away, confirmed by their fingerprints
+	thread_local std::vector<uint32_t> candidates;
+	candidates.clear();
+	for (int64_t i = pDedup->iClockBucket; i > pDedup->iClockBucket - iSize; i--)
+	{
+		ANPRDedupBucket& bucket = ANPRDedupGetBucket(pDedup, i);
+		if (bucket.iIndex != i || bucket.uKeys == 0)
+			continue;
+		for (uint32_t k = 0; k < uKeys; k++)
+		{
+			ANPRDedupFindKey(bucket, keys[k], [&](uint32_t uSlot) {
+				const ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+				if (open.bOpen && open.iBucket == i && std::find(candidates.begin(), candidates.end(), uSlot) == candidates.end())
+					candidates.push_back(uSlot);
+			});
+		}
+	}
+	for (uint32_t uSlot : candidates)
+	{
+		const ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+		if (open.fingerprint.empty())
+			continue;
+		if (ANPRPlateReadTextDistance(open.strText, strText) > 1 && ANPRPlateReadTextDistance(open.strLastText, strText) > 1)
+			continue;
+		if (!ANPRDedupTimeMatches(pDedup, open, read.iTimestampUs) || !ANPRDedupLaneMatches(pDedup, open, read))
+			continue;
+		pDedup->uComparisons++;
+		if (CDKPlateFingerprintMatch(pDedup->pMatcher, read.pFingerprint, read.uFingerprintSize, open.fingerprint.data(), (uint32_t)open.fingerprint.size()) == 1)
+		{
+			*pbConfirmed = true;
+			return uSlot;
+		}
+	}
+	return UINT32_MAX;
+}
+
+static void ANPRDedupSetBest(ANPRDedupOpenPassage& open, CDKMsg* pMsg, const ANPRPlateRead& read)
+{
+	open.pMsg = pMsg;
+	open.passage.uReliability = read.uReliability;
+	strcpy(open.passage.strPlate, read.strPlate);
+	if (read.pFingerprint && read.uFingerprintSize)
+		open.fingerprint.assign(read.pFingerprint, read.pFingerprint + read.uFingerprintSize);
+}
+
+void ANPRDedupDefaultConfig(ANPRDedupConfig* pConfig)
+{
+	pConfig->iWindowUs = 3000000;
+	pConfig->iBucketUs = 500000;
+	pConfig->uMaxPassages = 4096;
+	pConfig->uMaxLaneGap = 1;
+	pConfig->uMaxTextDistance = 1;
+}
+
+ANPRDedup* ANPRDedupCreate(const ANPRDedupConfig* pConfig, const ANPRPlateReadSchema* pSchema, CDKPlateFingerprintMatcher* pMatcher,
+	PANPRDEDUPPASSAGECALLBACK passageCallback, void* pUser)
+{
+	if (!passageCallback)
+	{
+		CDKSetLastError(nullptr, "no passage callback");
+		return nullptr;
+	}
+	ANPRDedup* pDedup = new (std::nothrow) ANPRDedup();
+	if (!pDedup)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pDedup->config = *pConfig;
+	else
+		ANPRDedupDefaultConfig(&pDedup->config);
+	if (pDedup->config.iWindowUs < 0 || pDedup->config.iBucketUs <= 0 || pDedup->config.uMaxPassages == 0)
+	{
+		CDKSetLastError(nullptr, "invalid de-duplication configuration");
+		delete pDedup;
+		return nullptr;
+	}
+	pDedup->config.uMaxTextDistance = std::min<uint32_t>(pDedup->config.uMaxTextDistance, 1);
+	if (!pSchema)
+	{
+		pDedup->pOwnedSchema = ANPRPlateReadSchemaCreate();
+		if (!pDedup->pOwnedSchema)
+		{
+			delete pDedup;
+			return nullptr;
+		}
+		pSchema = pDedup->pOwnedSchema;
+	}
+	pDedup->pSchema = pSchema;
+	pDedup->pMatcher = pMatcher;
+	pDedup->passageCallback = passageCallback;
+	pDedup->pUser = pUser;
+	try
+	{
+		pDedup->passages.resize(pDedup->config.uMaxPassages);
+		pDedup->freeSlots.reserve(pDedup->config.uMaxPassages);
+		for (uint32_t i = pDedup->config.uMaxPassages; i > 0; i--)
+			pDedup->freeSlots.push_back(i - 1);
+		// the window, rounded up to buckets, and the current bucket
+		pDedup->buckets.resize((size_t)((pDedup->config.iWindowUs + pDedup->config.iBucketUs - 1) / pDedup->config.iBucketUs + 1));
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		ANPRDedupDestroy(pDedup);
+		return nullptr;
+	}
+	return pDedup;
+}
+
+void ANPRDedupDestroy(ANPRDedup* pDedup)
+{
+	if (!pDedup)
+		return;
+	for (ANPRDedupOpenPassage& open : pDedup->passages)
+		CDKMsgDestroy(open.pMsg);
+	ANPRPlateReadSchemaDestroy(pDedup->pOwnedSchema);
+	delete pDedup;
+}
+
+int32_t ANPRDedupPush(ANPRDedup* pDedup, CDKMsg* pMsg, const ANPRPlateRead* pRead)
+{
+	if (!pDedup)
+	{
+		// the message is owned by the stage, even on failure
+		CDKMsgDestroy(pMsg);
+		return CDK_FAIL;
+	}
+	if (!pMsg)
+	{
+		CDKSetLastError(pDedup, "no message");
+		return CDK_FAIL;
+	}
+	ANPRPlateRead extracted;
+	if (!pRead)
+	{
+		ANPRPlateReadExtract(pDedup->pSchema, pMsg, &extracted);
+		pRead = &extracted;
+	}
+	const ANPRPlateRead& read = *pRead;
+	char strText[ANPR_PLATE_READ_MAX_PLATE];
+	bool bKeyed = (read.uFields & (1u << ANPR_PLATE_READ_PLATE)) && (read.uFields & (1u << ANPR_PLATE_READ_TIMESTAMP))
+		&& ANPRPlateReadNormalize(read.strPlate, strText) > 0;
+
+	thread_local std::vector<ANPRDedupEvent> events;
+	events.clear();
+	int32_t iResult = CDK_OK;
+	// the read, until it is handed to a passage or to an event : released on failure
+	CDKMsg* pPending = pMsg;
+	{
+		std::lock_guard<std::mutex> lock(pDedup->mutex);
+		pDedup->uReads++;
+		try
+		{
+			if (!bKeyed)
+			{
+				// nothing to group the read with : a passage of its own
+				ANPRDedupPassage passage = {};
+				passage.uReads = 1;
+				if ((read.uFields & (1u << ANPR_PLATE_READ_LANE)) && read.uLane < 32)
+					passage.uLanes = 1u << read.uLane;
+				passage.uReliability = read.uReliability;
+				passage.iFirstTimestampUs = passage.iLastTimestampUs = read.iTimestampUs;
+				strcpy(passage.strPlate, read.strPlate);
+				ANPRDedupEmit(pDedup, pMsg, passage, events);
+				pPending = nullptr;
+			}
+			else
+			{
+				int64_t iSize = (int64_t)pDedup->buckets.size();
+				int64_t iBucket = ANPRDedupFloorDiv(read.iTimestampUs, pDedup->config.iBucketUs);
+				ANPRDedupAdvance(pDedup, iBucket, events);
+				// a late read goes to the oldest open bucket
+				iBucket = std::max(iBucket, pDedup->iClockBucket - iSize + 1);
+
+				bool bConfirmed;
+				uint32_t uSlot = ANPRDedupFind(pDedup, read, strText, &bConfirmed);
+				if (uSlot != UINT32_MAX)
+				{
+					ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+					ANPRDedupPassage& passage = open.passage;
+					passage.uReads++;
+					pDedup->uDuplicates++;
+					if (bConfirmed)
+					{
+						passage.uConfirmed++;
+						pDedup->uConfirmed++;
+					}
+					if ((read.uFields & (1u << ANPR_PLATE_READ_LANE)) && read.uLane < 32)
+						passage.uLanes |= 1u << read.uLane;
+					passage.iFirstTimestampUs = std::min(passage.iFirstTimestampUs, read.iTimestampUs);
+					passage.iLastTimestampUs = std::max(passage.iLastTimestampUs, read.iTimestampUs);
+					if (read.uReliability > passage.uReliability)
+					{
+						CDKMsgDestroy(open.pMsg);
+						pPending = nullptr;
+						ANPRDedupSetBest(open, pMsg, read);
+					}
+					else
+					{
+						if (open.fingerprint.empty() && read.pFingerprint && read.uFingerprintSize)
+							open.fingerprint.assign(read.pFingerprint, read.pFingerprint + read.uFingerprintSize);
+						CDKMsgDestroy(pMsg);
+						pPending = nullptr;
+					}
+					strcpy(open.strLastText, strText);
+					if (iBucket > open.iBucket)
+					{
+						ANPRDedupMove(pDedup, uSlot, iBucket);
+						ANPRDedupIndex(pDedup, uSlot, open.strText);
+					}
+					if (strcmp(strText, open.strText) != 0)
+						ANPRDedupIndex(pDedup, uSlot, strText);
+				}
+				else
+				{
+					if (pDedup->freeSlots.empty())
+						ANPRDedupCloseOldest(pDedup, events);
+					uSlot = pDedup->freeSlots.back();
+					pDedup->freeSlots.pop_back();
+					ANPRDedupOpenPassage& open = pDedup->passages[uSlot];
+					open.bOpen = true;
+					open.pushed = std::chrono::steady_clock::now();
+					open.passage = {};
+					open.passage.uReads = 1;
+					if ((read.uFields & (1u << ANPR_PLATE_READ_LANE)) && read.uLane < 32)
+						open.passage.uLanes = 1u << read.uLane;
+					open.passage.iFirstTimestampUs = open.passage.iLastTimestampUs = read.iTimestampUs;
+					open.fingerprint.clear();
+					pPending = nullptr;
+					ANPRDedupSetBest(open, pMsg, read);
+					strcpy(open.strText, strText);
+					strcpy(open.strLastText, strText);
+					ANPRDedupMove(pDedup, uSlot, iBucket);
+					ANPRDedupIndex(pDedup, uSlot, strText);
+				}
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			CDKMsgDestroy(pPending);
+			CDKSetLastError(pDedup, "out of memory");
+			iResult = CDK_FAIL;
+		}
+	}
+	for (ANPRDedupEvent& event : events)
+		pDedup->passageCallback(event.pMsg, &event.passage, pDedup->pUser);
+	return iResult;
+}
+
+uint32_t ANPRDedupFlush(ANPRDedup* pDedup, int64_t iNowUs)
+{
+	if (!pDedup)
+		return 0;
+	thread_local std::vector<ANPRDedupEvent> events;
+	events.clear();
+	uint32_t uClosed = 0;
+	{
+		std::lock_guard<std::mutex> lock(pDedup->mutex);
+		try
+		{
+			if (iNowUs == INT64_MAX)
+			{
+				if (pDedup->iClockBucket != INT64_MIN)
+				{
+					int64_t iSize = (int64_t)pDedup->buckets.size();
+					for (int64_t i = pDedup->iClockBucket - iSize + 1; i <= pDedup->iClockBucket; i++)
+					{
+						ANPRDedupBucket& bucket = ANPRDedupGetBucket(pDedup, i);
+						if (bucket.iIndex == i)
+							uClosed += ANPRDedupCloseBucket(pDedup, bucket, events);
+					}
+				}
+			}
+			else if (pDedup->iClockBucket != INT64_MIN)
+				uClosed = ANPRDedupAdvance(pDedup, ANPRDedupFloorDiv(iNowUs, pDedup->config.iBucketUs), events);
+		}
+		catch (const std::bad_alloc&)
+		{
+			CDKSetLastError(pDedup, "out of memory");
+		}
+	}
+	for (ANPRDedupEvent& event : events)
+		pDedup->passageCallback(event.pMsg, &event.passage, pDedup->pUser);
+	return uClosed;
+}
+
+void ANPRDedupGetStats(ANPRDedup* pDedup, ANPRDedupStats* pStats)
+{
+	if (!pDedup || !pStats)
+		return;
+	std::lock_guard<std::mutex> lock(pDedup->mutex);
+	pStats->uReads = pDedup->uReads;
+	pStats->uPassages = pDedup->uPassages;
+	pStats->uDuplicates = pDedup->uDuplicates;
+	pStats->uConfirmed = pDedup->uConfirmed;
+	pStats->uComparisons = pDedup->uComparisons;
+	pStats->uForced = pDedup->uForced;
+	pStats->uOpen = pDedup->config.uMaxPassages - (uint32_t)pDedup->freeSlots.size();
+	pStats->dDedupRatio = pDedup->uReads ? (double)pDedup->uDuplicates / (double)pDedup->uReads : 0;
+	pStats->uLatencyAvgUs = pDedup->uPassages ? pDedup->uLatencySumUs / pDedup->uPassages : 0;
+	pStats->uLatencyMaxUs = pDedup->uLatencyMaxUs;
+}
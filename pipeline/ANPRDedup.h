@@ -0,0 +1,168 @@
+/*! \file
+
+ANPRDedup : de-duplication of the plate reads of a site, in front of the pipeline.<br/>
+A vehicle is often read several times, by the same lane or by adjacent lanes, within a few seconds. The stage groups
+these reads in a passage, and hands one consolidated event per passage to its callback : the read with the best
+reliability, carrying a <code>passage</code> element with the number of reads, the lanes and the times of the passage.<br/>
+The reads are keyed by their normalized plate text : upper case, without separators, the characters often confused by
+OCR engines (0/O/D/Q, 1/I, 2/Z, 5/S, 6/G, 8/B) folded together. A read with the same normalized text as an open passage,
+on a lane close to it, is a duplicate. A read whose text differs by one character from an open passage is only a
+duplicate when <a href="#CDKPlateFingerprintMatch">CDKPlateFingerprintMatch</a> confirms that both reads have the
+same plate.<br/>
+The passages are kept in a hash table split in time buckets : a passage is closed when its bucket leaves the window,
+so that its event is delayed by the window at most, plus a bucket. The time is the time of the reads, advanced by
+<a href="#ANPRDedupPush">ANPRDedupPush</a> and <a href="#ANPRDedupFlush">ANPRDedupFlush</a>, and the number of open
+passages is bounded : when it is reached, the oldest passage is closed early.
+
+*/
+
+#ifndef ANPRDEDUP_H
+#define ANPRDEDUP_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "ANPRPlateRead.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A de-duplication stage
+*/
+typedef struct _anprdedup ANPRDedup;
+
+/*! <summary>struct</summary>
+	Configuration of a de-duplication stage
+*/
+typedef struct
+{
+	/*! time without read after which a passage is closed, in us */
+	int64_t iWindowUs;
+	/*! size of a time bucket, in us : passages are closed one bucket at a time */
+	int64_t iBucketUs;
+	/*! maximum number of open passages, each holding its best read */
+	uint32_t uMaxPassages;
+	/*! maximum difference between the lane of a read and the lanes of a passage, for the read to be a duplicate */
+	uint32_t uMaxLaneGap;
+	/*! 1 to confirm the reads whose normalized text differs by one character with the fingerprint matcher, 0 to only group identical texts */
+	uint32_t uMaxTextDistance;
+} ANPRDedupConfig;
+
+/*! <summary>struct</summary>
+	A consolidated passage
+*/
+typedef struct
+{
+	/*! reads grouped in the passage */
+	uint32_t uReads;
+	/*! reads grouped after a fingerprint confirmation */
+	uint32_t uConfirmed;
+	/*! bit (1 << lane) for every lane of the passage, lanes 0 to 31 */
+	uint32_t uLanes;
+	/*! reliability of the best read */
+	uint32_t uReliability;
+	/*! time of the first read, in us */
+	int64_t iFirstTimestampUs;
+	/*! time of the last read, in us */
+	int64_t iLastTimestampUs;
+	/*! time from the push of the first read to the event, in us */
+	int64_t iLatencyUs;
+	/*! plate of the best read */
+	char strPlate[ANPR_PLATE_READ_MAX_PLATE];
+} ANPRDedupPassage;
+
+/*! <summary>callback</summary>
+
+	Callback called for every passage closed.<br/>
+	It is called by the thread that closed the passage, in <a href="#ANPRDedupPush">ANPRDedupPush</a> or
+	<a href="#ANPRDedupFlush">ANPRDedupFlush</a>, without any lock of the stage held.
+	@param[in] pMsg the best read of the passage, with a <code>passage</code> child element of its root. The callback owns it, and must destroy it with <a href="#CDKMsgDestroy">CDKMsgDestroy</a>
+	@param[in] pPassage the passage
+	@param[in] pUser User data
+*/
+typedef void (*PANPRDEDUPPASSAGECALLBACK)(CDKMsg* pMsg, const ANPRDedupPassage* pPassage, void* pUser);
+
+/*! <summary>struct</summary>
+	Counters of a de-duplication stage
+*/
+typedef struct
+{
+	/*! reads pushed */
+	uint64_t uReads;
+	/*! passages closed */
+	uint64_t uPassages;
+	/*! reads grouped in an open passage, and destroyed unless they are its best read */
+	uint64_t uDuplicates;
+	/*! reads grouped after a fingerprint confirmation */
+	uint64_t uConfirmed;
+	/*! fingerprint comparisons */
+	uint64_t uComparisons;
+	/*! passages closed before the end of their window, because uMaxPassages was reached */
+	uint64_t uForced;
+	/*! open passages */
+	uint32_t uOpen;
+	/*! uDuplicates / uReads */
+	double dDedupRatio;
+	/*! average time from the push of the first read of a passage to its event, in us */
+	uint64_t uLatencyAvgUs;
+	/*! maximum time from the push of the first read of a passage to its event, in us */
+	uint64_t uLatencyMaxUs;
+} ANPRDedupStats;
+
+/*!
+	Fills a configuration with default values : passages closed after 3 s without read, 500 ms buckets, 4096 open passages,
+	adjacent lanes, texts differing by one character confirmed
+*/
+void ANPRDedupDefaultConfig(ANPRDedupConfig* pConfig);
+
+/*!
+	Creates a de-duplication stage. Use <a href="#ANPRDedupDestroy">ANPRDedupDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@param[in] pSchema schema extracting the reads pushed without <a href="#ANPRPlateRead">ANPRPlateRead</a>, or NULL for the default schema. It must outlive the stage
+	@param[in] pMatcher matcher confirming the reads with close texts, started. Can be NULL to only group identical texts. It must outlive the stage
+	@param[in] passageCallback callback called for every passage
+	@param[in] pUser callback user data
+	@returns the stage, or NULL on failure
+*/
+ANPRDedup* ANPRDedupCreate(const ANPRDedupConfig* pConfig, const ANPRPlateReadSchema* pSchema, CDKPlateFingerprintMatcher* pMatcher,
+	PANPRDEDUPPASSAGECALLBACK passageCallback, void* pUser);
+
+/*!
+	Destroys a de-duplication stage. The open passages are released without event : call
+	<a href="#ANPRDedupFlush">ANPRDedupFlush</a> with INT64_MAX before to close them.
+*/
+void ANPRDedupDestroy(ANPRDedup* pDedup);
+
+/*!
+	Pushes a read. The read is grouped in an open passage, or opens a new one, and the passages whose window is over at
+	the time of the read are closed. A read without plate is a passage of its own.<br/>
+	Can be called from several threads, for instance from the callback of an <a href="#ANPRIngest">ingestion engine</a>.
+	@param[in] pDedup the stage
+	@param[in] pMsg the read. It is owned by the stage, even on failure
+	@param[in] pRead the read extracted from pMsg, or NULL to extract it with the schema of the stage
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRDedupPush(ANPRDedup* pDedup, CDKMsg* pMsg, const ANPRPlateRead* pRead);
+
+/*!
+	Advances the time of the stage without read, and closes the passages whose window is over : to be called
+	periodically when the reads stop.
+	@param[in] pDedup the stage
+	@param[in] iNowUs time, in the time base of the reads, in us. INT64_MAX closes every passage
+	@returns the number of passages closed
+*/
+uint32_t ANPRDedupFlush(ANPRDedup* pDedup, int64_t iNowUs);
+
+/*!
+	Returns the counters of a de-duplication stage
+*/
+void ANPRDedupGetStats(ANPRDedup* pDedup, ANPRDedupStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRDEDUP_H
@@ -0,0 +1,383 @@
+/*! \file
+
+ANPRDictionaryStore : persistent store of the plate fingerprint dictionaries.
+
+The store file is a 32 bytes header, followed by the table of the sites, then by their dictionaries. Every site
+entry holds a check value of its dictionary, and the header a check value of the table. All values are in host
+byte order.
+
+A reader keeps the store mapped, and compares the file of the store path with the mapped one at every access :
+a save renames a new file over the path, and the next access maps it.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <list>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRDictionaryStore.h"
+
+#define ANPR_DICTIONARY_STORE_MAGIC "ANPRDIC1"
+
+struct ANPRDictionaryStoreHeader
+{
+	char magic[8];
+	uint32_t uSites;
+	uint32_t uCheck;
+	uint64_t uReserved[2];
+};
+
+struct ANPRDictionaryStoreSite
+{
+	char strSite[ANPR_DICTIONARY_STORE_MAX_SITE + 1];
+	uint64_t uVersion;
+	int64_t iSavedUs;
+	uint64_t uOffset;
+	uint32_t uSize;
+	uint32_t uCheck;
+};
+
+/*!
+	A matcher attached to a site : user data of its save dictionary callback
+*/
+struct ANPRDictionaryStoreBinding
+{
+	ANPRDictionaryStore* pStore;
+	std::string strSite;
+};
+
+struct _anprdictionarystore : CDKObject
+{
+	std::string strPath;
+	/*! protects the mapping */
+	std::mutex mutex;
+	const uint8_t* pData = nullptr;
+	size_t uSize = 0;
+	dev_t device = 0;
+	ino_t inode = 0;
+	/*! sites of the mapping, validated */
+	std::vector<const ANPRDictionaryStoreSite*> sites;
+	std::list<ANPRDictionaryStoreBinding> bindings;
+};
+
+static uint32_t ANPRDictionaryStoreCheck(const uint8_t* pData, size_t uSize)
+{
+	// FNV-1a
+	uint32_t uCheck = 2166136261u;
+	for (size_t i = 0; i < uSize; i++)
+		uCheck = (uCheck ^ pData[i]) * 16777619u;
+	return uCheck;
+}
+
+static void ANPRDictionaryStoreUnmap(ANPRDictionaryStore* pStore)
+{
+	if (pStore->pData)
+		munmap((void*)pStore->pData, pStore->uSize);
+	pStore->pData = nullptr;
+	pStore->uSize = 0;
+	pStore->device = 0;
+	pStore->inode = 0;
+	pStore->sites.clear();
+}
+
+/*!
+	Maps the store file if it is not the mapped one, the mutex being held. A missing file is an empty store.
+*/
+static int32_t ANPRDictionaryStoreRefresh(ANPRDictionaryStore* pStore)
+{
+	int iFd = open(pStore->strPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (iFd < 0)
+	{
+		if (errno != ENOENT)
+		{
+			CDKSetLastError(pStore, "cannot open %s: %s", pStore->strPath.c_str(), strerror(errno));
+			return CDK_FAIL;
+		}
+		ANPRDictionaryStoreUnmap(pStore);
+		return CDK_OK;
+	}
+	struct stat st;
+	if (fstat(iFd, &st) != 0)
+	{
+		CDKSetLastError(pStore, "cannot stat %s: %s", pStore->strPath.c_str(), strerror(errno));
+		close(iFd);
+		return CDK_FAIL;
+	}
+	if (pStore->pData && st.st_dev == pStore->device && st.st_ino == pStore->inode)
+	{
+		close(iFd);
+		return CDK_OK;
+	}
+	size_t uSize = (size_t)st.st_size;
+	void* pMapped = uSize >= sizeof(ANPRDictionaryStoreHeader) ? mmap(nullptr, uSize, PROT_READ, MAP_SHARED, iFd, 0) : MAP_FAILED;
+	close(iFd);
+	const uint8_t* pData = (const uint8_t*)pMapped;
+	const ANPRDictionaryStoreHeader* pHeader = (const ANPRDictionaryStoreHeader*)pData;
+	if (pMapped == MAP_FAILED || memcmp(pHeader->magic, ANPR_DICTIONARY_STORE_MAGIC, sizeof(pHeader->magic)) != 0 ||
+		pHeader->uSites > (uSize - sizeof(ANPRDictionaryStoreHeader)) / sizeof(ANPRDictionaryStoreSite) ||
+		pHeader->uCheck != ANPRDictionaryStoreCheck(pData + sizeof(ANPRDictionaryStoreHeader), pHeader->uSites * sizeof(ANPRDictionaryStoreSite)))
+	{
+		if (pMapped != MAP_FAILED)
+			munmap(pMapped, uSize);
+		CDKSetLastError(pStore, "%s is not a dictionary store", pStore->strPath.c_str());
+		return CDK_FAIL;
+	}
+	ANPRDictionaryStoreUnmap(pStore);
+	pStore->pData = pData;
+	pStore->uSize = uSize;
+	pStore->device = st.st_dev;
+	pStore->inode = st.st_ino;
+	const ANPRDictionaryStoreSite* pSites = (const ANPRDictionaryStoreSite*)(pData + sizeof(ANPRDictionaryStoreHeader));
+	for (uint32_t i = 0; i < pHeader->uSites; i++)
+	{
+		const ANPRDictionaryStoreSite* pSite = &pSites[i];
+		if (pSite->strSite[ANPR_DICTIONARY_STORE_MAX_SITE] == 0 && pSite->uOffset <= uSize && pSite->uSize <= uSize - pSite->uOffset &&
+			pSite->uCheck == ANPRDictionaryStoreCheck(pData + pSite->uOffset, pSite->uSize))
+			pStore->sites.push_back(pSite);
+	}
+	return CDK_OK;
+}
+
+static const ANPRDictionaryStoreSite* ANPRDictionaryStoreFind(ANPRDictionaryStore* pStore, const char* strSite)
+{
+	for (const ANPRDictionaryStoreSite* pSite : pStore->sites)
+		if (strcmp(pSite->strSite, strSite) == 0)
+			return pSite;
+	return nullptr;
+}
+
+static int32_t ANPRDictionaryStoreWriteAll(int iFd, const uint8_t* pData, size_t uSize)
+{
+	while (uSize)
+	{
+		ssize_t iWritten = write(iFd, pData, uSize);
+		if (iWritten < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return CDK_FAIL;
+		}
+		pData += iWritten;
+		uSize -= (size_t)iWritten;
+	}
+	return CDK_OK;
+}
+
+static int32_t ANPRDictionaryStoreSaveCallback(CDKPlateFingerprintMatcher*, const uint8_t* pBuffer, uint32_t uSize, void* pUser)
+{
+	ANPRDictionaryStoreBinding* pBinding = (ANPRDictionaryStoreBinding*)pUser;
+	return ANPRDictionaryStoreSave(pBinding->pStore, pBinding->strSite.c_str(), pBuffer, uSize) == CDK_OK ? 1 : 0;
+}
+
+ANPRDictionaryStore* ANPRDictionaryStoreOpen(const char* strPath)
+{
+	if (!strPath || !*strPath)
+	{
+		CDKSetLastError(nullptr, "a store path is required");
+		return nullptr;
+	}
+	ANPRDictionaryStore* pStore = new (std::nothrow) ANPRDictionaryStore();
+	if (!pStore)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	pStore->strPath = strPath;
+	if (ANPRDictionaryStoreRefresh(pStore) != CDK_OK)
+	{
+		CDKSetLastError(nullptr, "%s", CDKGetLastError(pStore));
+		delete pStore;
+		return nullptr;
+	}
+	return pStore;
+}
+
+void ANPRDictionaryStoreClose(ANPRDictionaryStore* pStore)
+{
+	if (!pStore)
+		return;
+	ANPRDictionaryStoreUnmap(pStore);
+	delete pStore;
+}
+
+int32_t ANPRDictionaryStoreGet(ANPRDictionaryStore* pStore, const char* strSite, uint8_t* pBuffer, uint32_t uMaxSize, uint32_t* puSize, uint64_t* puVersion)
+{
+	if (!pStore)
+		return CDK_FAIL;
+	if (!strSite || !puSize || (uMaxSize && !pBuffer))
+	{
+		CDKSetLastError(pStore, "a site and a buffer are required");
+		return CDK_FAIL;
+	}
+	std::lock_guard<std::mutex> lock(pStore->mutex);
+	if (ANPRDictionaryStoreRefresh(pStore) != CDK_OK)
+		return CDK_FAIL;
+	const ANPRDictionaryStoreSite* pSite = ANPRDictionaryStoreFind(pStore, strSite);
+	if (!pSite)
+	{
+		CDKSetLastError(pStore, "no dictionary for site %s", strSite);
+		return CDK_FAIL;
+	}
+	*puSize = pSite->uSize;
+	if (pSite->uSize > uMaxSize)
+	{
+		CDKSetLastError(pStore, "dictionary of site %s is %u bytes", strSite, pSite->uSize);
+		return CDK_FAIL;
+	}
+	memcpy(pBuffer, pStore->pData + pSite->uOffset, pSite->uSize);
+	if (puVersion)
+		*puVersion = pSite->uVersion;
+	return CDK_OK;
+}
+
+/*!
+	Writes the store with a new version of a site, the mutex and the lock file being held
+*/
+static int32_t ANPRDictionaryStoreWrite(ANPRDictionaryStore* pStore, const char* strSite, const uint8_t* pDictionary, uint32_t uSize)
+{
+	if (ANPRDictionaryStoreRefresh(pStore) != CDK_OK)
+		return CDK_FAIL;
+
+	std::vector<ANPRDictionaryStoreSite> sites;
+	std::vector<const uint8_t*> dictionaries;
+	ANPRDictionaryStoreSite site = {};
+	strcpy(site.strSite, strSite);
+	site.uVersion = 1;
+	site.iSavedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	site.uSize = uSize;
+	site.uCheck = ANPRDictionaryStoreCheck(pDictionary, uSize);
+	try
+	{
+		for (const ANPRDictionaryStoreSite* pSite : pStore->sites)
+		{
+			if (strcmp(pSite->strSite, strSite) == 0)
+			{
+				site.uVersion = pSite->uVersion + 1;
+				continue;
+			}
+			sites.push_back(*pSite);
+			dictionaries.push_back(pStore->pData + pSite->uOffset);
+		}
+		sites.push_back(site);
+		dictionaries.push_back(pDictionary);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pStore, "out of memory");
+		return CDK_FAIL;
+	}
+	uint64_t uOffset = sizeof(ANPRDictionaryStoreHeader) + sites.size() * sizeof(ANPRDictionaryStoreSite);
+	for (ANPRDictionaryStoreSite& entry : sites)
+	{
+		entry.uOffset = uOffset;
+		uOffset += entry.uSize;
+	}
+	ANPRDictionaryStoreHeader header = {};
+	memcpy(header.magic, ANPR_DICTIONARY_STORE_MAGIC, sizeof(header.magic));
+	header.uSites = (uint32_t)sites.size();
+	header.uCheck = ANPRDictionaryStoreCheck((const uint8_t*)sites.data(), sites.size() * sizeof(ANPRDictionaryStoreSite));
+
+	std::string strTemporary = pStore->strPath + ".tmp";
+	int iFd = open(strTemporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (iFd < 0)
+	{
+		CDKSetLastError(pStore, "cannot create %s: %s", strTemporary.c_str(), strerror(errno));
+		return CDK_FAIL;
+	}
+	bool bOk = ANPRDictionaryStoreWriteAll(iFd, (const uint8_t*)&header, sizeof(header)) == CDK_OK &&
+		ANPRDictionaryStoreWriteAll(iFd, (const uint8_t*)sites.data(), sites.size() * sizeof(ANPRDictionaryStoreSite)) == CDK_OK;
+	for (size_t i = 0; bOk && i < sites.size(); i++)
+		bOk = ANPRDictionaryStoreWriteAll(iFd, dictionaries[i], sites[i].uSize) == CDK_OK;
+	bOk = bOk && fdatasync(iFd) == 0;
+	close(iFd);
+	if (!bOk || rename(strTemporary.c_str(), pStore->strPath.c_str()) != 0)
+	{
+		CDKSetLastError(pStore, "cannot write %s: %s", pStore->strPath.c_str(), strerror(errno));
+		unlink(strTemporary.c_str());
+		return CDK_FAIL;
+	}
+	// the rename is durable once the directory is synchronized
+	size_t uSlash = pStore->strPath.rfind('/');
+	std::string strDirectory = uSlash == std::string::npos ? "." : uSlash == 0 ? "/" : pStore->strPath.substr(0, uSlash);
+	int iDirectoryFd = open(strDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (iDirectoryFd >= 0)
+	{
+		fsync(iDirectoryFd);
+		close(iDirectoryFd);
+	}
+	return ANPRDictionaryStoreRefresh(pStore);
+}
+
+int32_t ANPRDictionaryStoreSave(ANPRDictionaryStore* pStore, const char* strSite, const uint8_t* pDictionary, uint32_t uSize)
+{
+	if (!pStore)
+		return CDK_FAIL;
+	if (!strSite || !*strSite || strlen(strSite) > ANPR_DICTIONARY_STORE_MAX_SITE || (uSize && !pDictionary))
+	{
+		CDKSetLastError(pStore, "invalid site or dictionary");
+		return CDK_FAIL;
+	}
+	std::lock_guard<std::mutex> lock(pStore->mutex);
+	// serializes the saves of every process
+	std::string strLock = pStore->strPath + ".lock";
+	int iLockFd = open(strLock.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (iLockFd < 0 || flock(iLockFd, LOCK_EX) != 0)
+	{
+		CDKSetLastError(pStore, "cannot lock %s: %s", strLock.c_str(), strerror(errno));
+		if (iLockFd >= 0)
+			close(iLockFd);
+		return CDK_FAIL;
+	}
+	int32_t iResult = ANPRDictionaryStoreWrite(pStore, strSite, pDictionary, uSize);
+	// releases the lock
+	close(iLockFd);
+	return iResult;
+}
+
+int32_t ANPRDictionaryStoreAttachMatcher(ANPRDictionaryStore* pStore, const char* strSite, CDKPlateFingerprintMatcher* pMatcher)
+{
+	if (!pStore)
+		return -1;
+	if (!strSite || !pMatcher)
+	{
+		CDKSetLastError(pStore, "a site and a matcher are required");
+		return -1;
+	}
+	ANPRDictionaryStoreBinding* pBinding;
+	try
+	{
+		std::lock_guard<std::mutex> lock(pStore->mutex);
+		pStore->bindings.push_back({ pStore, strSite });
+		pBinding = &pStore->bindings.back();
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pStore, "out of memory");
+		return -1;
+	}
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pMatcher, ANPRDictionaryStoreSaveCallback, pBinding);
+
+	std::vector<uint8_t> dictionary(256);
+	uint32_t uSize = 0;
+	while (ANPRDictionaryStoreGet(pStore, strSite, dictionary.data(), (uint32_t)dictionary.size(), &uSize, nullptr) != CDK_OK)
+	{
+		// no dictionary, or a bigger one
+		if (uSize <= dictionary.size())
+			return 0;
+		dictionary.resize(uSize);
+	}
+	if (CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), uSize) != CDK_OK)
+	{
+		CDKSetLastError(pStore, "%s", CDKGetLastError(pMatcher));
+		return -1;
+	}
+	return 1;
+}
@@ -0,0 +1,89 @@
+/*! \file
+
+ANPRDictionaryStore : persistent store of the plate fingerprint dictionaries, one per site.<br/>
+A <a href="#CDKPlateFingerprintMatcher">CDKPlateFingerprintMatcher</a> started without dictionary goes through a learning phase,
+during which its decisions are not optimal, and hands the learnt dictionary to its
+<a href="#PCDKPLATEFINGERPRINTMATCHERSAVEDICTIONARYFUNCTION">save dictionary callback</a>. The store keeps the last dictionary
+of every site, with a version incremented at every save, in a single file mapped in memory : at startup the dictionary of a
+site is read from the mapping, and every matcher of the site is started from it.<br/>
+A save writes the whole store to a temporary file renamed over the store, under a lock file, so that the readers, in this
+process or another one, see either the previous store or the new one. The readers map the new file at their next access.
+
+*/
+
+#ifndef ANPRDICTIONARYSTORE_H
+#define ANPRDICTIONARYSTORE_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "CDKPlateFingerprintMatcher.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*!
+	Maximum length of a site name
+*/
+#define ANPR_DICTIONARY_STORE_MAX_SITE 47
+
+/*! <summary>struct</summary>
+	A dictionary store
+*/
+typedef struct _anprdictionarystore ANPRDictionaryStore;
+
+/*!
+	Opens a dictionary store and maps it. The file is created by the first save.<br/>
+	Use <a href="#ANPRDictionaryStoreClose">ANPRDictionaryStoreClose</a> to close it.
+	@param[in] strPath path of the store file. The lock file is strPath followed by .lock
+	@returns the store, or NULL on failure (the file exists and is not a store). Use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+ANPRDictionaryStore* ANPRDictionaryStoreOpen(const char* strPath);
+
+/*!
+	Closes a dictionary store. The matchers attached to it must have been destroyed.
+*/
+void ANPRDictionaryStoreClose(ANPRDictionaryStore* pStore);
+
+/*!
+	Copies the last dictionary of a site.<br/>
+	Can be called from any thread.
+	@param[in] pStore the store
+	@param[in] strSite the site
+	@param[out] pBuffer the dictionary
+	@param[in] uMaxSize size of pBuffer
+	@param[out] puSize size of the dictionary
+	@param[out] puVersion version of the dictionary, 1 for the first save of the site. Can be NULL
+	@returns CDK_OK if the site has a dictionary. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRDictionaryStoreGet(ANPRDictionaryStore* pStore, const char* strSite, uint8_t* pBuffer, uint32_t uMaxSize, uint32_t* puSize, uint64_t* puVersion);
+
+/*!
+	Saves a new version of the dictionary of a site, and synchronizes the store.<br/>
+	Can be called from any thread, and from several processes.
+	@param[in] pStore the store
+	@param[in] strSite the site, at most ANPR_DICTIONARY_STORE_MAX_SITE characters
+	@param[in] pDictionary the dictionary
+	@param[in] uSize size of the dictionary
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRDictionaryStoreSave(ANPRDictionaryStore* pStore, const char* strSite, const uint8_t* pDictionary, uint32_t uSize);
+
+/*!
+	Prepares a matcher of a site, before it is started : the last dictionary of the site is given to the matcher, and the
+	dictionaries learnt by the matcher are saved in the store.<br/>
+	To start every matcher of a pool from the same version, get the dictionary once with
+	<a href="#ANPRDictionaryStoreGet">ANPRDictionaryStoreGet</a> and give it to <a href="#ANPRFingerprintPoolCreate">ANPRFingerprintPoolCreate</a>.
+	@param[in] pStore the store
+	@param[in] strSite the site
+	@param[in] pMatcher the matcher, not started
+	@returns 1 if the matcher got a dictionary, 0 if the site has none yet and the matcher will learn it, -1 on failure
+*/
+int32_t ANPRDictionaryStoreAttachMatcher(ANPRDictionaryStore* pStore, const char* strSite, CDKPlateFingerprintMatcher* pMatcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRDICTIONARYSTORE_H
@@ -0,0 +1,218 @@
+/*! \file
+
+ANPRFanout : zero-copy fan-out of messages to several consumers.
+
+Every consumer owns one reference to the message : the references are all added before the
+message is queued anywhere, so that a fast consumer cannot release the last reference while
+the message is still being handed to the others.
+
+*/
+
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRFanout.h"
+
+/*!
+	Timeout of a consumer wait, so that stop requests are seen
+*/
+#define ANPR_FANOUT_WAIT_MS 100
+
+struct ANPRFanoutConsumer
+{
+	PANPRFANOUTCONSUMERCALLBACK consumerCallback;
+	void* pUser;
+	CDKQueue* pQueue = nullptr;
+	std::thread thread;
+	/*! written by the consumer only, on its own cache line */
+	alignas(64) std::atomic<uint64_t> uDelivered{0};
+};
+
+struct _anprfanout : CDKObject
+{
+	ANPRFanoutConfig config;
+	std::vector<ANPRFanoutConsumer*> consumers;
+	std::atomic<bool> bStop{false};
+	bool bStarted = false;
+};
+
+static void ANPRFanoutConsumerThread(ANPRFanout* pFanout, uint32_t uConsumer)
+{
+	ANPRFanoutConsumer* pConsumer = pFanout->consumers[uConsumer];
+	std::vector<CDKMsg*> batch(pFanout->config.uBatchSize);
+	while (!pFanout->bStop.load(std::memory_order_relaxed))
+	{
+		if (CDKQueueWaitForNewMessages(pConsumer->pQueue, pFanout->config.uBatchSize, 0, ANPR_FANOUT_WAIT_MS) != CDK_OK)
+			continue;
+		uint32_t uCount = CDKQueuePopMessages(pConsumer->pQueue, batch.data(), (uint32_t)batch.size());
+		for (uint32_t i = 0; i < uCount; i++)
+		{
+			pConsumer->consumerCallback(batch[i], uConsumer, pConsumer->pUser);
+			// releases the reference of this consumer, the last one destroys the message
+			CDKMsgDestroy(batch[i]);
+		}
+		pConsumer->uDelivered.fetch_add(uCount, std::memory_order_relaxed);
+	}
+}
+
+void ANPRFanoutDefaultConfig(ANPRFanoutConfig* pConfig)
+{
+	pConfig->uMaxQueueSize = 4096;
+	pConfig->uOverflowPolicy = CDK_QUEUE_DROP_NEWEST;
+	pConfig->uBlockTimeout = 0;
+	pConfig->uBatchSize = 64;
+}
+
+ANPRFanout* ANPRFanoutCreate(const ANPRFanoutConfig* pConfig)
+{
+	ANPRFanout* pFanout = new (std::nothrow) ANPRFanout();
+	if (!pFanout)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pFanout->config = *pConfig;
+	else
+		ANPRFanoutDefaultConfig(&pFanout->config);
+	if (pFanout->config.uBatchSize == 0)
+		pFanout->config.uBatchSize = 1;
+	return pFanout;
+}
+
+void ANPRFanoutDestroy(ANPRFanout* pFanout)
+{
+	if (!pFanout)
+		return;
+	ANPRFanoutStop(pFanout);
+	for (ANPRFanoutConsumer* pConsumer : pFanout->consumers)
+	{
+		CDKQueueDestroy(pConsumer->pQueue);
+		delete pConsumer;
+	}
+	delete pFanout;
+}
+
+int32_t ANPRFanoutAddConsumer(ANPRFanout* pFanout, PANPRFANOUTCONSUMERCALLBACK consumerCallback, void* pUser)
+{
+	if (!pFanout)
+		return -1;
+	if (!consumerCallback)
+	{
+		CDKSetLastError(pFanout, "a consumer callback is required");
+		return -1;
+	}
+	if (pFanout->bStarted)
+	{
+		CDKSetLastError(pFanout, "stage is started");
+		return -1;
+	}
+	CDKQueue* pQueue = CDKQueueCreateLockFree(pFanout->config.uMaxQueueSize);
+	if (!pQueue)
+	{
+		CDKSetLastError(pFanout, "%s", CDKGetLastError(nullptr));
+		return -1;
+	}
+	if (CDKQueueSetOverflowPolicy(pQueue, pFanout->config.uOverflowPolicy, pFanout->config.uBlockTimeout) != CDK_OK)
+	{
+		CDKSetLastError(pFanout, "%s", CDKGetLastError(pQueue));
+		CDKQueueDestroy(pQueue);
+		return -1;
+	}
+	ANPRFanoutConsumer* pConsumer = new (std::nothrow) ANPRFanoutConsumer();
+	if (!pConsumer)
+	{
+		CDKSetLastError(pFanout, "out of memory");
+		CDKQueueDestroy(pQueue);
+		return -1;
+	}
+	pConsumer->consumerCallback = consumerCallback;
+	pConsumer->pUser = pUser;
+	pConsumer->pQueue = pQueue;
+	pFanout->consumers.push_back(pConsumer);
+	return (int32_t)pFanout->consumers.size() - 1;
+}
+
+int32_t ANPRFanoutPush(ANPRFanout* pFanout, CDKMsg* pMsg)
+{
+	if (!pFanout || !pMsg)
+	{
+		CDKMsgDestroy(pMsg);
+		return CDK_FAIL;
+	}
+	size_t uConsumers = pFanout->consumers.size();
+	if (uConsumers == 0)
+	{
+		CDKMsgDestroy(pMsg);
+		return CDK_OK;
+	}
+	CDKMsgSetReadOnly(pMsg, 1);
+	for (size_t i = 1; i < uConsumers; i++)
+		CDKMsgAddRef(pMsg);
+	int32_t iResult = CDK_OK;
+	for (ANPRFanoutConsumer* pConsumer : pFanout->consumers)
+	{
+		if (CDKQueuePushMessage(pConsumer->pQueue, pMsg) != CDK_OK)
+		{
+			// the reference of this consumer is not owned by its queue
+			CDKMsgDestroy(pMsg);
+			iResult = CDK_FAIL;
+		}
+	}
+	return iResult;
+}
+
+int32_t ANPRFanoutStart(ANPRFanout* pFanout)
+{
+	if (!pFanout)
+		return CDK_FAIL;
+	if (pFanout->bStarted)
+	{
+		CDKSetLastError(pFanout, "stage is already started");
+		return CDK_FAIL;
+	}
+	pFanout->bStop = false;
+	try
+	{
+		for (uint32_t i = 0; i < pFanout->consumers.size(); i++)
+			pFanout->consumers[i]->thread = std::thread(ANPRFanoutConsumerThread, pFanout, i);
+	}
+	catch (const std::exception& e)
+	{
+		CDKSetLastError(pFanout, "cannot start consumers: %s", e.what());
+		pFanout->bStarted = true;
+		ANPRFanoutStop(pFanout);
+		return CDK_FAIL;
+	}
+	pFanout->bStarted = true;
+	return CDK_OK;
+}
+
+void ANPRFanoutStop(ANPRFanout* pFanout)
+{
+	if (!pFanout || !pFanout->bStarted)
+		return;
+	pFanout->bStop = true;
+	for (ANPRFanoutConsumer* pConsumer : pFanout->consumers)
+	{
+		if (pConsumer->thread.joinable())
+			pConsumer->thread.join();
+	}
+	pFanout->bStarted = false;
+}
+
+int32_t ANPRFanoutGetConsumerStats(ANPRFanout* pFanout, uint32_t uConsumer, ANPRFanoutConsumerStats* pStats)
+{
+	if (!pFanout || !pStats)
+		return CDK_FAIL;
+	if (uConsumer >= pFanout->consumers.size())
+	{
+		CDKSetLastError(pFanout, "no consumer %u", uConsumer);
+		return CDK_FAIL;
+	}
+	ANPRFanoutConsumer* pConsumer = pFanout->consumers[uConsumer];
+	pStats->uDelivered = pConsumer->uDelivered.load(std::memory_order_relaxed);
+	pStats->uDrops = CDKQueueGetMessageDrops(pConsumer->pQueue);
+	pStats->uQueued = CDKQueueGetQueueSize(pConsumer->pQueue);
+	return CDK_OK;
+}
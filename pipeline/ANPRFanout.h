@@ -0,0 +1,122 @@
+/*! \file
+
+ANPRFanout : zero-copy fan-out of messages to several consumers.<br/>
+Every message pushed to the stage is made read-only (<a href="#CDKMsgSetReadOnly">CDKMsgSetReadOnly</a>) and a reference
+(<a href="#CDKMsgAddRef">CDKMsgAddRef</a>) is handed to every consumer instead of a <a href="#CDKMsgCopy">CDKMsgCopy</a>.
+Each consumer drains its own queue from its own thread, so a slow consumer does not delay the others.
+The message is destroyed when the last consumer is done with it.
+
+*/
+
+#ifndef ANPRFANOUT_H
+#define ANPRFANOUT_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A fan-out stage
+*/
+typedef struct _anprfanout ANPRFanout;
+
+/*! <summary>callback</summary>
+
+	Callback called by the thread of a consumer for every message.<br/>
+	The message is read-only and shared with the other consumers. It is released when the callback returns :
+	to keep it longer, call <a href="#CDKMsgAddRef">CDKMsgAddRef</a> and destroy it later with <a href="#CDKMsgDestroy">CDKMsgDestroy</a>.
+	@param[in] pMsg the message
+	@param[in] uConsumer index of the consumer, as returned by <a href="#ANPRFanoutAddConsumer">ANPRFanoutAddConsumer</a>
+	@param[in] pUser User data
+*/
+typedef void (*PANPRFANOUTCONSUMERCALLBACK)(CDKMsg* pMsg, uint32_t uConsumer, void* pUser);
+
+/*! <summary>struct</summary>
+	Configuration of a fan-out stage
+*/
+typedef struct
+{
+	/*! maximum size of the queue of each consumer */
+	uint32_t uMaxQueueSize;
+	/*! <a href="#CDKQueueSetOverflowPolicy">overflow policy</a> of the consumer queues */
+	uint32_t uOverflowPolicy;
+	/*! with <a href="#CDK_QUEUE_BLOCK">CDK_QUEUE_BLOCK</a>, maximum time <a href="#ANPRFanoutPush">ANPRFanoutPush</a> waits for room, in ms */
+	uint32_t uBlockTimeout;
+	/*! maximum number of messages a consumer takes from its queue at once */
+	uint32_t uBatchSize;
+} ANPRFanoutConfig;
+
+/*! <summary>struct</summary>
+	Counters of a consumer
+*/
+typedef struct
+{
+	/*! messages handed to the consumer callback */
+	uint64_t uDelivered;
+	/*! messages dropped by the consumer queue */
+	uint32_t uDrops;
+	/*! messages waiting in the consumer queue */
+	uint32_t uQueued;
+} ANPRFanoutConsumerStats;
+
+/*!
+	Fills a configuration with default values : 4096 messages per lock-free consumer queue dropping the newest message on overflow, batches of up to 64 messages
+*/
+void ANPRFanoutDefaultConfig(ANPRFanoutConfig* pConfig);
+
+/*!
+	Creates a fan-out stage. Use <a href="#ANPRFanoutDestroy">ANPRFanoutDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@returns the stage, or NULL on failure
+*/
+ANPRFanout* ANPRFanoutCreate(const ANPRFanoutConfig* pConfig);
+
+/*!
+	Stops the consumers and destroys the stage. Messages still queued are released.
+*/
+void ANPRFanoutDestroy(ANPRFanout* pFanout);
+
+/*!
+	Adds a consumer. Consumers can only be added while the stage is stopped, and not while messages are pushed.
+	@param[in] pFanout the stage
+	@param[in] consumerCallback callback called for every message
+	@param[in] pUser callback user data
+	@returns the index of the consumer, or -1 on failure
+*/
+int32_t ANPRFanoutAddConsumer(ANPRFanout* pFanout, PANPRFANOUTCONSUMERCALLBACK consumerCallback, void* pUser);
+
+/*!
+	Hands a message to every consumer. The message is owned by the stage, even on failure, and must not be modified any more.<br/>
+	Can be called from several threads, for instance from the callback of an <a href="#ANPRIngest">ingestion engine</a>.
+	@param[in] pFanout the stage
+	@param[in] pMsg the message
+	@returns CDK_OK if every consumer queued the message, CDK_FAIL if at least one of them dropped it
+*/
+int32_t ANPRFanoutPush(ANPRFanout* pFanout, CDKMsg* pMsg);
+
+/*!
+	Starts the consumer threads
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRFanoutStart(ANPRFanout* pFanout);
+
+/*!
+	Stops the consumer threads. Messages still queued stay in the queues until the next start.
+*/
+void ANPRFanoutStop(ANPRFanout* pFanout);
+
+/*!
+	Returns the counters of a consumer
+	@returns CDK_OK on success, CDK_FAIL if there is no such consumer
+*/
+int32_t ANPRFanoutGetConsumerStats(ANPRFanout* pFanout, uint32_t uConsumer, ANPRFanoutConsumerStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRFANOUT_H
@@ -0,0 +1,337 @@
+/*! \file
+
+ANPRFingerprintPool : batched plate fingerprint matching on a pool of threads.
+
+The rows x columns pairs of a batch are numbered row after row, and taken by the threads in chunks from a shared
+counter : a batch of a single row is spread over the pool as well as a square one. Every thread compares with its
+own matcher, so that the matchers never contend on their lock.
+
+*/
+
+#include <algorithm>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRFingerprintPool.h"
+
+/*!
+	Pairs taken at once by a thread
+*/
+#define ANPR_FINGERPRINT_POOL_CHUNK 256
+
+/*!
+	Matcher and results of one thread
+*/
+struct ANPRFingerprintPoolWorker
+{
+	CDKPlateFingerprintMatcher* pMatcher = nullptr;
+	std::vector<ANPRFingerprintPair> pairs;
+	uint64_t uCompared = 0;
+	uint64_t uMatches = 0;
+	uint64_t uErrors = 0;
+	/*! a pair could not be listed : the comparisons go on, so that the batch still ends on every thread */
+	bool bOutOfMemory = false;
+	std::thread thread;
+};
+
+struct _anprfingerprintpool : CDKObject
+{
+	ANPRFingerprintPoolConfig config;
+
+	/*! one batch at a time */
+	std::mutex batchMutex;
+	uint64_t uBatches = 0;
+	uint64_t uCompared = 0;
+	uint64_t uMatches = 0;
+	uint64_t uErrors = 0;
+
+	/*! running batch, set by the calling thread before waking the workers */
+	const ANPRFingerprint* pRows = nullptr;
+	const ANPRFingerprint* pColumns = nullptr;
+	uint32_t uColumns = 0;
+	uint64_t uPairs = 0;
+	int8_t* pMatrix = nullptr;
+	bool bList = false;
+	std::atomic<uint64_t> uNextChunk{0};
+
+	/*! worker 0 is the calling thread */
+	std::vector<ANPRFingerprintPoolWorker> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::condition_variable doneCondition;
+	uint64_t uGeneration = 0;
+	uint32_t uRunning = 0;
+	bool bStop = false;
+};
+
+static void ANPRFingerprintPoolCompare(ANPRFingerprintPool* pPool, ANPRFingerprintPoolWorker* pWorker)
+{
+	const uint32_t uColumns = pPool->uColumns;
+	uint64_t uMatches = 0;
+	uint64_t uErrors = 0;
+	uint64_t uCompared = 0;
+	for (;;)
+	{
+		uint64_t uBegin = pPool->uNextChunk.fetch_add(ANPR_FINGERPRINT_POOL_CHUNK, std::memory_order_relaxed);
+		if (uBegin >= pPool->uPairs)
+			break;
+		uint64_t uEnd = std::min<uint64_t>(uBegin + ANPR_FINGERPRINT_POOL_CHUNK, pPool->uPairs);
+		uint32_t uRow = (uint32_t)(uBegin / uColumns);
+		uint32_t uColumn = (uint32_t)(uBegin % uColumns);
+		for (uint64_t uPair = uBegin; uPair < uEnd; uPair++)
+		{
+			const ANPRFingerprint& row = pPool->pRows[uRow];
+			const ANPRFingerprint& column = pPool->pColumns[uColumn];
+			int32_t iResult = CDKPlateFingerprintMatch(pWorker->pMatcher, row.pBuffer, row.uSize, column.pBuffer, column.uSize);
+			if (iResult > 0)
+			{
+				uMatches++;
+				if (pPool->bList && !pWorker->bOutOfMemory)
+				{
+					try
+					{
+						pWorker->pairs.push_back({ uRow, uColumn });
+					}
+					catch (const std::bad_alloc&)
+					{
+						pWorker->bOutOfMemory = true;
+					}
+				}
+			}
+			else if (iResult < 0)
+				uErrors++;
+			if (pPool->pMatrix)
+				pPool->pMatrix[uPair] = (int8_t)iResult;
+			if (++uColumn == uColumns)
+			{
+				uColumn = 0;
+				uRow++;
+			}
+		}
+		uCompared += uEnd - uBegin;
+	}
+	pWorker->uCompared = uCompared;
+	pWorker->uMatches = uMatches;
+	pWorker->uErrors = uErrors;
+}
+
+static void ANPRFingerprintPoolThread(ANPRFingerprintPool* pPool, uint32_t uWorker)
+{
+	uint64_t uGeneration = 0;
+	std::unique_lock<std::mutex> lock(pPool->mutex);
+	for (;;)
+	{
+		pPool->condition.wait(lock, [&] { return pPool->bStop || pPool->uGeneration != uGeneration; });
+		if (pPool->bStop)
+			return;
+		uGeneration = pPool->uGeneration;
+		lock.unlock();
+		ANPRFingerprintPoolCompare(pPool, &pPool->workers[uWorker]);
+		lock.lock();
+		if (--pPool->uRunning == 0)
+			pPool->doneCondition.notify_one();
+	}
+}
+
+void ANPRFingerprintPoolDefaultConfig(ANPRFingerprintPoolConfig* pConfig)
+{
+	pConfig->uThreads = 0;
+}
+
+ANPRFingerprintPool* ANPRFingerprintPoolCreate(const ANPRFingerprintPoolConfig* pConfig, const uint8_t* pDictionary, uint32_t uDictionarySize)
+{
+	ANPRFingerprintPool* pPool = new (std::nothrow) ANPRFingerprintPool();
+	if (!pPool)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pPool->config = *pConfig;
+	else
+		ANPRFingerprintPoolDefaultConfig(&pPool->config);
+	if (pPool->config.uThreads == 0)
+		pPool->config.uThreads = std::max(1u, std::thread::hardware_concurrency());
+	try
+	{
+		pPool->workers = std::vector<ANPRFingerprintPoolWorker>(pPool->config.uThreads);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		delete pPool;
+		return nullptr;
+	}
+	for (ANPRFingerprintPoolWorker& worker : pPool->workers)
+	{
+		worker.pMatcher = CDKPlateFingerprintMatcherCreate();
+		if (!worker.pMatcher || (pDictionary && CDKPlateFingerprintMatcherSetDictionary(worker.pMatcher, pDictionary, uDictionarySize) != CDK_OK) ||
+			CDKPlateFingerprintMatcherStart(worker.pMatcher) != CDK_OK)
+		{
+			CDKSetLastError(nullptr, "cannot start matcher: %s", CDKGetLastError(worker.pMatcher));
+			ANPRFingerprintPoolDestroy(pPool);
+			return nullptr;
+		}
+	}
+	try
+	{
+		for (uint32_t i = 1; i < pPool->config.uThreads; i++)
+			pPool->workers[i].thread = std::thread(ANPRFingerprintPoolThread, pPool, i);
+	}
+	catch (const std::exception& e)
+	{
+		CDKSetLastError(nullptr, "cannot start matcher pool: %s", e.what());
+		ANPRFingerprintPoolDestroy(pPool);
+		return nullptr;
+	}
+	return pPool;
+}
+
+void ANPRFingerprintPoolDestroy(ANPRFingerprintPool* pPool)
+{
+	if (!pPool)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pPool->mutex);
+		pPool->bStop = true;
+	}
+	pPool->condition.notify_all();
+	for (ANPRFingerprintPoolWorker& worker : pPool->workers)
+	{
+		if (worker.thread.joinable())
+			worker.thread.join();
+		CDKPlateFingerprintMatcherDestroy(worker.pMatcher);
+	}
+	delete pPool;
+}
+
+/*!
+	Runs a batch on every thread, the batch mutex being held. Returns once every thread is done with the arrays.
+	@returns false if a thread could not list its pairs
+*/
+static bool ANPRFingerprintPoolRun(ANPRFingerprintPool* pPool, const ANPRFingerprint* pRows, uint32_t uRows,
+	const ANPRFingerprint* pColumns, uint32_t uColumns, int8_t* pMatrix, bool bList)
+{
+	pPool->pRows = pRows;
+	pPool->pColumns = pColumns;
+	pPool->uColumns = uColumns;
+	pPool->uPairs = (uint64_t)uRows * uColumns;
+	pPool->pMatrix = pMatrix;
+	pPool->bList = bList;
+	pPool->uNextChunk.store(0, std::memory_order_relaxed);
+	for (ANPRFingerprintPoolWorker& worker : pPool->workers)
+	{
+		worker.pairs.clear();
+		worker.uCompared = 0;
+		worker.uMatches = 0;
+		worker.uErrors = 0;
+		worker.bOutOfMemory = false;
+	}
+
+	// a single chunk is not worth waking the threads
+	uint32_t uHelpers = pPool->uPairs > ANPR_FINGERPRINT_POOL_CHUNK ? (uint32_t)pPool->workers.size() - 1 : 0;
+	if (uHelpers)
+	{
+		std::lock_guard<std::mutex> lock(pPool->mutex);
+		pPool->uRunning = uHelpers;
+		pPool->uGeneration++;
+		pPool->condition.notify_all();
+	}
+	ANPRFingerprintPoolCompare(pPool, &pPool->workers[0]);
+	if (uHelpers)
+	{
+		std::unique_lock<std::mutex> lock(pPool->mutex);
+		pPool->doneCondition.wait(lock, [&] { return pPool->uRunning == 0; });
+	}
+	pPool->uBatches++;
+	bool bOk = true;
+	for (ANPRFingerprintPoolWorker& worker : pPool->workers)
+	{
+		pPool->uCompared += worker.uCompared;
+		pPool->uMatches += worker.uMatches;
+		pPool->uErrors += worker.uErrors;
+		bOk = bOk && !worker.bOutOfMemory;
+	}
+	return bOk;
+}
+
+static bool ANPRFingerprintPoolCheck(ANPRFingerprintPool* pPool, const ANPRFingerprint* pRows, uint32_t uRows,
+	const ANPRFingerprint* pColumns, uint32_t uColumns)
+{
+	if ((uRows && !pRows) || (uColumns && !pColumns))
+	{
+		CDKSetLastError(pPool, "fingerprint arrays are required");
+		return false;
+	}
+	return true;
+}
+
+int32_t ANPRFingerprintPoolMatchMatrix(ANPRFingerprintPool* pPool, const ANPRFingerprint* pRows, uint32_t uRows,
+	const ANPRFingerprint* pColumns, uint32_t uColumns, int8_t* pMatrix)
+{
+	if (!pPool)
+		return CDK_FAIL;
+	if (!ANPRFingerprintPoolCheck(pPool, pRows, uRows, pColumns, uColumns))
+		return CDK_FAIL;
+	if (uRows && uColumns && !pMatrix)
+	{
+		CDKSetLastError(pPool, "a result matrix is required");
+		return CDK_FAIL;
+	}
+	if (!uRows || !uColumns)
+		return CDK_OK;
+	std::lock_guard<std::mutex> lock(pPool->batchMutex);
+	ANPRFingerprintPoolRun(pPool, pRows, uRows, pColumns, uColumns, pMatrix, false);
+	return CDK_OK;
+}
+
+int64_t ANPRFingerprintPoolMatchList(ANPRFingerprintPool* pPool, const ANPRFingerprint* pRows, uint32_t uRows,
+	const ANPRFingerprint* pColumns, uint32_t uColumns, ANPRFingerprintPair* pPairs, uint64_t uMaxPairs)
+{
+	if (!pPool)
+		return -1;
+	if (!ANPRFingerprintPoolCheck(pPool, pRows, uRows, pColumns, uColumns))
+		return -1;
+	if (uMaxPairs && !pPairs)
+	{
+		CDKSetLastError(pPool, "a pair array is required");
+		return -1;
+	}
+	if (!uRows || !uColumns)
+		return 0;
+	std::lock_guard<std::mutex> lock(pPool->batchMutex);
+	if (!ANPRFingerprintPoolRun(pPool, pRows, uRows, pColumns, uColumns, nullptr, true))
+	{
+		CDKSetLastError(pPool, "out of memory");
+		return -1;
+	}
+	try
+	{
+		// merges the pairs of every thread
+		std::vector<ANPRFingerprintPair>& merged = pPool->workers[0].pairs;
+		for (size_t i = 1; i < pPool->workers.size(); i++)
+			merged.insert(merged.end(), pPool->workers[i].pairs.begin(), pPool->workers[i].pairs.end());
+		std::sort(merged.begin(), merged.end(), [](const ANPRFingerprintPair& a, const ANPRFingerprintPair& b) {
+			return a.uRow != b.uRow ? a.uRow < b.uRow : a.uColumn < b.uColumn;
+		});
+		std::copy(merged.begin(), merged.begin() + std::min<uint64_t>(merged.size(), uMaxPairs), pPairs);
+		return (int64_t)merged.size();
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pPool, "out of memory");
+		return -1;
+	}
+}
+
+int32_t ANPRFingerprintPoolGetStats(ANPRFingerprintPool* pPool, ANPRFingerprintPoolStats* pStats)
+{
+	if (!pPool || !pStats)
+		return CDK_FAIL;
+	std::lock_guard<std::mutex> lock(pPool->batchMutex);
+	pStats->uBatches = pPool->uBatches;
+	pStats->uCompared = pPool->uCompared;
+	pStats->uMatches = pPool->uMatches;
+	pStats->uErrors = pPool->uErrors;
+	return CDK_OK;
+}
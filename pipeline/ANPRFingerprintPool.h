@@ -0,0 +1,131 @@
+/*! \file
+
+ANPRFingerprintPool : batched plate fingerprint matching on a pool of threads.<br/>
+Every thread of the pool owns a <a href="#CDKPlateFingerprintMatcher">CDKPlateFingerprintMatcher</a>, all given the same
+dictionary and started together, so that they take the same decisions without sharing any lock. A batch compares every
+fingerprint of a first array (for instance the exit reads of a toll plaza) with every fingerprint of a second array (the
+entry reads), and returns the full match matrix or the list of the matching pairs.
+
+*/
+
+#ifndef ANPRFINGERPRINTPOOL_H
+#define ANPRFINGERPRINTPOOL_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "CDKPlateFingerprintMatcher.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A matcher pool
+*/
+typedef struct _anprfingerprintpool ANPRFingerprintPool;
+
+/*! <summary>struct</summary>
+	Configuration of a matcher pool
+*/
+typedef struct
+{
+	/*! threads, and matchers, of the pool, the calling thread included. 0 for one per core */
+	uint32_t uThreads;
+} ANPRFingerprintPoolConfig;
+
+/*! <summary>struct</summary>
+	A fingerprint of a batch
+*/
+typedef struct
+{
+	const uint8_t* pBuffer;
+	uint32_t uSize;
+} ANPRFingerprint;
+
+/*! <summary>struct</summary>
+	A matching pair of a batch
+*/
+typedef struct
+{
+	/*! index in the first array */
+	uint32_t uRow;
+	/*! index in the second array */
+	uint32_t uColumn;
+} ANPRFingerprintPair;
+
+/*! <summary>struct</summary>
+	Counters of a matcher pool
+*/
+typedef struct
+{
+	/*! batches since the creation */
+	uint64_t uBatches;
+	/*! pairs compared */
+	uint64_t uCompared;
+	/*! matching pairs */
+	uint64_t uMatches;
+	/*! pairs that could not be compared : invalid fingerprint */
+	uint64_t uErrors;
+} ANPRFingerprintPoolStats;
+
+/*!
+	Fills a configuration with default values : one thread per core
+*/
+void ANPRFingerprintPoolDefaultConfig(ANPRFingerprintPoolConfig* pConfig);
+
+/*!
+	Creates a matcher pool, its matchers and its threads. Use <a href="#ANPRFingerprintPoolDestroy">ANPRFingerprintPoolDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@param[in] pDictionary dictionary given to every matcher, see <a href="#CDKPlateFingerprintMatcherSetDictionary">CDKPlateFingerprintMatcherSetDictionary</a>.
+	NULL to let every matcher learn on its own, in which case the matchers may take different decisions during the learning phase
+	@param[in] uDictionarySize size of the dictionary
+	@returns the pool, or NULL on failure
+*/
+ANPRFingerprintPool* ANPRFingerprintPoolCreate(const ANPRFingerprintPoolConfig* pConfig, const uint8_t* pDictionary, uint32_t uDictionarySize);
+
+/*!
+	Stops the threads and destroys a matcher pool with its matchers
+*/
+void ANPRFingerprintPoolDestroy(ANPRFingerprintPool* pPool);
+
+/*!
+	Compares every fingerprint of a first array with every fingerprint of a second array.<br/>
+	Can be called from any thread ; concurrent batches run one after the other, each on every thread of the pool.
+	@param[in] pPool the pool
+	@param[in] pRows first array
+	@param[in] uRows size of the first array
+	@param[in] pColumns second array
+	@param[in] uColumns size of the second array
+	@param[out] pMatrix uRows * uColumns results, row after row : the result of <a href="#CDKPlateFingerprintMatch">CDKPlateFingerprintMatch</a>
+	for pRows[i] and pColumns[j] is at i * uColumns + j
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRFingerprintPoolMatchMatrix(ANPRFingerprintPool* pPool, const ANPRFingerprint* pRows, uint32_t uRows,
+	const ANPRFingerprint* pColumns, uint32_t uColumns, int8_t* pMatrix);
+
+/*!
+	Compares every fingerprint of a first array with every fingerprint of a second array, and lists the matching pairs.<br/>
+	Can be called from any thread ; concurrent batches run one after the other, each on every thread of the pool.
+	@param[in] pPool the pool
+	@param[in] pRows first array
+	@param[in] uRows size of the first array
+	@param[in] pColumns second array
+	@param[in] uColumns size of the second array
+	@param[out] pPairs matching pairs, sorted by row then by column. Can be NULL if uMaxPairs is 0
+	@param[in] uMaxPairs size of pPairs : the pairs after the first uMaxPairs are counted but not stored
+	@returns the number of matching pairs, or -1 on failure
+*/
+int64_t ANPRFingerprintPoolMatchList(ANPRFingerprintPool* pPool, const ANPRFingerprint* pRows, uint32_t uRows,
+	const ANPRFingerprint* pColumns, uint32_t uColumns, ANPRFingerprintPair* pPairs, uint64_t uMaxPairs);
+
+/*!
+	Returns the counters of a matcher pool
+*/
+int32_t ANPRFingerprintPoolGetStats(ANPRFingerprintPool* pPool, ANPRFingerprintPoolStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRFINGERPRINTPOOL_H
@@ -0,0 +1,324 @@
+/*! \file
+
+ANPRFleet : connection supervisor of a fleet of sensors.
+
+A supervisor thread binds the sensors added to the fleet, keeping at most uMaxConcurrentConnects of them
+waiting for their first connection. A sensor frees its slot when it connects, or when its first connection
+attempt has timed out : it then keeps reconnecting on its own, with the exponential backoff of the bind option
+reconnectMax, and joins the ready-set whenever it connects.
+
+*/
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <new>
+#include <unordered_map>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRFleet.h"
+
+/*!
+	Time given to a first connection attempt on top of the connection timeout before its slot is freed, in ms
+*/
+#define ANPR_FLEET_CONNECT_MARGIN_MS 100
+
+enum ANPRFleetSensorState
+{
+	/*! added, not bound yet */
+	ANPR_FLEET_PENDING,
+	/*! bound, waiting for its first connection : holds a slot */
+	ANPR_FLEET_CONNECTING,
+	/*! bound, connected at least once or first attempt timed out */
+	ANPR_FLEET_BOUND,
+	/*! bind failed */
+	ANPR_FLEET_FAILED
+};
+
+struct ANPRFleetSensor
+{
+	CDK* pCDK;
+	std::string strAddress;
+	uint16_t uPort;
+	uint32_t bSSL;
+	ANPRFleetSensorState state = ANPR_FLEET_PENDING;
+	std::chrono::steady_clock::time_point connectDeadline;
+	uint32_t uSSLErrors = 0;
+	/*! index in the ready-set, -1 if not connected */
+	int32_t iReady = -1;
+};
+
+struct _anprfleet : CDKObject
+{
+	ANPRFleetConfig config;
+	PCDKSTATECALLBACK2 stateCallback = nullptr;
+	void* pUser = nullptr;
+	std::string strBindOptions;
+
+	/*! protects everything below */
+	std::mutex mutex;
+	/*! wakes the supervisor : new sensor, freed slot, stop */
+	std::condition_variable cvSupervisor;
+	/*! wakes ANPRFleetWaitForReady */
+	std::condition_variable cvReady;
+	std::unordered_map<CDK*, std::unique_ptr<ANPRFleetSensor>> sensors;
+	std::deque<ANPRFleetSensor*> pending;
+	std::vector<CDK*> ready;
+	uint32_t uConnecting = 0;
+	uint32_t uBound = 0;
+	uint32_t uDisconnections = 0;
+	bool bStop = false;
+	std::thread supervisor;
+};
+
+static void ANPRFleetReleaseSlot(ANPRFleet* pFleet, ANPRFleetSensor* pSensor, ANPRFleetSensorState state)
+{
+	if (pSensor->state == ANPR_FLEET_CONNECTING)
+	{
+		pFleet->uConnecting--;
+		pFleet->cvSupervisor.notify_one();
+	}
+	pSensor->state = state;
+}
+
+static void ANPRFleetOnState(CDK* pCDK, int32_t bConnected, uint32_t u32SSLErrors, void* pUser)
+{
+	ANPRFleet* pFleet = (ANPRFleet*)pUser;
+	{
+		std::lock_guard<std::mutex> lock(pFleet->mutex);
+		auto it = pFleet->sensors.find(pCDK);
+		if (it != pFleet->sensors.end())
+		{
+			ANPRFleetSensor* pSensor = it->second.get();
+			pSensor->uSSLErrors = u32SSLErrors;
+			if (bConnected)
+			{
+				ANPRFleetReleaseSlot(pFleet, pSensor, ANPR_FLEET_BOUND);
+				if (pSensor->iReady < 0)
+				{
+					pSensor->iReady = (int32_t)pFleet->ready.size();
+					pFleet->ready.push_back(pCDK);
+				}
+				pFleet->cvReady.notify_all();
+			}
+			else if (pSensor->iReady >= 0)
+			{
+				// swap with the last sensor of the ready-set
+				CDK* pLast = pFleet->ready.back();
+				pFleet->ready[pSensor->iReady] = pLast;
+				pFleet->sensors[pLast]->iReady = pSensor->iReady;
+				pFleet->ready.pop_back();
+				pSensor->iReady = -1;
+				pFleet->uDisconnections++;
+			}
+		}
+	}
+	if (pFleet->stateCallback)
+		pFleet->stateCallback(pCDK, bConnected, u32SSLErrors, pFleet->pUser);
+}
+
+static void ANPRFleetSupervisorThread(ANPRFleet* pFleet)
+{
+	std::unique_lock<std::mutex> lock(pFleet->mutex);
+	while (!pFleet->bStop)
+	{
+		auto now = std::chrono::steady_clock::now();
+		auto wakeUp = std::chrono::steady_clock::time_point::max();
+		// first connection attempts that timed out free their slot
+		if (pFleet->uConnecting)
+		{
+			for (auto& sensor : pFleet->sensors)
+			{
+				ANPRFleetSensor* pSensor = sensor.second.get();
+				if (pSensor->state != ANPR_FLEET_CONNECTING)
+					continue;
+				if (pSensor->connectDeadline <= now)
+					ANPRFleetReleaseSlot(pFleet, pSensor, ANPR_FLEET_BOUND);
+				else
+					wakeUp = std::min(wakeUp, pSensor->connectDeadline);
+			}
+		}
+		if (!pFleet->pending.empty() && pFleet->uConnecting < pFleet->config.uMaxConcurrentConnects)
+		{
+			ANPRFleetSensor* pSensor = pFleet->pending.front();
+			pFleet->pending.pop_front();
+			pSensor->state = ANPR_FLEET_CONNECTING;
+			pSensor->connectDeadline = now + std::chrono::milliseconds(pFleet->config.uConnectTimeout + ANPR_FLEET_CONNECT_MARGIN_MS);
+			pFleet->uConnecting++;
+			pFleet->uBound++;
+			// the state callback may be called before the bind returns
+			lock.unlock();
+			int32_t iResult = pSensor->bSSL ? CDKBindS(pSensor->pCDK, pSensor->strAddress.c_str(), pSensor->uPort, pFleet->strBindOptions.c_str())
+				: CDKBind(pSensor->pCDK, pSensor->strAddress.c_str(), pSensor->uPort, pFleet->strBindOptions.c_str());
+			lock.lock();
+			if (iResult != CDK_OK)
+			{
+				CDKTrace(pSensor->pCDK, CDK_TRACE_ERROR, "%s:%u bind failed: %s", pSensor->strAddress.c_str(), pSensor->uPort, CDKGetLastError(pSensor->pCDK));
+				pFleet->uBound--;
+				ANPRFleetReleaseSlot(pFleet, pSensor, ANPR_FLEET_FAILED);
+			}
+			continue;
+		}
+		if (wakeUp == std::chrono::steady_clock::time_point::max())
+			pFleet->cvSupervisor.wait(lock);
+		else
+			pFleet->cvSupervisor.wait_until(lock, wakeUp);
+	}
+}
+
+void ANPRFleetDefaultConfig(ANPRFleetConfig* pConfig)
+{
+	pConfig->uMaxConcurrentConnects = 32;
+	pConfig->uConnectTimeout = 3000;
+	pConfig->uReconnectMin = 500;
+	pConfig->uReconnectMax = 30000;
+}
+
+ANPRFleet* ANPRFleetCreate(const ANPRFleetConfig* pConfig, PCDKSTATECALLBACK2 stateCallback, void* pUser)
+{
+	ANPRFleet* pFleet = new (std::nothrow) ANPRFleet();
+	if (!pFleet)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pFleet->config = *pConfig;
+	else
+		ANPRFleetDefaultConfig(&pFleet->config);
+	if (pFleet->config.uMaxConcurrentConnects == 0)
+		pFleet->config.uMaxConcurrentConnects = 1;
+	pFleet->stateCallback = stateCallback;
+	pFleet->pUser = pUser;
+	char strOptions[96];
+	snprintf(strOptions, sizeof(strOptions), "connectTimeout=%u;reconnect=%u;reconnectMax=%u",
+		pFleet->config.uConnectTimeout, pFleet->config.uReconnectMin, pFleet->config.uReconnectMax);
+	pFleet->strBindOptions = strOptions;
+	return pFleet;
+}
+
+void ANPRFleetDestroy(ANPRFleet* pFleet)
+{
+	if (!pFleet)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pFleet->mutex);
+		pFleet->bStop = true;
+	}
+	pFleet->cvSupervisor.notify_all();
+	if (pFleet->supervisor.joinable())
+		pFleet->supervisor.join();
+	// the state callback locks the fleet mutex : unbind without it
+	for (auto& sensor : pFleet->sensors)
+	{
+		ANPRFleetSensor* pSensor = sensor.second.get();
+		if (pSensor->state == ANPR_FLEET_CONNECTING || pSensor->state == ANPR_FLEET_BOUND)
+			CDKUnbind(pSensor->pCDK);
+		CDKSetConnectionStateCallback2(pSensor->pCDK, nullptr, nullptr);
+	}
+	delete pFleet;
+}
+
+int32_t ANPRFleetAdd(ANPRFleet* pFleet, CDK* pCDK, const char* strAddress, uint16_t uPort, uint32_t bSSL)
+{
+	if (!pFleet || !pCDK)
+		return CDK_FAIL;
+	if (!strAddress || !*strAddress)
+	{
+		CDKSetLastError(pFleet, "invalid address");
+		return CDK_FAIL;
+	}
+	{
+		std::lock_guard<std::mutex> lock(pFleet->mutex);
+		if (pFleet->sensors.count(pCDK))
+		{
+			CDKSetLastError(pFleet, "CDK is already in the fleet");
+			return CDK_FAIL;
+		}
+		ANPRFleetSensor* pSensor = new ANPRFleetSensor();
+		pSensor->pCDK = pCDK;
+		pSensor->strAddress = strAddress;
+		pSensor->uPort = uPort;
+		pSensor->bSSL = bSSL;
+		pFleet->sensors[pCDK].reset(pSensor);
+		// installed before the supervisor can bind the sensor, so that its first connection is seen.
+		// The CDK calls the callback without its own lock held : no lock order issue with the fleet mutex
+		CDKSetConnectionStateCallback2(pCDK, ANPRFleetOnState, pFleet);
+		pFleet->pending.push_back(pSensor);
+	}
+	pFleet->cvSupervisor.notify_one();
+	return CDK_OK;
+}
+
+int32_t ANPRFleetStart(ANPRFleet* pFleet)
+{
+	if (!pFleet)
+		return CDK_FAIL;
+	if (pFleet->supervisor.joinable())
+	{
+		CDKSetLastError(pFleet, "fleet is already started");
+		return CDK_FAIL;
+	}
+	try
+	{
+		pFleet->supervisor = std::thread(ANPRFleetSupervisorThread, pFleet);
+	}
+	catch (const std::system_error& e)
+	{
+		CDKSetLastError(pFleet, "cannot start supervisor: %s", e.what());
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+int32_t ANPRFleetWaitForReady(ANPRFleet* pFleet, uint32_t uCount, uint32_t uTimeout)
+{
+	if (!pFleet)
+		return CDK_FAIL;
+	std::unique_lock<std::mutex> lock(pFleet->mutex);
+	bool bReady = pFleet->cvReady.wait_for(lock, std::chrono::milliseconds(uTimeout), [pFleet, uCount] {
+		return pFleet->ready.size() >= std::min<size_t>(uCount, pFleet->sensors.size());
+	});
+	if (!bReady)
+	{
+		CDKSetLastError(pFleet, "%u/%u sensors connected", (uint32_t)pFleet->ready.size(), uCount);
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+uint32_t ANPRFleetGetReady(ANPRFleet* pFleet, CDK** ppCDKs, uint32_t uMax)
+{
+	if (!pFleet || !ppCDKs)
+		return 0;
+	std::lock_guard<std::mutex> lock(pFleet->mutex);
+	uint32_t uCount = (uint32_t)std::min<size_t>(uMax, pFleet->ready.size());
+	std::copy_n(pFleet->ready.begin(), uCount, ppCDKs);
+	return uCount;
+}
+
+uint32_t ANPRFleetGetSSLErrors(ANPRFleet* pFleet, CDK* pCDK)
+{
+	if (!pFleet || !pCDK)
+		return 0;
+	std::lock_guard<std::mutex> lock(pFleet->mutex);
+	auto it = pFleet->sensors.find(pCDK);
+	return it != pFleet->sensors.end() ? it->second->uSSLErrors : 0;
+}
+
+void ANPRFleetGetStats(ANPRFleet* pFleet, ANPRFleetStats* pStats)
+{
+	if (!pFleet || !pStats)
+		return;
+	std::lock_guard<std::mutex> lock(pFleet->mutex);
+	pStats->uSensors = (uint32_t)pFleet->sensors.size();
+	pStats->uBound = pFleet->uBound;
+	pStats->uConnecting = pFleet->uConnecting;
+	pStats->uConnected = (uint32_t)pFleet->ready.size();
+	pStats->uSSLErrorSensors = 0;
+	for (auto& sensor : pFleet->sensors)
+		pStats->uSSLErrorSensors += sensor.second->uSSLErrors ? 1 : 0;
+	pStats->uDisconnections = pFleet->uDisconnections;
+}
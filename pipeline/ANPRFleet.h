@@ -0,0 +1,132 @@
+/*! \file
+
+ANPRFleet : connection supervisor of a fleet of sensors.<br/>
+The sensors are bound concurrently, with a bounded number of first connection attempts in flight, so that a few
+unreachable units do not delay the startup of the others. The connection state of every sensor is tracked with
+<a href="#CDKSetConnectionStateCallback2">CDKSetConnectionStateCallback2</a>, and the connected sensors form a ready-set
+that can be used as soon as the first sensors are connected.
+
+*/
+
+#ifndef ANPRFLEET_H
+#define ANPRFLEET_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A fleet supervisor
+*/
+typedef struct _anprfleet ANPRFleet;
+
+/*! <summary>struct</summary>
+	Configuration of a fleet supervisor
+*/
+typedef struct
+{
+	/*! maximum number of sensors whose first connection attempt is in flight */
+	uint32_t uMaxConcurrentConnects;
+	/*! timeout of a connection attempt, in ms (bind option connectTimeout) */
+	uint32_t uConnectTimeout;
+	/*! delay before the first reconnection attempt, in ms (bind option reconnect) */
+	uint32_t uReconnectMin;
+	/*! maximum delay between two reconnection attempts, in ms (bind option reconnectMax). The delay doubles after every failed attempt, with a random jitter */
+	uint32_t uReconnectMax;
+} ANPRFleetConfig;
+
+/*! <summary>struct</summary>
+	Counters of a fleet supervisor
+*/
+typedef struct
+{
+	/*! sensors added to the fleet */
+	uint32_t uSensors;
+	/*! sensors bound */
+	uint32_t uBound;
+	/*! sensors bound and waiting for their first connection, counted in uMaxConcurrentConnects */
+	uint32_t uConnecting;
+	/*! sensors connected : size of the ready-set */
+	uint32_t uConnected;
+	/*! sensors whose last connection reported SSL errors */
+	uint32_t uSSLErrorSensors;
+	/*! disconnections of connected sensors since the start */
+	uint32_t uDisconnections;
+} ANPRFleetStats;
+
+/*!
+	Fills a configuration with default values : 32 concurrent first connections, 3 s connection timeout, reconnection delay from 500 ms to 30 s
+*/
+void ANPRFleetDefaultConfig(ANPRFleetConfig* pConfig);
+
+/*!
+	Creates a fleet supervisor. Use <a href="#ANPRFleetDestroy">ANPRFleetDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@param[in] stateCallback callback called on every connection state change of a sensor of the fleet, from the CDK thread. Can be NULL
+	@param[in] pUser callback user data
+	@returns the supervisor, or NULL on failure
+*/
+ANPRFleet* ANPRFleetCreate(const ANPRFleetConfig* pConfig, PCDKSTATECALLBACK2 stateCallback, void* pUser);
+
+/*!
+	Unbinds every sensor of the fleet and destroys the supervisor. The CDK instances are not destroyed.
+*/
+void ANPRFleetDestroy(ANPRFleet* pFleet);
+
+/*!
+	Adds a sensor to the fleet. Can be called while the supervisor is running.<br/>
+	The connection state callback of the CDK is used by the supervisor
+	(<a href="#CDKSetConnectionStateCallback2">CDKSetConnectionStateCallback2</a>) : use the callback of the fleet instead.
+	@param[in] pFleet the supervisor
+	@param[in] pCDK the CDK instance, not bound
+	@param[in] strAddress equipment IPv4 address or hostname
+	@param[in] uPort equipment port
+	@param[in] bSSL 1 to bind with <a href="#CDKBindS">CDKBindS</a>, 0 with <a href="#CDKBind">CDKBind</a>
+	@returns CDK_OK on success, CDK_FAIL if the CDK is already in the fleet
+*/
+int32_t ANPRFleetAdd(ANPRFleet* pFleet, CDK* pCDK, const char* strAddress, uint16_t uPort, uint32_t bSSL);
+
+/*!
+	Starts binding the sensors of the fleet. Returns immediately.
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRFleetStart(ANPRFleet* pFleet);
+
+/*!
+	Waits until a number of sensors are connected
+	@param[in] pFleet the supervisor
+	@param[in] uCount number of connected sensors to wait for, capped to the number of sensors of the fleet
+	@param[in] uTimeout timeout in ms
+	@returns CDK_OK if uCount sensors are connected, CDK_FAIL on timeout
+*/
+int32_t ANPRFleetWaitForReady(ANPRFleet* pFleet, uint32_t uCount, uint32_t uTimeout);
+
+/*!
+	Returns the ready-set : the sensors currently connected, in no particular order
+	@param[in] pFleet the supervisor
+	@param[out] ppCDKs array of at least uMax CDK
+	@param[in] uMax size of the array
+	@returns the number of CDK written
+*/
+uint32_t ANPRFleetGetReady(ANPRFleet* pFleet, CDK** ppCDKs, uint32_t uMax);
+
+/*!
+	Returns the SSL errors reported by the last connection of a sensor
+	@returns an OR of <a href="#CDK_ERR_UNABLE_TO_GET_CRL (0x01)">these defines</a>, 0 if the sensor is not in the fleet
+*/
+uint32_t ANPRFleetGetSSLErrors(ANPRFleet* pFleet, CDK* pCDK);
+
+/*!
+	Returns the supervisor counters
+*/
+void ANPRFleetGetStats(ANPRFleet* pFleet, ANPRFleetStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRFLEET_H
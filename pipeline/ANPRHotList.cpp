@@ -0,0 +1,481 @@
+/*! \file
+
+ANPRHotList : hot-list index file.
+
+The index file is a 40 bytes header, followed by four sections aligned on 8 bytes : the bucket offsets, the keys, the
+plates and their strings. Every key of a plate, the hash of its normalized text or of the text with one character
+deleted, is stored in the bucket of its low bits, with the high 32 bits of the hash and the plate : the keys are
+sorted by bucket, and bucket b holds the keys from offset b to offset b + 1, so that a probe reads one or two cache
+lines. All values are in host byte order.
+
+The file is validated when it is mapped, and the offsets read from it are checked by the lookups, so that a damaged
+file cannot make them read outside of the mapping.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <shared_mutex>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRHotList.h"
+
+#define ANPR_HOT_LIST_MAGIC "ANPRHOT1"
+
+struct ANPRHotListHeader
+{
+	char magic[8];
+	uint32_t uMaxDistance;
+	/*! check value of the header, computed with uCheck set to 0 */
+	uint32_t uCheck;
+	uint32_t uEntries;
+	uint32_t uKeys;
+	/*! power of 2 */
+	uint32_t uBuckets;
+	uint32_t uReserved;
+	uint64_t uStringsSize;
+};
+
+struct ANPRHotListKey
+{
+	/*! high 32 bits of the hash */
+	uint32_t uTag;
+	uint32_t uEntry;
+};
+
+struct ANPRHotListRecord
+{
+	/*! offsets of the plate and of its normalized text in the strings */
+	uint32_t uPlate;
+	uint32_t uText;
+	uint32_t uList;
+	uint32_t uReserved;
+	uint64_t uTag;
+};
+
+/*!
+	Offsets of the sections of an index file
+*/
+struct ANPRHotListLayout
+{
+	uint64_t uKeys;
+	uint64_t uRecords;
+	uint64_t uStrings;
+	uint64_t uSize;
+};
+
+struct ANPRHotListMapping
+{
+	const uint8_t* pData = nullptr;
+	size_t uSize = 0;
+	dev_t device = 0;
+	ino_t inode = 0;
+	const ANPRHotListHeader* pHeader = nullptr;
+	const uint32_t* pBuckets = nullptr;
+	const ANPRHotListKey* pKeys = nullptr;
+	const ANPRHotListRecord* pRecords = nullptr;
+	const char* pStrings = nullptr;
+};
+
+struct _anprhotlist : CDKObject
+{
+	std::string strPath;
+	/*! shared by the lookups, exclusive for the swaps */
+	std::shared_mutex mutex;
+	ANPRHotListMapping mapping;
+	uint64_t uGeneration = 0;
+	/*! serializes the reloads */
+	std::mutex reloadMutex;
+};
+
+static uint32_t ANPRHotListCheck(const ANPRHotListHeader* pHeader)
+{
+	ANPRHotListHeader header = *pHeader;
+	header.uCheck = 0;
+	// FNV-1a
+	const uint8_t* pData = (const uint8_t*)&header;
+	uint32_t uCheck = 2166136261u;
+	for (size_t i = 0; i < sizeof(header); i++)
+		uCheck = (uCheck ^ pData[i]) * 16777619u;
+	return uCheck;
+}
+
+static uint64_t ANPRHotListAlign(uint64_t uOffset)
+{
+	return (uOffset + 7) & ~(uint64_t)7;
+}
+
+static ANPRHotListLayout ANPRHotListGetLayout(const ANPRHotListHeader& header)
+{
+	ANPRHotListLayout layout;
+	layout.uKeys = ANPRHotListAlign(sizeof(ANPRHotListHeader) + ((uint64_t)header.uBuckets + 1) * sizeof(uint32_t));
+	layout.uRecords = ANPRHotListAlign(layout.uKeys + (uint64_t)header.uKeys * sizeof(ANPRHotListKey));
+	layout.uStrings = layout.uRecords + (uint64_t)header.uEntries * sizeof(ANPRHotListRecord);
+	layout.uSize = layout.uStrings + header.uStringsSize;
+	return layout;
+}
+
+static void ANPRHotListUnmap(ANPRHotListMapping& mapping)
+{
+	if (mapping.pData)
+		munmap((void*)mapping.pData, mapping.uSize);
+	mapping = ANPRHotListMapping();
+}
+
+static int32_t ANPRHotListWriteAll(int iFd, const void* pData, size_t uSize)
+{
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	while (uSize)
+	{
+		ssize_t iWritten = write(iFd, pBytes, uSize);
+		if (iWritten < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return CDK_FAIL;
+		}
+		pBytes += iWritten;
+		uSize -= (size_t)iWritten;
+	}
+	return CDK_OK;
+}
+
+/*!
+	Maps and validates an index file, unless it is the file of pCurrent
+	@returns 1 if the file was mapped, 0 if it is the file of pCurrent, -1 on failure
+*/
+static int32_t ANPRHotListMap(ANPRHotList* pHotList, const ANPRHotListMapping* pCurrent, ANPRHotListMapping& mapping)
+{
+	const char* strPath = pHotList->strPath.c_str();
+	int iFd = open(strPath, O_RDONLY | O_CLOEXEC);
+	if (iFd < 0)
+	{
+		CDKSetLastError(pHotList, "cannot open %s: %s", strPath, strerror(errno));
+		return -1;
+	}
+	struct stat st;
+	if (fstat(iFd, &st) != 0)
+	{
+		CDKSetLastError(pHotList, "cannot stat %s: %s", strPath, strerror(errno));
+		close(iFd);
+		return -1;
+	}
+	if (pCurrent && pCurrent->pData && st.st_dev == pCurrent->device && st.st_ino == pCurrent->inode)
+	{
+		close(iFd);
+		return 0;
+	}
+	size_t uSize = (size_t)st.st_size;
+	void* pMapped = uSize >= sizeof(ANPRHotListHeader) ? mmap(nullptr, uSize, PROT_READ, MAP_SHARED, iFd, 0) : MAP_FAILED;
+	close(iFd);
+	const uint8_t* pData = (const uint8_t*)pMapped;
+	const ANPRHotListHeader* pHeader = (const ANPRHotListHeader*)pData;
+	bool bValid = pMapped != MAP_FAILED && memcmp(pHeader->magic, ANPR_HOT_LIST_MAGIC, sizeof(pHeader->magic)) == 0 &&
+		pHeader->uCheck == ANPRHotListCheck(pHeader) && pHeader->uMaxDistance <= 1 &&
+		pHeader->uBuckets && (pHeader->uBuckets & (pHeader->uBuckets - 1)) == 0 && pHeader->uStringsSize &&
+		ANPRHotListGetLayout(*pHeader).uSize == uSize;
+	if (bValid)
+	{
+		ANPRHotListLayout layout = ANPRHotListGetLayout(*pHeader);
+		mapping.pData = pData;
+		mapping.uSize = uSize;
+		mapping.device = st.st_dev;
+		mapping.inode = st.st_ino;
+		mapping.pHeader = pHeader;
+		mapping.pBuckets = (const uint32_t*)(pData + sizeof(ANPRHotListHeader));
+		mapping.pKeys = (const ANPRHotListKey*)(pData + layout.uKeys);
+		mapping.pRecords = (const ANPRHotListRecord*)(pData + layout.uRecords);
+		mapping.pStrings = (const char*)(pData + layout.uStrings);
+		bValid = mapping.pBuckets[pHeader->uBuckets] == pHeader->uKeys && mapping.pStrings[pHeader->uStringsSize - 1] == 0;
+	}
+	if (!bValid)
+	{
+		if (pMapped != MAP_FAILED)
+			munmap(pMapped, uSize);
+		mapping = ANPRHotListMapping();
+		CDKSetLastError(pHotList, "%s is not a hot-list index", strPath);
+		return -1;
+	}
+	// the lookups read the keys and the plates at random
+	madvise(pMapped, uSize, MADV_RANDOM);
+	return 1;
+}
+
+int32_t ANPRHotListBuild(const char* strPath, const ANPRHotListEntry* pEntries, uint32_t uEntries, uint32_t uMaxDistance)
+{
+	if (!strPath || !*strPath || (!pEntries && uEntries) || uMaxDistance > 1)
+	{
+		CDKSetLastError(nullptr, "a path, the plates and a distance of 0 or 1 are required");
+		return CDK_FAIL;
+	}
+	ANPRHotListHeader header = {};
+	memcpy(header.magic, ANPR_HOT_LIST_MAGIC, sizeof(header.magic));
+	header.uMaxDistance = uMaxDistance;
+	std::vector<ANPRHotListRecord> records;
+	std::vector<char> strings;
+	std::vector<uint32_t> buckets;
+	std::vector<ANPRHotListKey> keys;
+	try
+	{
+		// the strings start with an empty one, so that the section is never empty
+		strings.push_back(0);
+		records.reserve(uEntries);
+		uint64_t uKeys = 0;
+		for (uint32_t i = 0; i < uEntries; i++)
+		{
+			const char* strPlate = pEntries[i].strPlate ? pEntries[i].strPlate : "";
+			char strText[ANPR_PLATE_READ_MAX_PLATE];
+			if (ANPRPlateReadNormalize(strPlate, strText) == 0)
+				continue;
+			size_t uPlateLength = strnlen(strPlate, ANPR_PLATE_READ_MAX_PLATE - 1);
+			size_t uTextLength = strlen(strText);
+			if (strings.size() + uPlateLength + uTextLength + 2 > UINT32_MAX)
+			{
+				CDKSetLastError(nullptr, "too many plates");
+				return CDK_FAIL;
+			}
+			ANPRHotListRecord record = {};
+			record.uPlate = (uint32_t)strings.size();
+			strings.insert(strings.end(), strPlate, strPlate + uPlateLength);
+			strings.push_back(0);
+			record.uText = (uint32_t)strings.size();
+			strings.insert(strings.end(), strText, strText + uTextLength + 1);
+			record.uList = pEntries[i].uList;
+			record.uTag = pEntries[i].uTag;
+			records.push_back(record);
+			uint64_t hashes[ANPR_PLATE_READ_MAX_PLATE];
+			uKeys += ANPRPlateReadTextKeys(strText, uMaxDistance, hashes, ANPR_PLATE_READ_MAX_PLATE);
+		}
+		if (uKeys > UINT32_MAX / 2)
+		{
+			CDKSetLastError(nullptr, "too many plates");
+			return CDK_FAIL;
+		}
+		header.uEntries = (uint32_t)records.size();
+		header.uKeys = (uint32_t)uKeys;
+		header.uStringsSize = strings.size();
+		// two keys per bucket on average
+		header.uBuckets = 1;
+		while (header.uBuckets * 2 < header.uKeys)
+			header.uBuckets *= 2;
+
+		// counting sort of the keys by bucket : counts, offsets, then placement
+		buckets.assign((size_t)header.uBuckets + 1, 0);
+		uint32_t uMask = header.uBuckets - 1;
+		for (const ANPRHotListRecord& record : records)
+		{
+			uint64_t hashes[ANPR_PLATE_READ_MAX_PLATE];
+			uint32_t uHashes = ANPRPlateReadTextKeys(&strings[record.uText], uMaxDistance, hashes, ANPR_PLATE_READ_MAX_PLATE);
+			for (uint32_t k = 0; k < uHashes; k++)
+				buckets[(hashes[k] & uMask) + 1]++;
+		}
+		for (uint32_t b = 0; b < header.uBuckets; b++)
+			buckets[b + 1] += buckets[b];
+		keys.resize(header.uKeys);
+		std::vector<uint32_t> next(buckets.begin(), buckets.end() - 1);
+		for (uint32_t e = 0; e < header.uEntries; e++)
+		{
+			uint64_t hashes[ANPR_PLATE_READ_MAX_PLATE];
+			uint32_t uHashes = ANPRPlateReadTextKeys(&strings[records[e].uText], uMaxDistance, hashes, ANPR_PLATE_READ_MAX_PLATE);
+			for (uint32_t k = 0; k < uHashes; k++)
+				keys[next[hashes[k] & uMask]++] = { (uint32_t)(hashes[k] >> 32), e };
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return CDK_FAIL;
+	}
+	header.uCheck = ANPRHotListCheck(&header);
+	ANPRHotListLayout layout = ANPRHotListGetLayout(header);
+	static const uint8_t padding[8] = {};
+
+	std::string strTemporary = std::string(strPath) + ".tmp";
+	int iFd = open(strTemporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (iFd < 0)
+	{
+		CDKSetLastError(nullptr, "cannot create %s: %s", strTemporary.c_str(), strerror(errno));
+		return CDK_FAIL;
+	}
+	uint64_t uBucketsEnd = sizeof(header) + buckets.size() * sizeof(uint32_t);
+	uint64_t uKeysEnd = layout.uKeys + keys.size() * sizeof(ANPRHotListKey);
+	bool bOk = ANPRHotListWriteAll(iFd, &header, sizeof(header)) == CDK_OK &&
+		ANPRHotListWriteAll(iFd, buckets.data(), buckets.size() * sizeof(uint32_t)) == CDK_OK &&
+		ANPRHotListWriteAll(iFd, padding, layout.uKeys - uBucketsEnd) == CDK_OK &&
+		ANPRHotListWriteAll(iFd, keys.data(), keys.size() * sizeof(ANPRHotListKey)) == CDK_OK &&
+		ANPRHotListWriteAll(iFd, padding, layout.uRecords - uKeysEnd) == CDK_OK &&
+		ANPRHotListWriteAll(iFd, records.data(), records.size() * sizeof(ANPRHotListRecord)) == CDK_OK &&
+		ANPRHotListWriteAll(iFd, strings.data(), strings.size()) == CDK_OK;
+	bOk = bOk && fdatasync(iFd) == 0;
+	close(iFd);
+	if (!bOk || rename(strTemporary.c_str(), strPath) != 0)
+	{
+		CDKSetLastError(nullptr, "cannot write %s: %s", strPath, strerror(errno));
+		unlink(strTemporary.c_str());
+		return CDK_FAIL;
+	}
+	// the rename is durable once the directory is synchronized
+	std::string strFile = strPath;
+	size_t uSlash = strFile.rfind('/');
+	std::string strDirectory = uSlash == std::string::npos ? "." : uSlash == 0 ? "/" : strFile.substr(0, uSlash);
+	int iDirectoryFd = open(strDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (iDirectoryFd >= 0)
+	{
+		fsync(iDirectoryFd);
+		close(iDirectoryFd);
+	}
+	return CDK_OK;
+}
+
+ANPRHotList* ANPRHotListOpen(const char* strPath)
+{
+	if (!strPath || !*strPath)
+	{
+		CDKSetLastError(nullptr, "an index path is required");
+		return nullptr;
+	}
+	ANPRHotList* pHotList = new (std::nothrow) ANPRHotList();
+	if (!pHotList)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	pHotList->strPath = strPath;
+	if (ANPRHotListMap(pHotList, nullptr, pHotList->mapping) < 0)
+	{
+		CDKSetLastError(nullptr, "%s", CDKGetLastError(pHotList));
+		delete pHotList;
+		return nullptr;
+	}
+	pHotList->uGeneration = 1;
+	return pHotList;
+}
+
+void ANPRHotListClose(ANPRHotList* pHotList)
+{
+	if (!pHotList)
+		return;
+	ANPRHotListUnmap(pHotList->mapping);
+	delete pHotList;
+}
+
+int32_t ANPRHotListReload(ANPRHotList* pHotList)
+{
+	if (!pHotList)
+		return -1;
+	std::lock_guard<std::mutex> reloadLock(pHotList->reloadMutex);
+	// only the reloads change the mapping, and they are serialized : it can be read without the shared mutex
+	ANPRHotListMapping mapping;
+	int32_t iResult = ANPRHotListMap(pHotList, &pHotList->mapping, mapping);
+	if (iResult <= 0)
+		return iResult;
+	{
+		std::unique_lock<std::shared_mutex> lock(pHotList->mutex);
+		std::swap(pHotList->mapping, mapping);
+		pHotList->uGeneration++;
+	}
+	// no lookup uses the previous mapping anymore
+	ANPRHotListUnmap(mapping);
+	return 1;
+}
+
+/*!
+	Calls found(entry) for every plate having the key, the shared mutex being held
+*/
+template <typename Found>
+static inline void ANPRHotListProbe(const ANPRHotListMapping& mapping, uint64_t uHash, Found found)
+{
+	const ANPRHotListHeader* pHeader = mapping.pHeader;
+	uint32_t uBucket = (uint32_t)uHash & (pHeader->uBuckets - 1);
+	uint32_t uBegin = mapping.pBuckets[uBucket];
+	uint32_t uEnd = mapping.pBuckets[uBucket + 1];
+	if (uEnd > pHeader->uKeys || uBegin > uEnd)
+		return;
+	uint32_t uTag = (uint32_t)(uHash >> 32);
+	for (uint32_t i = uBegin; i < uEnd; i++)
+		if (mapping.pKeys[i].uTag == uTag && mapping.pKeys[i].uEntry < pHeader->uEntries)
+			found(mapping.pKeys[i].uEntry);
+}
+
+int32_t ANPRHotListLookup(ANPRHotList* pHotList, const char* strPlate, uint32_t uMaxDistance, ANPRHotListMatch* pMatches, uint32_t uMaxMatches)
+{
+	if (!pHotList || !strPlate || (!pMatches && uMaxMatches))
+	{
+		CDKSetLastError(pHotList, "a plate and a match buffer are required");
+		return -1;
+	}
+	char strText[ANPR_PLATE_READ_MAX_PLATE];
+	if (ANPRPlateReadNormalize(strPlate, strText) == 0)
+		return 0;
+	uMaxMatches = std::min<uint32_t>(uMaxMatches, ANPR_HOT_LIST_MAX_MATCHES);
+	uint32_t matched[ANPR_HOT_LIST_MAX_MATCHES];
+	uint32_t uMatches = 0;
+
+	std::shared_lock<std::shared_mutex> lock(pHotList->mutex);
+	const ANPRHotListMapping& mapping = pHotList->mapping;
+	uint64_t uStringsSize = mapping.pHeader->uStringsSize;
+	uMaxDistance = std::min(uMaxDistance, mapping.pHeader->uMaxDistance);
+	uint64_t hashes[ANPR_PLATE_READ_MAX_PLATE];
+	uint32_t uHashes = ANPRPlateReadTextKeys(strText, uMaxDistance, hashes, ANPR_PLATE_READ_MAX_PLATE);
+	auto add = [&](uint32_t uEntry, uint32_t uDistance)
+	{
+		const ANPRHotListRecord& record = mapping.pRecords[uEntry];
+		if (record.uPlate >= uStringsSize)
+			return;
+		ANPRHotListMatch& match = pMatches[uMatches];
+		match.uList = record.uList;
+		match.uDistance = uDistance;
+		match.uTag = record.uTag;
+		strncpy(match.strPlate, mapping.pStrings + record.uPlate, sizeof(match.strPlate) - 1);
+		match.strPlate[sizeof(match.strPlate) - 1] = 0;
+		matched[uMatches++] = uEntry;
+	};
+	auto text = [&](uint32_t uEntry) -> const char*
+	{
+		uint32_t uText = mapping.pRecords[uEntry].uText;
+		return uText < uStringsSize ? mapping.pStrings + uText : nullptr;
+	};
+
+	// the buckets of the keys are fetched together, rather than one cache miss after the other
+	for (uint32_t k = 0; k < uHashes; k++)
+		__builtin_prefetch(&mapping.pBuckets[(uint32_t)hashes[k] & (mapping.pHeader->uBuckets - 1)]);
+
+	// identical texts have the same first key
+	ANPRHotListProbe(mapping, hashes[0], [&](uint32_t uEntry)
+	{
+		const char* strEntryText = text(uEntry);
+		if (uMatches < uMaxMatches && strEntryText && strcmp(strEntryText, strText) == 0)
+			add(uEntry, 0);
+	});
+	// a text differing by one character shares one of the keys, maybe more when the text has repeated characters
+	for (uint32_t k = 0; uMaxDistance && k < uHashes && uMatches < uMaxMatches; k++)
+		ANPRHotListProbe(mapping, hashes[k], [&](uint32_t uEntry)
+		{
+			if (uMatches >= uMaxMatches || std::find(matched, matched + uMatches, uEntry) != matched + uMatches)
+				return;
+			const char* strEntryText = text(uEntry);
+			if (strEntryText && ANPRPlateReadTextDistance(strEntryText, strText) == 1)
+				add(uEntry, 1);
+		});
+	return (int32_t)uMatches;
+}
+
+void ANPRHotListGetInfo(ANPRHotList* pHotList, ANPRHotListInfo* pInfo)
+{
+	if (!pHotList || !pInfo)
+		return;
+	std::shared_lock<std::shared_mutex> lock(pHotList->mutex);
+	const ANPRHotListHeader* pHeader = pHotList->mapping.pHeader;
+	pInfo->uEntries = pHeader->uEntries;
+	pInfo->uKeys = pHeader->uKeys;
+	pInfo->uMaxDistance = pHeader->uMaxDistance;
+	pInfo->uBytes = pHotList->mapping.uSize;
+	pInfo->uGeneration = pHotList->uGeneration;
+}
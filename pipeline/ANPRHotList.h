@@ -0,0 +1,138 @@
+/*! \file
+
+ANPRHotList : matching of the plate reads against hot-lists of millions of plates, such as wanted, stolen or permit lists.<br/>
+The plates are keyed by their <a href="#ANPRPlateReadNormalize">normalized text</a>, so that the usual OCR confusions
+(0/O/D/Q, 1/I, 2/Z, 5/S, 6/G, 8/B) do not miss a match, and by the <a href="#ANPRPlateReadTextKeys">deletion keys</a> of
+this text, so that a read whose text differs by one more character, missed, added or misread, is still found : the
+candidates sharing a key with the read are verified with the edit distance.<br/>
+The index is compiled offline by <a href="#ANPRHotListBuild">ANPRHotListBuild</a> into a file that is mapped as is, without
+loading. A new version of the lists is built into a new file renamed over the previous one, and
+<a href="#ANPRHotListReload">ANPRHotListReload</a> swaps the mapping atomically : a lookup sees either the previous lists or
+the new ones.
+
+*/
+
+#ifndef ANPRHOTLIST_H
+#define ANPRHOTLIST_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "ANPRPlateRead.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*!
+	Maximum number of matches returned by a lookup
+*/
+#define ANPR_HOT_LIST_MAX_MATCHES 64
+
+/*! <summary>struct</summary>
+	A mapped hot-list index
+*/
+typedef struct _anprhotlist ANPRHotList;
+
+/*! <summary>struct</summary>
+	A plate of a hot-list, given to <a href="#ANPRHotListBuild">ANPRHotListBuild</a>
+*/
+typedef struct
+{
+	/*! plate text, as published by the list */
+	const char* strPlate;
+	/*! list of the plate, defined by the application : wanted, stolen, permit... */
+	uint32_t uList;
+	/*! value given back with the matches, for instance a record of the list */
+	uint64_t uTag;
+} ANPRHotListEntry;
+
+/*! <summary>struct</summary>
+	A plate of a hot-list matched by a read
+*/
+typedef struct
+{
+	/*! list of the plate */
+	uint32_t uList;
+	/*! 0 if the normalized texts of the read and of the plate are identical, 1 if they differ by one character */
+	uint32_t uDistance;
+	/*! tag of the plate */
+	uint64_t uTag;
+	/*! plate text, as published by the list */
+	char strPlate[ANPR_PLATE_READ_MAX_PLATE];
+} ANPRHotListMatch;
+
+/*! <summary>struct</summary>
+	Description of the mapped index
+*/
+typedef struct
+{
+	/*! plates of the index */
+	uint32_t uEntries;
+	/*! keys of the plates */
+	uint32_t uKeys;
+	/*! maximum text distance of the lookups, given to ANPRHotListBuild */
+	uint32_t uMaxDistance;
+	/*! size of the mapped file, in bytes */
+	uint64_t uBytes;
+	/*! 1 for the index mapped by ANPRHotListOpen, incremented at every swap */
+	uint64_t uGeneration;
+} ANPRHotListInfo;
+
+/*!
+	Builds a hot-list index file. The file is written to strPath followed by .tmp, synchronized, and renamed over
+	strPath, so that the mapped indexes are never modified.<br/>
+	The plates without any letter or digit are skipped.
+	@param[in] strPath path of the index file
+	@param[in] pEntries the plates. The same plate can be in several lists
+	@param[in] uEntries number of plates
+	@param[in] uMaxDistance 0 to only match identical normalized texts, 1 to match the texts differing by one character too
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> with NULL for more details
+*/
+int32_t ANPRHotListBuild(const char* strPath, const ANPRHotListEntry* pEntries, uint32_t uEntries, uint32_t uMaxDistance);
+
+/*!
+	Maps a hot-list index file.<br/>
+	Use <a href="#ANPRHotListClose">ANPRHotListClose</a> to close it.
+	@param[in] strPath path of the index file, built by <a href="#ANPRHotListBuild">ANPRHotListBuild</a>
+	@returns the index, or NULL on failure. Use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+ANPRHotList* ANPRHotListOpen(const char* strPath);
+
+/*!
+	Closes a hot-list index. No lookup may be running.
+*/
+void ANPRHotListClose(ANPRHotList* pHotList);
+
+/*!
+	Maps the index file again if it was replaced since it was mapped, and swaps the mappings. The lookups running keep the
+	previous mapping until they return.<br/>
+	Can be called from any thread, for instance periodically or when the lists are published.
+	@param[in] pHotList the index
+	@returns 1 if the new file was mapped, 0 if the file was not replaced, -1 on failure : the previous mapping is kept. Use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRHotListReload(ANPRHotList* pHotList);
+
+/*!
+	Looks a plate up in the lists. The plates whose normalized text is identical to the one of the plate are returned
+	first.<br/>
+	Can be called from several threads, for instance with the plate of an <a href="#ANPRPlateRead">extracted read</a>.
+	@param[in] pHotList the index
+	@param[in] strPlate plate text of the read
+	@param[in] uMaxDistance 0 to only match identical normalized texts, 1 to match the texts differing by one character too. It is limited by the maximum distance of the index
+	@param[out] pMatches the matches
+	@param[in] uMaxMatches size of pMatches
+	@returns the number of matches, at most uMaxMatches and ANPR_HOT_LIST_MAX_MATCHES, or -1 on failure. Use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRHotListLookup(ANPRHotList* pHotList, const char* strPlate, uint32_t uMaxDistance, ANPRHotListMatch* pMatches, uint32_t uMaxMatches);
+
+/*!
+	Describes the mapped index
+*/
+void ANPRHotListGetInfo(ANPRHotList* pHotList, ANPRHotListInfo* pInfo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRHOTLIST_H
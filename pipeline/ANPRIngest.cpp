@@ -0,0 +1,274 @@
+/*! \file
+
+ANPRIngest : multi-camera ingestion engine.
+
+*/
+
+#include <algorithm>
+#include <new>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRIngest.h"
+
+/*!
+	Timeout of a worker wait, so that stop requests are seen
+*/
+#define ANPR_INGEST_WAIT_MS 100
+
+struct ANPRIngestSource
+{
+	void* pSourceUser;
+	uint32_t uQueue;
+};
+
+struct ANPRIngestWorker
+{
+	std::thread thread;
+	/*! written by the worker only, on its own cache line */
+	alignas(64) std::atomic<uint64_t> uProcessed{0};
+};
+
+struct _anpringest : CDKObject
+{
+	ANPRIngestConfig config;
+	PANPRINGESTMESSAGECALLBACK messageCallback = nullptr;
+	void* pUser = nullptr;
+
+	std::vector<CDKQueue*> queues;
+	std::vector<uint32_t> queueSources;
+	std::vector<ANPRIngestWorker*> workers;
+	std::atomic<bool> bStop{false};
+	bool bStarted = false;
+	/*! messages processed by the workers of the previous runs */
+	uint64_t uProcessedBefore = 0;
+
+	/*! sources are looked up by every worker for every message, and modified on attach / detach */
+	std::shared_mutex sourcesMutex;
+	std::unordered_map<CDK*, ANPRIngestSource> sources;
+};
+
+static void ANPRIngestWorkerThread(ANPRIngest* pIngest, uint32_t uWorker)
+{
+	CDKQueue* pQueue = pIngest->queues[uWorker % pIngest->queues.size()];
+	ANPRIngestWorker* pWorker = pIngest->workers[uWorker];
+	CDK* pLastSource = nullptr;
+	void* pLastSourceUser = nullptr;
+	std::vector<CDKMsg*> batch(pIngest->config.uBatchSize);
+	while (!pIngest->bStop.load(std::memory_order_relaxed))
+	{
+		if (CDKQueueWaitForNewMessages(pQueue, pIngest->config.uBatchSize, pIngest->config.uBatchLatency, ANPR_INGEST_WAIT_MS) != CDK_OK)
+			continue;
+		uint32_t uCount = CDKQueuePopMessages(pQueue, batch.data(), (uint32_t)batch.size());
+		for (uint32_t i = 0; i < uCount; i++)
+		{
+			CDKMsg* pMsg = batch[i];
+			CDK* pSource = CDKMsgGetCDK(pMsg);
+			// consecutive messages often come from the same camera (bursts)
+			if (pSource != pLastSource)
+			{
+				std::shared_lock<std::shared_mutex> lock(pIngest->sourcesMutex);
+				auto it = pIngest->sources.find(pSource);
+				pLastSourceUser = it != pIngest->sources.end() ? it->second.pSourceUser : nullptr;
+				pLastSource = pSource;
+			}
+			pIngest->messageCallback(pMsg, pSource, pLastSourceUser, uWorker, pIngest->pUser);
+		}
+		pWorker->uProcessed.fetch_add(uCount, std::memory_order_relaxed);
+		// a detached source may be attached again with another user data
+		pLastSource = nullptr;
+	}
+}
+
+void ANPRIngestDefaultConfig(ANPRIngestConfig* pConfig)
+{
+	pConfig->uWorkers = 0;
+	pConfig->uQueues = 0;
+	pConfig->uMaxQueueSize = 4096;
+	pConfig->bLockFree = 1;
+	pConfig->uOverflowPolicy = CDK_QUEUE_DROP_NEWEST;
+	pConfig->uBlockTimeout = 0;
+	pConfig->uBatchSize = 64;
+	pConfig->uBatchLatency = 0;
+}
+
+ANPRIngest* ANPRIngestCreate(const ANPRIngestConfig* pConfig, PANPRINGESTMESSAGECALLBACK messageCallback, void* pUser)
+{
+	if (!messageCallback)
+	{
+		CDKSetLastError(nullptr, "a message callback is required");
+		return nullptr;
+	}
+	ANPRIngest* pIngest = new (std::nothrow) ANPRIngest();
+	if (!pIngest)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pIngest->config = *pConfig;
+	else
+		ANPRIngestDefaultConfig(&pIngest->config);
+	ANPRIngestConfig& config = pIngest->config;
+	if (config.uWorkers == 0)
+		config.uWorkers = std::max(1u, std::thread::hardware_concurrency());
+	if (config.uQueues == 0 || config.uQueues > config.uWorkers)
+		config.uQueues = config.uWorkers;
+	if (config.uBatchSize == 0)
+		config.uBatchSize = 1;
+	pIngest->messageCallback = messageCallback;
+	pIngest->pUser = pUser;
+
+	for (uint32_t i = 0; i < config.uQueues; i++)
+	{
+		CDKQueue* pQueue = config.bLockFree ? CDKQueueCreateLockFree(config.uMaxQueueSize) : CDKQueueCreate();
+		if (!pQueue)
+		{
+			ANPRIngestDestroy(pIngest);
+			return nullptr;
+		}
+		if (!config.bLockFree)
+			CDKQueueSetMaxQueueSize(pQueue, config.uMaxQueueSize);
+		if (CDKQueueSetOverflowPolicy(pQueue, config.uOverflowPolicy, config.uBlockTimeout) != CDK_OK)
+		{
+			CDKSetLastError(nullptr, "%s", CDKGetLastError(pQueue));
+			CDKQueueDestroy(pQueue);
+			ANPRIngestDestroy(pIngest);
+			return nullptr;
+		}
+		pIngest->queues.push_back(pQueue);
+		pIngest->queueSources.push_back(0);
+	}
+	return pIngest;
+}
+
+void ANPRIngestDestroy(ANPRIngest* pIngest)
+{
+	if (!pIngest)
+		return;
+	ANPRIngestStop(pIngest);
+	for (auto& source : pIngest->sources)
+		CDKSetQueue(source.first, nullptr);
+	pIngest->sources.clear();
+	for (CDKQueue* pQueue : pIngest->queues)
+		CDKQueueDestroy(pQueue);
+	delete pIngest;
+}
+
+int32_t ANPRIngestAttach(ANPRIngest* pIngest, CDK* pCDK, void* pSourceUser)
+{
+	if (!pIngest || !pCDK)
+		return CDK_FAIL;
+	std::unique_lock<std::shared_mutex> lock(pIngest->sourcesMutex);
+	if (pIngest->sources.count(pCDK))
+	{
+		CDKSetLastError(pIngest, "CDK is already attached");
+		return CDK_FAIL;
+	}
+	uint32_t uQueue = (uint32_t)(std::min_element(pIngest->queueSources.begin(), pIngest->queueSources.end()) - pIngest->queueSources.begin());
+	pIngest->sources[pCDK] = ANPRIngestSource{ pSourceUser, uQueue };
+	pIngest->queueSources[uQueue]++;
+	CDKSetQueue(pCDK, pIngest->queues[uQueue]);
+	return CDK_OK;
+}
+
+int32_t ANPRIngestDetach(ANPRIngest* pIngest, CDK* pCDK)
+{
+	if (!pIngest || !pCDK)
+		return CDK_FAIL;
+	std::unique_lock<std::shared_mutex> lock(pIngest->sourcesMutex);
+	auto it = pIngest->sources.find(pCDK);
+	if (it == pIngest->sources.end())
+	{
+		CDKSetLastError(pIngest, "CDK is not attached");
+		return CDK_FAIL;
+	}
+	CDKSetQueue(pCDK, nullptr);
+	pIngest->queueSources[it->second.uQueue]--;
+	pIngest->sources.erase(it);
+	return CDK_OK;
+}
+
+uint32_t ANPRIngestGetSourceDrops(ANPRIngest* pIngest, CDK* pCDK)
+{
+	if (!pIngest || !pCDK)
+		return 0;
+	std::shared_lock<std::shared_mutex> lock(pIngest->sourcesMutex);
+	auto it = pIngest->sources.find(pCDK);
+	if (it == pIngest->sources.end())
+		return 0;
+	return CDKQueueGetProducerDrops(pIngest->queues[it->second.uQueue], pCDK);
+}
+
+int32_t ANPRIngestStart(ANPRIngest* pIngest)
+{
+	if (!pIngest)
+		return CDK_FAIL;
+	if (pIngest->bStarted)
+	{
+		CDKSetLastError(pIngest, "engine is already started");
+		return CDK_FAIL;
+	}
+	pIngest->bStop = false;
+	try
+	{
+		for (uint32_t i = 0; i < pIngest->config.uWorkers; i++)
+			pIngest->workers.push_back(new ANPRIngestWorker());
+		for (uint32_t i = 0; i < pIngest->config.uWorkers; i++)
+			pIngest->workers[i]->thread = std::thread(ANPRIngestWorkerThread, pIngest, i);
+	}
+	catch (const std::exception& e)
+	{
+		CDKSetLastError(pIngest, "cannot start workers: %s", e.what());
+		pIngest->bStarted = true;
+		ANPRIngestStop(pIngest);
+		return CDK_FAIL;
+	}
+	pIngest->bStarted = true;
+	return CDK_OK;
+}
+
+void ANPRIngestStop(ANPRIngest* pIngest)
+{
+	if (!pIngest || !pIngest->bStarted)
+		return;
+	pIngest->bStop = true;
+	for (ANPRIngestWorker* pWorker : pIngest->workers)
+	{
+		if (pWorker->thread.joinable())
+			pWorker->thread.join();
+	}
+	// processed counters are kept across restarts
+	uint64_t uProcessed = 0;
+	for (ANPRIngestWorker* pWorker : pIngest->workers)
+	{
+		uProcessed += pWorker->uProcessed;
+		delete pWorker;
+	}
+	pIngest->workers.clear();
+	pIngest->uProcessedBefore += uProcessed;
+	pIngest->bStarted = false;
+}
+
+void ANPRIngestGetStats(ANPRIngest* pIngest, ANPRIngestStats* pStats)
+{
+	if (!pIngest || !pStats)
+		return;
+	pStats->uProcessed = pIngest->uProcessedBefore;
+	for (ANPRIngestWorker* pWorker : pIngest->workers)
+		pStats->uProcessed += pWorker->uProcessed.load(std::memory_order_relaxed);
+	pStats->uQueueDrops = 0;
+	pStats->uQueued = 0;
+	for (CDKQueue* pQueue : pIngest->queues)
+	{
+		pStats->uQueueDrops += CDKQueueGetMessageDrops(pQueue);
+		pStats->uQueued += CDKQueueGetQueueSize(pQueue);
+	}
+	{
+		std::shared_lock<std::shared_mutex> lock(pIngest->sourcesMutex);
+		pStats->uSources = (uint32_t)pIngest->sources.size();
+	}
+	pStats->uWorkers = pIngest->config.uWorkers;
+	pStats->uQueues = (uint32_t)pIngest->queues.size();
+}
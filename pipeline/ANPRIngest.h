@@ -0,0 +1,133 @@
+/*! \file
+
+ANPRIngest : multi-camera ingestion engine.<br/>
+Many CDK instances are attached to a small number of shared <a href="#CDKQueue">CDKQueue</a>s with <a href="#CDKSetQueue">CDKSetQueue</a>,
+and the queues are drained by a fixed pool of workers. The number of threads does not depend on the number of cameras.
+
+*/
+
+#ifndef ANPRINGEST_H
+#define ANPRINGEST_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	An ingestion engine
+*/
+typedef struct _anpringest ANPRIngest;
+
+/*! <summary>callback</summary>
+
+	Callback called by a worker for every message received from an attached CDK.<br/>
+	The message is owned by the callback and has to be destroyed by it.
+	@param[in] pMsg the message
+	@param[in] pSource the CDK that received the message (<a href="#CDKMsgGetCDK">CDKMsgGetCDK</a>)
+	@param[in] pSourceUser user data given to <a href="#ANPRIngestAttach">ANPRIngestAttach</a> for this CDK
+	@param[in] uWorker index of the worker calling the callback
+	@param[in] pUser User data
+*/
+typedef void (*PANPRINGESTMESSAGECALLBACK)(CDKMsg* pMsg, CDK* pSource, void* pSourceUser, uint32_t uWorker, void* pUser);
+
+/*! <summary>struct</summary>
+	Configuration of an ingestion engine
+*/
+typedef struct
+{
+	/*! number of workers, 0 for one per core */
+	uint32_t uWorkers;
+	/*! number of shared queues, 0 for one per worker. Worker i drains queue i modulo uQueues */
+	uint32_t uQueues;
+	/*! maximum size of each shared queue */
+	uint32_t uMaxQueueSize;
+	/*! 1 to use <a href="#CDKQueueCreateLockFree">lock-free queues</a>, 0 for locked queues */
+	uint32_t bLockFree;
+	/*! <a href="#CDKQueueSetOverflowPolicy">overflow policy</a> of the shared queues */
+	uint32_t uOverflowPolicy;
+	/*! with <a href="#CDK_QUEUE_BLOCK">CDK_QUEUE_BLOCK</a>, maximum time a camera waits for room, in ms */
+	uint32_t uBlockTimeout;
+	/*! maximum number of messages a worker takes from its queue at once */
+	uint32_t uBatchSize;
+	/*! time a message may wait for a batch to fill, in ms. 0 hands out whatever is queued immediately */
+	uint32_t uBatchLatency;
+} ANPRIngestConfig;
+
+/*! <summary>struct</summary>
+	Counters of an ingestion engine
+*/
+typedef struct
+{
+	uint64_t uProcessed;
+	uint32_t uQueueDrops;
+	uint32_t uQueued;
+	uint32_t uSources;
+	uint32_t uWorkers;
+	uint32_t uQueues;
+} ANPRIngestStats;
+
+/*!
+	Fills a configuration with default values : one worker and one queue per core, 4096 messages per lock-free queue dropping the newest message on overflow, batches of up to 64 messages without added latency
+*/
+void ANPRIngestDefaultConfig(ANPRIngestConfig* pConfig);
+
+/*!
+	Creates an ingestion engine. Use <a href="#ANPRIngestDestroy">ANPRIngestDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@param[in] messageCallback callback called for every message
+	@param[in] pUser callback user data
+	@returns the engine, or NULL on failure
+*/
+ANPRIngest* ANPRIngestCreate(const ANPRIngestConfig* pConfig, PANPRINGESTMESSAGECALLBACK messageCallback, void* pUser);
+
+/*!
+	Stops the engine, detaches every CDK and destroys the engine. Messages still queued are destroyed.
+*/
+void ANPRIngestDestroy(ANPRIngest* pIngest);
+
+/*!
+	Attaches a CDK to the least loaded queue. Can be called while the engine is running.
+	@param[in] pIngest the engine
+	@param[in] pCDK the CDK instance
+	@param[in] pSourceUser user data handed to the callback with every message of this CDK
+	@returns CDK_OK on success, CDK_FAIL if the CDK is already attached
+*/
+int32_t ANPRIngestAttach(ANPRIngest* pIngest, CDK* pCDK, void* pSourceUser);
+
+/*!
+	Detaches a CDK : it uses its internal queue again. Messages already queued are still delivered.
+	@returns CDK_OK on success, CDK_FAIL if the CDK is not attached
+*/
+int32_t ANPRIngestDetach(ANPRIngest* pIngest, CDK* pCDK);
+
+/*!
+	Returns the number of messages of an attached CDK dropped by its shared queue (<a href="#CDKQueueGetProducerDrops">CDKQueueGetProducerDrops</a>)
+	@returns the number of messages dropped, 0 if the CDK is not attached
+*/
+uint32_t ANPRIngestGetSourceDrops(ANPRIngest* pIngest, CDK* pCDK);
+
+/*!
+	Starts the workers
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRIngestStart(ANPRIngest* pIngest);
+
+/*!
+	Stops the workers. Messages still queued stay in the queues until the next start.
+*/
+void ANPRIngestStop(ANPRIngest* pIngest);
+
+/*!
+	Returns the engine counters
+*/
+void ANPRIngestGetStats(ANPRIngest* pIngest, ANPRIngestStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRINGEST_H
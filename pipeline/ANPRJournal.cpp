@@ -0,0 +1,1007 @@
+/*! \file
+
+ANPRJournal : append-only journal of the messages received from the sensors.
+
+A segment is named after the number of its first record, and starts with a 16 bytes header. Every record is a
+40 bytes header followed by the exported message, padded to 8 bytes. The record header holds the CRC-32C of the
+message, and a check value of the header fields : a reader stops at the first record whose header is incomplete or
+inconsistent, or whose message does not match its CRC, which is where a crash cut the segment.
+All values are in host byte order.
+
+The index of a segment is written when the segment is closed, to a temporary file renamed once synchronized. It holds
+the offsets of the records in append order, followed by their keys sorted by sensor, timestamp and sequence number.
+
+Appending threads export their message in the pending buffer, under the mutex. The writer thread swaps the pending
+buffer with its own and writes it with one write per segment, so that the records appended while a group is written
+and synchronized form the next group.
+
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRJournal.h"
+
+#define ANPR_JOURNAL_SEGMENT_MAGIC "ANPRJNL2"
+#define ANPR_JOURNAL_INDEX_MAGIC "ANPRIDX1"
+
+/*!
+	Offsets in a segment are 32 bits : bigger segment sizes are reduced to this one
+*/
+#define ANPR_JOURNAL_MAX_SEGMENT_SIZE (1024u * 1024u * 1024u)
+
+struct ANPRJournalSegmentHeader
+{
+	char magic[8];
+	uint64_t uFirstRecord;
+};
+
+struct ANPRJournalRecordHeader
+{
+	uint32_t uSize;
+	uint32_t uSensor;
+	int64_t iTimestampUs;
+	int64_t iSeq;
+	int64_t iAppendedUs;
+	uint32_t uCheck;
+	/*! CRC-32C of the uSize bytes of the message */
+	uint32_t uPayloadCheck;
+};
+
+struct ANPRJournalIndexHeader
+{
+	char magic[8];
+	uint32_t uRecords;
+	uint32_t uReserved;
+	int64_t iMinTimestampUs;
+	int64_t iMaxTimestampUs;
+};
+
+struct ANPRJournalIndexEntry
+{
+	uint32_t uSensor;
+	/*! number of the record in its segment */
+	uint32_t uRecord;
+	int64_t iTimestampUs;
+	int64_t iSeq;
+};
+
+static_assert(sizeof(ANPRJournalSegmentHeader) == 16, "segment header layout");
+static_assert(sizeof(ANPRJournalRecordHeader) == 40, "record header layout");
+static_assert(sizeof(ANPRJournalIndexHeader) == 32, "index header layout");
+static_assert(sizeof(ANPRJournalIndexEntry) == 24, "index entry layout");
+
+static bool operator<(const ANPRJournalIndexEntry& a, const ANPRJournalIndexEntry& b)
+{
+	if (a.uSensor != b.uSensor)
+		return a.uSensor < b.uSensor;
+	if (a.iTimestampUs != b.iTimestampUs)
+		return a.iTimestampUs < b.iTimestampUs;
+	if (a.iSeq != b.iSeq)
+		return a.iSeq < b.iSeq;
+	return a.uRecord < b.uRecord;
+}
+
+/*!
+	Growable byte buffer, not zeroed on growth
+*/
+struct ANPRJournalBuffer
+{
+	std::unique_ptr<uint8_t[]> pData;
+	size_t uSize = 0;
+	size_t uCapacity = 0;
+
+	uint8_t* Append(size_t uLength)
+	{
+		if (uSize + uLength > uCapacity)
+		{
+			size_t uCapacityNew = std::max(uSize + uLength, uCapacity * 2);
+			std::unique_ptr<uint8_t[]> pDataNew(new uint8_t[uCapacityNew]);
+			if (uSize)
+				memcpy(pDataNew.get(), pData.get(), uSize);
+			pData = std::move(pDataNew);
+			uCapacity = uCapacityNew;
+		}
+		uint8_t* p = pData.get() + uSize;
+		uSize += uLength;
+		return p;
+	}
+};
+
+struct ANPRJournalPendingRecord
+{
+	uint32_t uSensor;
+	uint32_t uLength;
+	int64_t iTimestampUs;
+	int64_t iSeq;
+};
+
+/*!
+	Records of the segment being written, kept by the writer thread for its index
+*/
+struct ANPRJournalSegmentIndex
+{
+	std::vector<uint32_t> offsets;
+	std::vector<ANPRJournalIndexEntry> entries;
+	int64_t iMinTimestampUs = INT64_MAX;
+	int64_t iMaxTimestampUs = INT64_MIN;
+
+	void Add(uint32_t uOffset, uint32_t uSensor, int64_t iTimestampUs, int64_t iSeq)
+	{
+		entries.push_back(ANPRJournalIndexEntry{ uSensor, (uint32_t)offsets.size(), iTimestampUs, iSeq });
+		offsets.push_back(uOffset);
+		iMinTimestampUs = std::min(iMinTimestampUs, iTimestampUs);
+		iMaxTimestampUs = std::max(iMaxTimestampUs, iTimestampUs);
+	}
+
+	void Clear()
+	{
+		offsets.clear();
+		entries.clear();
+		iMinTimestampUs = INT64_MAX;
+		iMaxTimestampUs = INT64_MIN;
+	}
+};
+
+struct _anprjournal : CDKObject
+{
+	ANPRJournalConfig config;
+	std::string strDirectory;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::condition_variable writerCondition;
+	std::condition_variable roomCondition;
+	std::condition_variable durableCondition;
+	ANPRJournalBuffer pending;
+	std::vector<ANPRJournalPendingRecord> pendingRecords;
+	uint64_t uAppended = 0;
+	uint64_t uWritten = 0;
+	uint64_t uDurable = 0;
+	/*! records ANPRJournalFlush waits for */
+	uint64_t uSyncTarget = 0;
+	bool bStop = false;
+	bool bFailed = false;
+
+	// writer thread only
+	ANPRJournalBuffer writing;
+	std::vector<ANPRJournalPendingRecord> writingRecords;
+	int iDirectoryFd = -1;
+	int iFd = -1;
+	std::string strSegmentPath;
+	uint32_t uSegmentBytes = 0;
+	uint64_t uNextRecord = 0;
+	ANPRJournalSegmentIndex index;
+
+	std::atomic<uint64_t> uBytes{0};
+	std::atomic<uint64_t> uGroups{0};
+	std::atomic<uint64_t> uSyncs{0};
+	std::atomic<uint32_t> uSegments{0};
+};
+
+struct ANPRJournalSegment
+{
+	uint64_t uFirstRecord = 0;
+	const uint8_t* pData = nullptr;
+	size_t uSize = 0;
+	const uint8_t* pIndex = nullptr;
+	size_t uIndexSize = 0;
+	uint32_t uRecords = 0;
+	const uint32_t* pOffsets = nullptr;
+	const ANPRJournalIndexEntry* pEntries = nullptr;
+	int64_t iMinTimestampUs = INT64_MAX;
+	int64_t iMaxTimestampUs = INT64_MIN;
+	/*! index rebuilt in memory, when the segment has none */
+	ANPRJournalSegmentIndex rebuilt;
+};
+
+struct _anprjournalreader : CDKObject
+{
+	std::vector<ANPRJournalSegment*> segments;
+};
+
+static int64_t ANPRJournalNowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*!
+	Tables of the CRC-32C (Castagnoli), computed 8 bytes at a time
+*/
+struct ANPRJournalCrcTables
+{
+	uint32_t table[8][256];
+
+	ANPRJournalCrcTables()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t u = i;
+			for (int iBit = 0; iBit < 8; iBit++)
+				u = (u >> 1) ^ (0x82F63B78u & (0u - (u & 1u)));
+			table[0][i] = u;
+		}
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			for (int iSlice = 1; iSlice < 8; iSlice++)
+				table[iSlice][i] = (table[iSlice - 1][i] >> 8) ^ table[0][table[iSlice - 1][i] & 0xFF];
+		}
+	}
+};
+
+static const ANPRJournalCrcTables g_crcTables;
+
+static uint32_t ANPRJournalCrc(const uint8_t* pData, size_t uSize)
+{
+	const uint32_t (*t)[256] = g_crcTables.table;
+	uint32_t uCrc = 0xFFFFFFFFu;
+	for (; uSize >= 8; pData += 8, uSize -= 8)
+	{
+		uint32_t uLow;
+		uint32_t uHigh;
+		memcpy(&uLow, pData, 4);
+		memcpy(&uHigh, pData + 4, 4);
+		uLow ^= uCrc;
+		uCrc = t[7][uLow & 0xFF] ^ t[6][(uLow >> 8) & 0xFF] ^ t[5][(uLow >> 16) & 0xFF] ^ t[4][uLow >> 24] ^
+			t[3][uHigh & 0xFF] ^ t[2][(uHigh >> 8) & 0xFF] ^ t[1][(uHigh >> 16) & 0xFF] ^ t[0][uHigh >> 24];
+	}
+	for (; uSize; pData++, uSize--)
+		uCrc = (uCrc >> 8) ^ t[0][(uCrc ^ *pData) & 0xFF];
+	return ~uCrc;
+}
+
+static uint32_t ANPRJournalCheck(const ANPRJournalRecordHeader& header)
+{
+	uint64_t u = 0x9E3779B97F4A7C15ull ^ header.uSize;
+	const uint64_t values[5] = { header.uSensor, (uint64_t)header.iTimestampUs, (uint64_t)header.iSeq, (uint64_t)header.iAppendedUs,
+		header.uPayloadCheck };
+	for (uint64_t uValue : values)
+	{
+		u = (u ^ uValue) * 0xFF51AFD7ED558CCDull;
+		u ^= u >> 32;
+	}
+	return (uint32_t)u;
+}
+
+static uint32_t ANPRJournalRecordLength(uint32_t uSize)
+{
+	return (uint32_t)sizeof(ANPRJournalRecordHeader) + ((uSize + 7u) & ~7u);
+}
+
+static std::string ANPRJournalPath(const std::string& strDirectory, uint64_t uFirstRecord, const char* strExtension)
+{
+	char strName[64];
+	snprintf(strName, sizeof(strName), "/%020" PRIu64 "%s", uFirstRecord, strExtension);
+	return strDirectory + strName;
+}
+
+/*!
+	Lists the first record numbers of the segments of a directory, sorted
+*/
+static int32_t ANPRJournalListSegments(const std::string& strDirectory, std::vector<uint64_t>& segments)
+{
+	DIR* pDir = opendir(strDirectory.c_str());
+	if (!pDir)
+		return CDK_FAIL;
+	while (struct dirent* pEntry = readdir(pDir))
+	{
+		const char* strName = pEntry->d_name;
+		if (strlen(strName) != 24 || strcmp(strName + 20, ".jnl") != 0 || strspn(strName, "0123456789") != 20)
+			continue;
+		segments.push_back(strtoull(strName, nullptr, 10));
+	}
+	closedir(pDir);
+	std::sort(segments.begin(), segments.end());
+	return CDK_OK;
+}
+
+static int32_t ANPRJournalWriteAll(int iFd, const uint8_t* pData, size_t uSize)
+{
+	while (uSize)
+	{
+		ssize_t iWritten = write(iFd, pData, uSize);
+		if (iWritten < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return CDK_FAIL;
+		}
+		pData += iWritten;
+		uSize -= (size_t)iWritten;
+	}
+	return CDK_OK;
+}
+
+/*!
+	Returns the length of the record at uOffset of a mapped segment, or 0 if its header is incomplete or inconsistent.
+	With bPayload, the message is checked against its CRC too
+*/
+static uint32_t ANPRJournalCheckRecord(const uint8_t* pData, size_t uSize, size_t uOffset, bool bPayload)
+{
+	ANPRJournalRecordHeader header;
+	if (uOffset + sizeof(header) > uSize)
+		return 0;
+	memcpy(&header, pData + uOffset, sizeof(header));
+	if (header.uCheck != ANPRJournalCheck(header) || header.uSize > ANPR_JOURNAL_MAX_SEGMENT_SIZE ||
+		ANPRJournalRecordLength(header.uSize) > uSize - uOffset)
+		return 0;
+	if (bPayload && header.uPayloadCheck != ANPRJournalCrc(pData + uOffset + sizeof(header), header.uSize))
+		return 0;
+	return ANPRJournalRecordLength(header.uSize);
+}
+
+/*!
+	Walks the records of a mapped segment, up to the first incomplete or inconsistent one
+*/
+static void ANPRJournalScanSegment(const uint8_t* pData, size_t uSize, ANPRJournalSegmentIndex& index)
+{
+	size_t uOffset = sizeof(ANPRJournalSegmentHeader);
+	while (uint32_t uLength = ANPRJournalCheckRecord(pData, uSize, uOffset, true))
+	{
+		ANPRJournalRecordHeader header;
+		memcpy(&header, pData + uOffset, sizeof(header));
+		index.Add((uint32_t)uOffset, header.uSensor, header.iTimestampUs, header.iSeq);
+		uOffset += uLength;
+	}
+	std::sort(index.entries.begin(), index.entries.end());
+}
+
+/*!
+	Writes the index of a segment. index.entries is sorted
+*/
+static int32_t ANPRJournalWriteIndex(const std::string& strPath, const ANPRJournalSegmentIndex& index)
+{
+	ANPRJournalIndexHeader header = {};
+	memcpy(header.magic, ANPR_JOURNAL_INDEX_MAGIC, sizeof(header.magic));
+	header.uRecords = (uint32_t)index.offsets.size();
+	header.iMinTimestampUs = index.iMinTimestampUs;
+	header.iMaxTimestampUs = index.iMaxTimestampUs;
+	std::string strTemporary = strPath + ".tmp";
+	int iFd = open(strTemporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (iFd < 0)
+		return CDK_FAIL;
+	// the entries are 8 bytes aligned in the file
+	uint32_t uPadding = 0;
+	size_t uOffsetsSize = index.offsets.size() * sizeof(uint32_t);
+	bool bOk = ANPRJournalWriteAll(iFd, (const uint8_t*)&header, sizeof(header)) == CDK_OK &&
+		ANPRJournalWriteAll(iFd, (const uint8_t*)index.offsets.data(), uOffsetsSize) == CDK_OK &&
+		ANPRJournalWriteAll(iFd, (const uint8_t*)&uPadding, uOffsetsSize % 8) == CDK_OK &&
+		ANPRJournalWriteAll(iFd, (const uint8_t*)index.entries.data(), index.entries.size() * sizeof(ANPRJournalIndexEntry)) == CDK_OK &&
+		fdatasync(iFd) == 0;
+	close(iFd);
+	if (!bOk || rename(strTemporary.c_str(), strPath.c_str()) != 0)
+	{
+		unlink(strTemporary.c_str());
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+/*!
+	Maps a whole file in memory
+*/
+static const uint8_t* ANPRJournalMap(const std::string& strPath, size_t* puSize)
+{
+	int iFd = open(strPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (iFd < 0)
+		return nullptr;
+	struct stat st;
+	void* pData = MAP_FAILED;
+	if (fstat(iFd, &st) == 0 && st.st_size > 0)
+		pData = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, iFd, 0);
+	close(iFd);
+	if (pData == MAP_FAILED)
+		return nullptr;
+	*puSize = (size_t)st.st_size;
+	return (const uint8_t*)pData;
+}
+
+//---------------------------------------------------------------------------------------------
+// writer
+//---------------------------------------------------------------------------------------------
+
+/*!
+	Synchronizes and closes the current segment, then writes its index
+*/
+static int32_t ANPRJournalCloseSegment(ANPRJournal* pJournal)
+{
+	if (pJournal->iFd < 0)
+		return CDK_OK;
+	int32_t iResult = CDK_OK;
+	if (fdatasync(pJournal->iFd) != 0)
+	{
+		CDKSetLastError(pJournal, "cannot synchronize %s: %s", pJournal->strSegmentPath.c_str(), strerror(errno));
+		iResult = CDK_FAIL;
+	}
+	else
+		pJournal->uSyncs.fetch_add(1, std::memory_order_relaxed);
+	close(pJournal->iFd);
+	pJournal->iFd = -1;
+	if (iResult == CDK_OK)
+	{
+		std::sort(pJournal->index.entries.begin(), pJournal->index.entries.end());
+		std::string strIndexPath = pJournal->strSegmentPath.substr(0, pJournal->strSegmentPath.size() - 4) + ".idx";
+		// without index, readers rebuild it from the segment
+		if (ANPRJournalWriteIndex(strIndexPath, pJournal->index) == CDK_OK)
+			fsync(pJournal->iDirectoryFd);
+	}
+	pJournal->index.Clear();
+	return iResult;
+}
+
+static int32_t ANPRJournalOpenSegment(ANPRJournal* pJournal)
+{
+	pJournal->strSegmentPath = ANPRJournalPath(pJournal->strDirectory, pJournal->uNextRecord, ".jnl");
+	pJournal->iFd = open(pJournal->strSegmentPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (pJournal->iFd < 0)
+	{
+		CDKSetLastError(pJournal, "cannot create %s: %s", pJournal->strSegmentPath.c_str(), strerror(errno));
+		return CDK_FAIL;
+	}
+	ANPRJournalSegmentHeader header;
+	memcpy(header.magic, ANPR_JOURNAL_SEGMENT_MAGIC, sizeof(header.magic));
+	header.uFirstRecord = pJournal->uNextRecord;
+	if (ANPRJournalWriteAll(pJournal->iFd, (const uint8_t*)&header, sizeof(header)) != CDK_OK || fsync(pJournal->iDirectoryFd) != 0)
+	{
+		CDKSetLastError(pJournal, "cannot write %s: %s", pJournal->strSegmentPath.c_str(), strerror(errno));
+		close(pJournal->iFd);
+		pJournal->iFd = -1;
+		return CDK_FAIL;
+	}
+	pJournal->uSegmentBytes = sizeof(header);
+	pJournal->uBytes.fetch_add(sizeof(header), std::memory_order_relaxed);
+	pJournal->uSegments.fetch_add(1, std::memory_order_relaxed);
+	return CDK_OK;
+}
+
+/*!
+	Writes the group of records of the writing buffer, with one write per segment
+*/
+static int32_t ANPRJournalWriteGroup(ANPRJournal* pJournal)
+{
+	const uint8_t* pData = pJournal->writing.pData.get();
+	size_t uOffset = 0;
+	size_t uRunStart = 0;
+	auto writeRun = [&]() {
+		if (uOffset == uRunStart)
+			return CDK_OK;
+		if (ANPRJournalWriteAll(pJournal->iFd, pData + uRunStart, uOffset - uRunStart) != CDK_OK)
+		{
+			CDKSetLastError(pJournal, "cannot write %s: %s", pJournal->strSegmentPath.c_str(), strerror(errno));
+			return CDK_FAIL;
+		}
+		pJournal->uBytes.fetch_add(uOffset - uRunStart, std::memory_order_relaxed);
+		uRunStart = uOffset;
+		return CDK_OK;
+	};
+	for (const ANPRJournalPendingRecord& record : pJournal->writingRecords)
+	{
+		if (pJournal->iFd < 0 ||
+			(!pJournal->index.offsets.empty() && pJournal->uSegmentBytes + record.uLength > pJournal->config.uSegmentSize))
+		{
+			if (writeRun() != CDK_OK || ANPRJournalCloseSegment(pJournal) != CDK_OK || ANPRJournalOpenSegment(pJournal) != CDK_OK)
+				return CDK_FAIL;
+		}
+		pJournal->index.Add(pJournal->uSegmentBytes, record.uSensor, record.iTimestampUs, record.iSeq);
+		pJournal->uSegmentBytes += record.uLength;
+		pJournal->uNextRecord++;
+		uOffset += record.uLength;
+	}
+	if (writeRun() != CDK_OK)
+		return CDK_FAIL;
+	if (!pJournal->writingRecords.empty())
+		pJournal->uGroups.fetch_add(1, std::memory_order_relaxed);
+	return CDK_OK;
+}
+
+static void ANPRJournalWriterThread(ANPRJournal* pJournal)
+{
+	const uint32_t uPolicy = pJournal->config.uSyncPolicy;
+	const std::chrono::milliseconds interval(pJournal->config.uSyncInterval);
+	auto lastSync = std::chrono::steady_clock::now();
+	// records written and not synchronized yet
+	bool bDirty = false;
+	std::unique_lock<std::mutex> lock(pJournal->mutex);
+	for (;;)
+	{
+		while (pJournal->pending.uSize == 0 && !pJournal->bStop && !(bDirty && pJournal->uSyncTarget > pJournal->uDurable))
+		{
+			if (!bDirty || uPolicy != ANPR_JOURNAL_SYNC_INTERVAL)
+				pJournal->writerCondition.wait(lock);
+			else if (pJournal->writerCondition.wait_until(lock, lastSync + interval) == std::cv_status::timeout)
+				break;
+		}
+		std::swap(pJournal->pending, pJournal->writing);
+		std::swap(pJournal->pendingRecords, pJournal->writingRecords);
+		bool bSyncRequested = pJournal->uSyncTarget > pJournal->uDurable;
+		bool bStop = pJournal->bStop;
+		lock.unlock();
+		pJournal->roomCondition.notify_all();
+
+		int32_t iResult = ANPRJournalWriteGroup(pJournal);
+		size_t uCount = pJournal->writingRecords.size();
+		bDirty = bDirty || uCount != 0;
+		auto now = std::chrono::steady_clock::now();
+		bool bSync = uPolicy == ANPR_JOURNAL_SYNC_GROUP || bSyncRequested || bStop ||
+			(uPolicy == ANPR_JOURNAL_SYNC_INTERVAL && now >= lastSync + interval);
+		if (iResult == CDK_OK && bDirty && bSync)
+		{
+			if (fdatasync(pJournal->iFd) != 0)
+			{
+				CDKSetLastError(pJournal, "cannot synchronize %s: %s", pJournal->strSegmentPath.c_str(), strerror(errno));
+				iResult = CDK_FAIL;
+			}
+			else
+			{
+				pJournal->uSyncs.fetch_add(1, std::memory_order_relaxed);
+				bDirty = false;
+				lastSync = now;
+			}
+		}
+		pJournal->writing.uSize = 0;
+		pJournal->writingRecords.clear();
+
+		lock.lock();
+		pJournal->uWritten += uCount;
+		if (iResult != CDK_OK)
+			pJournal->bFailed = true;
+		else if (!bDirty)
+			pJournal->uDurable = pJournal->uWritten;
+		pJournal->durableCondition.notify_all();
+		pJournal->roomCondition.notify_all();
+		if (pJournal->bFailed || (pJournal->bStop && pJournal->pending.uSize == 0))
+			break;
+	}
+	if (ANPRJournalCloseSegment(pJournal) != CDK_OK)
+		pJournal->bFailed = true;
+	else if (!pJournal->bFailed)
+		pJournal->uDurable = pJournal->uWritten;
+	pJournal->durableCondition.notify_all();
+	pJournal->roomCondition.notify_all();
+}
+
+/*!
+	Finds the number of the next record, after the segments already in the directory
+*/
+static int32_t ANPRJournalRecover(ANPRJournal* pJournal)
+{
+	std::vector<uint64_t> segments;
+	if (ANPRJournalListSegments(pJournal->strDirectory, segments) != CDK_OK)
+	{
+		CDKSetLastError(pJournal, "cannot list %s: %s", pJournal->strDirectory.c_str(), strerror(errno));
+		return CDK_FAIL;
+	}
+	if (segments.empty())
+		return CDK_OK;
+	uint64_t uLast = segments.back();
+	std::string strPath = ANPRJournalPath(pJournal->strDirectory, uLast, ".jnl");
+	std::string strIndexPath = ANPRJournalPath(pJournal->strDirectory, uLast, ".idx");
+	size_t uSize = 0;
+	const uint8_t* pData = ANPRJournalMap(strPath, &uSize);
+	ANPRJournalSegmentIndex index;
+	if (pData && uSize >= sizeof(ANPRJournalSegmentHeader))
+		ANPRJournalScanSegment(pData, uSize, index);
+	if (pData)
+		munmap((void*)pData, uSize);
+	if (index.offsets.empty())
+	{
+		// the new segment takes the name of this empty one
+		unlink(strIndexPath.c_str());
+		unlink(strPath.c_str());
+		pJournal->uNextRecord = uLast;
+		return CDK_OK;
+	}
+	pJournal->uNextRecord = uLast + index.offsets.size();
+	if (access(strIndexPath.c_str(), F_OK) != 0)
+		ANPRJournalWriteIndex(strIndexPath, index);
+	return CDK_OK;
+}
+
+void ANPRJournalDefaultConfig(ANPRJournalConfig* pConfig)
+{
+	pConfig->strDirectory = nullptr;
+	pConfig->uSegmentSize = 256u * 1024u * 1024u;
+	pConfig->uSyncPolicy = ANPR_JOURNAL_SYNC_GROUP;
+	pConfig->uSyncInterval = 100;
+	pConfig->uMaxPendingSize = 64u * 1024u * 1024u;
+}
+
+ANPRJournal* ANPRJournalCreate(const ANPRJournalConfig* pConfig)
+{
+	if (!pConfig || !pConfig->strDirectory || !pConfig->strDirectory[0])
+	{
+		CDKSetLastError(nullptr, "a directory is required");
+		return nullptr;
+	}
+	if (pConfig->uSyncPolicy > ANPR_JOURNAL_SYNC_INTERVAL)
+	{
+		CDKSetLastError(nullptr, "invalid synchronization policy %u", pConfig->uSyncPolicy);
+		return nullptr;
+	}
+	ANPRJournal* pJournal = new (std::nothrow) ANPRJournal();
+	if (!pJournal)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	pJournal->config = *pConfig;
+	pJournal->strDirectory = pConfig->strDirectory;
+	pJournal->config.strDirectory = pJournal->strDirectory.c_str();
+	pJournal->config.uSegmentSize = std::min(std::max(pJournal->config.uSegmentSize, 4096u), ANPR_JOURNAL_MAX_SEGMENT_SIZE);
+	if (mkdir(pConfig->strDirectory, 0755) != 0 && errno != EEXIST)
+	{
+		CDKSetLastError(nullptr, "cannot create %s: %s", pConfig->strDirectory, strerror(errno));
+		delete pJournal;
+		return nullptr;
+	}
+	pJournal->iDirectoryFd = open(pConfig->strDirectory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (pJournal->iDirectoryFd < 0)
+	{
+		CDKSetLastError(nullptr, "cannot open %s: %s", pConfig->strDirectory, strerror(errno));
+		delete pJournal;
+		return nullptr;
+	}
+	if (ANPRJournalRecover(pJournal) != CDK_OK)
+	{
+		CDKSetLastError(nullptr, "%s", CDKGetLastError(pJournal));
+		close(pJournal->iDirectoryFd);
+		delete pJournal;
+		return nullptr;
+	}
+	try
+	{
+		pJournal->thread = std::thread(ANPRJournalWriterThread, pJournal);
+	}
+	catch (const std::exception& e)
+	{
+		CDKSetLastError(nullptr, "cannot start writer: %s", e.what());
+		close(pJournal->iDirectoryFd);
+		delete pJournal;
+		return nullptr;
+	}
+	return pJournal;
+}
+
+void ANPRJournalDestroy(ANPRJournal* pJournal)
+{
+	if (!pJournal)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pJournal->mutex);
+		pJournal->bStop = true;
+	}
+	pJournal->writerCondition.notify_one();
+	pJournal->thread.join();
+	close(pJournal->iDirectoryFd);
+	delete pJournal;
+}
+
+int32_t ANPRJournalAppend(ANPRJournal* pJournal, CDKMsg* pMsg, uint32_t uSensor, int64_t iTimestampUs, int64_t iSeq)
+{
+	if (!pJournal || !pMsg)
+		return CDK_FAIL;
+	uint32_t uSize = CDKMsgGetExportSize(pMsg);
+	uint32_t uLength = ANPRJournalRecordLength(uSize);
+	std::unique_lock<std::mutex> lock(pJournal->mutex);
+	pJournal->roomCondition.wait(lock, [&] {
+		return pJournal->pending.uSize == 0 || pJournal->pending.uSize + uLength <= pJournal->config.uMaxPendingSize ||
+			pJournal->bFailed || pJournal->bStop;
+	});
+	if (pJournal->bFailed || pJournal->bStop)
+	{
+		CDKSetLastError(pJournal, "journal cannot be written: %s", pJournal->bFailed ? "write failure" : "closing");
+		return CDK_FAIL;
+	}
+	uint8_t* pRecord;
+	try
+	{
+		pRecord = pJournal->pending.Append(uLength);
+		pJournal->pendingRecords.reserve(pJournal->pendingRecords.size() + 1);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pJournal, "out of memory");
+		return CDK_FAIL;
+	}
+	ANPRJournalRecordHeader header = {};
+	header.uSize = uSize;
+	header.uSensor = uSensor;
+	// taken under the mutex : append times follow the record order
+	header.iAppendedUs = ANPRJournalNowUs();
+	header.iTimestampUs = iTimestampUs ? iTimestampUs : header.iAppendedUs;
+	header.iSeq = iSeq;
+	if (CDKMsgExportToBinaryArray(pMsg, pRecord + sizeof(header), uSize) < 0)
+	{
+		pJournal->pending.uSize -= uLength;
+		CDKSetLastError(pJournal, "cannot export message: %s", CDKGetLastError(pMsg));
+		return CDK_FAIL;
+	}
+	header.uPayloadCheck = ANPRJournalCrc(pRecord + sizeof(header), uSize);
+	header.uCheck = ANPRJournalCheck(header);
+	memcpy(pRecord, &header, sizeof(header));
+	memset(pRecord + sizeof(header) + uSize, 0, uLength - sizeof(header) - uSize);
+	pJournal->pendingRecords.push_back(ANPRJournalPendingRecord{ uSensor, uLength, header.iTimestampUs, iSeq });
+	pJournal->uAppended++;
+	bool bWake = pJournal->pendingRecords.size() == 1;
+	lock.unlock();
+	// the writer only waits while nothing is pending
+	if (bWake)
+		pJournal->writerCondition.notify_one();
+	return CDK_OK;
+}
+
+int32_t ANPRJournalFlush(ANPRJournal* pJournal)
+{
+	if (!pJournal)
+		return CDK_FAIL;
+	std::unique_lock<std::mutex> lock(pJournal->mutex);
+	uint64_t uTarget = pJournal->uAppended;
+	pJournal->uSyncTarget = std::max(pJournal->uSyncTarget, uTarget);
+	pJournal->writerCondition.notify_one();
+	pJournal->durableCondition.wait(lock, [&] { return pJournal->uDurable >= uTarget || pJournal->bFailed; });
+	if (pJournal->uDurable < uTarget)
+	{
+		CDKSetLastError(pJournal, "journal cannot be written: write failure");
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+int32_t ANPRJournalGetStats(ANPRJournal* pJournal, ANPRJournalStats* pStats)
+{
+	if (!pJournal || !pStats)
+		return CDK_FAIL;
+	{
+		std::lock_guard<std::mutex> lock(pJournal->mutex);
+		pStats->uAppended = pJournal->uAppended;
+		pStats->uWritten = pJournal->uWritten;
+		pStats->uDurable = pJournal->uDurable;
+	}
+	pStats->uBytes = pJournal->uBytes.load(std::memory_order_relaxed);
+	pStats->uGroups = pJournal->uGroups.load(std::memory_order_relaxed);
+	pStats->uSyncs = pJournal->uSyncs.load(std::memory_order_relaxed);
+	pStats->uSegments = pJournal->uSegments.load(std::memory_order_relaxed);
+	return CDK_OK;
+}
+
+//---------------------------------------------------------------------------------------------
+// reader
+//---------------------------------------------------------------------------------------------
+
+/*!
+	Maps the index of a segment, if it has one consistent with the segment
+*/
+static bool ANPRJournalMapIndex(ANPRJournalSegment* pSegment, const std::string& strPath)
+{
+	pSegment->pIndex = ANPRJournalMap(strPath, &pSegment->uIndexSize);
+	if (!pSegment->pIndex)
+		return false;
+	ANPRJournalIndexHeader header;
+	bool bValid = pSegment->uIndexSize >= sizeof(header);
+	if (bValid)
+	{
+		memcpy(&header, pSegment->pIndex, sizeof(header));
+		size_t uOffsetsSize = ((size_t)header.uRecords * sizeof(uint32_t) + 7) & ~(size_t)7;
+		bValid = memcmp(header.magic, ANPR_JOURNAL_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+			pSegment->uIndexSize == sizeof(header) + uOffsetsSize + (size_t)header.uRecords * sizeof(ANPRJournalIndexEntry);
+		if (bValid)
+		{
+			pSegment->uRecords = header.uRecords;
+			pSegment->iMinTimestampUs = header.iMinTimestampUs;
+			pSegment->iMaxTimestampUs = header.iMaxTimestampUs;
+			pSegment->pOffsets = (const uint32_t*)(pSegment->pIndex + sizeof(header));
+			pSegment->pEntries = (const ANPRJournalIndexEntry*)(pSegment->pIndex + sizeof(header) + uOffsetsSize);
+			// every record must be complete and consistent, the readers trust the offsets and the record numbers
+			size_t uEnd = sizeof(ANPRJournalSegmentHeader);
+			for (uint32_t i = 0; bValid && i < header.uRecords; i++)
+			{
+				uint32_t uOffset = pSegment->pOffsets[i];
+				bValid = uOffset >= uEnd && pSegment->pEntries[i].uRecord < header.uRecords;
+				uint32_t uLength = bValid ? ANPRJournalCheckRecord(pSegment->pData, pSegment->uSize, uOffset, false) : 0;
+				bValid = uLength != 0;
+				uEnd = (size_t)uOffset + uLength;
+			}
+		}
+	}
+	if (!bValid)
+	{
+		munmap((void*)pSegment->pIndex, pSegment->uIndexSize);
+		pSegment->pIndex = nullptr;
+		pSegment->uRecords = 0;
+	}
+	return bValid;
+}
+
+static void ANPRJournalSegmentDestroy(ANPRJournalSegment* pSegment)
+{
+	if (pSegment->pData)
+		munmap((void*)pSegment->pData, pSegment->uSize);
+	if (pSegment->pIndex)
+		munmap((void*)pSegment->pIndex, pSegment->uIndexSize);
+	delete pSegment;
+}
+
+/*!
+	Returns the segment holding a record, or NULL
+*/
+static const ANPRJournalSegment* ANPRJournalFindSegment(ANPRJournalReader* pReader, uint64_t uRecord)
+{
+	auto it = std::upper_bound(pReader->segments.begin(), pReader->segments.end(), uRecord,
+		[](uint64_t u, const ANPRJournalSegment* pSegment) { return u < pSegment->uFirstRecord; });
+	if (it == pReader->segments.begin())
+		return nullptr;
+	const ANPRJournalSegment* pSegment = *(it - 1);
+	return uRecord - pSegment->uFirstRecord < pSegment->uRecords ? pSegment : nullptr;
+}
+
+static void ANPRJournalReadRecord(const ANPRJournalSegment* pSegment, uint32_t uIndex, ANPRJournalRecord* pRecord)
+{
+	ANPRJournalRecordHeader header;
+	const uint8_t* pData = pSegment->pData + pSegment->pOffsets[uIndex];
+	memcpy(&header, pData, sizeof(header));
+	pRecord->uRecord = pSegment->uFirstRecord + uIndex;
+	pRecord->uSensor = header.uSensor;
+	pRecord->iTimestampUs = header.iTimestampUs;
+	pRecord->iSeq = header.iSeq;
+	pRecord->iAppendedUs = header.iAppendedUs;
+	pRecord->pData = pData + sizeof(header);
+	pRecord->uSize = header.uSize;
+}
+
+ANPRJournalReader* ANPRJournalReaderCreate(const char* strDirectory)
+{
+	if (!strDirectory)
+	{
+		CDKSetLastError(nullptr, "a directory is required");
+		return nullptr;
+	}
+	std::vector<uint64_t> segments;
+	if (ANPRJournalListSegments(strDirectory, segments) != CDK_OK)
+	{
+		CDKSetLastError(nullptr, "cannot list %s: %s", strDirectory, strerror(errno));
+		return nullptr;
+	}
+	ANPRJournalReader* pReader = new (std::nothrow) ANPRJournalReader();
+	if (!pReader)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	for (uint64_t uFirstRecord : segments)
+	{
+		ANPRJournalSegment* pSegment = new (std::nothrow) ANPRJournalSegment();
+		if (!pSegment)
+			break;
+		pSegment->uFirstRecord = uFirstRecord;
+		pSegment->pData = ANPRJournalMap(ANPRJournalPath(strDirectory, uFirstRecord, ".jnl"), &pSegment->uSize);
+		ANPRJournalSegmentHeader header;
+		if (pSegment->pData && pSegment->uSize >= sizeof(header))
+			memcpy(&header, pSegment->pData, sizeof(header));
+		if (!pSegment->pData || pSegment->uSize < sizeof(header) ||
+			memcmp(header.magic, ANPR_JOURNAL_SEGMENT_MAGIC, sizeof(header.magic)) != 0 || header.uFirstRecord != uFirstRecord)
+		{
+			// a segment being created, or not a segment
+			ANPRJournalSegmentDestroy(pSegment);
+			continue;
+		}
+		if (!ANPRJournalMapIndex(pSegment, ANPRJournalPath(strDirectory, uFirstRecord, ".idx")))
+		{
+			ANPRJournalSegmentIndex& index = pSegment->rebuilt;
+			ANPRJournalScanSegment(pSegment->pData, pSegment->uSize, index);
+			pSegment->uRecords = (uint32_t)index.offsets.size();
+			pSegment->iMinTimestampUs = index.iMinTimestampUs;
+			pSegment->iMaxTimestampUs = index.iMaxTimestampUs;
+			pSegment->pOffsets = index.offsets.data();
+			pSegment->pEntries = index.entries.data();
+		}
+		pReader->segments.push_back(pSegment);
+	}
+	return pReader;
+}
+
+void ANPRJournalReaderDestroy(ANPRJournalReader* pReader)
+{
+	if (!pReader)
+		return;
+	for (ANPRJournalSegment* pSegment : pReader->segments)
+		ANPRJournalSegmentDestroy(pSegment);
+	delete pReader;
+}
+
+uint64_t ANPRJournalReaderGetRecordCount(ANPRJournalReader* pReader)
+{
+	if (!pReader || pReader->segments.empty())
+		return 0;
+	const ANPRJournalSegment* pLast = pReader->segments.back();
+	return pLast->uFirstRecord + pLast->uRecords;
+}
+
+int32_t ANPRJournalReaderGetRecord(ANPRJournalReader* pReader, uint64_t uRecord, ANPRJournalRecord* pRecord)
+{
+	if (!pReader || !pRecord)
+		return CDK_FAIL;
+	const ANPRJournalSegment* pSegment = ANPRJournalFindSegment(pReader, uRecord);
+	if (!pSegment)
+	{
+		CDKSetLastError(pReader, "no record %" PRIu64, uRecord);
+		return CDK_FAIL;
+	}
+	ANPRJournalReadRecord(pSegment, (uint32_t)(uRecord - pSegment->uFirstRecord), pRecord);
+	return CDK_OK;
+}
+
+int32_t ANPRJournalReaderImport(ANPRJournalReader* pReader, uint64_t uRecord, CDKMsg* pMsg)
+{
+	ANPRJournalRecord record;
+	if (!pMsg || ANPRJournalReaderGetRecord(pReader, uRecord, &record) != CDK_OK)
+		return CDK_FAIL;
+	if (CDKMsgClear(pMsg) != CDK_OK || CDKMsgImportFromBinaryArray(pMsg, record.pData, record.uSize) != CDK_OK)
+	{
+		CDKSetLastError(pReader, "cannot import record %" PRIu64 ": %s", uRecord, CDKGetLastError(pMsg));
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+uint64_t ANPRJournalReaderSeekAppended(ANPRJournalReader* pReader, int64_t iAppendedUs)
+{
+	uint64_t uLow = 0;
+	uint64_t uHigh = ANPRJournalReaderGetRecordCount(pReader);
+	while (uLow < uHigh)
+	{
+		uint64_t uMiddle = uLow + (uHigh - uLow) / 2;
+		ANPRJournalRecord record;
+		// records missing between two segments compare as appended before
+		if (ANPRJournalReaderGetRecord(pReader, uMiddle, &record) != CDK_OK || record.iAppendedUs < iAppendedUs)
+			uLow = uMiddle + 1;
+		else
+			uHigh = uMiddle;
+	}
+	return uLow;
+}
+
+uint64_t ANPRJournalReaderScan(ANPRJournalReader* pReader, uint32_t uSensor, int64_t iFromUs, int64_t iToUs,
+	PANPRJOURNALSCANCALLBACK scanCallback, void* pUser)
+{
+	if (!pReader || !scanCallback)
+		return 0;
+	uint64_t uFound = 0;
+	for (const ANPRJournalSegment* pSegment : pReader->segments)
+	{
+		if (pSegment->uRecords == 0 || pSegment->iMaxTimestampUs < iFromUs || pSegment->iMinTimestampUs > iToUs)
+			continue;
+		const ANPRJournalIndexEntry* pBegin = pSegment->pEntries;
+		const ANPRJournalIndexEntry* pEnd = pBegin + pSegment->uRecords;
+		const ANPRJournalIndexEntry* pEntry = pBegin;
+		while (pEntry != pEnd)
+		{
+			uint32_t uRunSensor = uSensor == ANPR_JOURNAL_ANY_SENSOR ? pEntry->uSensor : uSensor;
+			pEntry = std::lower_bound(pEntry, pEnd, ANPRJournalIndexEntry{ uRunSensor, 0, iFromUs, INT64_MIN });
+			for (; pEntry != pEnd && pEntry->uSensor == uRunSensor && pEntry->iTimestampUs <= iToUs; pEntry++)
+			{
+				ANPRJournalRecord record;
+				ANPRJournalReadRecord(pSegment, pEntry->uRecord, &record);
+				uFound++;
+				if (!scanCallback(&record, pUser))
+					return uFound;
+			}
+			if (uSensor != ANPR_JOURNAL_ANY_SENSOR || uRunSensor == UINT32_MAX)
+				break;
+			// next sensor of the segment
+			pEntry = std::lower_bound(pEntry, pEnd, ANPRJournalIndexEntry{ uRunSensor + 1, 0, INT64_MIN, INT64_MIN });
+		}
+	}
+	return uFound;
+}
@@ -0,0 +1,214 @@
+/*! \file
+
+ANPRJournal : append-only journal of the messages received from the sensors.<br/>
+Messages are exported (<a href="#CDKMsgExportToBinaryArray">CDKMsgExportToBinaryArray</a>) by the appending threads and written by a
+single writer thread, that writes everything appended meanwhile at once and synchronizes it to disk according to the
+<a href="#ANPRJournalConfig">synchronization policy</a> (group commit).<br/>
+The journal is a directory of segment files. When a segment is full, it is synchronized, closed, and an index of its records
+sorted by sensor, timestamp and sequence number is written next to it.<br/>
+Readers map the segments in memory : records are imported in place with <a href="#CDKMsgImportFromBinaryArray">CDKMsgImportFromBinaryArray</a>,
+and found by sensor and time with a binary search in the index of each segment.
+
+*/
+
+#ifndef ANPRJOURNAL_H
+#define ANPRJOURNAL_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*!
+	Synchronization policies of a journal
+*/
+/*! the records are synchronized when a segment is closed and by <a href="#ANPRJournalFlush">ANPRJournalFlush</a> only */
+#define ANPR_JOURNAL_SYNC_NONE		0
+/*! every group of records written at once is synchronized before the next group is written */
+#define ANPR_JOURNAL_SYNC_GROUP		1
+/*! the records are synchronized at most every ANPRJournalConfig::uSyncInterval ms */
+#define ANPR_JOURNAL_SYNC_INTERVAL	2
+
+/*!
+	Sensor value matching every sensor in <a href="#ANPRJournalReaderScan">ANPRJournalReaderScan</a>
+*/
+#define ANPR_JOURNAL_ANY_SENSOR 0xFFFFFFFFu
+
+/*! <summary>struct</summary>
+	A journal opened for writing
+*/
+typedef struct _anprjournal ANPRJournal;
+
+/*! <summary>struct</summary>
+	A journal opened for reading
+*/
+typedef struct _anprjournalreader ANPRJournalReader;
+
+/*! <summary>struct</summary>
+	Configuration of a journal
+*/
+typedef struct
+{
+	/*! directory of the segments, created if needed */
+	const char* strDirectory;
+	/*! size after which a segment is closed and a new one is started, in bytes */
+	uint32_t uSegmentSize;
+	/*! ANPR_JOURNAL_SYNC_NONE, ANPR_JOURNAL_SYNC_GROUP or ANPR_JOURNAL_SYNC_INTERVAL */
+	uint32_t uSyncPolicy;
+	/*! with ANPR_JOURNAL_SYNC_INTERVAL, maximum time between two synchronizations, in ms */
+	uint32_t uSyncInterval;
+	/*! appended bytes not yet written after which <a href="#ANPRJournalAppend">ANPRJournalAppend</a> waits for the writer */
+	uint32_t uMaxPendingSize;
+} ANPRJournalConfig;
+
+/*! <summary>struct</summary>
+	Counters of a journal
+*/
+typedef struct
+{
+	/*! records appended */
+	uint64_t uAppended;
+	/*! records written to the segments */
+	uint64_t uWritten;
+	/*! records synchronized to disk */
+	uint64_t uDurable;
+	/*! bytes written to the segments */
+	uint64_t uBytes;
+	/*! writes of a group of records */
+	uint64_t uGroups;
+	/*! synchronizations to disk */
+	uint64_t uSyncs;
+	/*! segments started by this journal */
+	uint32_t uSegments;
+} ANPRJournalStats;
+
+/*! <summary>struct</summary>
+	A record of a journal. pData points into the mapped segment : it is valid until the reader is destroyed
+*/
+typedef struct
+{
+	/*! number of the record in the journal, from 0 */
+	uint64_t uRecord;
+	uint32_t uSensor;
+	int64_t iTimestampUs;
+	int64_t iSeq;
+	/*! time the record was appended, in us since the epoch */
+	int64_t iAppendedUs;
+	/*! the exported message */
+	const uint8_t* pData;
+	uint32_t uSize;
+} ANPRJournalRecord;
+
+/*! <summary>callback</summary>
+
+	Callback called by <a href="#ANPRJournalReaderScan">ANPRJournalReaderScan</a> for every record found
+	@param[in] pRecord the record
+	@param[in] pUser User data
+	@returns 1 to continue the scan, 0 to stop it
+*/
+typedef int32_t (*PANPRJOURNALSCANCALLBACK)(const ANPRJournalRecord* pRecord, void* pUser);
+
+/*!
+	Fills a configuration with default values : no directory, segments of 256 MB, every group of records synchronized, up to 64 MB appended ahead of the writer
+*/
+void ANPRJournalDefaultConfig(ANPRJournalConfig* pConfig);
+
+/*!
+	Opens a journal for writing and starts its writer thread. The records are appended after the records already in the directory, in a new segment.<br/>
+	Use <a href="#ANPRJournalDestroy">ANPRJournalDestroy</a> to close it.
+	@param[in] pConfig configuration, with a directory
+	@returns the journal, or NULL on failure
+*/
+ANPRJournal* ANPRJournalCreate(const ANPRJournalConfig* pConfig);
+
+/*!
+	Writes and synchronizes the records appended so far, closes the current segment and destroys the journal
+*/
+void ANPRJournalDestroy(ANPRJournal* pJournal);
+
+/*!
+	Appends a message to the journal. The message is exported before the function returns : it stays owned by the caller,
+	and may be read-only. Can be called from several threads.<br/>
+	Waits if more than ANPRJournalConfig::uMaxPendingSize bytes are waiting for the writer : the journal never drops a record.
+	@param[in] pJournal the journal
+	@param[in] pMsg the message
+	@param[in] uSensor sensor of the message
+	@param[in] iTimestampUs timestamp of the message in us, or 0 for the time of the append
+	@param[in] iSeq sequence number of the message
+	@returns CDK_OK on success, CDK_FAIL if the message cannot be exported or if the journal cannot be written any more
+*/
+int32_t ANPRJournalAppend(ANPRJournal* pJournal, CDKMsg* pMsg, uint32_t uSensor, int64_t iTimestampUs, int64_t iSeq);
+
+/*!
+	Waits until every record appended before the call is written and synchronized to disk, whatever the synchronization policy
+	@returns CDK_OK on success, CDK_FAIL if the journal cannot be written any more
+*/
+int32_t ANPRJournalFlush(ANPRJournal* pJournal);
+
+/*!
+	Returns the counters of a journal
+*/
+int32_t ANPRJournalGetStats(ANPRJournal* pJournal, ANPRJournalStats* pStats);
+
+/*!
+	Opens the journal of a directory for reading. The segments are mapped in memory, the records appended later are not seen.<br/>
+	The index of a segment that has not been closed (the segment being written, or the last one after a crash) is rebuilt in memory,
+	and a partially written or corrupt last record is ignored.<br/>
+	Use <a href="#ANPRJournalReaderDestroy">ANPRJournalReaderDestroy</a> to close it.
+	@returns the reader, or NULL on failure
+*/
+ANPRJournalReader* ANPRJournalReaderCreate(const char* strDirectory);
+
+/*!
+	Unmaps the segments and destroys the reader
+*/
+void ANPRJournalReaderDestroy(ANPRJournalReader* pReader);
+
+/*!
+	Returns the number of records of the journal
+*/
+uint64_t ANPRJournalReaderGetRecordCount(ANPRJournalReader* pReader);
+
+/*!
+	Reads a record, by number
+	@returns CDK_OK on success, CDK_FAIL if there is no such record
+*/
+int32_t ANPRJournalReaderGetRecord(ANPRJournalReader* pReader, uint64_t uRecord, ANPRJournalRecord* pRecord);
+
+/*!
+	Imports a record in a message, from the mapped segment
+	@param[in] pReader the reader
+	@param[in] uRecord number of the record
+	@param[in] pMsg the message, cleared first
+	@returns CDK_OK on success
+*/
+int32_t ANPRJournalReaderImport(ANPRJournalReader* pReader, uint64_t uRecord, CDKMsg* pMsg);
+
+/*!
+	Returns the number of the first record appended at or after a time, in O(log n). Records are in append order.
+	@returns the record number, or the record count if every record was appended before
+*/
+uint64_t ANPRJournalReaderSeekAppended(ANPRJournalReader* pReader, int64_t iAppendedUs);
+
+/*!
+	Calls a callback for the records of a sensor with iFromUs <= timestamp <= iToUs, using the segment indexes.<br/>
+	Segments are visited in append order. Within a segment, the records are sorted by sensor, then by timestamp and sequence number.
+	@param[in] pReader the reader
+	@param[in] uSensor the sensor, or ANPR_JOURNAL_ANY_SENSOR
+	@param[in] iFromUs first timestamp
+	@param[in] iToUs last timestamp
+	@param[in] scanCallback callback called for every record
+	@param[in] pUser callback user data
+	@returns the number of records found
+*/
+uint64_t ANPRJournalReaderScan(ANPRJournalReader* pReader, uint32_t uSensor, int64_t iFromUs, int64_t iToUs,
+	PANPRJOURNALSCANCALLBACK scanCallback, void* pUser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRJOURNAL_H
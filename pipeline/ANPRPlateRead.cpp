@@ -0,0 +1,395 @@
+/*! \file
+
+ANPRPlateRead : flat extraction of plate reads.
+
+The paths of a schema are compiled into a tree mirroring the message : every node holds the name of an
+element, the keys read from its attributes and the field read from its content. An extraction walks the
+children of the message elements that have a node only, compares every attribute key with the few keys of
+its node, and stops as soon as every field of the node has been found.
+
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <charconv>
+#include <new>
+#include <string_view>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRPlateRead.h"
+
+enum ANPRPlateReadFieldType
+{
+	ANPR_FIELD_STRING,
+	ANPR_FIELD_U32,
+	ANPR_FIELD_I64,
+	ANPR_FIELD_BINARY
+};
+
+static const ANPRPlateReadFieldType g_fieldTypes[ANPR_PLATE_READ_FIELDS] = {
+	ANPR_FIELD_STRING,	// plate
+	ANPR_FIELD_U32,		// reliability
+	ANPR_FIELD_U32,		// lane
+	ANPR_FIELD_U32,		// sensor
+	ANPR_FIELD_I64,		// seq
+	ANPR_FIELD_I64,		// date
+	ANPR_FIELD_I64,		// timestamp
+	ANPR_FIELD_BINARY,	// fingerprint
+	ANPR_FIELD_BINARY,	// signature
+	ANPR_FIELD_BINARY	// jpeg
+};
+
+static const char* g_defaultPaths[ANPR_PLATE_READ_FIELDS] = {
+	"decision@plate",
+	"decision@reliability",
+	"decision@lane",
+	"@sensor",
+	"@seq",
+	"decision@date",
+	"decision@timestampUs",
+	"fingerprint",
+	"signature",
+	"jpeg"
+};
+
+/*!
+	A name or attribute key of a schema, compared to the message by length first, then as written in the path
+	(the usual case), then case insensitively
+*/
+struct ANPRSchemaName
+{
+	std::string strName;
+	std::string strLower;
+};
+
+struct ANPRSchemaKey
+{
+	ANPRSchemaName key;
+	uint32_t uField;
+};
+
+struct ANPRSchemaNode
+{
+	ANPRSchemaName name;
+	std::vector<ANPRSchemaKey> keys;
+	int32_t iContentField = -1;
+	std::vector<ANPRSchemaNode> children;
+	/*! fields of the node and of its descendants : the walk stops once they are all found */
+	uint32_t uFields = 0;
+};
+
+struct _anprplatereadschema : CDKObject
+{
+	std::string paths[ANPR_PLATE_READ_FIELDS];
+	bool bPathSet[ANPR_PLATE_READ_FIELDS] = {};
+	/*! node of the root element, whatever its name */
+	ANPRSchemaNode root;
+};
+
+static ANPRSchemaName ANPRPlateReadName(const char* str, size_t uLength)
+{
+	ANPRSchemaName name;
+	name.strName.assign(str, uLength);
+	name.strLower = name.strName;
+	for (char& c : name.strLower)
+		c = (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+	return name;
+}
+
+static bool ANPRPlateReadEquals(const ANPRSchemaName& name, std::string_view str)
+{
+	size_t uLength = name.strName.size();
+	if (str.size() != uLength)
+		return false;
+	if (memcmp(str.data(), name.strName.data(), uLength) == 0)
+		return true;
+	const std::string& strLower = name.strLower;
+	for (size_t i = 0; i < uLength; i++)
+	{
+		char c = str[i];
+		if (c >= 'A' && c <= 'Z')
+			c = (char)(c + ('a' - 'A'));
+		if (c != strLower[i])
+			return false;
+	}
+	return true;
+}
+
+/*!
+	Adds a field to the tree. The path has been validated
+*/
+static void ANPRPlateReadCompilePath(ANPRSchemaNode& root, uint32_t uField, const std::string& strPath)
+{
+	ANPRSchemaNode* pNode = &root;
+	root.uFields |= 1u << uField;
+	size_t uAt = strPath.find('@');
+	std::string strElements = strPath.substr(0, uAt);
+	size_t uStart = 0;
+	while (uStart < strElements.size())
+	{
+		size_t uEnd = strElements.find('/', uStart);
+		if (uEnd == std::string::npos)
+			uEnd = strElements.size();
+		ANPRSchemaName name = ANPRPlateReadName(strElements.c_str() + uStart, uEnd - uStart);
+		ANPRSchemaNode* pChild = nullptr;
+		for (ANPRSchemaNode& child : pNode->children)
+		{
+			if (child.name.strLower == name.strLower)
+				pChild = &child;
+		}
+		if (!pChild)
+		{
+			pNode->children.emplace_back();
+			pChild = &pNode->children.back();
+			pChild->name = name;
+		}
+		pNode = pChild;
+		pNode->uFields |= 1u << uField;
+		uStart = uEnd + 1;
+	}
+	if (uAt != std::string::npos)
+		pNode->keys.push_back(ANPRSchemaKey{ ANPRPlateReadName(strPath.c_str() + uAt + 1, strPath.size() - uAt - 1), uField });
+	else
+		pNode->iContentField = (int32_t)uField;
+}
+
+static void ANPRPlateReadCompile(ANPRPlateReadSchema* pSchema)
+{
+	pSchema->root = ANPRSchemaNode();
+	for (uint32_t i = 0; i < ANPR_PLATE_READ_FIELDS; i++)
+	{
+		if (pSchema->bPathSet[i])
+			ANPRPlateReadCompilePath(pSchema->root, i, pSchema->paths[i]);
+	}
+}
+
+static bool ANPRPlateReadValidPath(uint32_t uField, const std::string& strPath)
+{
+	size_t uAt = strPath.find('@');
+	if ((uAt != std::string::npos) == (g_fieldTypes[uField] == ANPR_FIELD_BINARY))
+		return false;
+	if (uAt != std::string::npos && (uAt + 1 == strPath.size() || strPath.find_first_of("@/", uAt + 1) != std::string::npos))
+		return false;
+	std::string strElements = strPath.substr(0, uAt);
+	if (strElements.empty())
+		return uAt != std::string::npos;
+	// no empty element name
+	return strElements.front() != '/' && strElements.back() != '/' && strElements.find("//") == std::string::npos;
+}
+
+template <typename T>
+static bool ANPRPlateReadParse(std::string_view strValue, T& value)
+{
+	const char* pBegin = strValue.data();
+	const char* pEnd = pBegin + strValue.size();
+	if (pBegin != pEnd && *pBegin == '+')
+		pBegin++;
+	return std::from_chars(pBegin, pEnd, value).ec == std::errc();
+}
+
+static void ANPRPlateReadSetAttribute(ANPRPlateRead* pRead, uint32_t uField, std::string_view strValue)
+{
+	bool bOk = false;
+	switch (uField)
+	{
+	case ANPR_PLATE_READ_PLATE:
+	{
+		size_t uLength = std::min(strValue.size(), (size_t)ANPR_PLATE_READ_MAX_PLATE - 1);
+		memcpy(pRead->strPlate, strValue.data(), uLength);
+		pRead->strPlate[uLength] = 0;
+		bOk = true;
+		break;
+	}
+	case ANPR_PLATE_READ_RELIABILITY: bOk = ANPRPlateReadParse(strValue, pRead->uReliability); break;
+	case ANPR_PLATE_READ_LANE: bOk = ANPRPlateReadParse(strValue, pRead->uLane); break;
+	case ANPR_PLATE_READ_SENSOR: bOk = ANPRPlateReadParse(strValue, pRead->uSensor); break;
+	case ANPR_PLATE_READ_SEQ: bOk = ANPRPlateReadParse(strValue, pRead->iSeq); break;
+	case ANPR_PLATE_READ_DATE: bOk = ANPRPlateReadParse(strValue, pRead->iDate); break;
+	case ANPR_PLATE_READ_TIMESTAMP: bOk = ANPRPlateReadParse(strValue, pRead->iTimestampUs); break;
+	}
+	if (bOk)
+		pRead->uFields |= 1u << uField;
+}
+
+static void ANPRPlateReadSetContent(ANPRPlateRead* pRead, uint32_t uField, CDKMsgElement* pElement)
+{
+	const uint8_t* pContent = CDKMsgElementContent(pElement);
+	uint32_t uSize = pContent ? CDKMsgElementContentSize(pElement) : 0;
+	switch (uField)
+	{
+	case ANPR_PLATE_READ_FINGERPRINT: pRead->pFingerprint = pContent; pRead->uFingerprintSize = uSize; break;
+	case ANPR_PLATE_READ_SIGNATURE: pRead->pSignature = pContent; pRead->uSignatureSize = uSize; break;
+	case ANPR_PLATE_READ_JPEG: pRead->pJpeg = pContent; pRead->uJpegSize = uSize; break;
+	}
+	pRead->uFields |= 1u << uField;
+}
+
+static void ANPRPlateReadWalk(const ANPRSchemaNode& node, CDKMsgElement* pElement, ANPRPlateRead* pRead)
+{
+	// like CDKMsgElementFirstChild and CDKMsgElementAttributeValue, the first match wins
+	uint32_t uAttributes = node.keys.empty() ? 0 : CDKMsgElementAttributeCount(pElement);
+	for (uint32_t i = 0; i < uAttributes; i++)
+	{
+		if ((pRead->uFields & node.uFields) == node.uFields)
+			return;
+		std::string_view strKey = CDKMsgElementAttributeName(pElement, i);
+		for (const ANPRSchemaKey& key : node.keys)
+		{
+			if (!(pRead->uFields & (1u << key.uField)) && ANPRPlateReadEquals(key.key, strKey))
+				ANPRPlateReadSetAttribute(pRead, key.uField, CDKMsgElementAttributeValueAt(pElement, i));
+		}
+	}
+	if (node.iContentField >= 0 && !(pRead->uFields & (1u << node.iContentField)))
+		ANPRPlateReadSetContent(pRead, (uint32_t)node.iContentField, pElement);
+	if (node.children.empty())
+		return;
+	for (CDKMsgElement* pChild = CDKMsgElementFirstChild(pElement, nullptr); pChild; pChild = CDKMsgElementNextChild(pElement, pChild, nullptr))
+	{
+		if ((pRead->uFields & node.uFields) == node.uFields)
+			return;
+		for (const ANPRSchemaNode& child : node.children)
+		{
+			if (ANPRPlateReadEquals(child.name, CDKMsgElementName(pChild)))
+			{
+				ANPRPlateReadWalk(child, pChild, pRead);
+				break;
+			}
+		}
+	}
+}
+
+ANPRPlateReadSchema* ANPRPlateReadSchemaCreate()
+{
+	ANPRPlateReadSchema* pSchema = new (std::nothrow) ANPRPlateReadSchema();
+	if (!pSchema)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	for (uint32_t i = 0; i < ANPR_PLATE_READ_FIELDS; i++)
+	{
+		pSchema->paths[i] = g_defaultPaths[i];
+		pSchema->bPathSet[i] = true;
+	}
+	ANPRPlateReadCompile(pSchema);
+	return pSchema;
+}
+
+void ANPRPlateReadSchemaDestroy(ANPRPlateReadSchema* pSchema)
+{
+	delete pSchema;
+}
+
+int32_t ANPRPlateReadSchemaSetPath(ANPRPlateReadSchema* pSchema, uint32_t uField, const char* strPath)
+{
+	if (!pSchema)
+		return CDK_FAIL;
+	if (uField >= ANPR_PLATE_READ_FIELDS)
+	{
+		CDKSetLastError(pSchema, "invalid field %u", uField);
+		return CDK_FAIL;
+	}
+	if (strPath && !ANPRPlateReadValidPath(uField, strPath))
+	{
+		CDKSetLastError(pSchema, "invalid path '%s' for field %u", strPath, uField);
+		return CDK_FAIL;
+	}
+	pSchema->bPathSet[uField] = strPath != nullptr;
+	pSchema->paths[uField] = strPath ? strPath : "";
+	ANPRPlateReadCompile(pSchema);
+	return CDK_OK;
+}
+
+uint32_t ANPRPlateReadExtract(const ANPRPlateReadSchema* pSchema, CDKMsg* pMsg, ANPRPlateRead* pRead)
+{
+	if (!pRead)
+		return 0;
+	memset(pRead, 0, sizeof(*pRead));
+	CDKMsgElement* pRoot = CDKMsgChild(pMsg);
+	if (!pSchema || !pRoot)
+		return 0;
+	ANPRPlateReadWalk(pSchema->root, pRoot, pRead);
+	return (uint32_t)__builtin_popcount(pRead->uFields);
+}
+
+uint32_t ANPRPlateReadNormalize(const char* strPlate, char* strText)
+{
+	uint32_t uLength = 0;
+	for (const char* p = strPlate; *p && uLength < ANPR_PLATE_READ_MAX_PLATE - 1; p++)
+	{
+		char c = *p;
+		if (c >= 'a' && c <= 'z')
+			c = (char)(c - 'a' + 'A');
+		else if (!(c >= 'A' && c <= 'Z') && !(c >= '0' && c <= '9'))
+			continue;
+		switch (c)
+		{
+		case 'O': case 'D': case 'Q': c = '0'; break;
+		case 'I': c = '1'; break;
+		case 'Z': c = '2'; break;
+		case 'S': c = '5'; break;
+		case 'G': c = '6'; break;
+		case 'B': c = '8'; break;
+		default: break;
+		}
+		strText[uLength++] = c;
+	}
+	strText[uLength] = 0;
+	return uLength;
+}
+
+/*!
+	FNV-1a hash of a text, skipping the character at uSkip
+*/
+static uint64_t ANPRPlateReadHash(const char* strText, size_t uLength, size_t uSkip)
+{
+	uint64_t uHash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < uLength; i++)
+	{
+		if (i == uSkip)
+			continue;
+		uHash ^= (uint8_t)strText[i];
+		uHash *= 0x100000001b3ull;
+	}
+	return uHash ? uHash : 1;
+}
+
+uint32_t ANPRPlateReadTextKeys(const char* strText, uint32_t uMaxDistance, uint64_t* pKeys, uint32_t uMaxKeys)
+{
+	size_t uLength = strlen(strText);
+	uint32_t uKeys = 0;
+	pKeys[uKeys++] = ANPRPlateReadHash(strText, uLength, SIZE_MAX);
+	if (uMaxDistance == 0)
+		return uKeys;
+	for (size_t i = 0; i < uLength && uKeys < uMaxKeys; i++)
+	{
+		// deleting any character of a run gives the same text
+		if (i > 0 && strText[i] == strText[i - 1])
+			continue;
+		pKeys[uKeys++] = ANPRPlateReadHash(strText, uLength, i);
+	}
+	return uKeys;
+}
+
+uint32_t ANPRPlateReadTextDistance(const char* strText1, const char* strText2)
+{
+	size_t uLength1 = strlen(strText1);
+	size_t uLength2 = strlen(strText2);
+	if (uLength1 < uLength2)
+	{
+		std::swap(strText1, strText2);
+		std::swap(uLength1, uLength2);
+	}
+	if (uLength1 - uLength2 > 1)
+		return 2;
+	size_t i = 0;
+	while (i < uLength2 && strText1[i] == strText2[i])
+		i++;
+	if (i == uLength2)
+		return uLength1 == uLength2 ? 0 : 1;
+	// substitution, or deletion from the longer text
+	if (uLength1 == uLength2)
+		return strcmp(strText1 + i + 1, strText2 + i + 1) == 0 ? 1 : 2;
+	return strcmp(strText1 + i + 1, strText2 + i) == 0 ? 1 : 2;
+}
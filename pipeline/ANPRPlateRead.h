@@ -0,0 +1,136 @@
+/*! \file
+
+ANPRPlateRead : flat extraction of plate reads.<br/>
+A schema maps every field of <a href="#ANPRPlateRead">ANPRPlateRead</a> to a place in the message. The paths are compiled once
+into a tree of lower case element names and attribute keys, so that a message is walked in a single pass, without
+<a href="#CDKMsgElementAttributeValue">CDKMsgElementAttributeValue</a> lookups, and numbers are parsed without allocation.
+
+*/
+
+#ifndef ANPRPLATEREAD_H
+#define ANPRPLATEREAD_H
+
+#include <stdint.h>
+
+#include "CDKMsg.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*!
+	Size of ANPRPlateRead::strPlate, including the terminating NULL. Longer plates are truncated
+*/
+#define ANPR_PLATE_READ_MAX_PLATE 32
+
+/*!
+	Fields of a plate read, used as indices in a schema and as bits of ANPRPlateRead::uFields
+*/
+#define ANPR_PLATE_READ_PLATE		0
+#define ANPR_PLATE_READ_RELIABILITY	1
+#define ANPR_PLATE_READ_LANE		2
+#define ANPR_PLATE_READ_SENSOR		3
+#define ANPR_PLATE_READ_SEQ			4
+#define ANPR_PLATE_READ_DATE		5
+#define ANPR_PLATE_READ_TIMESTAMP	6
+#define ANPR_PLATE_READ_FINGERPRINT	7
+#define ANPR_PLATE_READ_SIGNATURE	8
+#define ANPR_PLATE_READ_JPEG		9
+#define ANPR_PLATE_READ_FIELDS		10
+
+/*! <summary>struct</summary>
+	A plate read. Binary fields point into the message : they are valid as long as the message is not modified or destroyed
+*/
+typedef struct
+{
+	/*! bit (1 << field) is set for every field found in the message */
+	uint32_t uFields;
+	uint32_t uReliability;
+	uint32_t uLane;
+	uint32_t uSensor;
+	int64_t iSeq;
+	/*! date of the read, in ms */
+	int64_t iDate;
+	/*! timestamp of the read, in us */
+	int64_t iTimestampUs;
+	const uint8_t* pFingerprint;
+	const uint8_t* pSignature;
+	const uint8_t* pJpeg;
+	uint32_t uFingerprintSize;
+	uint32_t uSignatureSize;
+	uint32_t uJpegSize;
+	char strPlate[ANPR_PLATE_READ_MAX_PLATE];
+} ANPRPlateRead;
+
+/*! <summary>struct</summary>
+	A compiled extraction schema. It is not modified by extractions, and can be shared by several threads
+*/
+typedef struct _anprplatereadschema ANPRPlateReadSchema;
+
+/*!
+	Creates a schema with the default paths :
+	decision@plate, decision@reliability, decision@lane, \@sensor, \@seq, decision@date, decision@timestampUs, fingerprint, signature and jpeg.
+	Use <a href="#ANPRPlateReadSchemaDestroy">ANPRPlateReadSchemaDestroy</a> to destroy it.
+	@returns the schema, or NULL on failure
+*/
+ANPRPlateReadSchema* ANPRPlateReadSchemaCreate();
+
+/*!
+	Destroys a schema
+*/
+void ANPRPlateReadSchemaDestroy(ANPRPlateReadSchema* pSchema);
+
+/*!
+	Changes the path of a field.<br/>
+	A path is a list of element names separated by '/', relative to the root element, and ending with \@key for an attribute.
+	Without attribute, the field is the content of the element : only the binary fields can be read from a content.
+	Names and keys are case insensitive.
+	@param[in] pSchema the schema
+	@param[in] uField ANPR_PLATE_READ_PLATE to ANPR_PLATE_READ_JPEG
+	@param[in] strPath the path, or NULL not to extract the field
+	@returns CDK_OK on success, CDK_FAIL if the path is invalid for this field
+*/
+int32_t ANPRPlateReadSchemaSetPath(ANPRPlateReadSchema* pSchema, uint32_t uField, const char* strPath);
+
+/*!
+	Fills a plate read from a message, in one pass over the elements of the schema.<br/>
+	Numeric fields that cannot be parsed are not set.
+	@param[in] pSchema the schema
+	@param[in] pMsg the message
+	@param[out] pRead the plate read, fully overwritten
+	@returns the number of fields found
+*/
+uint32_t ANPRPlateReadExtract(const ANPRPlateReadSchema* pSchema, CDKMsg* pMsg, ANPRPlateRead* pRead);
+
+/*!
+	Normalizes a plate text, so that two reads of the same plate have the same text despite the usual OCR confusions :
+	upper case, letters and digits only, and 0/O/D/Q, 1/I, 2/Z, 5/S, 6/G, 8/B folded to the digit.
+	@param[in] strPlate the plate text
+	@param[out] strText the normalized text, ANPR_PLATE_READ_MAX_PLATE characters including the terminating NULL
+	@returns the length of the normalized text
+*/
+uint32_t ANPRPlateReadNormalize(const char* strPlate, char* strText);
+
+/*!
+	Computes the hash keys of a normalized text : the hash of the text, then with a text distance of 1, the hashes of
+	the text with one character deleted. Two texts differing by one substitution, insertion or deletion share one of
+	their keys. The keys are never 0, and are stable : they can be stored in files.
+	@param[in] strText the normalized text
+	@param[in] uMaxDistance 0 for the hash of the text only, 1 for the deletion keys too
+	@param[out] pKeys the keys, the hash of the text first
+	@param[in] uMaxKeys size of pKeys, at least 1 : the characters after the first uMaxKeys - 1 have no deletion key
+	@returns the number of keys
+*/
+uint32_t ANPRPlateReadTextKeys(const char* strText, uint32_t uMaxDistance, uint64_t* pKeys, uint32_t uMaxKeys);
+
+/*!
+	Says if two normalized texts differ by one substitution, insertion or deletion at most
+	@returns 0 if the texts are identical, 1 if they differ by one edit, 2 if they differ more
+*/
+uint32_t ANPRPlateReadTextDistance(const char* strText1, const char* strText2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRPLATEREAD_H
@@ -0,0 +1,263 @@
+/*! \file
+
+ANPRReplay : replay of a journal into a CDKQueue.
+
+The replay thread imports a record before waiting for its time, so that the push itself is on time. Every loop
+restarts the recorded timeline at the time the loop starts.
+
+The consumer lag is measured without touching the messages : the push time of the last accepted messages is kept
+in a ring, and the oldest message still queued is the one accepted CDKQueueGetQueueSize messages ago.
+
+*/
+
+#include <algorithm>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRReplay.h"
+
+/*!
+	Push times kept for the consumer lag : a lag of more messages than this is measured on the oldest one kept
+*/
+#define ANPR_REPLAY_PUSH_TIMES 65536
+
+struct _anprreplay : CDKObject
+{
+	ANPRReplayConfig config;
+	ANPRJournalReader* pReader;
+	CDKQueue* pQueue;
+	uint64_t uEnd = 0;
+	std::thread thread;
+	bool bStarted = false;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool bStop = false;
+	bool bDone = false;
+	/*! time the last record was pushed, in us since the start */
+	int64_t iDoneUs = 0;
+
+	std::chrono::steady_clock::time_point start;
+	uint32_t uDropsAtStart = 0;
+	std::atomic<uint64_t> uPushed{0};
+	std::atomic<uint64_t> uRefused{0};
+	std::atomic<uint64_t> uImportErrors{0};
+	std::atomic<int64_t> iScheduleLagUs{0};
+	/*! push time of accepted message i at i % ANPR_REPLAY_PUSH_TIMES, in us since the start */
+	std::vector<std::atomic<int64_t>> pushTimes;
+};
+
+static int64_t ANPRReplayElapsedUs(ANPRReplay* pReplay)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - pReplay->start).count();
+}
+
+/*!
+	Waits until a time, or until the replay is stopped
+	@returns false if the replay is stopped
+*/
+static bool ANPRReplayWaitUntil(ANPRReplay* pReplay, std::chrono::steady_clock::time_point until)
+{
+	std::unique_lock<std::mutex> lock(pReplay->mutex);
+	pReplay->condition.wait_until(lock, until, [&] { return pReplay->bStop; });
+	return !pReplay->bStop;
+}
+
+static void ANPRReplayThread(ANPRReplay* pReplay)
+{
+	const double dSpeed = pReplay->config.dSpeed;
+	ANPRJournalRecord first;
+	bool bTimed = dSpeed > 0 && ANPRJournalReaderGetRecord(pReplay->pReader, pReplay->config.uFirstRecord, &first) == CDK_OK;
+	bool bRunning = true;
+	for (uint32_t uLoop = 0; uLoop < pReplay->config.uLoops && bRunning; uLoop++)
+	{
+		auto loopStart = std::chrono::steady_clock::now();
+		for (uint64_t uRecord = pReplay->config.uFirstRecord; uRecord < pReplay->uEnd; uRecord++)
+		{
+			ANPRJournalRecord record;
+			CDKMsg* pMsg = CDKMsgCreate();
+			if (!pMsg || ANPRJournalReaderGetRecord(pReplay->pReader, uRecord, &record) != CDK_OK ||
+				CDKMsgImportFromBinaryArray(pMsg, record.pData, record.uSize) != CDK_OK)
+			{
+				pReplay->uImportErrors.fetch_add(1, std::memory_order_relaxed);
+				CDKMsgDestroy(pMsg);
+				continue;
+			}
+			auto scheduled = std::chrono::steady_clock::now();
+			if (bTimed)
+			{
+				int64_t iOffsetUs = (int64_t)((double)(record.iAppendedUs - first.iAppendedUs) / dSpeed);
+				scheduled = loopStart + std::chrono::microseconds(iOffsetUs > 0 ? iOffsetUs : 0);
+				if (!ANPRReplayWaitUntil(pReplay, scheduled))
+				{
+					CDKMsgDestroy(pMsg);
+					bRunning = false;
+					break;
+				}
+			}
+			else if (uRecord % 256 == 0 && !ANPRReplayWaitUntil(pReplay, scheduled))
+			{
+				CDKMsgDestroy(pMsg);
+				bRunning = false;
+				break;
+			}
+			auto now = std::chrono::steady_clock::now();
+			if (CDKQueuePushMessage(pReplay->pQueue, pMsg) != CDK_OK)
+			{
+				// not owned by the queue
+				CDKMsgDestroy(pMsg);
+				pReplay->uRefused.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				uint64_t uPushed = pReplay->uPushed.load(std::memory_order_relaxed);
+				pReplay->pushTimes[uPushed % ANPR_REPLAY_PUSH_TIMES].store(
+					std::chrono::duration_cast<std::chrono::microseconds>(now - pReplay->start).count(), std::memory_order_relaxed);
+				pReplay->uPushed.store(uPushed + 1, std::memory_order_release);
+			}
+			pReplay->iScheduleLagUs.store(std::chrono::duration_cast<std::chrono::microseconds>(now - scheduled).count(), std::memory_order_relaxed);
+		}
+	}
+	std::lock_guard<std::mutex> lock(pReplay->mutex);
+	pReplay->iDoneUs = ANPRReplayElapsedUs(pReplay);
+	pReplay->bDone = true;
+	pReplay->condition.notify_all();
+}
+
+void ANPRReplayDefaultConfig(ANPRReplayConfig* pConfig)
+{
+	pConfig->dSpeed = 1.0;
+	pConfig->uFirstRecord = 0;
+	pConfig->uRecordCount = 0;
+	pConfig->uLoops = 1;
+}
+
+ANPRReplay* ANPRReplayCreate(const ANPRReplayConfig* pConfig, ANPRJournalReader* pReader, CDKQueue* pQueue)
+{
+	if (!pReader || !pQueue)
+	{
+		CDKSetLastError(nullptr, "a journal reader and a queue are required");
+		return nullptr;
+	}
+	ANPRReplay* pReplay = new (std::nothrow) ANPRReplay();
+	if (!pReplay)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	try
+	{
+		pReplay->pushTimes = std::vector<std::atomic<int64_t>>(ANPR_REPLAY_PUSH_TIMES);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		delete pReplay;
+		return nullptr;
+	}
+	if (pConfig)
+		pReplay->config = *pConfig;
+	else
+		ANPRReplayDefaultConfig(&pReplay->config);
+	if (pReplay->config.dSpeed < 0)
+		pReplay->config.dSpeed = 0;
+	pReplay->pReader = pReader;
+	pReplay->pQueue = pQueue;
+	uint64_t uRecords = ANPRJournalReaderGetRecordCount(pReader);
+	uint64_t uFirst = std::min(pReplay->config.uFirstRecord, uRecords);
+	pReplay->config.uFirstRecord = uFirst;
+	pReplay->uEnd = pReplay->config.uRecordCount && pReplay->config.uRecordCount < uRecords - uFirst ? uFirst + pReplay->config.uRecordCount : uRecords;
+	return pReplay;
+}
+
+void ANPRReplayDestroy(ANPRReplay* pReplay)
+{
+	if (!pReplay)
+		return;
+	ANPRReplayStop(pReplay);
+	delete pReplay;
+}
+
+int32_t ANPRReplayStart(ANPRReplay* pReplay)
+{
+	if (!pReplay)
+		return CDK_FAIL;
+	if (pReplay->bStarted)
+	{
+		CDKSetLastError(pReplay, "replay is already started");
+		return CDK_FAIL;
+	}
+	pReplay->bStop = false;
+	pReplay->bDone = false;
+	pReplay->uPushed = 0;
+	pReplay->uRefused = 0;
+	pReplay->uImportErrors = 0;
+	pReplay->iScheduleLagUs = 0;
+	pReplay->uDropsAtStart = CDKQueueGetMessageDrops(pReplay->pQueue);
+	pReplay->start = std::chrono::steady_clock::now();
+	try
+	{
+		pReplay->thread = std::thread(ANPRReplayThread, pReplay);
+	}
+	catch (const std::exception& e)
+	{
+		CDKSetLastError(pReplay, "cannot start replay: %s", e.what());
+		return CDK_FAIL;
+	}
+	pReplay->bStarted = true;
+	return CDK_OK;
+}
+
+void ANPRReplayStop(ANPRReplay* pReplay)
+{
+	if (!pReplay || !pReplay->bStarted)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pReplay->mutex);
+		pReplay->bStop = true;
+	}
+	pReplay->condition.notify_all();
+	pReplay->thread.join();
+	pReplay->bStarted = false;
+}
+
+int32_t ANPRReplayWait(ANPRReplay* pReplay, uint32_t uTimeout)
+{
+	if (!pReplay)
+		return CDK_FAIL;
+	std::unique_lock<std::mutex> lock(pReplay->mutex);
+	if (!pReplay->condition.wait_for(lock, std::chrono::milliseconds(uTimeout), [&] { return pReplay->bDone; }))
+	{
+		CDKSetLastError(pReplay, "timeout");
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+int32_t ANPRReplayGetStats(ANPRReplay* pReplay, ANPRReplayStats* pStats)
+{
+	if (!pReplay || !pStats)
+		return CDK_FAIL;
+	uint64_t uPushed = pReplay->uPushed.load(std::memory_order_acquire);
+	uint32_t uQueued = CDKQueueGetQueueSize(pReplay->pQueue);
+	pStats->uPushed = uPushed;
+	pStats->uRefused = pReplay->uRefused.load(std::memory_order_relaxed);
+	pStats->uDrops = (uint32_t)(CDKQueueGetMessageDrops(pReplay->pQueue) - pReplay->uDropsAtStart);
+	pStats->uImportErrors = pReplay->uImportErrors.load(std::memory_order_relaxed);
+	pStats->uQueued = uQueued;
+	{
+		std::lock_guard<std::mutex> lock(pReplay->mutex);
+		pStats->bDone = pReplay->bDone ? 1 : 0;
+		pStats->iElapsedUs = pReplay->bDone ? pReplay->iDoneUs : pReplay->bStarted ? ANPRReplayElapsedUs(pReplay) : 0;
+	}
+	pStats->iScheduleLagUs = pReplay->iScheduleLagUs.load(std::memory_order_relaxed);
+	pStats->iConsumerLagUs = 0;
+	if (uQueued && uPushed)
+	{
+		// the oldest queued message, or the oldest push time kept
+		uint64_t uOldest = uPushed - std::min<uint64_t>(std::min<uint64_t>(uQueued, uPushed), ANPR_REPLAY_PUSH_TIMES);
+		int64_t iPushedUs = pReplay->pushTimes[uOldest % ANPR_REPLAY_PUSH_TIMES].load(std::memory_order_relaxed);
+		pStats->iConsumerLagUs = std::max<int64_t>(0, ANPRReplayElapsedUs(pReplay) - iPushedUs);
+	}
+	return CDK_OK;
+}
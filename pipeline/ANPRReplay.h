@@ -0,0 +1,116 @@
+/*! \file
+
+ANPRReplay : replay of a journal into a CDKQueue.<br/>
+The records of an <a href="#ANPRJournalReader">ANPRJournalReader</a> are imported from the mapped segments and pushed into a
+<a href="#CDKQueue">CDKQueue</a> with <a href="#CDKQueuePushMessage">CDKQueuePushMessage</a>, as the CDK would push received messages :
+with the recorded inter-arrival times, N times faster, or as fast as possible. The consumers of the queue do not see the difference
+with live traffic, so that a production incident or a benchmark can be replayed against the real downstream stages.
+
+*/
+
+#ifndef ANPRREPLAY_H
+#define ANPRREPLAY_H
+
+#include <stdint.h>
+
+#include "CDKQueue.h"
+#include "ANPRJournal.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A replay
+*/
+typedef struct _anprreplay ANPRReplay;
+
+/*! <summary>struct</summary>
+	Configuration of a replay
+*/
+typedef struct
+{
+	/*! 1 for the recorded timing, N for N times faster, 0 for as fast as possible */
+	double dSpeed;
+	/*! number of the first record replayed, see <a href="#ANPRJournalReaderSeekAppended">ANPRJournalReaderSeekAppended</a> */
+	uint64_t uFirstRecord;
+	/*! number of records replayed, 0 up to the last record */
+	uint64_t uRecordCount;
+	/*! number of times the records are replayed, one after the other */
+	uint32_t uLoops;
+} ANPRReplayConfig;
+
+/*! <summary>struct</summary>
+	Counters of a replay
+*/
+typedef struct
+{
+	/*! messages accepted by the queue */
+	uint64_t uPushed;
+	/*! messages refused by the queue, and destroyed */
+	uint64_t uRefused;
+	/*! <a href="#CDKQueueGetMessageDrops">messages dropped by the queue</a> since the start, refused or evicted */
+	uint64_t uDrops;
+	/*! records that could not be imported */
+	uint64_t uImportErrors;
+	/*! messages waiting in the queue */
+	uint32_t uQueued;
+	/*! 1 once every record has been pushed */
+	uint32_t bDone;
+	/*! time since the start, in us */
+	int64_t iElapsedUs;
+	/*! delay of the last push after its recorded time, in us : the replay cannot keep up with the requested speed when it grows */
+	int64_t iScheduleLagUs;
+	/*! time the oldest message of the queue has been waiting for the consumers, in us. Only meaningful if the replay is the only producer of the queue */
+	int64_t iConsumerLagUs;
+} ANPRReplayStats;
+
+/*!
+	Fills a configuration with default values : recorded timing, every record replayed once
+*/
+void ANPRReplayDefaultConfig(ANPRReplayConfig* pConfig);
+
+/*!
+	Creates a replay. The reader and the queue are not owned by the replay, and must outlive it.<br/>
+	Use <a href="#ANPRReplayDestroy">ANPRReplayDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@param[in] pReader the journal
+	@param[in] pQueue the queue the messages are pushed into
+	@returns the replay, or NULL on failure
+*/
+ANPRReplay* ANPRReplayCreate(const ANPRReplayConfig* pConfig, ANPRJournalReader* pReader, CDKQueue* pQueue);
+
+/*!
+	Stops and destroys a replay. Messages already pushed stay in the queue.
+*/
+void ANPRReplayDestroy(ANPRReplay* pReplay);
+
+/*!
+	Starts the replay thread. The recorded timeline starts at the call.
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRReplayStart(ANPRReplay* pReplay);
+
+/*!
+	Stops the replay thread, before the last record if it is still running
+*/
+void ANPRReplayStop(ANPRReplay* pReplay);
+
+/*!
+	Waits until every record has been pushed
+	@param[in] pReplay the replay
+	@param[in] uTimeout maximum time to wait, in ms
+	@returns CDK_OK if every record has been pushed, CDK_FAIL if the timeout has been reached
+*/
+int32_t ANPRReplayWait(ANPRReplay* pReplay, uint32_t uTimeout);
+
+/*!
+	Returns the counters of a replay
+*/
+int32_t ANPRReplayGetStats(ANPRReplay* pReplay, ANPRReplayStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRREPLAY_H
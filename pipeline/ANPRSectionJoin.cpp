@@ -0,0 +1,507 @@
+/*! \file
+
+ANPRSectionJoin : streaming join of the entry and exit reads of average speed sections.
+
+The entry reads are kept in a deque, in the order of their insertion, and numbered by a sequence number. Every key of
+an entry read, the hash of its normalized text and of the texts with one character deleted (ANPRPlateReadTextKeys,
+shared with the de-duplication stage and the hot-lists), heads a chain : a flat hash table gives the sequence number
+of the last entry read with the key, and every entry read gives the previous one for each of its keys. A chain is
+walked from the newest entry read down, and stops at the first sequence number that left the window, so that leaving
+the window only has to remove the heads that point to the entry read leaving it.
+
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "CDKSignature.h"
+#include "ANPRSectionJoin.h"
+
+/*!
+	Initial size of the table of the chain heads
+*/
+#define ANPR_SECTION_JOIN_MIN_HEADS 1024
+
+/*!
+	End of a chain
+*/
+#define ANPR_SECTION_JOIN_NONE UINT64_MAX
+
+struct ANPRSectionJoinSection
+{
+	uint32_t uEntrySensor;
+	uint32_t uExitSensor;
+	double dLengthM;
+	double dSpeedLimitKmh;
+};
+
+struct ANPRSectionJoinSensor
+{
+	bool bEntry = false;
+	/*! sections ending at the sensor */
+	std::vector<uint32_t> exitSections;
+};
+
+struct ANPRSectionJoinEntry
+{
+	uint64_t uId;
+	int64_t iTimestampUs;
+	uint32_t uSensor;
+	bool bJoined;
+	uint32_t uKeys;
+	/*! keys of the text : it is shorter than ANPR_PLATE_READ_MAX_PLATE, so that none is dropped */
+	uint64_t hashes[ANPR_PLATE_READ_MAX_PLATE];
+	/*! sequence number of the previous entry read with the same key, or ANPR_SECTION_JOIN_NONE */
+	uint64_t previous[ANPR_PLATE_READ_MAX_PLATE];
+	char strPlate[ANPR_PLATE_READ_MAX_PLATE];
+	char strText[ANPR_PLATE_READ_MAX_PLATE];
+	std::vector<uint8_t> fingerprint;
+	/*! signature parsed once on insertion, NULL when signatures are not compared. Destroyed when the entry leaves the window */
+	CDKSignature* pSignature;
+};
+
+struct ANPRSectionJoinHead
+{
+	/*! 0 for an empty entry */
+	uint64_t uHash;
+	uint64_t uSeq;
+};
+
+struct _anprsectionjoin : CDKObject
+{
+	ANPRSectionJoinConfig config;
+	CDKPlateFingerprintMatcher* pMatcher = nullptr;
+	PANPRSECTIONJOINMATCHCALLBACK matchCallback = nullptr;
+	void* pUser = nullptr;
+
+	std::mutex mutex;
+	std::vector<ANPRSectionJoinSection> sections;
+	std::unordered_map<uint32_t, ANPRSectionJoinSensor> sensors;
+	bool bStarted = false;
+
+	std::deque<ANPRSectionJoinEntry> entries;
+	/*! sequence number of entries.front() */
+	uint64_t uFirstSeq = 0;
+	/*! open addressing table of the chain heads, at most half full */
+	std::vector<ANPRSectionJoinHead> heads;
+	size_t uHeads = 0;
+	int64_t iNewestUs = INT64_MIN;
+
+	uint64_t uEntries = 0;
+	uint64_t uExits = 0;
+	uint64_t uTextMatches = 0;
+	uint64_t uFingerprintMatches = 0;
+	uint64_t uSignatureMatches = 0;
+	uint64_t uComparisons = 0;
+	uint64_t uOverLimit = 0;
+	uint64_t uExpired = 0;
+	uint64_t uEvicted = 0;
+	uint64_t uExitSumNs = 0;
+	uint64_t uExitMaxNs = 0;
+};
+
+//---------------------------------------------------------------------------------------------
+// chain heads
+//---------------------------------------------------------------------------------------------
+
+static size_t ANPRSectionJoinHeadIndex(uint64_t uHash, size_t uMask)
+{
+	return (size_t)(uHash ^ (uHash >> 32)) & uMask;
+}
+
+static uint64_t ANPRSectionJoinGetHead(const ANPRSectionJoin* pJoin, uint64_t uHash)
+{
+	if (pJoin->uHeads == 0)
+		return ANPR_SECTION_JOIN_NONE;
+	size_t uMask = pJoin->heads.size() - 1;
+	for (size_t i = ANPRSectionJoinHeadIndex(uHash, uMask); pJoin->heads[i].uHash; i = (i + 1) & uMask)
+		if (pJoin->heads[i].uHash == uHash)
+			return pJoin->heads[i].uSeq;
+	return ANPR_SECTION_JOIN_NONE;
+}
+
+static void ANPRSectionJoinSetHead(ANPRSectionJoin* pJoin, uint64_t uHash, uint64_t uSeq)
+{
+	if ((pJoin->uHeads + 1) * 2 > pJoin->heads.size())
+	{
+		std::vector<ANPRSectionJoinHead> heads(std::max<size_t>(pJoin->heads.size() * 2, ANPR_SECTION_JOIN_MIN_HEADS), ANPRSectionJoinHead{ 0, 0 });
+		std::swap(heads, pJoin->heads);
+		pJoin->uHeads = 0;
+		for (const ANPRSectionJoinHead& head : heads)
+			if (head.uHash)
+				ANPRSectionJoinSetHead(pJoin, head.uHash, head.uSeq);
+	}
+	size_t uMask = pJoin->heads.size() - 1;
+	size_t i = ANPRSectionJoinHeadIndex(uHash, uMask);
+	while (pJoin->heads[i].uHash && pJoin->heads[i].uHash != uHash)
+		i = (i + 1) & uMask;
+	if (!pJoin->heads[i].uHash)
+		pJoin->uHeads++;
+	pJoin->heads[i] = { uHash, uSeq };
+}
+
+static void ANPRSectionJoinEraseHead(ANPRSectionJoin* pJoin, uint64_t uHash)
+{
+	if (pJoin->uHeads == 0)
+		return;
+	size_t uMask = pJoin->heads.size() - 1;
+	size_t i = ANPRSectionJoinHeadIndex(uHash, uMask);
+	while (pJoin->heads[i].uHash != uHash)
+	{
+		if (!pJoin->heads[i].uHash)
+			return;
+		i = (i + 1) & uMask;
+	}
+	// backward shift : the following entries of the cluster that can move closer to their index fill the hole
+	for (size_t j = (i + 1) & uMask; pJoin->heads[j].uHash; j = (j + 1) & uMask)
+	{
+		size_t k = ANPRSectionJoinHeadIndex(pJoin->heads[j].uHash, uMask);
+		if (((j - k) & uMask) >= ((j - i) & uMask))
+		{
+			pJoin->heads[i] = pJoin->heads[j];
+			i = j;
+		}
+	}
+	pJoin->heads[i] = { 0, 0 };
+	pJoin->uHeads--;
+}
+
+//---------------------------------------------------------------------------------------------
+// window
+//---------------------------------------------------------------------------------------------
+
+static void ANPRSectionJoinPopFront(ANPRSectionJoin* pJoin, bool bEvicted)
+{
+	const ANPRSectionJoinEntry& entry = pJoin->entries.front();
+	for (uint32_t j = 0; j < entry.uKeys; j++)
+		if (ANPRSectionJoinGetHead(pJoin, entry.hashes[j]) == pJoin->uFirstSeq)
+			ANPRSectionJoinEraseHead(pJoin, entry.hashes[j]);
+	if (!entry.bJoined)
+		(bEvicted ? pJoin->uEvicted : pJoin->uExpired)++;
+	CDKSignatureDestroy(entry.pSignature);
+	pJoin->entries.pop_front();
+	pJoin->uFirstSeq++;
+}
+
+static void ANPRSectionJoinInsert(ANPRSectionJoin* pJoin, const ANPRPlateRead& read, uint64_t uId, const char* strText)
+{
+	while (pJoin->entries.size() >= pJoin->config.uMaxEntries)
+		ANPRSectionJoinPopFront(pJoin, true);
+	uint64_t uSeq = pJoin->uFirstSeq + pJoin->entries.size();
+	pJoin->entries.emplace_back();
+	ANPRSectionJoinEntry& entry = pJoin->entries.back();
+	entry.uId = uId;
+	entry.iTimestampUs = read.iTimestampUs;
+	entry.uSensor = read.uSensor;
+	entry.bJoined = false;
+	strcpy(entry.strPlate, read.strPlate);
+	strcpy(entry.strText, strText);
+	if (read.pFingerprint)
+		entry.fingerprint.assign(read.pFingerprint, read.pFingerprint + read.uFingerprintSize);
+	bool bSignature = pJoin->config.iMinSignatureScore > 0 && read.pSignature && read.uSignatureSize;
+	entry.pSignature = bSignature ? CDKSignatureCreate(read.pSignature, read.uSignatureSize) : nullptr;
+	entry.uKeys = ANPRPlateReadTextKeys(strText, pJoin->config.uMaxTextDistance, entry.hashes, ANPR_PLATE_READ_MAX_PLATE);
+	for (uint32_t j = 0; j < entry.uKeys; j++)
+	{
+		entry.previous[j] = ANPRSectionJoinGetHead(pJoin, entry.hashes[j]);
+		ANPRSectionJoinSetHead(pJoin, entry.hashes[j], uSeq);
+	}
+	pJoin->uEntries++;
+}
+
+/*!
+	Calls f(entry, uSeq) for the entry reads of a key still in the window, from the newest one
+*/
+template <typename F>
+static void ANPRSectionJoinWalk(ANPRSectionJoin* pJoin, uint64_t uHash, const F& f)
+{
+	uint64_t uSeq = ANPRSectionJoinGetHead(pJoin, uHash);
+	while (uSeq != ANPR_SECTION_JOIN_NONE && uSeq >= pJoin->uFirstSeq)
+	{
+		ANPRSectionJoinEntry& entry = pJoin->entries[uSeq - pJoin->uFirstSeq];
+		uint32_t j = 0;
+		while (j < entry.uKeys && entry.hashes[j] != uHash)
+			j++;
+		if (j == entry.uKeys || !f(entry, uSeq))
+			return;
+		uSeq = entry.previous[j];
+	}
+}
+
+//---------------------------------------------------------------------------------------------
+// join
+//---------------------------------------------------------------------------------------------
+
+/*!
+	Returns the section from the sensor of an entry read to an exit sensor, or UINT32_MAX
+*/
+static uint32_t ANPRSectionJoinSectionOf(const ANPRSectionJoin* pJoin, const ANPRSectionJoinSensor& exit, const ANPRSectionJoinEntry& entry)
+{
+	for (uint32_t uSection : exit.exitSections)
+		if (pJoin->sections[uSection].uEntrySensor == entry.uSensor)
+			return uSection;
+	return UINT32_MAX;
+}
+
+static bool ANPRSectionJoinConfirm(ANPRSectionJoin* pJoin, const ANPRPlateRead& read, CDKSignature** ppSignature,
+	const ANPRSectionJoinEntry& entry, uint32_t* puMethod)
+{
+	if (pJoin->pMatcher && !entry.fingerprint.empty() && read.pFingerprint && read.uFingerprintSize)
+	{
+		pJoin->uComparisons++;
+		*puMethod = ANPR_SECTION_MATCH_FINGERPRINT;
+		return CDKPlateFingerprintMatch(pJoin->pMatcher, read.pFingerprint, read.uFingerprintSize, entry.fingerprint.data(), (uint32_t)entry.fingerprint.size()) == 1;
+	}
+	if (!entry.pSignature || !read.pSignature || read.uSignatureSize == 0)
+		return false;
+	// the signature of the exit read is parsed once, for its first candidate
+	if (!*ppSignature)
+		*ppSignature = CDKSignatureCreate(read.pSignature, read.uSignatureSize);
+	if (!*ppSignature)
+		return false;
+	pJoin->uComparisons++;
+	*puMethod = ANPR_SECTION_MATCH_SIGNATURE;
+	return CDKSignatureCompareEx(*ppSignature, entry.pSignature, pJoin->config.iMinSignatureScore) >= pJoin->config.iMinSignatureScore;
+}
+
+/*!
+	Finds the entry read of an exit read
+	@returns the sequence number of the entry read, or ANPR_SECTION_JOIN_NONE
+*/
+static uint64_t ANPRSectionJoinFind(ANPRSectionJoin* pJoin, const ANPRSectionJoinSensor& exit, const ANPRPlateRead& read, const char* strText,
+	uint32_t* puSection, uint32_t* puMethod)
+{
+	auto plausible = [&](const ANPRSectionJoinEntry& entry) {
+		if (entry.bJoined || entry.iTimestampUs >= read.iTimestampUs || read.iTimestampUs - entry.iTimestampUs > pJoin->config.iWindowUs)
+			return false;
+		*puSection = ANPRSectionJoinSectionOf(pJoin, exit, entry);
+		return *puSection != UINT32_MAX;
+	};
+
+	// identical texts, the newest entry read first
+	uint64_t hashes[ANPR_PLATE_READ_MAX_PLATE];
+	uint32_t uKeys = ANPRPlateReadTextKeys(strText, pJoin->config.uMaxTextDistance, hashes, ANPR_PLATE_READ_MAX_PLATE);
+	uint64_t uFound = ANPR_SECTION_JOIN_NONE;
+	ANPRSectionJoinWalk(pJoin, hashes[0], [&](const ANPRSectionJoinEntry& entry, uint64_t uSeq) {
+		if (strcmp(entry.strText, strText) != 0 || !plausible(entry))
+			return true;
+		uFound = uSeq;
+		return false;
+	});
+	*puMethod = ANPR_SECTION_MATCH_TEXT;
+	if (uFound != ANPR_SECTION_JOIN_NONE || uKeys == 1)
+		return uFound;
+
+	// texts one character away, confirmed by the fingerprints or the signatures
+	thread_local std::vector<uint64_t> candidates;
+	candidates.clear();
+	for (uint32_t k = 0; k < uKeys; k++)
+	{
+		ANPRSectionJoinWalk(pJoin, hashes[k], [&](const ANPRSectionJoinEntry& entry, uint64_t uSeq) {
+			if (!entry.bJoined && ANPRPlateReadTextDistance(entry.strText, strText) <= 1)
+				candidates.push_back(uSeq);
+			return true;
+		});
+	}
+	std::sort(candidates.begin(), candidates.end(), std::greater<uint64_t>());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	CDKSignature* pSignature = nullptr;
+	for (uint64_t uSeq : candidates)
+	{
+		const ANPRSectionJoinEntry& entry = pJoin->entries[uSeq - pJoin->uFirstSeq];
+		if (plausible(entry) && ANPRSectionJoinConfirm(pJoin, read, &pSignature, entry, puMethod))
+		{
+			uFound = uSeq;
+			break;
+		}
+	}
+	CDKSignatureDestroy(pSignature);
+	return uFound;
+}
+
+void ANPRSectionJoinDefaultConfig(ANPRSectionJoinConfig* pConfig)
+{
+	pConfig->iWindowUs = 3600000000ll;
+	pConfig->uMaxEntries = 262144;
+	pConfig->uMaxTextDistance = 1;
+	pConfig->iMinSignatureScore = 7;
+}
+
+ANPRSectionJoin* ANPRSectionJoinCreate(const ANPRSectionJoinConfig* pConfig, CDKPlateFingerprintMatcher* pMatcher,
+	PANPRSECTIONJOINMATCHCALLBACK matchCallback, void* pUser)
+{
+	if (!matchCallback)
+	{
+		CDKSetLastError(nullptr, "no match callback");
+		return nullptr;
+	}
+	ANPRSectionJoin* pJoin = new (std::nothrow) ANPRSectionJoin();
+	if (!pJoin)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pJoin->config = *pConfig;
+	else
+		ANPRSectionJoinDefaultConfig(&pJoin->config);
+	if (pJoin->config.iWindowUs <= 0 || pJoin->config.uMaxEntries == 0 || pJoin->config.iMinSignatureScore > 10)
+	{
+		CDKSetLastError(nullptr, "invalid section join configuration");
+		delete pJoin;
+		return nullptr;
+	}
+	pJoin->config.uMaxTextDistance = std::min<uint32_t>(pJoin->config.uMaxTextDistance, 1);
+	pJoin->pMatcher = pMatcher;
+	pJoin->matchCallback = matchCallback;
+	pJoin->pUser = pUser;
+	return pJoin;
+}
+
+void ANPRSectionJoinDestroy(ANPRSectionJoin* pJoin)
+{
+	if (!pJoin)
+		return;
+	for (ANPRSectionJoinEntry& entry : pJoin->entries)
+		CDKSignatureDestroy(entry.pSignature);
+	delete pJoin;
+}
+
+int32_t ANPRSectionJoinAddSection(ANPRSectionJoin* pJoin, uint32_t uEntrySensor, uint32_t uExitSensor, double dLengthM, double dSpeedLimitKmh)
+{
+	if (!pJoin)
+		return -1;
+	std::lock_guard<std::mutex> lock(pJoin->mutex);
+	if (pJoin->bStarted)
+	{
+		CDKSetLastError(pJoin, "sections must be added before the first read");
+		return -1;
+	}
+	if (!(dLengthM > 0) || dSpeedLimitKmh < 0 || uEntrySensor == uExitSensor)
+	{
+		CDKSetLastError(pJoin, "invalid section %u -> %u", uEntrySensor, uExitSensor);
+		return -1;
+	}
+	for (const ANPRSectionJoinSection& section : pJoin->sections)
+	{
+		if (section.uEntrySensor == uEntrySensor && section.uExitSensor == uExitSensor)
+		{
+			CDKSetLastError(pJoin, "section %u -> %u already added", uEntrySensor, uExitSensor);
+			return -1;
+		}
+	}
+	try
+	{
+		pJoin->sections.push_back({ uEntrySensor, uExitSensor, dLengthM, dSpeedLimitKmh });
+		pJoin->sensors[uEntrySensor].bEntry = true;
+		pJoin->sensors[uExitSensor].exitSections.push_back((uint32_t)pJoin->sections.size() - 1);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pJoin, "out of memory");
+		return -1;
+	}
+	return (int32_t)pJoin->sections.size() - 1;
+}
+
+int32_t ANPRSectionJoinPush(ANPRSectionJoin* pJoin, const ANPRPlateRead* pRead, uint64_t uId)
+{
+	if (!pJoin)
+		return -1;
+	const uint32_t uRequired = (1u << ANPR_PLATE_READ_PLATE) | (1u << ANPR_PLATE_READ_SENSOR) | (1u << ANPR_PLATE_READ_TIMESTAMP);
+	if (!pRead || (pRead->uFields & uRequired) != uRequired)
+	{
+		CDKSetLastError(pJoin, "the read has no plate, sensor or timestamp");
+		return -1;
+	}
+	const ANPRPlateRead& read = *pRead;
+	char strText[ANPR_PLATE_READ_MAX_PLATE];
+	if (ANPRPlateReadNormalize(read.strPlate, strText) == 0)
+		return 0;
+
+	bool bJoined = false;
+	ANPRSectionMatch match;
+	{
+		std::lock_guard<std::mutex> lock(pJoin->mutex);
+		pJoin->bStarted = true;
+		auto itSensor = pJoin->sensors.find(read.uSensor);
+		if (itSensor == pJoin->sensors.end())
+			return 0;
+		const ANPRSectionJoinSensor& sensor = itSensor->second;
+		try
+		{
+			if (read.iTimestampUs > pJoin->iNewestUs)
+			{
+				pJoin->iNewestUs = read.iTimestampUs;
+				while (!pJoin->entries.empty() && pJoin->entries.front().iTimestampUs < pJoin->iNewestUs - pJoin->config.iWindowUs)
+					ANPRSectionJoinPopFront(pJoin, false);
+			}
+			if (!sensor.exitSections.empty())
+			{
+				auto start = std::chrono::steady_clock::now();
+				pJoin->uExits++;
+				uint32_t uSection;
+				uint32_t uMethod;
+				uint64_t uSeq = ANPRSectionJoinFind(pJoin, sensor, read, strText, &uSection, &uMethod);
+				if (uSeq != ANPR_SECTION_JOIN_NONE)
+				{
+					ANPRSectionJoinEntry& entry = pJoin->entries[uSeq - pJoin->uFirstSeq];
+					const ANPRSectionJoinSection& section = pJoin->sections[uSection];
+					entry.bJoined = true;
+					bJoined = true;
+					match.uSection = uSection;
+					match.uMethod = uMethod;
+					match.uEntryId = entry.uId;
+					match.uExitId = uId;
+					match.iEntryTimestampUs = entry.iTimestampUs;
+					match.iExitTimestampUs = read.iTimestampUs;
+					match.dSpeedKmh = section.dLengthM / ((double)(read.iTimestampUs - entry.iTimestampUs) / 1e6) * 3.6;
+					match.bOverLimit = section.dSpeedLimitKmh > 0 && match.dSpeedKmh > section.dSpeedLimitKmh;
+					strcpy(match.strEntryPlate, entry.strPlate);
+					strcpy(match.strExitPlate, read.strPlate);
+					(uMethod == ANPR_SECTION_MATCH_TEXT ? pJoin->uTextMatches
+						: uMethod == ANPR_SECTION_MATCH_FINGERPRINT ? pJoin->uFingerprintMatches : pJoin->uSignatureMatches)++;
+					pJoin->uOverLimit += match.bOverLimit;
+				}
+				uint64_t uNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				pJoin->uExitSumNs += uNs;
+				pJoin->uExitMaxNs = std::max(pJoin->uExitMaxNs, uNs);
+			}
+			// the exit of a section can be the entry of the next one
+			if (sensor.bEntry)
+				ANPRSectionJoinInsert(pJoin, read, uId, strText);
+		}
+		catch (const std::bad_alloc&)
+		{
+			CDKSetLastError(pJoin, "out of memory");
+			return -1;
+		}
+	}
+	if (!bJoined)
+		return 0;
+	pJoin->matchCallback(&match, pJoin->pUser);
+	return 1;
+}
+
+void ANPRSectionJoinGetStats(ANPRSectionJoin* pJoin, ANPRSectionJoinStats* pStats)
+{
+	if (!pJoin || !pStats)
+		return;
+	std::lock_guard<std::mutex> lock(pJoin->mutex);
+	pStats->uEntries = pJoin->uEntries;
+	pStats->uExits = pJoin->uExits;
+	pStats->uTextMatches = pJoin->uTextMatches;
+	pStats->uFingerprintMatches = pJoin->uFingerprintMatches;
+	pStats->uSignatureMatches = pJoin->uSignatureMatches;
+	pStats->uComparisons = pJoin->uComparisons;
+	pStats->uOverLimit = pJoin->uOverLimit;
+	pStats->uExpired = pJoin->uExpired;
+	pStats->uEvicted = pJoin->uEvicted;
+	pStats->uWindowEntries = pJoin->entries.size();
+	pStats->uExitAvgNs = pJoin->uExits ? pJoin->uExitSumNs / pJoin->uExits : 0;
+	pStats->uExitMaxNs = pJoin->uExitMaxNs;
+}
@@ -0,0 +1,173 @@
+/*! \file
+
+ANPRSectionJoin : streaming join of the entry and exit reads of average speed sections.<br/>
+A section goes from an entry sensor to an exit sensor. The reads of the entry sensors are kept in a sliding window,
+keyed by the hash of their <a href="#ANPRPlateReadNormalize">normalized plate text</a>. Every read of an exit sensor
+probes the window : the last entry read with the same text, on a section ending at the exit sensor, is joined to it,
+and the match is handed to the callback from <a href="#ANPRSectionJoinPush">ANPRSectionJoinPush</a>, with the
+average speed over the section.<br/>
+When no entry read has the same text, the entry reads whose text differs by one character are confirmed with
+<a href="#CDKPlateFingerprintMatch">CDKPlateFingerprintMatch</a> when both reads have a fingerprint, or else with
+<a href="#CDKSignatureCompareEx">CDKSignatureCompareEx</a> when both have a signature.<br/>
+An entry read is joined once. It leaves the window when it is older than the window length, or when the maximum
+number of entry reads is reached. A sensor can be the exit of a section and the entry of the next one.
+
+*/
+
+#ifndef ANPRSECTIONJOIN_H
+#define ANPRSECTIONJOIN_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "ANPRPlateRead.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*!
+	How an exit read was joined to its entry read
+*/
+#define ANPR_SECTION_MATCH_TEXT			0
+#define ANPR_SECTION_MATCH_FINGERPRINT	1
+#define ANPR_SECTION_MATCH_SIGNATURE	2
+
+/*! <summary>struct</summary>
+	A section join engine
+*/
+typedef struct _anprsectionjoin ANPRSectionJoin;
+
+/*! <summary>struct</summary>
+	Configuration of a section join engine
+*/
+typedef struct
+{
+	/*! maximum time from an entry read to its exit read, in us : older entry reads leave the window */
+	int64_t iWindowUs;
+	/*! maximum number of entry reads in the window : beyond, the oldest ones leave it */
+	uint32_t uMaxEntries;
+	/*! 1 to confirm the entry reads whose normalized text differs by one character, 0 to only join identical texts */
+	uint32_t uMaxTextDistance;
+	/*! minimum <a href="#CDKSignatureCompareEx">signature score</a> confirming a join, from 1 to 10. 0 not to use the signatures */
+	int32_t iMinSignatureScore;
+} ANPRSectionJoinConfig;
+
+/*! <summary>struct</summary>
+	An exit read joined to its entry read
+*/
+typedef struct
+{
+	/*! section, as returned by <a href="#ANPRSectionJoinAddSection">ANPRSectionJoinAddSection</a> */
+	uint32_t uSection;
+	/*! ANPR_SECTION_MATCH_TEXT, ANPR_SECTION_MATCH_FINGERPRINT or ANPR_SECTION_MATCH_SIGNATURE */
+	uint32_t uMethod;
+	/*! identifier given with the entry read */
+	uint64_t uEntryId;
+	/*! identifier given with the exit read */
+	uint64_t uExitId;
+	int64_t iEntryTimestampUs;
+	int64_t iExitTimestampUs;
+	/*! average speed over the section, in km/h */
+	double dSpeedKmh;
+	/*! 1 if dSpeedKmh is above the speed limit of the section */
+	uint32_t bOverLimit;
+	char strEntryPlate[ANPR_PLATE_READ_MAX_PLATE];
+	char strExitPlate[ANPR_PLATE_READ_MAX_PLATE];
+} ANPRSectionMatch;
+
+/*! <summary>callback</summary>
+
+	Callback called for every exit read joined to an entry read.<br/>
+	It is called by the thread that pushed the exit read, without any lock of the engine held.
+	@param[in] pMatch the match
+	@param[in] pUser User data
+*/
+typedef void (*PANPRSECTIONJOINMATCHCALLBACK)(const ANPRSectionMatch* pMatch, void* pUser);
+
+/*! <summary>struct</summary>
+	Counters of a section join engine
+*/
+typedef struct
+{
+	/*! reads of entry sensors pushed */
+	uint64_t uEntries;
+	/*! reads of exit sensors pushed */
+	uint64_t uExits;
+	/*! exit reads joined, by identical text */
+	uint64_t uTextMatches;
+	/*! exit reads joined after a fingerprint confirmation */
+	uint64_t uFingerprintMatches;
+	/*! exit reads joined after a signature confirmation */
+	uint64_t uSignatureMatches;
+	/*! fingerprint and signature comparisons */
+	uint64_t uComparisons;
+	/*! joins above the speed limit of their section */
+	uint64_t uOverLimit;
+	/*! entry reads that left the window without being joined, by age */
+	uint64_t uExpired;
+	/*! entry reads that left the window without being joined, because uMaxEntries was reached */
+	uint64_t uEvicted;
+	/*! entry reads in the window */
+	uint64_t uWindowEntries;
+	/*! average time to process an exit read, in ns */
+	uint64_t uExitAvgNs;
+	/*! maximum time to process an exit read, in ns */
+	uint64_t uExitMaxNs;
+} ANPRSectionJoinStats;
+
+/*!
+	Fills a configuration with default values : 1 hour window, 262144 entry reads, texts differing by one character
+	confirmed, signature score of 7
+*/
+void ANPRSectionJoinDefaultConfig(ANPRSectionJoinConfig* pConfig);
+
+/*!
+	Creates a section join engine. Use <a href="#ANPRSectionJoinDestroy">ANPRSectionJoinDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@param[in] pMatcher matcher confirming the reads with close texts, started. Can be NULL to confirm them with the signatures only. It must outlive the engine
+	@param[in] matchCallback callback called for every match
+	@param[in] pUser callback user data
+	@returns the engine, or NULL on failure
+*/
+ANPRSectionJoin* ANPRSectionJoinCreate(const ANPRSectionJoinConfig* pConfig, CDKPlateFingerprintMatcher* pMatcher,
+	PANPRSECTIONJOINMATCHCALLBACK matchCallback, void* pUser);
+
+/*!
+	Destroys a section join engine
+*/
+void ANPRSectionJoinDestroy(ANPRSectionJoin* pJoin);
+
+/*!
+	Adds a section. Sections can only be added before the first read is pushed.
+	@param[in] pJoin the engine
+	@param[in] uEntrySensor sensor of the entry reads
+	@param[in] uExitSensor sensor of the exit reads
+	@param[in] dLengthM length of the section, in m
+	@param[in] dSpeedLimitKmh speed limit of the section, in km/h. 0 for no limit
+	@returns the index of the section, or -1 on failure
+*/
+int32_t ANPRSectionJoinAddSection(ANPRSectionJoin* pJoin, uint32_t uEntrySensor, uint32_t uExitSensor, double dLengthM, double dSpeedLimitKmh);
+
+/*!
+	Pushes a read. A read of an exit sensor is joined to its entry read, if any ; a read of an entry sensor enters the
+	window. The reads are expected in the order of their times.<br/>
+	Can be called from several threads, for instance from the callback of an <a href="#ANPRIngest">ingestion engine</a>.
+	@param[in] pJoin the engine
+	@param[in] pRead the read, with at least its plate, sensor and timestamp. Its fingerprint and signature are copied
+	@param[in] uId identifier of the read, given back in the matches, for instance its journal record
+	@returns 1 if the read was joined to an entry read, 0 if not, -1 on failure. Use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRSectionJoinPush(ANPRSectionJoin* pJoin, const ANPRPlateRead* pRead, uint64_t uId);
+
+/*!
+	Returns the counters of a section join engine
+*/
+void ANPRSectionJoinGetStats(ANPRSectionJoin* pJoin, ANPRSectionJoinStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRSECTIONJOIN_H
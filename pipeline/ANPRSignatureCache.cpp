@@ -0,0 +1,314 @@
+/*! \file
+
+ANPRSignatureCache : cache of parsed signatures.
+
+The cache is split in shards chosen by the hash of the buffer, each with its own lock, map and budget. An entry is
+referenced by the threads that acquired it ; only the unreferenced cached entries are in the LRU list, so that the
+eviction never has to skip an entry in use. The buffer is parsed outside of the lock : two threads missing the same
+buffer both parse it, and the second one keeps the entry inserted by the first.
+
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRSignatureCache.h"
+
+/*!
+	Memory of a parsed signature besides its features, and of the map node of an entry, in bytes
+*/
+#define ANPR_SIGNATURE_CACHE_ENTRY_OVERHEAD 384
+
+struct _anprsignaturecacheentry
+{
+	uint64_t uHash;
+	uint32_t uShard;
+	/*! threads using the signature */
+	uint32_t uRefs = 0;
+	/*! in the map of its shard, counted in its budget */
+	bool bCached = false;
+	uint64_t uBytes;
+	CDKSignature* pSignature = nullptr;
+	/*! copy of the buffer, to tell apart two buffers with the same hash */
+	std::vector<uint8_t> buffer;
+	/*! LRU list of the unreferenced cached entries, from the most recently released */
+	_anprsignaturecacheentry* pPrev = nullptr;
+	_anprsignaturecacheentry* pNext = nullptr;
+};
+
+struct ANPRSignatureCacheShard
+{
+	alignas(64) std::mutex mutex;
+	std::unordered_map<uint64_t, ANPRSignatureCacheEntry*> entries;
+	ANPRSignatureCacheEntry* pHead = nullptr;
+	ANPRSignatureCacheEntry* pTail = nullptr;
+	uint64_t uBytes = 0;
+	uint64_t uHits = 0;
+	uint64_t uMisses = 0;
+	uint64_t uEvictions = 0;
+	uint64_t uUncached = 0;
+};
+
+struct _anprsignaturecache : CDKObject
+{
+	ANPRSignatureCacheConfig config;
+	uint64_t uShardMaxBytes = 0;
+	std::vector<ANPRSignatureCacheShard> shards;
+};
+
+static uint64_t ANPRSignatureCacheHash(const uint8_t* pBuffer, uint32_t uSize)
+{
+	uint64_t uHash = 0x9E3779B97F4A7C15ull ^ uSize;
+	uint32_t i = 0;
+	for (; i + 8 <= uSize; i += 8)
+	{
+		uint64_t uWord;
+		memcpy(&uWord, pBuffer + i, 8);
+		uHash = (uHash ^ uWord) * 0xFF51AFD7ED558CCDull;
+		uHash ^= uHash >> 32;
+	}
+	for (; i < uSize; i++)
+		uHash = (uHash ^ pBuffer[i]) * 0x100000001B3ull;
+	uHash ^= uHash >> 33;
+	uHash *= 0xC4CEB9FE1A85EC53ull;
+	return uHash ^ (uHash >> 33);
+}
+
+static void ANPRSignatureCacheUnlink(ANPRSignatureCacheShard& shard, ANPRSignatureCacheEntry* pEntry)
+{
+	(pEntry->pPrev ? pEntry->pPrev->pNext : shard.pHead) = pEntry->pNext;
+	(pEntry->pNext ? pEntry->pNext->pPrev : shard.pTail) = pEntry->pPrev;
+	pEntry->pPrev = nullptr;
+	pEntry->pNext = nullptr;
+}
+
+static void ANPRSignatureCacheDeleteEntry(ANPRSignatureCacheEntry* pEntry)
+{
+	CDKSignatureDestroy(pEntry->pSignature);
+	delete pEntry;
+}
+
+void ANPRSignatureCacheDefaultConfig(ANPRSignatureCacheConfig* pConfig)
+{
+	pConfig->uMaxBytes = 64ull * 1024 * 1024;
+	pConfig->uShards = 0;
+}
+
+ANPRSignatureCache* ANPRSignatureCacheCreate(const ANPRSignatureCacheConfig* pConfig)
+{
+	ANPRSignatureCache* pCache = new (std::nothrow) ANPRSignatureCache();
+	if (!pCache)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pCache->config = *pConfig;
+	else
+		ANPRSignatureCacheDefaultConfig(&pCache->config);
+	if (pCache->config.uShards == 0)
+		pCache->config.uShards = std::max(1u, std::thread::hardware_concurrency());
+	pCache->uShardMaxBytes = pCache->config.uMaxBytes / pCache->config.uShards;
+	try
+	{
+		pCache->shards = std::vector<ANPRSignatureCacheShard>(pCache->config.uShards);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		delete pCache;
+		return nullptr;
+	}
+	return pCache;
+}
+
+void ANPRSignatureCacheDestroy(ANPRSignatureCache* pCache)
+{
+	if (!pCache)
+		return;
+	for (ANPRSignatureCacheShard& shard : pCache->shards)
+		for (auto& entry : shard.entries)
+			ANPRSignatureCacheDeleteEntry(entry.second);
+	delete pCache;
+}
+
+CDKSignature* ANPRSignatureCacheAcquire(ANPRSignatureCache* pCache, const uint8_t* pBuffer, uint32_t uSize, ANPRSignatureCacheEntry** ppEntry)
+{
+	if (!pCache)
+		return nullptr;
+	if (!pBuffer || !ppEntry)
+	{
+		CDKSetLastError(pCache, "a buffer and an entry are required");
+		return nullptr;
+	}
+	uint64_t uHash = ANPRSignatureCacheHash(pBuffer, uSize);
+	uint32_t uShard = (uint32_t)((uHash >> 32) % pCache->shards.size());
+	ANPRSignatureCacheShard& shard = pCache->shards[uShard];
+	auto sameBuffer = [&](const ANPRSignatureCacheEntry* pEntry) {
+		return pEntry->buffer.size() == uSize && memcmp(pEntry->buffer.data(), pBuffer, uSize) == 0;
+	};
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto found = shard.entries.find(uHash);
+		if (found != shard.entries.end() && sameBuffer(found->second))
+		{
+			ANPRSignatureCacheEntry* pEntry = found->second;
+			if (pEntry->uRefs++ == 0)
+				ANPRSignatureCacheUnlink(shard, pEntry);
+			shard.uHits++;
+			*ppEntry = pEntry;
+			return pEntry->pSignature;
+		}
+	}
+
+	ANPRSignatureCacheEntry* pEntry = new (std::nothrow) ANPRSignatureCacheEntry();
+	if (!pEntry)
+	{
+		CDKSetLastError(pCache, "out of memory");
+		return nullptr;
+	}
+	pEntry->pSignature = CDKSignatureCreate(pBuffer, uSize);
+	if (!pEntry->pSignature)
+	{
+		CDKSetLastError(pCache, "%s", CDKGetLastError(nullptr));
+		delete pEntry;
+		return nullptr;
+	}
+	try
+	{
+		pEntry->buffer.assign(pBuffer, pBuffer + uSize);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pCache, "out of memory");
+		ANPRSignatureCacheDeleteEntry(pEntry);
+		return nullptr;
+	}
+	pEntry->uHash = uHash;
+	pEntry->uShard = uShard;
+	pEntry->uRefs = 1;
+	pEntry->uBytes = sizeof(ANPRSignatureCacheEntry) + ANPR_SIGNATURE_CACHE_ENTRY_OVERHEAD + (uint64_t)uSize * (1 + sizeof(float));
+
+	std::vector<ANPRSignatureCacheEntry*> evicted;
+	ANPRSignatureCacheEntry* pResult = pEntry;
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto found = shard.entries.find(uHash);
+		if (found != shard.entries.end() && sameBuffer(found->second))
+		{
+			// parsed meanwhile by another thread
+			pResult = found->second;
+			if (pResult->uRefs++ == 0)
+				ANPRSignatureCacheUnlink(shard, pResult);
+			shard.uHits++;
+		}
+		else
+		{
+			shard.uMisses++;
+			if (found == shard.entries.end())
+			{
+				while (shard.uBytes + pEntry->uBytes > pCache->uShardMaxBytes && shard.pTail)
+				{
+					ANPRSignatureCacheEntry* pOldest = shard.pTail;
+					ANPRSignatureCacheUnlink(shard, pOldest);
+					shard.entries.erase(pOldest->uHash);
+					shard.uBytes -= pOldest->uBytes;
+					shard.uEvictions++;
+					evicted.push_back(pOldest);
+				}
+				if (shard.uBytes + pEntry->uBytes <= pCache->uShardMaxBytes)
+				{
+					try
+					{
+						shard.entries.emplace(uHash, pEntry);
+						shard.uBytes += pEntry->uBytes;
+						pEntry->bCached = true;
+					}
+					catch (const std::bad_alloc&)
+					{
+					}
+				}
+			}
+			if (!pEntry->bCached)
+				shard.uUncached++;
+		}
+	}
+	// destroyed outside of the lock
+	for (ANPRSignatureCacheEntry* pOldest : evicted)
+		ANPRSignatureCacheDeleteEntry(pOldest);
+	if (pResult != pEntry)
+		ANPRSignatureCacheDeleteEntry(pEntry);
+	*ppEntry = pResult;
+	return pResult->pSignature;
+}
+
+void ANPRSignatureCacheRelease(ANPRSignatureCache* pCache, ANPRSignatureCacheEntry* pEntry)
+{
+	if (!pCache || !pEntry)
+		return;
+	ANPRSignatureCacheShard& shard = pCache->shards[pEntry->uShard];
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if (--pEntry->uRefs)
+			return;
+		if (pEntry->bCached)
+		{
+			pEntry->pNext = shard.pHead;
+			(shard.pHead ? shard.pHead->pPrev : shard.pTail) = pEntry;
+			shard.pHead = pEntry;
+			return;
+		}
+	}
+	ANPRSignatureCacheDeleteEntry(pEntry);
+}
+
+int32_t ANPRSignatureCacheCompare(ANPRSignatureCache* pCache, const uint8_t* pBuffer1, uint32_t uSize1,
+	const uint8_t* pBuffer2, uint32_t uSize2, int32_t iMinScoreRequired)
+{
+	if (!pCache)
+		return -1;
+	// the cached signatures are shared by the threads : a comparison of different sizes would set their last error
+	if (uSize1 != uSize2)
+	{
+		CDKSetLastError(pCache, "signature sizes differ (%u / %u)", uSize1, uSize2);
+		return -1;
+	}
+	ANPRSignatureCacheEntry* pEntry1;
+	ANPRSignatureCacheEntry* pEntry2;
+	CDKSignature* pSignature1 = ANPRSignatureCacheAcquire(pCache, pBuffer1, uSize1, &pEntry1);
+	if (!pSignature1)
+		return -1;
+	CDKSignature* pSignature2 = ANPRSignatureCacheAcquire(pCache, pBuffer2, uSize2, &pEntry2);
+	if (!pSignature2)
+	{
+		ANPRSignatureCacheRelease(pCache, pEntry1);
+		return -1;
+	}
+	int32_t iScore = CDKSignatureCompareEx(pSignature1, pSignature2, iMinScoreRequired);
+	if (iScore < 0)
+		CDKSetLastError(pCache, "%s", CDKGetLastError(pSignature1));
+	ANPRSignatureCacheRelease(pCache, pEntry2);
+	ANPRSignatureCacheRelease(pCache, pEntry1);
+	return iScore;
+}
+
+int32_t ANPRSignatureCacheGetStats(ANPRSignatureCache* pCache, ANPRSignatureCacheStats* pStats)
+{
+	if (!pCache || !pStats)
+		return CDK_FAIL;
+	memset(pStats, 0, sizeof(*pStats));
+	for (ANPRSignatureCacheShard& shard : pCache->shards)
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		pStats->uHits += shard.uHits;
+		pStats->uMisses += shard.uMisses;
+		pStats->uEvictions += shard.uEvictions;
+		pStats->uUncached += shard.uUncached;
+		pStats->uEntries += shard.entries.size();
+		pStats->uBytes += shard.uBytes;
+	}
+	return CDK_OK;
+}
@@ -0,0 +1,122 @@
+/*! \file
+
+ANPRSignatureCache : cache of parsed signatures, keyed by the content of the signature buffers.<br/>
+The same signature buffer is usually compared many times : against the reads of the other sensors, and by every query
+it takes part in. The cache parses a buffer with <a href="#CDKSignatureCreate">CDKSignatureCreate</a> the first time it is
+seen, and returns the same <a href="#CDKSignature">CDKSignature</a> for every later buffer with the same content, until it
+is evicted. The cache holds at most a configured number of bytes, and evicts the least recently used signatures first.<br/>
+A signature acquired from the cache stays valid until it is released, even if it is evicted in between.
+
+*/
+
+#ifndef ANPRSIGNATURECACHE_H
+#define ANPRSIGNATURECACHE_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "CDKSignature.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A signature cache
+*/
+typedef struct _anprsignaturecache ANPRSignatureCache;
+
+/*! <summary>struct</summary>
+	A signature acquired from a cache, to be given back to <a href="#ANPRSignatureCacheRelease">ANPRSignatureCacheRelease</a>
+*/
+typedef struct _anprsignaturecacheentry ANPRSignatureCacheEntry;
+
+/*! <summary>struct</summary>
+	Configuration of a signature cache
+*/
+typedef struct
+{
+	/*! memory held by the cached signatures, in bytes : parsed features, copy of the buffer and bookkeeping */
+	uint64_t uMaxBytes;
+	/*! independently locked parts of the cache, each holding uMaxBytes / uShards bytes. 0 for one per core */
+	uint32_t uShards;
+} ANPRSignatureCacheConfig;
+
+/*! <summary>struct</summary>
+	Counters of a signature cache
+*/
+typedef struct
+{
+	/*! acquisitions of a cached signature */
+	uint64_t uHits;
+	/*! acquisitions that parsed the buffer */
+	uint64_t uMisses;
+	/*! signatures evicted to stay within the memory budget */
+	uint64_t uEvictions;
+	/*! signatures parsed but not cached, because the budget is held by acquired signatures or another buffer has the same hash */
+	uint64_t uUncached;
+	/*! cached signatures */
+	uint64_t uEntries;
+	/*! memory held by the cached signatures, in bytes */
+	uint64_t uBytes;
+} ANPRSignatureCacheStats;
+
+/*!
+	Fills a configuration with default values : 64 MB, one shard per core
+*/
+void ANPRSignatureCacheDefaultConfig(ANPRSignatureCacheConfig* pConfig);
+
+/*!
+	Creates a signature cache. Use <a href="#ANPRSignatureCacheDestroy">ANPRSignatureCacheDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@returns the cache, or NULL on failure
+*/
+ANPRSignatureCache* ANPRSignatureCacheCreate(const ANPRSignatureCacheConfig* pConfig);
+
+/*!
+	Destroys a signature cache and its signatures. Every acquired signature must have been released.
+*/
+void ANPRSignatureCacheDestroy(ANPRSignatureCache* pCache);
+
+/*!
+	Returns the parsed signature of a buffer, parsing it only if it is not cached.<br/>
+	Can be called from any thread. The signature must not be destroyed : give the entry back to
+	<a href="#ANPRSignatureCacheRelease">ANPRSignatureCacheRelease</a> once the signature is no longer used.<br/>
+	The signature is shared by every thread acquiring the same buffer : it must not be compared with a signature of another
+	size, as the comparison would then set its last error.
+	@param[in] pCache the cache
+	@param[in] pBuffer signature buffer, as given to <a href="#CDKSignatureCreate">CDKSignatureCreate</a>
+	@param[in] uSize signature buffer size
+	@param[out] ppEntry entry of the signature in the cache
+	@returns the signature, or NULL on failure. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> with pCache for more details
+*/
+CDKSignature* ANPRSignatureCacheAcquire(ANPRSignatureCache* pCache, const uint8_t* pBuffer, uint32_t uSize, ANPRSignatureCacheEntry** ppEntry);
+
+/*!
+	Releases a signature acquired with <a href="#ANPRSignatureCacheAcquire">ANPRSignatureCacheAcquire</a>
+*/
+void ANPRSignatureCacheRelease(ANPRSignatureCache* pCache, ANPRSignatureCacheEntry* pEntry);
+
+/*!
+	Compares 2 signature buffers with <a href="#CDKSignatureCompareEx">CDKSignatureCompareEx</a>, through the cache
+	@param[in] pCache the cache
+	@param[in] pBuffer1 first signature buffer
+	@param[in] uSize1 first signature buffer size
+	@param[in] pBuffer2 second signature buffer
+	@param[in] uSize2 second signature buffer size
+	@param[in] iMinScoreRequired minimum score, 0 for a full comparison
+	@returns the comparison score, between 0 and 10, or -1 in case of error, such as buffers of different sizes
+*/
+int32_t ANPRSignatureCacheCompare(ANPRSignatureCache* pCache, const uint8_t* pBuffer1, uint32_t uSize1,
+	const uint8_t* pBuffer2, uint32_t uSize2, int32_t iMinScoreRequired);
+
+/*!
+	Returns the counters of a signature cache
+*/
+int32_t ANPRSignatureCacheGetStats(ANPRSignatureCache* pCache, ANPRSignatureCacheStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRSIGNATURECACHE_H
@@ -0,0 +1,340 @@
+/*! \file
+
+ANPRSignatureIndex : time-windowed index of vehicle signatures.
+
+The live signatures are kept in insertion order, so that expiry pops the front. A query splits them in chunks taken
+by the threads from a shared counter. Every thread keeps its own k best candidates in a heap whose top is the worst
+one, and publishes the score of that top in a shared threshold : a candidate below the k-th best score of any
+thread cannot be in the global k best, so every comparison requires the highest of these scores.
+
+*/
+
+#include <algorithm>
+#include <new>
+#include <shared_mutex>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRSignatureIndex.h"
+
+/*!
+	Signatures taken at once by a query thread
+*/
+#define ANPR_SIGNATURE_INDEX_CHUNK 512
+
+struct ANPRSignatureIndexEntry
+{
+	CDKSignature* pSignature;
+	/*! compared only to a query of the same size */
+	uint32_t uFeatures;
+	uint64_t uId;
+	int64_t iTimestampUs;
+};
+
+/*!
+	Results of one query thread
+*/
+struct ANPRSignatureIndexWorker
+{
+	std::vector<ANPRSignatureMatch> heap;
+	uint64_t uCompared = 0;
+	std::thread thread;
+};
+
+struct _anprsignatureindex : CDKObject
+{
+	ANPRSignatureIndexConfig config;
+
+	/*! live signatures, in insertion order : shared by the queries, exclusive for insertions and expiry */
+	std::shared_mutex storeMutex;
+	std::deque<ANPRSignatureIndexEntry> entries;
+	uint64_t uInserted = 0;
+	uint64_t uExpired = 0;
+
+	/*! one query at a time */
+	std::mutex queryMutex;
+	uint64_t uQueries = 0;
+	uint64_t uCompared = 0;
+
+	/*! running query, set by the calling thread before waking the workers */
+	CDKSignature* pQuerySignature = nullptr;
+	uint32_t uQueryFeatures = 0;
+	uint32_t uQueryK = 0;
+	int32_t iQueryMinScore = 0;
+	int64_t iQueryFromUs = 0;
+	int64_t iQueryToUs = 0;
+	std::atomic<size_t> uNextChunk{0};
+	std::atomic<int32_t> iThreshold{0};
+
+	/*! worker 0 is the calling thread */
+	std::vector<ANPRSignatureIndexWorker> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::condition_variable doneCondition;
+	uint64_t uGeneration = 0;
+	uint32_t uRunning = 0;
+	bool bStop = false;
+};
+
+/*!
+	Orders the candidates from the best : highest score, then most recent read
+*/
+static bool ANPRSignatureIndexBetter(const ANPRSignatureMatch& a, const ANPRSignatureMatch& b)
+{
+	if (a.iScore != b.iScore)
+		return a.iScore > b.iScore;
+	if (a.iTimestampUs != b.iTimestampUs)
+		return a.iTimestampUs > b.iTimestampUs;
+	return a.uId > b.uId;
+}
+
+static void ANPRSignatureIndexSearch(ANPRSignatureIndex* pIndex, ANPRSignatureIndexWorker* pWorker)
+{
+	std::vector<ANPRSignatureMatch>& heap = pWorker->heap;
+	heap.clear();
+	const uint32_t uK = pIndex->uQueryK;
+	const size_t uCount = pIndex->entries.size();
+	uint64_t uCompared = 0;
+	for (;;)
+	{
+		size_t uBegin = pIndex->uNextChunk.fetch_add(ANPR_SIGNATURE_INDEX_CHUNK, std::memory_order_relaxed);
+		if (uBegin >= uCount)
+			break;
+		size_t uEnd = std::min(uBegin + ANPR_SIGNATURE_INDEX_CHUNK, uCount);
+		for (size_t i = uBegin; i < uEnd; i++)
+		{
+			const ANPRSignatureIndexEntry& entry = pIndex->entries[i];
+			if ((pIndex->iQueryFromUs && entry.iTimestampUs < pIndex->iQueryFromUs) || (pIndex->iQueryToUs && entry.iTimestampUs >= pIndex->iQueryToUs))
+				continue;
+			// the comparison would set the last error of the query signature, shared by the threads
+			if (entry.uFeatures != pIndex->uQueryFeatures)
+				continue;
+			int32_t iRequired = std::max(pIndex->iQueryMinScore, pIndex->iThreshold.load(std::memory_order_relaxed));
+			if (heap.size() == uK)
+				iRequired = std::max(iRequired, heap.front().iScore);
+			uCompared++;
+			int32_t iScore = CDKSignatureCompareEx(pIndex->pQuerySignature, entry.pSignature, iRequired);
+			// pruned, or below the required score
+			if (iScore < iRequired)
+				continue;
+			ANPRSignatureMatch match = { entry.uId, entry.iTimestampUs, iScore };
+			if (heap.size() == uK)
+			{
+				if (!ANPRSignatureIndexBetter(match, heap.front()))
+					continue;
+				std::pop_heap(heap.begin(), heap.end(), ANPRSignatureIndexBetter);
+				heap.back() = match;
+			}
+			else
+				heap.push_back(match);
+			std::push_heap(heap.begin(), heap.end(), ANPRSignatureIndexBetter);
+			if (heap.size() == uK)
+			{
+				// raises the threshold of the other threads
+				int32_t iKth = heap.front().iScore;
+				int32_t iThreshold = pIndex->iThreshold.load(std::memory_order_relaxed);
+				while (iKth > iThreshold && !pIndex->iThreshold.compare_exchange_weak(iThreshold, iKth, std::memory_order_relaxed))
+					;
+			}
+		}
+	}
+	pWorker->uCompared = uCompared;
+}
+
+static void ANPRSignatureIndexThread(ANPRSignatureIndex* pIndex, uint32_t uWorker)
+{
+	uint64_t uGeneration = 0;
+	std::unique_lock<std::mutex> lock(pIndex->mutex);
+	for (;;)
+	{
+		pIndex->condition.wait(lock, [&] { return pIndex->bStop || pIndex->uGeneration != uGeneration; });
+		if (pIndex->bStop)
+			return;
+		uGeneration = pIndex->uGeneration;
+		lock.unlock();
+		ANPRSignatureIndexSearch(pIndex, &pIndex->workers[uWorker]);
+		lock.lock();
+		if (--pIndex->uRunning == 0)
+			pIndex->doneCondition.notify_one();
+	}
+}
+
+void ANPRSignatureIndexDefaultConfig(ANPRSignatureIndexConfig* pConfig)
+{
+	pConfig->uThreads = 0;
+	pConfig->iWindowUs = 0;
+}
+
+ANPRSignatureIndex* ANPRSignatureIndexCreate(const ANPRSignatureIndexConfig* pConfig)
+{
+	ANPRSignatureIndex* pIndex = new (std::nothrow) ANPRSignatureIndex();
+	if (!pIndex)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pIndex->config = *pConfig;
+	else
+		ANPRSignatureIndexDefaultConfig(&pIndex->config);
+	if (pIndex->config.uThreads == 0)
+		pIndex->config.uThreads = std::max(1u, std::thread::hardware_concurrency());
+	try
+	{
+		pIndex->workers = std::vector<ANPRSignatureIndexWorker>(pIndex->config.uThreads);
+		for (uint32_t i = 1; i < pIndex->config.uThreads; i++)
+			pIndex->workers[i].thread = std::thread(ANPRSignatureIndexThread, pIndex, i);
+	}
+	catch (const std::exception& e)
+	{
+		CDKSetLastError(nullptr, "cannot start signature index: %s", e.what());
+		ANPRSignatureIndexDestroy(pIndex);
+		return nullptr;
+	}
+	return pIndex;
+}
+
+void ANPRSignatureIndexDestroy(ANPRSignatureIndex* pIndex)
+{
+	if (!pIndex)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pIndex->mutex);
+		pIndex->bStop = true;
+	}
+	pIndex->condition.notify_all();
+	for (ANPRSignatureIndexWorker& worker : pIndex->workers)
+		if (worker.thread.joinable())
+			worker.thread.join();
+	for (ANPRSignatureIndexEntry& entry : pIndex->entries)
+		CDKSignatureDestroy(entry.pSignature);
+	delete pIndex;
+}
+
+/*!
+	Expires the front of the store, the store lock being held
+*/
+static uint64_t ANPRSignatureIndexExpireLocked(ANPRSignatureIndex* pIndex, int64_t iBeforeUs)
+{
+	uint64_t uExpired = 0;
+	while (!pIndex->entries.empty() && pIndex->entries.front().iTimestampUs < iBeforeUs)
+	{
+		CDKSignatureDestroy(pIndex->entries.front().pSignature);
+		pIndex->entries.pop_front();
+		uExpired++;
+	}
+	pIndex->uExpired += uExpired;
+	return uExpired;
+}
+
+int32_t ANPRSignatureIndexInsert(ANPRSignatureIndex* pIndex, const uint8_t* pBuffer, uint32_t uSize, uint64_t uId, int64_t iTimestampUs)
+{
+	if (!pIndex)
+		return CDK_FAIL;
+	// parsed before taking the lock, the queries are not delayed by the parsing
+	CDKSignature* pSignature = CDKSignatureCreate(pBuffer, uSize);
+	if (!pSignature)
+	{
+		CDKSetLastError(pIndex, "%s", CDKGetLastError(nullptr));
+		return CDK_FAIL;
+	}
+	std::unique_lock<std::shared_mutex> lock(pIndex->storeMutex);
+	try
+	{
+		pIndex->entries.push_back({ pSignature, uSize, uId, iTimestampUs });
+	}
+	catch (const std::bad_alloc&)
+	{
+		lock.unlock();
+		CDKSignatureDestroy(pSignature);
+		CDKSetLastError(pIndex, "out of memory");
+		return CDK_FAIL;
+	}
+	pIndex->uInserted++;
+	if (pIndex->config.iWindowUs > 0)
+		ANPRSignatureIndexExpireLocked(pIndex, iTimestampUs - pIndex->config.iWindowUs);
+	return CDK_OK;
+}
+
+uint64_t ANPRSignatureIndexExpire(ANPRSignatureIndex* pIndex, int64_t iBeforeUs)
+{
+	if (!pIndex)
+		return 0;
+	std::unique_lock<std::shared_mutex> lock(pIndex->storeMutex);
+	return ANPRSignatureIndexExpireLocked(pIndex, iBeforeUs);
+}
+
+int32_t ANPRSignatureIndexQuery(ANPRSignatureIndex* pIndex, CDKSignature* pSignature, uint32_t uK, int32_t iMinScore,
+	int64_t iFromUs, int64_t iToUs, ANPRSignatureMatch* pMatches)
+{
+	if (!pIndex)
+		return -1;
+	if (!pSignature || (uK && !pMatches))
+	{
+		CDKSetLastError(pIndex, "a signature and a result array are required");
+		return -1;
+	}
+	if (uK == 0)
+		return 0;
+	std::lock_guard<std::mutex> queryLock(pIndex->queryMutex);
+	std::shared_lock<std::shared_mutex> storeLock(pIndex->storeMutex);
+	pIndex->pQuerySignature = pSignature;
+	pIndex->uQueryFeatures = CDKSignatureFeatureCount(pSignature);
+	pIndex->uQueryK = uK;
+	pIndex->iQueryMinScore = std::max(iMinScore, 1);
+	pIndex->iQueryFromUs = iFromUs;
+	pIndex->iQueryToUs = iToUs;
+	pIndex->uNextChunk.store(0, std::memory_order_relaxed);
+	pIndex->iThreshold.store(0, std::memory_order_relaxed);
+	for (ANPRSignatureIndexWorker& worker : pIndex->workers)
+	{
+		worker.heap.clear();
+		worker.uCompared = 0;
+	}
+
+	// a single chunk is not worth waking the threads
+	uint32_t uHelpers = pIndex->entries.size() > ANPR_SIGNATURE_INDEX_CHUNK ? (uint32_t)pIndex->workers.size() - 1 : 0;
+	if (uHelpers)
+	{
+		std::lock_guard<std::mutex> lock(pIndex->mutex);
+		pIndex->uRunning = uHelpers;
+		pIndex->uGeneration++;
+		pIndex->condition.notify_all();
+	}
+	ANPRSignatureIndexSearch(pIndex, &pIndex->workers[0]);
+	if (uHelpers)
+	{
+		std::unique_lock<std::mutex> lock(pIndex->mutex);
+		pIndex->doneCondition.wait(lock, [&] { return pIndex->uRunning == 0; });
+	}
+
+	// merges the k best of every thread
+	std::vector<ANPRSignatureMatch>& merged = pIndex->workers[0].heap;
+	for (size_t i = 1; i < pIndex->workers.size(); i++)
+	{
+		ANPRSignatureIndexWorker& worker = pIndex->workers[i];
+		merged.insert(merged.end(), worker.heap.begin(), worker.heap.end());
+		pIndex->uCompared += worker.uCompared;
+	}
+	pIndex->uCompared += pIndex->workers[0].uCompared;
+	pIndex->uQueries++;
+	size_t uCount = std::min<size_t>(uK, merged.size());
+	std::partial_sort(merged.begin(), merged.begin() + uCount, merged.end(), ANPRSignatureIndexBetter);
+	std::copy(merged.begin(), merged.begin() + uCount, pMatches);
+	return (int32_t)uCount;
+}
+
+int32_t ANPRSignatureIndexGetStats(ANPRSignatureIndex* pIndex, ANPRSignatureIndexStats* pStats)
+{
+	if (!pIndex || !pStats)
+		return CDK_FAIL;
+	{
+		std::shared_lock<std::shared_mutex> lock(pIndex->storeMutex);
+		pStats->uSignatures = pIndex->entries.size();
+		pStats->uInserted = pIndex->uInserted;
+		pStats->uExpired = pIndex->uExpired;
+	}
+	std::lock_guard<std::mutex> lock(pIndex->queryMutex);
+	pStats->uQueries = pIndex->uQueries;
+	pStats->uCompared = pIndex->uCompared;
+	return CDK_OK;
+}
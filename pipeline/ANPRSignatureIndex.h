@@ -0,0 +1,131 @@
+/*! \file
+
+ANPRSignatureIndex : time-windowed index of vehicle signatures, answering top-k re-identification queries.<br/>
+The signatures are parsed once with <a href="#CDKSignatureCreate">CDKSignatureCreate</a> when they are inserted, and kept with the
+identifier and the time of their read. A query compares a signature with every live signature of a time range, on a pool of
+threads, and returns the k best scores. The comparisons use <a href="#CDKSignatureCompareEx">CDKSignatureCompareEx</a> with the
+score of the k-th best candidate found so far by any thread, so that most candidates are rejected after a few features.
+
+*/
+
+#ifndef ANPRSIGNATUREINDEX_H
+#define ANPRSIGNATUREINDEX_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+#include "CDKSignature.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A signature index
+*/
+typedef struct _anprsignatureindex ANPRSignatureIndex;
+
+/*! <summary>struct</summary>
+	Configuration of a signature index
+*/
+typedef struct
+{
+	/*! threads comparing the signatures of a query, the calling thread included. 0 for one per core */
+	uint32_t uThreads;
+	/*! signatures older than the last inserted one by more than this are expired on insertion, in us. 0 to only expire with <a href="#ANPRSignatureIndexExpire">ANPRSignatureIndexExpire</a> */
+	int64_t iWindowUs;
+} ANPRSignatureIndexConfig;
+
+/*! <summary>struct</summary>
+	A query result
+*/
+typedef struct
+{
+	/*! identifier given on insertion */
+	uint64_t uId;
+	/*! time of the read given on insertion, in us */
+	int64_t iTimestampUs;
+	/*! comparison score, from 1 to 10 */
+	int32_t iScore;
+} ANPRSignatureMatch;
+
+/*! <summary>struct</summary>
+	Counters of a signature index
+*/
+typedef struct
+{
+	/*! live signatures */
+	uint64_t uSignatures;
+	/*! signatures inserted since the creation */
+	uint64_t uInserted;
+	/*! signatures expired since the creation */
+	uint64_t uExpired;
+	/*! queries since the creation */
+	uint64_t uQueries;
+	/*! signatures compared by the queries, pruned or not */
+	uint64_t uCompared;
+} ANPRSignatureIndexStats;
+
+/*!
+	Fills a configuration with default values : one thread per core, no window
+*/
+void ANPRSignatureIndexDefaultConfig(ANPRSignatureIndexConfig* pConfig);
+
+/*!
+	Creates a signature index and its threads. Use <a href="#ANPRSignatureIndexDestroy">ANPRSignatureIndexDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@returns the index, or NULL on failure
+*/
+ANPRSignatureIndex* ANPRSignatureIndexCreate(const ANPRSignatureIndexConfig* pConfig);
+
+/*!
+	Stops the threads and destroys a signature index with its signatures
+*/
+void ANPRSignatureIndexDestroy(ANPRSignatureIndex* pIndex);
+
+/*!
+	Parses and inserts a signature. The signatures are expected in the order of their reads : expiry removes the oldest
+	insertions first.<br/>
+	Can be called from any thread. An insertion waits for the running query, if any.
+	@param[in] pIndex the index
+	@param[in] pBuffer signature buffer, as given to <a href="#CDKSignatureCreate">CDKSignatureCreate</a>
+	@param[in] uSize signature buffer size
+	@param[in] uId identifier returned by the queries, for instance the journal record of the read
+	@param[in] iTimestampUs time of the read, in us
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t ANPRSignatureIndexInsert(ANPRSignatureIndex* pIndex, const uint8_t* pBuffer, uint32_t uSize, uint64_t uId, int64_t iTimestampUs);
+
+/*!
+	Expires the signatures read before a time, from the oldest insertion up to the first signature read at or after that time
+	@param[in] pIndex the index
+	@param[in] iBeforeUs time, in us
+	@returns the number of signatures expired
+*/
+uint64_t ANPRSignatureIndexExpire(ANPRSignatureIndex* pIndex, int64_t iBeforeUs);
+
+/*!
+	Finds the live signatures closest to a signature.<br/>
+	Can be called from any thread ; concurrent queries run one after the other, each on every thread of the index.
+	@param[in] pIndex the index
+	@param[in] pSignature the signature searched, compared only with the signatures of its size
+	@param[in] uK maximum number of results
+	@param[in] iMinScore minimum score of a result, at least 1
+	@param[in] iFromUs only signatures read at or after this time, in us. 0 for no limit
+	@param[in] iToUs only signatures read before this time, in us. 0 for no limit
+	@param[out] pMatches array of at least uK results, sorted from the best score down, then from the most recent read
+	@returns the number of results, or -1 on failure
+*/
+int32_t ANPRSignatureIndexQuery(ANPRSignatureIndex* pIndex, CDKSignature* pSignature, uint32_t uK, int32_t iMinScore,
+	int64_t iFromUs, int64_t iToUs, ANPRSignatureMatch* pMatches);
+
+/*!
+	Returns the counters of a signature index
+*/
+int32_t ANPRSignatureIndexGetStats(ANPRSignatureIndex* pIndex, ANPRSignatureIndexStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRSIGNATUREINDEX_H
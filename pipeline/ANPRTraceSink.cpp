@@ -0,0 +1,481 @@
+/*! \file
+
+ANPRTraceSink : asynchronous trace sink.
+
+Every thread sending traces gets its own ring, a single producer single consumer ring of lines : the thread writes
+the line in the slot at its push position and publishes it by moving the position, the writer thread reads the
+lines up to the push position and frees their slots by moving its pop position. The ring is shared by the thread
+(through a thread local pointer) and by the sink : when the thread exits, the writer frees the ring once it is empty.<br/>
+The writer drains every ring at once, sorts the lines by time, applies the rate limit, and writes them in batches.
+
+*/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "ANPRTraceSink.h"
+
+struct ANPRTraceSinkRing
+{
+	alignas(64) std::atomic<uint64_t> uPushPos{0};
+	/*! lines dropped because the ring was full, written by the thread only */
+	std::atomic<uint64_t> uDropped{0};
+	alignas(64) std::atomic<uint64_t> uPopPos{0};
+	uint64_t uMask = 0;
+	uint32_t uThread = 0;
+	std::unique_ptr<ANPRTraceLine[]> lines;
+};
+
+/*!
+	Ring of the calling thread for the last sink it sent a trace to
+*/
+struct ANPRTraceSinkThread
+{
+	uint64_t uSinkId = 0;
+	std::shared_ptr<ANPRTraceSinkRing> pRing;
+};
+
+static thread_local ANPRTraceSinkThread t_traceThread;
+
+/*!
+	Identifiers of the sinks : a new sink at the address of a destroyed one does not get its rings
+*/
+static std::atomic<uint64_t> g_uNextSinkId{1};
+
+/*!
+	Sink installed as the trace callback of the SDK, if any
+*/
+static std::mutex g_installMutex;
+static ANPRTraceSink* g_pInstalledSink = nullptr;
+
+struct _anprtracesink : CDKObject
+{
+	ANPRTraceSinkConfig config;
+	PANPRTRACESINKWRITEFUNCTION writeFunction = nullptr;
+	void* pUser = nullptr;
+	uint64_t uId = 0;
+	std::atomic<uint8_t> level{0};
+
+	/*! protects the rings and the counters of the freed rings */
+	std::mutex mutex;
+	std::vector<std::shared_ptr<ANPRTraceSinkRing>> rings;
+	uint64_t uFreedLines = 0;
+	uint64_t uFreedDropped = 0;
+
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<bool> bWake{false};
+	bool bStop = false;
+	std::thread writer;
+
+	/*! written by the writer thread only */
+	std::atomic<uint64_t> uWritten{0};
+	std::atomic<uint64_t> uDroppedRate{0};
+	std::atomic<uint64_t> uBatches{0};
+};
+
+void ANPRTraceSinkDefaultConfig(ANPRTraceSinkConfig* pConfig)
+{
+	if (!pConfig)
+		return;
+	pConfig->uLevel = CDK_TRACE_INFO;
+	pConfig->uRingLines = 1024;
+	pConfig->uBatchLines = 256;
+	pConfig->uFlushIntervalMs = 20;
+	pConfig->uMaxLinesPerSecond = 10000;
+	pConfig->iFd = 2;
+}
+
+static int64_t ANPRTraceSinkNowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*!
+	Returns the ring of the calling thread, registering a new one on its first trace
+*/
+static ANPRTraceSinkRing* ANPRTraceSinkGetRing(ANPRTraceSink* pSink)
+{
+	ANPRTraceSinkThread& thread = t_traceThread;
+	if (thread.uSinkId == pSink->uId)
+		return thread.pRing.get();
+	std::shared_ptr<ANPRTraceSinkRing> pRing;
+	try
+	{
+		pRing = std::make_shared<ANPRTraceSinkRing>();
+		pRing->lines.reset(new ANPRTraceLine[pSink->config.uRingLines]);
+		pRing->uMask = pSink->config.uRingLines - 1;
+		pRing->uThread = (uint32_t)syscall(SYS_gettid);
+		std::lock_guard<std::mutex> lock(pSink->mutex);
+		pSink->rings.push_back(pRing);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return nullptr;
+	}
+	// the ring of the previous sink, if any, is released and freed by its writer
+	thread.uSinkId = pSink->uId;
+	thread.pRing = pRing;
+	return pRing.get();
+}
+
+/*!
+	Reserves the next slot of the ring of the calling thread, or returns NULL if it is full.
+	The line is published by <a href="#ANPRTraceSinkPublish">ANPRTraceSinkPublish</a>
+*/
+static ANPRTraceLine* ANPRTraceSinkReserve(ANPRTraceSink* pSink, ANPRTraceSinkRing*& pRing, uint8_t level, uint8_t uSource, const void* pObject)
+{
+	pRing = ANPRTraceSinkGetRing(pSink);
+	if (!pRing)
+		return nullptr;
+	uint64_t uPush = pRing->uPushPos.load(std::memory_order_relaxed);
+	if (uPush - pRing->uPopPos.load(std::memory_order_acquire) > pRing->uMask)
+	{
+		pRing->uDropped.store(pRing->uDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	ANPRTraceLine* pLine = &pRing->lines[uPush & pRing->uMask];
+	pLine->iTimeUs = ANPRTraceSinkNowUs();
+	pLine->pObject = pObject;
+	pLine->uThread = pRing->uThread;
+	pLine->level = level;
+	pLine->uSource = uSource;
+	return pLine;
+}
+
+static void ANPRTraceSinkPublish(ANPRTraceSink* pSink, ANPRTraceSinkRing* pRing)
+{
+	uint64_t uPush = pRing->uPushPos.load(std::memory_order_relaxed) + 1;
+	pRing->uPushPos.store(uPush, std::memory_order_release);
+	// the writer is woken once when the ring gets half full, rather than at every line
+	if (uPush - pRing->uPopPos.load(std::memory_order_relaxed) == (pRing->uMask + 1) / 2)
+	{
+		pSink->bWake.store(true, std::memory_order_relaxed);
+		pSink->wakeCondition.notify_one();
+	}
+}
+
+static void ANPRTraceSinkPush(ANPRTraceSink* pSink, uint8_t level, uint8_t uSource, const void* pObject, const char* strTrace)
+{
+	if (level > pSink->level.load(std::memory_order_relaxed))
+		return;
+	ANPRTraceSinkRing* pRing;
+	ANPRTraceLine* pLine = ANPRTraceSinkReserve(pSink, pRing, level, uSource, pObject);
+	if (!pLine)
+		return;
+	size_t uLength = strnlen(strTrace, ANPR_TRACE_SINK_MAX_LINE - 1);
+	memcpy(pLine->strText, strTrace, uLength);
+	pLine->strText[uLength] = 0;
+	pLine->uLength = (uint16_t)uLength;
+	ANPRTraceSinkPublish(pSink, pRing);
+}
+
+static void ANPRTraceSinkCDKTrace(CDK* pCDK, uint8_t level, const char* strTrace, void* pUser)
+{
+	ANPRTraceSinkPush((ANPRTraceSink*)pUser, level, ANPR_TRACE_SOURCE_CDK, pCDK, strTrace);
+}
+
+static void ANPRTraceSinkMatcherTrace(CDKPlateFingerprintMatcher* pMatcher, uint8_t level, const char* strTrace, void* pUser)
+{
+	ANPRTraceSinkPush((ANPRTraceSink*)pUser, level, ANPR_TRACE_SOURCE_MATCHER, pMatcher, strTrace);
+}
+
+static const char* ANPRTraceSinkLevelName(uint8_t level)
+{
+	if (level <= CDK_TRACE_CRITICAL)
+		return "CRITICAL";
+	if (level < CDK_TRACE_WARNING)
+		return "ERROR";
+	if (level < CDK_TRACE_INFO)
+		return "WARNING";
+	if (level < CDK_TRACE_DEBUG)
+		return "INFO";
+	return "DEBUG";
+}
+
+/*!
+	Writes lines as text to the file descriptor of the sink, in a single write
+*/
+static void ANPRTraceSinkWriteText(ANPRTraceSink* pSink, const ANPRTraceLine* pLines, uint32_t uLines, std::string& text)
+{
+	static const char* const sources[] = { "cdk", "matcher", "app", "sink" };
+	text.clear();
+	time_t lastSecond = -1;
+	char strSecond[32] = "";
+	for (uint32_t i = 0; i < uLines; i++)
+	{
+		const ANPRTraceLine& line = pLines[i];
+		time_t second = (time_t)(line.iTimeUs / 1000000);
+		if (second != lastSecond)
+		{
+			struct tm tm;
+			gmtime_r(&second, &tm);
+			strftime(strSecond, sizeof(strSecond), "%Y-%m-%dT%H:%M:%S", &tm);
+			lastSecond = second;
+		}
+		char strPrefix[96];
+		int iPrefix = snprintf(strPrefix, sizeof(strPrefix), "%s.%06uZ %-8s %s %u: ", strSecond, (unsigned)(line.iTimeUs % 1000000),
+			ANPRTraceSinkLevelName(line.level), sources[std::min<uint8_t>(line.uSource, ANPR_TRACE_SOURCE_SINK)], line.uThread);
+		text.append(strPrefix, (size_t)std::min(std::max(iPrefix, 0), (int)sizeof(strPrefix) - 1));
+		text.append(line.strText, std::min<size_t>(line.uLength, ANPR_TRACE_SINK_MAX_LINE - 1));
+		text.push_back('\n');
+	}
+	const char* pData = text.data();
+	size_t uSize = text.size();
+	while (uSize)
+	{
+		ssize_t iWritten = write(pSink->config.iFd, pData, uSize);
+		if (iWritten < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		pData += iWritten;
+		uSize -= (size_t)iWritten;
+	}
+}
+
+static void ANPRTraceSinkWriterThread(ANPRTraceSink* pSink)
+{
+	const ANPRTraceSinkConfig& config = pSink->config;
+	std::vector<std::shared_ptr<ANPRTraceSinkRing>> rings;
+	std::vector<ANPRTraceLine> lines;
+	std::vector<uint32_t> order;
+	std::vector<ANPRTraceLine> batch(config.uBatchLines);
+	std::string text;
+	double dTokens = config.uMaxLinesPerSecond;
+	int64_t iRefillUs = ANPRTraceSinkNowUs();
+	int64_t iReportUs = 0;
+	uint64_t uReported = 0;
+	for (;;)
+	{
+		bool bStop;
+		{
+			std::unique_lock<std::mutex> lock(pSink->wakeMutex);
+			pSink->wakeCondition.wait_for(lock, std::chrono::milliseconds(config.uFlushIntervalMs),
+				[&] { return pSink->bStop || pSink->bWake.load(std::memory_order_relaxed); });
+			pSink->bWake.store(false, std::memory_order_relaxed);
+			bStop = pSink->bStop;
+		}
+
+		// rings of the exited threads are freed once drained
+		uint64_t uDropped = 0;
+		{
+			std::lock_guard<std::mutex> lock(pSink->mutex);
+			rings.clear();
+			for (size_t i = 0; i < pSink->rings.size();)
+			{
+				ANPRTraceSinkRing* pRing = pSink->rings[i].get();
+				if (pSink->rings[i].use_count() == 1 &&
+					pRing->uPopPos.load(std::memory_order_relaxed) == pRing->uPushPos.load(std::memory_order_acquire))
+				{
+					pSink->uFreedLines += pRing->uPushPos.load(std::memory_order_relaxed);
+					pSink->uFreedDropped += pRing->uDropped.load(std::memory_order_relaxed);
+					pSink->rings[i] = pSink->rings.back();
+					pSink->rings.pop_back();
+					continue;
+				}
+				rings.push_back(pSink->rings[i]);
+				uDropped += pRing->uDropped.load(std::memory_order_relaxed);
+				i++;
+			}
+			uDropped += pSink->uFreedDropped;
+		}
+
+		// every ring is drained, so that the threads never find it full because of another one
+		lines.clear();
+		for (const std::shared_ptr<ANPRTraceSinkRing>& pRing : rings)
+		{
+			uint64_t uPop = pRing->uPopPos.load(std::memory_order_relaxed);
+			uint64_t uPush = pRing->uPushPos.load(std::memory_order_acquire);
+			for (uint64_t u = uPop; u < uPush; u++)
+				lines.push_back(pRing->lines[u & pRing->uMask]);
+			pRing->uPopPos.store(uPush, std::memory_order_release);
+		}
+		rings.clear();
+
+		// the lines are sorted by time : the oldest ones are written, the newest ones are dropped by the rate limit,
+		// with a burst of one second
+		order.resize(lines.size());
+		for (uint32_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return lines[a].iTimeUs < lines[b].iTimeUs; });
+		int64_t iNowUs = ANPRTraceSinkNowUs();
+		if (config.uMaxLinesPerSecond)
+		{
+			dTokens = std::min<double>(config.uMaxLinesPerSecond, dTokens + (double)(iNowUs - iRefillUs) * config.uMaxLinesPerSecond / 1e6);
+			size_t uAllowed = (size_t)std::min<double>((double)order.size(), dTokens);
+			dTokens -= (double)uAllowed;
+			pSink->uDroppedRate.fetch_add(order.size() - uAllowed, std::memory_order_relaxed);
+			order.resize(uAllowed);
+		}
+		iRefillUs = iNowUs;
+		uDropped += pSink->uDroppedRate.load(std::memory_order_relaxed);
+
+		// the drops are reported by a line of the sink, after the rate limit, at most once per second
+		if (uDropped != uReported && iNowUs - iReportUs >= 1000000)
+		{
+			ANPRTraceLine report = {};
+			report.iTimeUs = iNowUs;
+			report.level = CDK_TRACE_WARNING;
+			report.uSource = ANPR_TRACE_SOURCE_SINK;
+			int iLength = snprintf(report.strText, sizeof(report.strText), "%llu trace lines dropped since the last report",
+				(unsigned long long)(uDropped - uReported));
+			report.uLength = (uint16_t)std::min(std::max(iLength, 0), ANPR_TRACE_SINK_MAX_LINE - 1);
+			order.push_back((uint32_t)lines.size());
+			lines.push_back(report);
+			uReported = uDropped;
+			iReportUs = iNowUs;
+		}
+		for (size_t uFirst = 0; uFirst < order.size(); uFirst += config.uBatchLines)
+		{
+			uint32_t uCount = (uint32_t)std::min<size_t>(config.uBatchLines, order.size() - uFirst);
+			for (uint32_t i = 0; i < uCount; i++)
+				batch[i] = lines[order[uFirst + i]];
+			if (pSink->writeFunction)
+				pSink->writeFunction(batch.data(), uCount, pSink->pUser);
+			else
+				ANPRTraceSinkWriteText(pSink, batch.data(), uCount, text);
+			pSink->uWritten.fetch_add(uCount, std::memory_order_relaxed);
+			pSink->uBatches.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (bStop)
+			break;
+	}
+}
+
+ANPRTraceSink* ANPRTraceSinkCreate(const ANPRTraceSinkConfig* pConfig, PANPRTRACESINKWRITEFUNCTION writeFunction, void* pUser)
+{
+	ANPRTraceSink* pSink = new (std::nothrow) ANPRTraceSink();
+	if (!pSink)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (pConfig)
+		pSink->config = *pConfig;
+	else
+		ANPRTraceSinkDefaultConfig(&pSink->config);
+	ANPRTraceSinkConfig& config = pSink->config;
+	config.uLevel = std::min<uint32_t>(config.uLevel, CDK_TRACE_DEBUG);
+	uint32_t uRingLines = 2;
+	while (uRingLines < config.uRingLines && uRingLines < (1u << 24))
+		uRingLines *= 2;
+	config.uRingLines = uRingLines;
+	config.uBatchLines = std::max(1u, config.uBatchLines);
+	config.uFlushIntervalMs = std::max(1u, config.uFlushIntervalMs);
+	pSink->writeFunction = writeFunction;
+	pSink->pUser = pUser;
+	pSink->uId = g_uNextSinkId.fetch_add(1, std::memory_order_relaxed);
+	pSink->level.store((uint8_t)config.uLevel, std::memory_order_relaxed);
+	try
+	{
+		pSink->writer = std::thread(ANPRTraceSinkWriterThread, pSink);
+	}
+	catch (const std::exception& e)
+	{
+		CDKSetLastError(nullptr, "cannot start the writer thread: %s", e.what());
+		delete pSink;
+		return nullptr;
+	}
+	return pSink;
+}
+
+void ANPRTraceSinkDestroy(ANPRTraceSink* pSink)
+{
+	if (!pSink)
+		return;
+	{
+		// the SDK waits for the traces being copied : none is sent to the sink after this
+		std::lock_guard<std::mutex> lock(g_installMutex);
+		if (g_pInstalledSink == pSink)
+		{
+			CDKSetTraceFunction(nullptr, nullptr);
+			CDKPlateFingerprintMatcherSetTraceFunction(nullptr, nullptr);
+			g_pInstalledSink = nullptr;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(pSink->wakeMutex);
+		pSink->bStop = true;
+	}
+	pSink->wakeCondition.notify_one();
+	pSink->writer.join();
+	delete pSink;
+}
+
+void ANPRTraceSinkInstall(ANPRTraceSink* pSink)
+{
+	if (!pSink)
+		return;
+	std::lock_guard<std::mutex> lock(g_installMutex);
+	uint8_t level = pSink->level.load(std::memory_order_relaxed);
+	CDKSetTraceLevel(level);
+	CDKPlateFingerprintMatcherSetTraceLevel(level);
+	CDKSetTraceFunction(ANPRTraceSinkCDKTrace, pSink);
+	CDKPlateFingerprintMatcherSetTraceFunction(ANPRTraceSinkMatcherTrace, pSink);
+	g_pInstalledSink = pSink;
+}
+
+void ANPRTraceSinkSetLevel(ANPRTraceSink* pSink, uint8_t level)
+{
+	if (!pSink)
+		return;
+	level = std::min<uint8_t>(level, CDK_TRACE_DEBUG);
+	pSink->level.store(level, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(g_installMutex);
+	if (g_pInstalledSink == pSink)
+	{
+		CDKSetTraceLevel(level);
+		CDKPlateFingerprintMatcherSetTraceLevel(level);
+	}
+}
+
+void ANPRTraceSinkWrite(ANPRTraceSink* pSink, uint8_t level, const char* strFormat, ...)
+{
+	if (!pSink || !strFormat || level > pSink->level.load(std::memory_order_relaxed))
+		return;
+	ANPRTraceSinkRing* pRing;
+	ANPRTraceLine* pLine = ANPRTraceSinkReserve(pSink, pRing, level, ANPR_TRACE_SOURCE_APPLICATION, nullptr);
+	if (!pLine)
+		return;
+	va_list args;
+	va_start(args, strFormat);
+	int iLength = vsnprintf(pLine->strText, sizeof(pLine->strText), strFormat, args);
+	va_end(args);
+	pLine->uLength = (uint16_t)std::min(std::max(iLength, 0), ANPR_TRACE_SINK_MAX_LINE - 1);
+	ANPRTraceSinkPublish(pSink, pRing);
+}
+
+void ANPRTraceSinkGetStats(ANPRTraceSink* pSink, ANPRTraceSinkStats* pStats)
+{
+	if (!pSink || !pStats)
+		return;
+	memset(pStats, 0, sizeof(*pStats));
+	{
+		std::lock_guard<std::mutex> lock(pSink->mutex);
+		pStats->uLines = pSink->uFreedLines;
+		pStats->uDroppedFull = pSink->uFreedDropped;
+		for (const std::shared_ptr<ANPRTraceSinkRing>& pRing : pSink->rings)
+		{
+			pStats->uLines += pRing->uPushPos.load(std::memory_order_relaxed);
+			pStats->uDroppedFull += pRing->uDropped.load(std::memory_order_relaxed);
+		}
+		pStats->uRings = (uint32_t)pSink->rings.size();
+	}
+	pStats->uWritten = pSink->uWritten.load(std::memory_order_relaxed);
+	pStats->uDroppedRate = pSink->uDroppedRate.load(std::memory_order_relaxed);
+	pStats->uBatches = pSink->uBatches.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,169 @@
+/*! \file
+
+ANPRTraceSink : asynchronous sink of the traces of the CDK, of the fingerprint matchers and of the application.<br/>
+The <a href="#PCDKTRACEFUNCTION">trace callbacks</a> are called synchronously by the threads of the SDK : a trace written
+to a file or a logging service from the callback delays the network threads, and the queues fill up. The sink copies
+every trace into a ring of the calling thread, without lock nor system call, and a writer thread writes the rings in
+batches, in time order. When a ring is full, the trace is dropped and counted : tracing never waits.<br/>
+The traces above the level of the sink are discarded by the SDK before they are formatted
+(<a href="#CDKSetTraceLevel">CDKSetTraceLevel</a>), and the writer limits the number of lines written per second. The
+number of lines dropped is given by <a href="#ANPRTraceSinkGetStats">ANPRTraceSinkGetStats</a>, and written as a trace
+of the sink itself, at most once per second.
+
+*/
+
+#ifndef ANPRTRACESINK_H
+#define ANPRTRACESINK_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*!
+	Size of ANPRTraceLine::strText, including the terminating NULL. Longer traces are truncated
+*/
+#define ANPR_TRACE_SINK_MAX_LINE 232
+
+/*!
+	Sources of the traces
+*/
+#define ANPR_TRACE_SOURCE_CDK			0
+#define ANPR_TRACE_SOURCE_MATCHER		1
+#define ANPR_TRACE_SOURCE_APPLICATION	2
+#define ANPR_TRACE_SOURCE_SINK			3
+
+/*! <summary>struct</summary>
+	A trace sink
+*/
+typedef struct _anprtracesink ANPRTraceSink;
+
+/*! <summary>struct</summary>
+	Configuration of a trace sink
+*/
+typedef struct
+{
+	/*! maximum trace level kept : 1 (CRITICAL) to 8 (DEBUG) */
+	uint32_t uLevel;
+	/*! size of the ring of every thread, in lines, rounded up to a power of 2 : a line takes 256 bytes */
+	uint32_t uRingLines;
+	/*! maximum number of lines given to the write callback at once */
+	uint32_t uBatchLines;
+	/*! maximum time between two writes, in ms : the writer is woken earlier when a ring is half full */
+	uint32_t uFlushIntervalMs;
+	/*! maximum number of lines written per second, beyond which they are dropped. 0 for no limit */
+	uint32_t uMaxLinesPerSecond;
+	/*! file descriptor the lines are written to, without write callback */
+	int32_t iFd;
+} ANPRTraceSinkConfig;
+
+/*! <summary>struct</summary>
+	A trace
+*/
+typedef struct
+{
+	/*! time of the trace, in us since the epoch */
+	int64_t iTimeUs;
+	/*! CDK or matcher that sent the trace. Can be NULL */
+	const void* pObject;
+	/*! system identifier of the thread that sent the trace */
+	uint32_t uThread;
+	/*! trace level : 1 (CRITICAL) to 8 (DEBUG) */
+	uint8_t level;
+	/*! ANPR_TRACE_SOURCE_CDK, ANPR_TRACE_SOURCE_MATCHER, ANPR_TRACE_SOURCE_APPLICATION or ANPR_TRACE_SOURCE_SINK */
+	uint8_t uSource;
+	/*! length of strText */
+	uint16_t uLength;
+	char strText[ANPR_TRACE_SINK_MAX_LINE];
+} ANPRTraceLine;
+
+/*! <summary>callback</summary>
+
+	Callback called by the writer thread with a batch of traces, in time order.
+	@param[in] pLines the traces
+	@param[in] uLines number of traces
+	@param[in] pUser User data
+*/
+typedef void (*PANPRTRACESINKWRITEFUNCTION)(const ANPRTraceLine* pLines, uint32_t uLines, void* pUser);
+
+/*! <summary>struct</summary>
+	Counters of a trace sink
+*/
+typedef struct
+{
+	/*! traces copied into the rings */
+	uint64_t uLines;
+	/*! traces written */
+	uint64_t uWritten;
+	/*! traces dropped because the ring of their thread was full */
+	uint64_t uDroppedFull;
+	/*! traces dropped because of uMaxLinesPerSecond */
+	uint64_t uDroppedRate;
+	/*! batches written */
+	uint64_t uBatches;
+	/*! rings of the threads that sent traces */
+	uint32_t uRings;
+} ANPRTraceSinkStats;
+
+/*!
+	Fills a configuration with default values : INFO level, rings of 1024 lines, batches of 256 lines, written every
+	20 ms, at most 10000 lines per second, to the standard error
+*/
+void ANPRTraceSinkDefaultConfig(ANPRTraceSinkConfig* pConfig);
+
+/*!
+	Creates a trace sink and starts its writer thread. Use <a href="#ANPRTraceSinkDestroy">ANPRTraceSinkDestroy</a> to destroy it.
+	@param[in] pConfig configuration, or NULL for the default configuration
+	@param[in] writeFunction callback writing the traces, or NULL to write them as text lines to ANPRTraceSinkConfig::iFd
+	@param[in] pUser callback user data
+	@returns the sink, or NULL on failure
+*/
+ANPRTraceSink* ANPRTraceSinkCreate(const ANPRTraceSinkConfig* pConfig, PANPRTRACESINKWRITEFUNCTION writeFunction, void* pUser);
+
+/*!
+	Writes the traces sent so far and destroys a trace sink. If it is still the installed sink, the trace callbacks are
+	removed, once the traces being sent by the SDK are copied : the CDK instances and the matchers can keep running. The
+	application must not call <a href="#ANPRTraceSinkWrite">ANPRTraceSinkWrite</a> with the sink any more.
+*/
+void ANPRTraceSinkDestroy(ANPRTraceSink* pSink);
+
+/*!
+	Installs the sink as the trace callback of the CDK (<a href="#CDKSetTraceFunction">CDKSetTraceFunction</a>) and of the
+	fingerprint matchers (<a href="#CDKPlateFingerprintMatcherSetTraceFunction">CDKPlateFingerprintMatcherSetTraceFunction</a>),
+	and sets their trace level to the level of the sink. It replaces the sink installed before, if any.
+*/
+void ANPRTraceSinkInstall(ANPRTraceSink* pSink);
+
+/*!
+	Changes the maximum trace level kept, and the trace level of the SDK if the sink is installed.
+	@param[in] pSink the sink
+	@param[in] level maximum trace level : 0 (no trace) to 8 (DEBUG)
+*/
+void ANPRTraceSinkSetLevel(ANPRTraceSink* pSink, uint8_t level);
+
+/*!
+	Sends a trace of the application. The format is only expanded if the level is kept.<br/>
+	Can be called from any thread.
+	@param[in] pSink the sink
+	@param[in] level trace level : 1 (CRITICAL) to 8 (DEBUG)
+	@param[in] strFormat printf format
+*/
+void ANPRTraceSinkWrite(ANPRTraceSink* pSink, uint8_t level, const char* strFormat, ...)
+#ifdef __GNUC__
+	__attribute__((format(printf, 3, 4)))
+#endif
+	;
+
+/*!
+	Returns the counters of a trace sink
+*/
+void ANPRTraceSinkGetStats(ANPRTraceSink* pSink, ANPRTraceSinkStats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ANPRTRACESINK_H
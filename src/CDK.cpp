@@ -0,0 +1,875 @@
+/*! \file
+
+CDK : reference implementation of the link to a SURVISION equipment.
+
+Each bound CDK instance owns one connection thread. It connects to the equipment, reconnects after
+a failure, pushes received asynchronous messages to the CDK queue and hands answers back to
+<a href="#CDKSendRequest">CDKSendRequest</a>. See CDKWire.h for the framing.
+
+Bind options are a list of key=value pairs separated by ';' :
+<ul>
+<li>reconnect : delay between two connection attempts, in ms (default 1000)</li>
+<li>reconnectMax : maximum delay between two connection attempts, in ms (default 0, the delay is fixed). When it is greater
+than reconnect, the delay doubles after every failed attempt up to reconnectMax, with a random jitter of +/- 25% so that
+a fleet of CDK losing the same network does not reconnect in lockstep. A successful connection resets the delay.</li>
+<li>connectTimeout : timeout of a connection attempt, in ms (default 3000)</li>
+</ul>
+The reference implementation does not negotiate TLS : <a href="#CDKBindS">CDKBindS</a> uses the same transport
+as <a href="#CDKBind">CDKBind</a> and only records the secured mode.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <utility>
+
+#include "CDKPrivate.h"
+#include "CDKWire.h"
+
+#define CDK_VERSION "1.0.0-ref"
+
+static CDKTraceHook<PCDKTRACEFUNCTION> g_traceHook;
+static std::atomic<uint8_t> g_traceLevel{CDK_TRACE_DEBUG};
+static thread_local char g_strThreadLastError[CDK_LAST_ERROR_SIZE];
+
+void CDKSetLastError(void* pObject, const char* strFormat, ...)
+{
+	char* strError = pObject ? ((CDKObject*)pObject)->strLastError : g_strThreadLastError;
+	va_list args;
+	va_start(args, strFormat);
+	vsnprintf(strError, CDK_LAST_ERROR_SIZE, strFormat, args);
+	va_end(args);
+}
+
+void CDKTrace(CDK* pCDK, uint8_t level, const char* strFormat, ...)
+{
+	if (level > g_traceLevel.load(std::memory_order_relaxed))
+		return;
+	CDKTraceHook<PCDKTRACEFUNCTION>::Slot* pSlot = g_traceHook.Enter();
+	PCDKTRACEFUNCTION traceFunction = pSlot->function.load(std::memory_order_relaxed);
+	if (traceFunction)
+	{
+		char strTrace[512];
+		va_list args;
+		va_start(args, strFormat);
+		vsnprintf(strTrace, sizeof(strTrace), strFormat, args);
+		va_end(args);
+		traceFunction(pCDK, level, strTrace, pSlot->pUser.load(std::memory_order_relaxed));
+	}
+	g_traceHook.Leave(pSlot);
+}
+
+//---------------------------------------------------------------------------------------------
+// connection thread
+//---------------------------------------------------------------------------------------------
+
+static void CDKParseOptions(CDK* pCDK, const char* options)
+{
+	if (!options)
+		return;
+	std::string strOptions(options);
+	size_t uStart = 0;
+	while (uStart < strOptions.size())
+	{
+		size_t uEnd = strOptions.find(';', uStart);
+		if (uEnd == std::string::npos)
+			uEnd = strOptions.size();
+		std::string strPair = strOptions.substr(uStart, uEnd - uStart);
+		size_t uEqual = strPair.find('=');
+		if (uEqual != std::string::npos)
+		{
+			std::string strKey = strPair.substr(0, uEqual);
+			uint32_t uValue = (uint32_t)strtoul(strPair.c_str() + uEqual + 1, nullptr, 10);
+			if (CDKMsgStringEqual(strKey.c_str(), "reconnect"))
+				pCDK->uReconnectDelayMs = uValue;
+			else if (CDKMsgStringEqual(strKey.c_str(), "reconnectMax"))
+				pCDK->uReconnectMaxMs = uValue;
+			else if (CDKMsgStringEqual(strKey.c_str(), "connectTimeout"))
+				pCDK->uConnectTimeoutMs = uValue;
+			else
+				CDKTrace(pCDK, CDK_TRACE_WARNING, "unknown bind option %s", strKey.c_str());
+		}
+		uStart = uEnd + 1;
+	}
+}
+
+static void CDKSetConnected(CDK* pCDK, int32_t bConnected)
+{
+	PCDKSTATECALLBACK stateCallback;
+	void* pStateUser;
+	PCDKSTATECALLBACK2 stateCallback2;
+	void* pStateUser2;
+	std::vector<CDKPendingRequest*> failedRequests;
+	{
+		std::lock_guard<std::mutex> lock(pCDK->mutex);
+		pCDK->bConnected = bConnected;
+		if (!bConnected)
+		{
+			// wake up requests waiting for an answer that will never come
+			for (CDKPendingRequest* pRequest : pCDK->pendingRequests)
+			{
+				pRequest->bDone = true;
+				if (pRequest->callback)
+					failedRequests.push_back(pRequest);
+			}
+			pCDK->pendingRequests.clear();
+			pCDK->iNextDeadline = INT64_MAX;
+		}
+		stateCallback = pCDK->stateCallback;
+		pStateUser = pCDK->pStateUser;
+		stateCallback2 = pCDK->stateCallback2;
+		pStateUser2 = pCDK->pStateUser2;
+	}
+	pCDK->cvState.notify_all();
+	for (CDKPendingRequest* pRequest : failedRequests)
+	{
+		pRequest->callback(pCDK, nullptr, pRequest->pUser);
+		delete pRequest;
+	}
+	CDKTrace(pCDK, CDK_TRACE_INFO, "%s:%u %s", pCDK->strAddress.c_str(), pCDK->uPort, bConnected ? "connected" : "disconnected");
+	if (stateCallback)
+		stateCallback(pCDK, bConnected, pStateUser);
+	if (stateCallback2)
+		stateCallback2(pCDK, bConnected, pCDK->uSSLErrors.load(), pStateUser2);
+}
+
+static int CDKConnect(CDK* pCDK)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	char strPort[8];
+	snprintf(strPort, sizeof(strPort), "%u", pCDK->uPort);
+
+	struct addrinfo* pResult = nullptr;
+	int iError = getaddrinfo(pCDK->strAddress.c_str(), strPort, &hints, &pResult);
+	if (iError != 0)
+	{
+		CDKSetLastError(pCDK, "cannot resolve %s: %s", pCDK->strAddress.c_str(), gai_strerror(iError));
+		return -1;
+	}
+
+	int iSocket = -1;
+	for (struct addrinfo* pAddr = pResult; pAddr && iSocket < 0; pAddr = pAddr->ai_next)
+	{
+		iSocket = socket(pAddr->ai_family, pAddr->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, pAddr->ai_protocol);
+		if (iSocket < 0)
+			continue;
+		if (connect(iSocket, pAddr->ai_addr, pAddr->ai_addrlen) != 0 && errno != EINPROGRESS)
+		{
+			CDKSetLastError(pCDK, "cannot connect to %s:%u: %s", pCDK->strAddress.c_str(), pCDK->uPort, strerror(errno));
+			close(iSocket);
+			iSocket = -1;
+			continue;
+		}
+		struct pollfd pfd = { iSocket, POLLOUT, 0 };
+		int iSocketError = 0;
+		socklen_t uLen = sizeof(iSocketError);
+		if (poll(&pfd, 1, (int)pCDK->uConnectTimeoutMs) != 1
+			|| getsockopt(iSocket, SOL_SOCKET, SO_ERROR, &iSocketError, &uLen) != 0 || iSocketError != 0)
+		{
+			CDKSetLastError(pCDK, "cannot connect to %s:%u: %s", pCDK->strAddress.c_str(), pCDK->uPort,
+				iSocketError ? strerror(iSocketError) : "timeout");
+			close(iSocket);
+			iSocket = -1;
+		}
+	}
+	freeaddrinfo(pResult);
+
+	if (iSocket >= 0)
+	{
+		int iOne = 1;
+		setsockopt(iSocket, IPPROTO_TCP, TCP_NODELAY, &iOne, sizeof(iOne));
+	}
+	return iSocket;
+}
+
+static void CDKOnFrame(CDK* pCDK, uint32_t uId, const std::vector<uint8_t>& payload)
+{
+	CDKMsg* pMsg = CDKMsgCreate();
+	if (!pMsg)
+		return;
+	if (CDKMsgImportFromBinaryArray(pMsg, payload.data(), (uint32_t)payload.size()) != CDK_OK)
+	{
+		CDKTrace(pCDK, CDK_TRACE_ERROR, "%s:%u invalid message: %s", pCDK->strAddress.c_str(), pCDK->uPort, CDKGetLastError(pMsg));
+		CDKMsgDestroy(pMsg);
+		return;
+	}
+
+	if (uId != 0)
+	{
+		std::unique_lock<std::mutex> lock(pCDK->mutex);
+		for (auto it = pCDK->pendingRequests.begin(); it != pCDK->pendingRequests.end(); ++it)
+		{
+			CDKPendingRequest* pRequest = *it;
+			if (pRequest->uId != uId || pRequest->bDone)
+				continue;
+			if (pRequest->callback)
+			{
+				pCDK->pendingRequests.erase(it);
+				lock.unlock();
+				pRequest->callback(pCDK, pMsg, pRequest->pUser);
+				delete pRequest;
+				return;
+			}
+			pRequest->pAnswer = pMsg;
+			pRequest->bDone = true;
+			lock.unlock();
+			pCDK->cvState.notify_all();
+			return;
+		}
+		lock.unlock();
+		CDKTrace(pCDK, CDK_TRACE_WARNING, "%s:%u late answer %u dropped", pCDK->strAddress.c_str(), pCDK->uPort, uId);
+		CDKMsgDestroy(pMsg);
+		return;
+	}
+
+	pMsg->pCDK = pCDK;
+	bool bWasEmpty = false;
+	if (CDKQueuePushInternal(pCDK->pQueue.load(std::memory_order_acquire), pMsg, &bWasEmpty) != CDK_OK)
+	{
+		pCDK->uDrops.fetch_add(1, std::memory_order_relaxed);
+		CDKMsgDestroy(pMsg);
+		return;
+	}
+	if (bWasEmpty)
+	{
+		PCDKNEWMESSAGECALLBACK newMessageCallback;
+		void* pUser;
+		{
+			std::lock_guard<std::mutex> lock(pCDK->mutex);
+			newMessageCallback = pCDK->newMessageCallback;
+			pUser = pCDK->pNewMessageUser;
+		}
+		if (newMessageCallback)
+			newMessageCallback(pCDK, pUser);
+	}
+}
+
+/*!
+	Fails the asynchronous requests whose deadline has passed. Called by the connection thread between two frames and while it waits.
+*/
+static void CDKExpireRequests(void* pUser)
+{
+	CDK* pCDK = (CDK*)pUser;
+	int64_t iNow = std::chrono::steady_clock::now().time_since_epoch().count();
+	if (iNow < pCDK->iNextDeadline.load(std::memory_order_relaxed))
+		return;
+	std::vector<CDKPendingRequest*> expiredRequests;
+	{
+		std::lock_guard<std::mutex> lock(pCDK->mutex);
+		int64_t iNextDeadline = INT64_MAX;
+		auto it = pCDK->pendingRequests.begin();
+		while (it != pCDK->pendingRequests.end())
+		{
+			CDKPendingRequest* pRequest = *it;
+			if (!pRequest->callback)
+			{
+				++it;
+				continue;
+			}
+			int64_t iDeadline = pRequest->deadline.time_since_epoch().count();
+			if (iDeadline <= iNow)
+			{
+				expiredRequests.push_back(pRequest);
+				it = pCDK->pendingRequests.erase(it);
+				continue;
+			}
+			iNextDeadline = std::min(iNextDeadline, iDeadline);
+			++it;
+		}
+		pCDK->iNextDeadline = iNextDeadline;
+	}
+	for (CDKPendingRequest* pRequest : expiredRequests)
+	{
+		CDKTrace(pCDK, CDK_TRACE_DEBUG, "%s:%u request %u timeout", pCDK->strAddress.c_str(), pCDK->uPort, pRequest->uId);
+		pRequest->callback(pCDK, nullptr, pRequest->pUser);
+		delete pRequest;
+	}
+}
+
+static void CDKReadLoop(CDK* pCDK, int iSocket)
+{
+	uint8_t header[CDK_WIRE_HEADER_SIZE];
+	std::vector<uint8_t> payload;
+	while (!pCDK->bStop)
+	{
+		CDKExpireRequests(pCDK);
+		if (CDKWireRecvAll(iSocket, header, sizeof(header), 0, &pCDK->bStop, CDKExpireRequests, pCDK) != CDK_OK)
+			return;
+		uint32_t uSize;
+		uint32_t uId;
+		CDKWireDecodeHeader(header, &uSize, &uId);
+		if (uSize > CDK_WIRE_MAX_PAYLOAD)
+		{
+			CDKTrace(pCDK, CDK_TRACE_ERROR, "%s:%u frame too big (%u bytes)", pCDK->strAddress.c_str(), pCDK->uPort, uSize);
+			return;
+		}
+		payload.resize(uSize);
+		if (uSize && CDKWireRecvAll(iSocket, payload.data(), uSize, pCDK->uConnectTimeoutMs, &pCDK->bStop) != CDK_OK)
+			return;
+		CDKOnFrame(pCDK, uId, payload);
+	}
+}
+
+static uint32_t CDKNextReconnectDelay(CDK* pCDK)
+{
+	uint32_t uDelay = pCDK->uReconnectDelayMs;
+	if (pCDK->uReconnectMaxMs <= uDelay)
+		return uDelay;
+	// exponential backoff, the shift is bounded so that it does not overflow
+	uint64_t uBackoff = (uint64_t)std::max(uDelay, 1u) << std::min(pCDK->uReconnectFailures, 20u);
+	uDelay = (uint32_t)std::min<uint64_t>(uBackoff, pCDK->uReconnectMaxMs);
+	pCDK->uReconnectFailures++;
+	// +/- 25% jitter
+	std::uniform_int_distribution<uint32_t> jitter(0, uDelay / 2);
+	return uDelay - uDelay / 4 + jitter(pCDK->reconnectRandom);
+}
+
+static void CDKWaitReconnectDelay(CDK* pCDK)
+{
+	uint32_t uDelay = CDKNextReconnectDelay(pCDK);
+	std::unique_lock<std::mutex> lock(pCDK->mutex);
+	pCDK->cvState.wait_for(lock, std::chrono::milliseconds(uDelay), [pCDK] { return pCDK->bStop.load(); });
+}
+
+static void CDKConnectionThread(CDK* pCDK)
+{
+	while (!pCDK->bStop)
+	{
+		int iSocket = CDKConnect(pCDK);
+		if (iSocket < 0)
+		{
+			CDKTrace(pCDK, CDK_TRACE_DEBUG, "%s", pCDK->strLastError);
+			CDKWaitReconnectDelay(pCDK);
+			continue;
+		}
+		pCDK->iSocket = iSocket;
+		pCDK->uReconnectFailures = 0;
+		CDKSetConnected(pCDK, 1);
+		CDKReadLoop(pCDK, iSocket);
+		{
+			std::lock_guard<std::mutex> lock(pCDK->sendMutex);
+			pCDK->iSocket = -1;
+			close(iSocket);
+		}
+		CDKSetConnected(pCDK, 0);
+		if (!pCDK->bStop)
+			CDKWaitReconnectDelay(pCDK);
+	}
+}
+
+static int32_t CDKBindInternal(CDK* pCDK, const char* strAddress, uint16_t uPort, const char* options, uint32_t bSSL)
+{
+	if (!pCDK)
+		return CDK_FAIL;
+	if (!strAddress || !*strAddress)
+	{
+		CDKSetLastError(pCDK, "invalid address");
+		return CDK_FAIL;
+	}
+	if (pCDK->bBound)
+	{
+		CDKSetLastError(pCDK, "already bound to %s:%u", pCDK->strAddress.c_str(), pCDK->uPort);
+		return CDK_FAIL;
+	}
+	pCDK->strAddress = strAddress;
+	pCDK->uPort = uPort;
+	pCDK->bSSL = bSSL;
+	pCDK->uSSLErrors = 0;
+	CDKParseOptions(pCDK, options);
+	pCDK->uReconnectFailures = 0;
+	pCDK->reconnectRandom.seed((uint32_t)(std::chrono::steady_clock::now().time_since_epoch().count() ^ (uintptr_t)pCDK));
+	pCDK->bStop = false;
+	try
+	{
+		pCDK->ioThread = std::thread(CDKConnectionThread, pCDK);
+	}
+	catch (const std::system_error& e)
+	{
+		CDKSetLastError(pCDK, "cannot start connection thread: %s", e.what());
+		return CDK_FAIL;
+	}
+	pCDK->bBound = true;
+	return CDK_OK;
+}
+
+//---------------------------------------------------------------------------------------------
+// API
+//---------------------------------------------------------------------------------------------
+
+void CDK_API CDKSetTraceFunction(PCDKTRACEFUNCTION traceFunction, void* pUser)
+{
+	g_traceHook.Set(traceFunction, pUser);
+}
+
+void CDK_API CDKSetTraceLevel(uint8_t level)
+{
+	g_traceLevel.store(level, std::memory_order_relaxed);
+}
+
+const char CDK_API * CDKGetLastError(void* pCDKObject)
+{
+	return pCDKObject ? ((CDKObject*)pCDKObject)->strLastError : g_strThreadLastError;
+}
+
+const char CDK_API * CDKGetVersion()
+{
+	return CDK_VERSION;
+}
+
+void CDK_API CDKGetFullVersion(char* strVersion)
+{
+	if (!strVersion)
+		return;
+	sprintf(strVersion, "CDK %s (reference implementation, %u bits, protocol %s)", CDK_VERSION,
+		(unsigned)(sizeof(void*) * 8), CDK_WIRE_PROTOCOL);
+}
+
+CDK CDK_API * CDKCreate()
+{
+	CDK* pCDK = new (std::nothrow) CDK();
+	if (!pCDK)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	pCDK->pInternalQueue = CDKQueueCreate();
+	if (!pCDK->pInternalQueue)
+	{
+		delete pCDK;
+		return nullptr;
+	}
+	pCDK->pInternalQueue->uUsers = 1;
+	pCDK->pQueue = pCDK->pInternalQueue;
+	return pCDK;
+}
+
+void CDK_API CDKDestroy(CDK* pCDK)
+{
+	if (!pCDK)
+		return;
+	CDKUnbind(pCDK);
+	// the connection thread is stopped : no message of this instance can be dropped any more
+	CDKQueueForgetProducer(pCDK->pQueue.load(), pCDK);
+	CDKSetQueue(pCDK, nullptr);
+	pCDK->pInternalQueue->uUsers = 0;
+	CDKQueueDestroy(pCDK->pInternalQueue);
+	delete pCDK;
+}
+
+int32_t CDK_API CDKBind(CDK* pCDK, const char* strAddress, uint16_t uPort, const char* options)
+{
+	return CDKBindInternal(pCDK, strAddress, uPort, options, 0);
+}
+
+int32_t CDK_API CDKBindS(CDK* pCDK, const char* strAddress, uint16_t uPort, const char* options)
+{
+	return CDKBindInternal(pCDK, strAddress, uPort, options, 1);
+}
+
+int32_t CDK_API CDKUnbind(CDK* pCDK)
+{
+	if (!pCDK)
+		return CDK_FAIL;
+	if (!pCDK->bBound)
+	{
+		CDKSetLastError(pCDK, "not bound");
+		return CDK_FAIL;
+	}
+	{
+		std::lock_guard<std::mutex> lock(pCDK->mutex);
+		pCDK->bStop = true;
+	}
+	pCDK->cvState.notify_all();
+	if (pCDK->ioThread.joinable())
+		pCDK->ioThread.join();
+	pCDK->bBound = false;
+	return CDK_OK;
+}
+
+const char CDK_API * CDKGetAddress(CDK* pCDK)
+{
+	return pCDK ? pCDK->strAddress.c_str() : nullptr;
+}
+
+uint16_t CDK_API CDKGetPort(CDK* pCDK)
+{
+	return pCDK ? pCDK->uPort : 0;
+}
+
+void CDK_API CDKSetQueue(CDK* pCDK, CDKQueue* pQueue)
+{
+	if (!pCDK)
+		return;
+	if (!pQueue)
+		pQueue = pCDK->pInternalQueue;
+	CDKQueue* pOldQueue = pCDK->pQueue.exchange(pQueue, std::memory_order_acq_rel);
+	if (pOldQueue == pQueue)
+		return;
+	CDKQueueForgetProducer(pOldQueue, pCDK);
+	if (pQueue != pCDK->pInternalQueue)
+		pQueue->uUsers++;
+	if (pOldQueue != pCDK->pInternalQueue)
+		pOldQueue->uUsers--;
+}
+
+int32_t CDK_API CDKGetConnectionState(CDK* pCDK)
+{
+	return pCDK ? pCDK->bConnected.load() : 0;
+}
+
+void CDK_API CDKSetConnectionStateCallback(CDK* pCDK, PCDKSTATECALLBACK stateCallback, void* pUser)
+{
+	if (!pCDK)
+		return;
+	std::lock_guard<std::mutex> lock(pCDK->mutex);
+	pCDK->stateCallback = stateCallback;
+	pCDK->pStateUser = pUser;
+}
+
+void CDK_API CDKSetConnectionStateCallback2(CDK* pCDK, PCDKSTATECALLBACK2 stateCallback, void* pUser)
+{
+	if (!pCDK)
+		return;
+	std::lock_guard<std::mutex> lock(pCDK->mutex);
+	pCDK->stateCallback2 = stateCallback;
+	pCDK->pStateUser2 = pUser;
+}
+
+void CDK_API CDKSetNewMessageCallback(CDK* pCDK, PCDKNEWMESSAGECALLBACK newMessageCallback, void* pUser)
+{
+	if (!pCDK)
+		return;
+	std::lock_guard<std::mutex> lock(pCDK->mutex);
+	pCDK->newMessageCallback = newMessageCallback;
+	pCDK->pNewMessageUser = pUser;
+}
+
+uint32_t CDK_API CDKGetMessageDrops(CDK* pCDK)
+{
+	return pCDK ? pCDK->uDrops.load(std::memory_order_relaxed) : 0;
+}
+
+void CDK_API CDKResetMessageDrops(CDK* pCDK)
+{
+	if (pCDK)
+		pCDK->uDrops = 0;
+}
+
+uint32_t CDK_API CDKGetMaxQueueSize(CDK* pCDK)
+{
+	return pCDK ? CDKQueueGetMaxQueueSize(pCDK->pQueue.load()) : 0;
+}
+
+void CDK_API CDKSetMaxQueueSize(CDK* pCDK, uint32_t uMax)
+{
+	if (pCDK)
+		CDKQueueSetMaxQueueSize(pCDK->pQueue.load(), uMax);
+}
+
+int32_t CDK_API CDKWaitForNewMessage(CDK* pCDK, uint32_t uTimeout)
+{
+	return pCDK ? CDKQueueWaitForNewMessage(pCDK->pQueue.load(), uTimeout) : CDK_FAIL;
+}
+
+int CDK_API CDKGetReadyFd(CDK* pCDK)
+{
+	if (!pCDK)
+		return -1;
+	CDKQueue* pQueue = pCDK->pQueue.load();
+	int iFd = CDKQueueGetReadyFd(pQueue);
+	if (iFd < 0)
+		CDKSetLastError(pCDK, "%s", CDKGetLastError(pQueue));
+	return iFd;
+}
+
+uint32_t CDK_API CDKGetQueueSize(CDK* pCDK)
+{
+	return pCDK ? CDKQueueGetQueueSize(pCDK->pQueue.load()) : 0;
+}
+
+CDKMsg CDK_API * CDKPopMessage(CDK* pCDK)
+{
+	return pCDK ? CDKQueuePopMessage(pCDK->pQueue.load()) : nullptr;
+}
+
+/*!
+	Sends a frame on the current connection, in at most uTimeoutMs. A frame partly sent leaves the stream unusable : the
+	connection is then shut down, and reopened by the connection thread
+*/
+static int32_t CDKSendFrame(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uId, uint32_t uTimeoutMs)
+{
+	// large contents (images) are sent from the message itself, without being copied into a frame
+	CDKMsgExportBuffer* pBuffer = CDKMsgExportToSegments(pMsgToSend, 0);
+	if (!pBuffer)
+	{
+		CDKSetLastError(pCDK, "cannot export message: %s", CDKGetLastError(pMsgToSend));
+		return CDK_FAIL;
+	}
+	uint8_t header[CDK_WIRE_HEADER_SIZE];
+	CDKWireEncodeHeader(header, CDKMsgExportBufferGetSize(pBuffer), uId);
+	const CDKMsgSegment* pSegments = nullptr;
+	uint32_t uSegments = CDKMsgExportBufferGetSegments(pBuffer, &pSegments);
+	int32_t iResult = CDK_OK;
+	{
+		std::lock_guard<std::mutex> lock(pCDK->sendMutex);
+		int iSocket = pCDK->iSocket;
+		if (iSocket < 0)
+		{
+			CDKSetLastError(pCDK, "not connected");
+			iResult = CDK_FAIL;
+		}
+		else if (CDKWireSendSegments(iSocket, header, pSegments, uSegments, uTimeoutMs, &pCDK->bStop) != CDK_OK)
+		{
+			CDKSetLastError(pCDK, "send failed: %s", strerror(errno));
+			shutdown(iSocket, SHUT_RDWR);
+			iResult = CDK_FAIL;
+		}
+	}
+	CDKMsgExportBufferDestroy(pBuffer);
+	return iResult;
+}
+
+/*!
+	Returns a request identifier. 0 is reserved for asynchronous messages.
+*/
+static uint32_t CDKNextRequestId(CDK* pCDK)
+{
+	uint32_t uId = pCDK->uNextRequestId.fetch_add(1);
+	return uId ? uId : pCDK->uNextRequestId.fetch_add(1);
+}
+
+CDKMsg CDK_API * CDKSendRequest(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs)
+{
+	if (!pCDK || !pMsgToSend)
+		return nullptr;
+	if (!pCDK->bConnected)
+	{
+		CDKSetLastError(pCDK, "not connected");
+		return nullptr;
+	}
+
+	CDKPendingRequest request;
+	request.uId = CDKNextRequestId(pCDK);
+	{
+		std::lock_guard<std::mutex> lock(pCDK->mutex);
+		pCDK->pendingRequests.push_back(&request);
+	}
+
+	// the timeout covers the send and the answer
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(uTimeoutMs);
+	bool bSent = CDKSendFrame(pCDK, pMsgToSend, request.uId, std::max(1u, uTimeoutMs)) == CDK_OK;
+
+	std::unique_lock<std::mutex> lock(pCDK->mutex);
+	if (bSent)
+		pCDK->cvState.wait_until(lock, deadline, [&request] { return request.bDone; });
+	auto it = std::find(pCDK->pendingRequests.begin(), pCDK->pendingRequests.end(), &request);
+	if (it != pCDK->pendingRequests.end())
+		pCDK->pendingRequests.erase(it);
+	if (bSent && !request.pAnswer)
+		CDKSetLastError(pCDK, request.bDone ? "connection lost" : "request timeout");
+	return request.pAnswer;
+}
+
+int32_t CDK_API CDKSendRequestCallback(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs, PCDKREQUESTCALLBACK callback, void* pUser)
+{
+	if (!pCDK || !pMsgToSend || !callback)
+		return CDK_FAIL;
+	if (!pCDK->bConnected)
+	{
+		CDKSetLastError(pCDK, "not connected");
+		return CDK_FAIL;
+	}
+	CDKPendingRequest* pRequest = new (std::nothrow) CDKPendingRequest();
+	if (!pRequest)
+	{
+		CDKSetLastError(pCDK, "out of memory");
+		return CDK_FAIL;
+	}
+	pRequest->uId = CDKNextRequestId(pCDK);
+	pRequest->callback = callback;
+	pRequest->pUser = pUser;
+	pRequest->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(uTimeoutMs);
+	{
+		std::lock_guard<std::mutex> lock(pCDK->mutex);
+		pCDK->pendingRequests.push_back(pRequest);
+		pCDK->iNextDeadline = std::min(pCDK->iNextDeadline.load(), (int64_t)pRequest->deadline.time_since_epoch().count());
+	}
+
+	uint32_t uId = pRequest->uId;
+	if (CDKSendFrame(pCDK, pMsgToSend, uId, std::max(1u, uTimeoutMs)) == CDK_OK)
+		return CDK_OK;
+	std::lock_guard<std::mutex> lock(pCDK->mutex);
+	auto it = std::find_if(pCDK->pendingRequests.begin(), pCDK->pendingRequests.end(),
+		[uId](CDKPendingRequest* pPending) { return pPending->uId == uId; });
+	// otherwise the connection has been lost meanwhile, and the callback has already been called
+	if (it == pCDK->pendingRequests.end())
+		return CDK_OK;
+	pCDK->pendingRequests.erase(it);
+	delete pRequest;
+	return CDK_FAIL;
+}
+
+static void CDKRequestRelease(CDKRequest* pRequest)
+{
+	if (pRequest->iRefCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+	CDKMsgDestroy(pRequest->pAnswer);
+	delete pRequest;
+}
+
+static void CDKRequestOnAnswer(CDK*, CDKMsg* pAnswer, void* pUser)
+{
+	CDKRequest* pRequest = (CDKRequest*)pUser;
+	{
+		std::lock_guard<std::mutex> lock(pRequest->mutex);
+		pRequest->pAnswer = pAnswer;
+		pRequest->bDone = true;
+	}
+	pRequest->cvDone.notify_all();
+	CDKRequestRelease(pRequest);
+}
+
+CDKRequest CDK_API * CDKSendRequestAsync(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs, void* pUser)
+{
+	if (!pCDK || !pMsgToSend)
+		return nullptr;
+	CDKRequest* pRequest = new (std::nothrow) CDKRequest();
+	if (!pRequest)
+	{
+		CDKSetLastError(pCDK, "out of memory");
+		return nullptr;
+	}
+	pRequest->pUser = pUser;
+	if (CDKSendRequestCallback(pCDK, pMsgToSend, uTimeoutMs, CDKRequestOnAnswer, pRequest) != CDK_OK)
+	{
+		delete pRequest;
+		return nullptr;
+	}
+	return pRequest;
+}
+
+static void CDKRequestOnAnswerToQueue(CDK* pCDK, CDKMsg* pAnswer, void* pUser)
+{
+	CDKRequestCompletion completion = *(CDKRequestCompletion*)pUser;
+	delete (CDKRequestCompletion*)pUser;
+	// a failed request is completed with an empty message
+	CDKMsg* pMsg = pAnswer ? pAnswer : CDKMsgCreate();
+	if (!pMsg)
+		return;
+	pMsg->pCDK = pCDK;
+	pMsg->pUserData = completion.pUser;
+	if (CDKQueuePushInternal(completion.pQueue, pMsg, nullptr) != CDK_OK)
+		CDKMsgDestroy(pMsg);
+}
+
+int32_t CDK_API CDKSendRequestToQueue(CDK* pCDK, CDKMsg* pMsgToSend, uint32_t uTimeoutMs, CDKQueue* pQueue, void* pUser)
+{
+	if (!pCDK || !pMsgToSend || !pQueue)
+		return CDK_FAIL;
+	CDKRequestCompletion* pCompletion = new (std::nothrow) CDKRequestCompletion{ pQueue, pUser };
+	if (!pCompletion)
+	{
+		CDKSetLastError(pCDK, "out of memory");
+		return CDK_FAIL;
+	}
+	if (CDKSendRequestCallback(pCDK, pMsgToSend, uTimeoutMs, CDKRequestOnAnswerToQueue, pCompletion) != CDK_OK)
+	{
+		delete pCompletion;
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+int32_t CDK_API CDKRequestWait(CDKRequest* pRequest, uint32_t uTimeout)
+{
+	if (!pRequest)
+		return CDK_FAIL;
+	std::unique_lock<std::mutex> lock(pRequest->mutex);
+	bool bDone = pRequest->cvDone.wait_for(lock, std::chrono::milliseconds(uTimeout), [pRequest] { return pRequest->bDone; });
+	return bDone ? CDK_OK : CDK_FAIL;
+}
+
+int32_t CDK_API CDKRequestIsComplete(CDKRequest* pRequest)
+{
+	if (!pRequest)
+		return 0;
+	std::lock_guard<std::mutex> lock(pRequest->mutex);
+	return pRequest->bDone ? 1 : 0;
+}
+
+CDKMsg CDK_API * CDKRequestTakeAnswer(CDKRequest* pRequest)
+{
+	if (!pRequest)
+		return nullptr;
+	std::lock_guard<std::mutex> lock(pRequest->mutex);
+	return std::exchange(pRequest->pAnswer, nullptr);
+}
+
+void CDK_API * CDKRequestGetUserData(CDKRequest* pRequest)
+{
+	return pRequest ? pRequest->pUser : nullptr;
+}
+
+void CDK_API CDKRequestDestroy(CDKRequest* pRequest)
+{
+	if (pRequest)
+		CDKRequestRelease(pRequest);
+}
+
+int32_t CDK_API CDKSendAsynchronousMessage(CDK* pCDK, CDKMsg* pMsgToSend)
+{
+	if (!pCDK || !pMsgToSend)
+		return CDK_FAIL;
+	return CDKSendFrame(pCDK, pMsgToSend, 0, pCDK->uConnectTimeoutMs);
+}
+
+int32_t CDK_API CDKWaitForConnection(CDK* pCDK, uint32_t uTimeout)
+{
+	if (!pCDK)
+		return CDK_FAIL;
+	std::unique_lock<std::mutex> lock(pCDK->mutex);
+	bool bConnected = pCDK->cvState.wait_for(lock, std::chrono::milliseconds(uTimeout), [pCDK] { return pCDK->bConnected.load() != 0; });
+	return bConnected ? CDK_OK : CDK_FAIL;
+}
+
+const char CDK_API * CDKGetDetectedProtocol(CDK* pCDK)
+{
+	return pCDK && pCDK->bConnected ? CDK_WIRE_PROTOCOL : "";
+}
+
+uint32_t CDK_API CDKGetSSL(CDK* pCDK)
+{
+	return pCDK ? pCDK->bSSL : 0;
+}
+
+void CDK_API CDKSetIgnoreSSLErrors(CDK* pCDK, uint32_t uErrors)
+{
+	if (pCDK)
+		pCDK->uIgnoreSSLErrors = uErrors;
+}
+
+uint32_t CDK_API CDKGetIgnoreSSLErrors(CDK* pCDK)
+{
+	return pCDK ? pCDK->uIgnoreSSLErrors : 0;
+}
+
+uint32_t CDK_API CDKGetSSLErrors(CDK* pCDK)
+{
+	return pCDK ? pCDK->uSSLErrors.load() : 0;
+}
@@ -0,0 +1,1095 @@
+/*! \file
+
+CDKMsg : reference implementation of the messages exchanged between the CDK and the Survision equipment.
+
+Binary format used by <a href="#CDKMsgExport">CDKMsgExport</a> (all integers little endian) :
+<pre>
+message : 'C' 'D' 'K' '1', u8 hasRoot, [element]
+element : u16 nameLen, name, u16 attributeCount, { u16 keyLen, key, u32 valueLen, value }*,
+          u32 contentLen, content, u32 childCount, { element }*
+</pre>
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include "CDKPrivate.h"
+
+static const uint8_t g_msgMagic[4] = { 'C', 'D', 'K', '1' };
+
+/*!
+	Maximum depth of an imported element tree. Deeper trees are considered as corrupted.
+*/
+#define CDK_MSG_MAX_DEPTH 64
+
+/*!
+	Size of the staging buffer used by CDKMsgExport before calling the export callback
+*/
+#define CDK_MSG_EXPORT_CHUNK 4096
+
+//---------------------------------------------------------------------------------------------
+// helpers
+//---------------------------------------------------------------------------------------------
+
+static bool CDKMsgIsElementReadOnly(CDKMsgElement* pElement)
+{
+	return pElement->pMsg && pElement->pMsg->bReadOnly.load(std::memory_order_acquire);
+}
+
+static void CDKMsgElementSetMsg(CDKMsgElement* pElement, CDKMsg* pMsg)
+{
+	pElement->pMsg = pMsg;
+	for (CDKMsgElement* pChild = pElement->pFirstChild; pChild; pChild = pChild->pNext)
+		CDKMsgElementSetMsg(pChild, pMsg);
+}
+
+static void CDKMsgElementUnlink(CDKMsgElement* pElement)
+{
+	CDKMsgElement* pParent = pElement->pParent;
+	if (pParent)
+	{
+		if (pElement->pPrev)
+			pElement->pPrev->pNext = pElement->pNext;
+		else
+			pParent->pFirstChild = pElement->pNext;
+		if (pElement->pNext)
+			pElement->pNext->pPrev = pElement->pPrev;
+		else
+			pParent->pLastChild = pElement->pPrev;
+		pParent->uChildCount--;
+	}
+	else if (pElement->pMsg && pElement->pMsg->pRoot == pElement)
+	{
+		pElement->pMsg->pRoot = nullptr;
+	}
+	pElement->pParent = nullptr;
+	pElement->pPrev = nullptr;
+	pElement->pNext = nullptr;
+	CDKMsgElementSetMsg(pElement, nullptr);
+}
+
+static void CDKMsgElementFree(CDKMsgElement* pElement)
+{
+	// last child first : the pool hands the elements back in document order, so that rebuilding
+	// a message of the same shape gets every element with the storage it had
+	CDKMsgElement* pChild = pElement->pLastChild;
+	while (pChild)
+	{
+		CDKMsgElement* pPrev = pChild->pPrev;
+		CDKMsgElementFree(pChild);
+		pChild = pPrev;
+	}
+	CDKMsgPoolFreeElement(pElement);
+}
+
+static CDKMsgAttribute* CDKMsgElementFindAttribute(CDKMsgElement* pElement, const char* strKey)
+{
+	for (CDKMsgAttribute& attribute : pElement->attributes)
+	{
+		if (strcasecmp(attribute.strKey.c_str(), strKey) == 0)
+			return &attribute;
+	}
+	return nullptr;
+}
+
+static bool CDKMsgNameMatches(CDKMsgElement* pElement, const char* strName)
+{
+	return !strName || strcasecmp(pElement->strName.c_str(), strName) == 0;
+}
+
+static void CDKMsgElementAppendChild(CDKMsgElement* pElement, CDKMsgElement* pChildElement)
+{
+	pChildElement->pParent = pElement;
+	pChildElement->pPrev = pElement->pLastChild;
+	pChildElement->pNext = nullptr;
+	if (pElement->pLastChild)
+		pElement->pLastChild->pNext = pChildElement;
+	else
+		pElement->pFirstChild = pChildElement;
+	pElement->pLastChild = pChildElement;
+	pElement->uChildCount++;
+	CDKMsgElementSetMsg(pChildElement, pElement->pMsg);
+}
+
+//---------------------------------------------------------------------------------------------
+// export / import
+//---------------------------------------------------------------------------------------------
+
+/*!
+	Destination of an export : a caller buffer, a callback fed by chunks, the segments of an export buffer,
+	or nothing at all to compute the size of the export
+*/
+struct CDKMsgWriter
+{
+	uint8_t* pBuffer = nullptr;
+	uint32_t uSize = 0;
+	uint32_t uPos = 0;
+	bool bOverflow = false;
+
+	PCDKMSGEXPORTCALLBACK exportCallback = nullptr;
+	void* pUser = nullptr;
+	bool bFailed = false;
+
+	CDKMsgExportBuffer* pExport = nullptr;
+	uint32_t uMinSegment = 0;
+
+	uint8_t staging[CDK_MSG_EXPORT_CHUNK];
+
+	bool Flush()
+	{
+		if (exportCallback && uPos && !bFailed)
+		{
+			if (!exportCallback(staging, uPos, pUser))
+				bFailed = true;
+			uPos = 0;
+		}
+		return !bFailed;
+	}
+
+	void Write(const void* pData, uint32_t uLen)
+	{
+		if (exportCallback)
+		{
+			if (bFailed)
+				return;
+			if (uLen >= CDK_MSG_EXPORT_CHUNK)
+			{
+				// big contents (pictures) are handed directly to the callback
+				if (Flush() && !exportCallback((const uint8_t*)pData, uLen, pUser))
+					bFailed = true;
+				return;
+			}
+			if (uPos + uLen > CDK_MSG_EXPORT_CHUNK && !Flush())
+				return;
+			memcpy(staging + uPos, pData, uLen);
+			uPos += uLen;
+			return;
+		}
+		if (pExport)
+		{
+			WriteSegment((const uint8_t*)pData, uLen);
+			return;
+		}
+		if (!pBuffer)
+		{
+			uPos += uLen;
+			return;
+		}
+		if (bOverflow || uLen > uSize - uPos)
+		{
+			bOverflow = true;
+			return;
+		}
+		memcpy(pBuffer + uPos, pData, uLen);
+		uPos += uLen;
+	}
+
+	void WriteSegment(const uint8_t* pData, uint32_t uLen)
+	{
+		std::vector<CDKMsgSegmentRef>& refs = pExport->refs;
+		uPos += uLen;
+		if (uLen >= uMinSegment)
+		{
+			// left in the message
+			refs.push_back(CDKMsgSegmentRef{ pData, 0, uLen });
+			return;
+		}
+		std::vector<uint8_t>& data = pExport->data;
+		if (refs.empty() || refs.back().pShared)
+			refs.push_back(CDKMsgSegmentRef{ nullptr, (uint32_t)data.size(), 0 });
+		data.insert(data.end(), pData, pData + uLen);
+		refs.back().uSize += uLen;
+	}
+
+	void WriteU8(uint8_t u) { Write(&u, 1); }
+	void WriteU16(uint16_t u) { uint8_t b[2] = { (uint8_t)u, (uint8_t)(u >> 8) }; Write(b, 2); }
+	void WriteU32(uint32_t u) { uint8_t b[4] = { (uint8_t)u, (uint8_t)(u >> 8), (uint8_t)(u >> 16), (uint8_t)(u >> 24) }; Write(b, 4); }
+};
+
+static void CDKMsgWriteElement(CDKMsgWriter& writer, CDKMsgElement* pElement)
+{
+	writer.WriteU16((uint16_t)pElement->strName.size());
+	writer.Write(pElement->strName.data(), (uint32_t)pElement->strName.size());
+	writer.WriteU16((uint16_t)pElement->attributes.size());
+	for (const CDKMsgAttribute& attribute : pElement->attributes)
+	{
+		writer.WriteU16((uint16_t)attribute.strKey.size());
+		writer.Write(attribute.strKey.data(), (uint32_t)attribute.strKey.size());
+		writer.WriteU32((uint32_t)attribute.strValue.size());
+		writer.Write(attribute.strValue.data(), (uint32_t)attribute.strValue.size());
+	}
+	writer.WriteU32((uint32_t)pElement->content.size());
+	if (!pElement->content.empty())
+		writer.Write(pElement->content.data(), (uint32_t)pElement->content.size());
+	writer.WriteU32(pElement->uChildCount);
+	for (CDKMsgElement* pChild = pElement->pFirstChild; pChild; pChild = pChild->pNext)
+		CDKMsgWriteElement(writer, pChild);
+}
+
+static void CDKMsgWrite(CDKMsgWriter& writer, CDKMsg* pMsg)
+{
+	writer.Write(g_msgMagic, sizeof(g_msgMagic));
+	writer.WriteU8(pMsg->pRoot ? 1 : 0);
+	if (pMsg->pRoot)
+		CDKMsgWriteElement(writer, pMsg->pRoot);
+}
+
+/*!
+	Source of an import : either a caller buffer, or a callback
+*/
+struct CDKMsgReader
+{
+	const uint8_t* pBuffer;
+	uint32_t uSize;
+	uint32_t uPos;
+
+	PCDKMSGIMPORTCALLBACK importCallback;
+	void* pUser;
+
+	bool Read(void* pData, uint32_t uLen)
+	{
+		if (importCallback)
+		{
+			uint8_t* pDest = (uint8_t*)pData;
+			while (uLen)
+			{
+				int32_t iRead = importCallback(pDest, uLen, pUser);
+				if (iRead <= 0 || (uint32_t)iRead > uLen)
+					return false;
+				pDest += iRead;
+				uLen -= (uint32_t)iRead;
+			}
+			return true;
+		}
+		if (uLen > uSize - uPos)
+			return false;
+		memcpy(pData, pBuffer + uPos, uLen);
+		uPos += uLen;
+		return true;
+	}
+
+	bool ReadU8(uint8_t& u) { return Read(&u, 1); }
+	bool ReadU16(uint16_t& u) { uint8_t b[2]; if (!Read(b, 2)) return false; u = (uint16_t)(b[0] | (b[1] << 8)); return true; }
+	bool ReadU32(uint32_t& u)
+	{
+		uint8_t b[4];
+		if (!Read(b, 4))
+			return false;
+		u = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+		return true;
+	}
+
+	bool ReadString(std::string& str, uint32_t uLen)
+	{
+		str.resize(uLen);
+		return uLen == 0 || Read(&str[0], uLen);
+	}
+
+	/*! Sanity check for sizes read from the stream, so that corrupted data does not trigger huge allocations */
+	bool Plausible(uint32_t uLen) const
+	{
+		return importCallback ? uLen <= 0x7FFFFFFF : uLen <= uSize - uPos;
+	}
+};
+
+static CDKMsgElement* CDKMsgReadElement(CDKMsgReader& reader, uint32_t uDepth)
+{
+	if (uDepth > CDK_MSG_MAX_DEPTH)
+		return nullptr;
+
+	CDKMsgElement* pElement = CDKMsgPoolAllocateElement();
+	if (!pElement)
+		return nullptr;
+
+	uint16_t u16;
+	uint32_t u32;
+	bool bOk = reader.ReadU16(u16) && reader.ReadString(pElement->strName, u16) && reader.ReadU16(u16);
+	if (bOk)
+	{
+		pElement->attributes.resize(u16);
+		for (CDKMsgAttribute& attribute : pElement->attributes)
+		{
+			bOk = reader.ReadU16(u16) && reader.ReadString(attribute.strKey, u16) && reader.ReadU32(u32)
+				&& reader.Plausible(u32) && reader.ReadString(attribute.strValue, u32);
+			if (!bOk)
+				break;
+		}
+	}
+	if (bOk)
+	{
+		bOk = reader.ReadU32(u32) && reader.Plausible(u32);
+		if (bOk && u32)
+		{
+			pElement->content.resize(u32);
+			bOk = reader.Read(pElement->content.data(), u32);
+		}
+	}
+	uint32_t uChildCount = 0;
+	if (bOk)
+		bOk = reader.ReadU32(uChildCount);
+	for (uint32_t i = 0; bOk && i < uChildCount; i++)
+	{
+		CDKMsgElement* pChild = CDKMsgReadElement(reader, uDepth + 1);
+		if (!pChild)
+			bOk = false;
+		else
+			CDKMsgElementAppendChild(pElement, pChild);
+	}
+	if (!bOk)
+	{
+		CDKMsgElementFree(pElement);
+		return nullptr;
+	}
+	return pElement;
+}
+
+static int32_t CDKMsgRead(CDKMsg* pMsg, CDKMsgReader& reader)
+{
+	if (pMsg->bReadOnly)
+	{
+		CDKSetLastError(pMsg, "message is read only");
+		return CDK_FAIL;
+	}
+
+	uint8_t magic[4];
+	uint8_t bHasRoot;
+	if (!reader.Read(magic, sizeof(magic)) || memcmp(magic, g_msgMagic, sizeof(magic)) != 0 || !reader.ReadU8(bHasRoot))
+	{
+		CDKSetLastError(pMsg, "invalid message header");
+		return CDK_FAIL;
+	}
+
+	CDKMsgElement* pRoot = nullptr;
+	if (bHasRoot)
+	{
+		pRoot = CDKMsgReadElement(reader, 0);
+		if (!pRoot)
+		{
+			CDKSetLastError(pMsg, "corrupted or truncated message");
+			return CDK_FAIL;
+		}
+	}
+
+	CDKMsgClear(pMsg);
+	if (pRoot)
+	{
+		pMsg->pRoot = pRoot;
+		CDKMsgElementSetMsg(pRoot, pMsg);
+	}
+	return CDK_OK;
+}
+
+//---------------------------------------------------------------------------------------------
+// CDKMsg
+//---------------------------------------------------------------------------------------------
+
+int32_t CDK_API CDKMsgStrToBool(const char* str)
+{
+	if (!str)
+		return 0;
+	return (CDKMsgStringEqual(str, "true") || strcmp(str, "1") == 0) ? 1 : 0;
+}
+
+int32_t CDK_API CDKMsgStringEqual(const char* str1, const char* str2)
+{
+	if (!str1 || !str2)
+		return 0;
+	return strcasecmp(str1, str2) == 0 ? 1 : 0;
+}
+
+CDKMsg CDK_API * CDKMsgCreate()
+{
+	CDKMsg* pMsg = CDKMsgPoolAllocate();
+	if (!pMsg)
+		CDKSetLastError(nullptr, "out of memory");
+	return pMsg;
+}
+
+int32_t CDK_API CDKMsgIsReadOnly(CDKMsg* pMsg)
+{
+	return pMsg && pMsg->bReadOnly.load(std::memory_order_acquire) ? 1 : 0;
+}
+
+int32_t CDK_API CDKMsgSetReadOnly(CDKMsg* pMsg, int32_t bReadOnly)
+{
+	if (!pMsg)
+		return CDK_FAIL;
+	if (!bReadOnly && pMsg->iRefCount.load(std::memory_order_acquire) > 1)
+	{
+		CDKSetLastError(pMsg, "cannot remove read only state of a message having several references");
+		return CDK_FAIL;
+	}
+	pMsg->bReadOnly.store(bReadOnly ? 1 : 0, std::memory_order_release);
+	return CDK_OK;
+}
+
+int32_t CDK_API CDKMsgSetUserData(CDKMsg* pMsg, void* pData)
+{
+	if (!pMsg)
+		return CDK_FAIL;
+	if (pMsg->bReadOnly)
+	{
+		CDKSetLastError(pMsg, "message is read only");
+		return CDK_FAIL;
+	}
+	pMsg->pUserData = pData;
+	return CDK_OK;
+}
+
+void CDK_API * CDKMsgGetUserData(CDKMsg* pMsg)
+{
+	return pMsg ? pMsg->pUserData : nullptr;
+}
+
+int32_t CDK_API CDKMsgClear(CDKMsg* pMsg)
+{
+	if (!pMsg)
+		return CDK_FAIL;
+	if (pMsg->bReadOnly)
+	{
+		CDKSetLastError(pMsg, "message is read only");
+		return CDK_FAIL;
+	}
+	if (pMsg->pRoot)
+	{
+		CDKMsgElementFree(pMsg->pRoot);
+		pMsg->pRoot = nullptr;
+	}
+	return CDK_OK;
+}
+
+void CDK_API CDKMsgDestroy(CDKMsg* pMsg)
+{
+	if (!pMsg)
+		return;
+	if (pMsg->iRefCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+	if (pMsg->pRoot)
+		CDKMsgElementFree(pMsg->pRoot);
+	CDKMsgPoolFree(pMsg);
+}
+
+CDKMsgElement CDK_API * CDKMsgChild(CDKMsg* pMsg)
+{
+	return pMsg ? pMsg->pRoot : nullptr;
+}
+
+int32_t CDK_API CDKMsgExport(CDKMsg* pMsg, PCDKMSGEXPORTCALLBACK exportCallback, void* pUser)
+{
+	if (!pMsg || !exportCallback)
+		return CDK_FAIL;
+	CDKMsgWriter* pWriter = new (std::nothrow) CDKMsgWriter();
+	if (!pWriter)
+	{
+		CDKSetLastError(pMsg, "out of memory");
+		return CDK_FAIL;
+	}
+	pWriter->exportCallback = exportCallback;
+	pWriter->pUser = pUser;
+	CDKMsgWrite(*pWriter, pMsg);
+	int32_t iResult = pWriter->Flush() ? CDK_OK : CDK_FAIL;
+	delete pWriter;
+	if (iResult != CDK_OK)
+		CDKSetLastError(pMsg, "export stopped by the callback");
+	return iResult;
+}
+
+int32_t CDK_API CDKMsgImport(CDKMsg* pMsg, PCDKMSGIMPORTCALLBACK importCallback, void* pUser)
+{
+	if (!pMsg || !importCallback)
+		return CDK_FAIL;
+	CDKMsgReader reader = {};
+	reader.importCallback = importCallback;
+	reader.pUser = pUser;
+	return CDKMsgRead(pMsg, reader);
+}
+
+int32_t CDK_API CDKMsgExportToBinaryArray(CDKMsg* pMsg, uint8_t* pBuffer, uint32_t uBufferSize)
+{
+	if (!pMsg || !pBuffer)
+		return CDK_FAIL;
+	CDKMsgWriter writer;
+	writer.pBuffer = pBuffer;
+	writer.uSize = uBufferSize;
+	CDKMsgWrite(writer, pMsg);
+	if (writer.bOverflow)
+	{
+		CDKSetLastError(pMsg, "buffer too small");
+		return CDK_FAIL;
+	}
+	return (int32_t)writer.uPos;
+}
+
+uint32_t CDK_API CDKMsgGetExportSize(CDKMsg* pMsg)
+{
+	if (!pMsg)
+		return 0;
+	CDKMsgWriter writer;
+	CDKMsgWrite(writer, pMsg);
+	return writer.uPos;
+}
+
+CDKMsgExportBuffer CDK_API * CDKMsgExportToBuffer(CDKMsg* pMsg)
+{
+	if (!pMsg)
+		return nullptr;
+	CDKMsgExportBuffer* pBuffer = CDKMsgPoolAllocateExportBuffer();
+	if (!pBuffer)
+	{
+		CDKSetLastError(pMsg, "out of memory");
+		return nullptr;
+	}
+	uint32_t uSize = CDKMsgGetExportSize(pMsg);
+	try
+	{
+		// the buffer never shrinks, so that a pooled buffer is not zeroed again
+		if (pBuffer->data.size() < uSize)
+			pBuffer->data.resize(uSize);
+		pBuffer->segments.push_back(CDKMsgSegment{ nullptr, uSize });
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKMsgPoolFreeExportBuffer(pBuffer);
+		CDKSetLastError(pMsg, "out of memory");
+		return nullptr;
+	}
+	CDKMsgExportToBinaryArray(pMsg, pBuffer->data.data(), uSize);
+	pBuffer->segments[0].pData = pBuffer->data.data();
+	pBuffer->uSize = uSize;
+	pBuffer->bContiguous = true;
+	return pBuffer;
+}
+
+CDKMsgExportBuffer CDK_API * CDKMsgExportToSegments(CDKMsg* pMsg, uint32_t uMinSegmentSize)
+{
+	if (!pMsg)
+		return nullptr;
+	CDKMsgExportBuffer* pBuffer = CDKMsgPoolAllocateExportBuffer();
+	if (!pBuffer)
+	{
+		CDKSetLastError(pMsg, "out of memory");
+		return nullptr;
+	}
+	CDKMsgWriter writer;
+	writer.pExport = pBuffer;
+	writer.uMinSegment = uMinSegmentSize ? uMinSegmentSize : CDK_MSG_EXPORT_CHUNK;
+	try
+	{
+		pBuffer->data.clear();
+		CDKMsgWrite(writer, pMsg);
+		pBuffer->segments.reserve(pBuffer->refs.size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKMsgPoolFreeExportBuffer(pBuffer);
+		CDKSetLastError(pMsg, "out of memory");
+		return nullptr;
+	}
+	// the data does not move any more
+	for (const CDKMsgSegmentRef& ref : pBuffer->refs)
+		pBuffer->segments.push_back(CDKMsgSegment{ ref.pShared ? ref.pShared : pBuffer->data.data() + ref.uOffset, ref.uSize });
+	pBuffer->uSize = writer.uPos;
+	if (pMsg->bReadOnly.load(std::memory_order_acquire) && CDKMsgAddRef(pMsg) == CDK_OK)
+		pBuffer->pHeld = pMsg;
+	return pBuffer;
+}
+
+uint32_t CDK_API CDKMsgExportBufferGetSize(CDKMsgExportBuffer* pBuffer)
+{
+	return pBuffer ? pBuffer->uSize : 0;
+}
+
+const uint8_t CDK_API * CDKMsgExportBufferGetData(CDKMsgExportBuffer* pBuffer)
+{
+	return pBuffer && pBuffer->bContiguous ? pBuffer->data.data() : nullptr;
+}
+
+uint32_t CDK_API CDKMsgExportBufferGetSegments(CDKMsgExportBuffer* pBuffer, const CDKMsgSegment** ppSegments)
+{
+	if (!pBuffer || !ppSegments)
+		return 0;
+	*ppSegments = pBuffer->segments.data();
+	return (uint32_t)pBuffer->segments.size();
+}
+
+void CDK_API CDKMsgExportBufferDestroy(CDKMsgExportBuffer* pBuffer)
+{
+	if (pBuffer)
+		CDKMsgPoolFreeExportBuffer(pBuffer);
+}
+
+int32_t CDK_API CDKMsgImportFromBinaryArray(CDKMsg* pMsg, const uint8_t* pBuffer, uint32_t uBufferSize)
+{
+	if (!pMsg || !pBuffer)
+		return CDK_FAIL;
+	CDKMsgReader reader = {};
+	reader.pBuffer = pBuffer;
+	reader.uSize = uBufferSize;
+	return CDKMsgRead(pMsg, reader);
+}
+
+CDK CDK_API * CDKMsgGetCDK(CDKMsg* pMsg)
+{
+	return pMsg ? pMsg->pCDK : nullptr;
+}
+
+CDKMsg CDK_API * CDKMsgCopy(CDKMsg* pMsg)
+{
+	if (!pMsg)
+		return nullptr;
+	CDKMsg* pCopy = CDKMsgCreate();
+	if (!pCopy)
+		return nullptr;
+	pCopy->pUserData = pMsg->pUserData;
+	pCopy->pCDK = pMsg->pCDK;
+	if (pMsg->pRoot)
+	{
+		CDKMsgElement* pRoot = CDKMsgElementCopy(pMsg->pRoot);
+		if (!pRoot)
+		{
+			CDKMsgDestroy(pCopy);
+			return nullptr;
+		}
+		pCopy->pRoot = pRoot;
+		CDKMsgElementSetMsg(pRoot, pCopy);
+	}
+	return pCopy;
+}
+
+int32_t CDK_API CDKMsgAddRef(CDKMsg* pMsg)
+{
+	if (!pMsg)
+		return CDK_FAIL;
+	if (!pMsg->bReadOnly.load(std::memory_order_acquire))
+	{
+		CDKSetLastError(pMsg, "message is not read only");
+		return CDK_FAIL;
+	}
+	pMsg->iRefCount.fetch_add(1, std::memory_order_relaxed);
+	return CDK_OK;
+}
+
+int32_t CDK_API CDKMsgSetChild(CDKMsg* pMsg, CDKMsgElement* pChildElement)
+{
+	if (!pMsg || !pChildElement)
+		return CDK_FAIL;
+	if (pMsg->bReadOnly)
+	{
+		CDKSetLastError(pMsg, "message is read only");
+		return CDK_FAIL;
+	}
+	if (pChildElement->pParent || pChildElement->pMsg)
+	{
+		CDKSetLastError(pMsg, "element is already owned");
+		return CDK_FAIL;
+	}
+	if (pMsg->pRoot)
+		CDKMsgElementFree(pMsg->pRoot);
+	pMsg->pRoot = pChildElement;
+	CDKMsgElementSetMsg(pChildElement, pMsg);
+	return CDK_OK;
+}
+
+//---------------------------------------------------------------------------------------------
+// CDKMsgElement
+//---------------------------------------------------------------------------------------------
+
+CDKMsgElement CDK_API * CDKMsgElementCreate(const char* strName)
+{
+	CDKMsgElement* pElement = CDKMsgPoolAllocateElement();
+	if (!pElement)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	if (strName)
+		pElement->strName = strName;
+	return pElement;
+}
+
+int32_t CDK_API CDKMsgElementSetName(CDKMsgElement* pElement, const char* strName)
+{
+	if (!pElement || !strName)
+		return CDK_FAIL;
+	if (CDKMsgIsElementReadOnly(pElement))
+	{
+		CDKSetLastError(pElement, "message is read only");
+		return CDK_FAIL;
+	}
+	pElement->strName = strName;
+	return CDK_OK;
+}
+
+int32_t CDK_API CDKMsgElementDestroy(CDKMsgElement* pElement)
+{
+	if (!pElement)
+		return CDK_FAIL;
+	if (CDKMsgIsElementReadOnly(pElement))
+	{
+		CDKSetLastError(pElement, "message is read only");
+		return CDK_FAIL;
+	}
+	CDKMsgElementUnlink(pElement);
+	CDKMsgElementFree(pElement);
+	return CDK_OK;
+}
+
+int32_t CDK_API CDKMsgElementDetach(CDKMsgElement* pElement)
+{
+	if (!pElement)
+		return CDK_FAIL;
+	if (CDKMsgIsElementReadOnly(pElement))
+	{
+		CDKSetLastError(pElement, "message is read only");
+		return CDK_FAIL;
+	}
+	if (!pElement->pParent && !pElement->pMsg)
+	{
+		CDKSetLastError(pElement, "element has no parent");
+		return CDK_FAIL;
+	}
+	CDKMsgElementUnlink(pElement);
+	return CDK_OK;
+}
+
+const char CDK_API * CDKMsgElementName(CDKMsgElement* pElement)
+{
+	return pElement ? pElement->strName.c_str() : nullptr;
+}
+
+CDKMsgElement CDK_API * CDKMsgElementParent(CDKMsgElement* pElement)
+{
+	return pElement ? pElement->pParent : nullptr;
+}
+
+CDKMsg CDK_API * CDKMsgElementMsg(CDKMsgElement* pElement)
+{
+	return pElement ? pElement->pMsg : nullptr;
+}
+
+int32_t CDK_API CDKMsgElementSetAttribute(CDKMsgElement* pElement, const char* strKey, const char* strValue)
+{
+	if (!pElement || !strKey || !strValue)
+		return CDK_FAIL;
+	if (CDKMsgIsElementReadOnly(pElement))
+	{
+		CDKSetLastError(pElement, "message is read only");
+		return CDK_FAIL;
+	}
+	CDKMsgAttribute* pAttribute = CDKMsgElementFindAttribute(pElement, strKey);
+	if (pAttribute)
+	{
+		pAttribute->strValue = strValue;
+		return CDK_OK;
+	}
+	pElement->attributes.push_back(CDKMsgAttribute{ strKey, strValue });
+	return CDK_OK;
+}
+
+int32_t CDK_API CDKMsgElementSetAttributeInt(CDKMsgElement* pElement, const char* strKey, int32_t iValue)
+{
+	char strValue[16];
+	snprintf(strValue, sizeof(strValue), "%d", iValue);
+	return CDKMsgElementSetAttribute(pElement, strKey, strValue);
+}
+
+int32_t CDK_API CDKMsgElementSetAttributeUInt(CDKMsgElement* pElement, const char* strKey, uint32_t uValue)
+{
+	char strValue[16];
+	snprintf(strValue, sizeof(strValue), "%u", uValue);
+	return CDKMsgElementSetAttribute(pElement, strKey, strValue);
+}
+
+int32_t CDK_API CDKMsgElementSetAttributeInt64(CDKMsgElement* pElement, const char* strKey, int64_t iValue)
+{
+	char strValue[24];
+	snprintf(strValue, sizeof(strValue), "%lld", (long long)iValue);
+	return CDKMsgElementSetAttribute(pElement, strKey, strValue);
+}
+
+int32_t CDK_API CDKMsgElementSetAttributeBool(CDKMsgElement* pElement, const char* strKey, int32_t bValue)
+{
+	return CDKMsgElementSetAttribute(pElement, strKey, bValue ? "true" : "false");
+}
+
+int32_t CDK_API CDKMsgElementSetAttributeFloat(CDKMsgElement* pElement, const char* strKey, float fValue)
+{
+	char strValue[32];
+	snprintf(strValue, sizeof(strValue), "%g", (double)fValue);
+	return CDKMsgElementSetAttribute(pElement, strKey, strValue);
+}
+
+int32_t CDK_API CDKMsgElementRemoveAttribute(CDKMsgElement* pElement, const char* strKey)
+{
+	if (!pElement || !strKey)
+		return CDK_FAIL;
+	if (CDKMsgIsElementReadOnly(pElement))
+	{
+		CDKSetLastError(pElement, "message is read only");
+		return CDK_FAIL;
+	}
+	for (size_t i = 0; i < pElement->attributes.size(); i++)
+	{
+		if (strcasecmp(pElement->attributes[i].strKey.c_str(), strKey) == 0)
+		{
+			pElement->attributes.erase(pElement->attributes.begin() + i);
+			return CDK_OK;
+		}
+	}
+	CDKSetLastError(pElement, "attribute %s does not exist", strKey);
+	return CDK_FAIL;
+}
+
+uint32_t CDK_API CDKMsgElementAttributeCount(CDKMsgElement* pElement)
+{
+	return pElement ? (uint32_t)pElement->attributes.size() : 0;
+}
+
+const char CDK_API * CDKMsgElementAttributeName(CDKMsgElement* pElement, uint32_t uIndex)
+{
+	if (!pElement || uIndex >= pElement->attributes.size())
+		return nullptr;
+	return pElement->attributes[uIndex].strKey.c_str();
+}
+
+const char CDK_API * CDKMsgElementAttributeValueAt(CDKMsgElement* pElement, uint32_t uIndex)
+{
+	if (!pElement || uIndex >= pElement->attributes.size())
+		return nullptr;
+	return pElement->attributes[uIndex].strValue.c_str();
+}
+
+const char CDK_API * CDKMsgElementAttributeValue(CDKMsgElement* pElement, const char* strKey)
+{
+	if (!pElement || !strKey)
+		return nullptr;
+	CDKMsgAttribute* pAttribute = CDKMsgElementFindAttribute(pElement, strKey);
+	return pAttribute ? pAttribute->strValue.c_str() : nullptr;
+}
+
+int32_t CDK_API CDKMsgElementAddChild(CDKMsgElement* pElement, CDKMsgElement* pChildElement)
+{
+	if (!pElement || !pChildElement || pElement == pChildElement)
+		return CDK_FAIL;
+	if (CDKMsgIsElementReadOnly(pElement))
+	{
+		CDKSetLastError(pElement, "message is read only");
+		return CDK_FAIL;
+	}
+	if (pChildElement->pParent || pChildElement->pMsg)
+	{
+		CDKSetLastError(pElement, "child element is already owned");
+		return CDK_FAIL;
+	}
+	for (CDKMsgElement* pAncestor = pElement->pParent; pAncestor; pAncestor = pAncestor->pParent)
+	{
+		if (pAncestor == pChildElement)
+		{
+			CDKSetLastError(pElement, "child element is an ancestor of the element");
+			return CDK_FAIL;
+		}
+	}
+	CDKMsgElementAppendChild(pElement, pChildElement);
+	return CDK_OK;
+}
+
+CDKMsgElement CDK_API * CDKMsgElementCopy(CDKMsgElement* pElt)
+{
+	if (!pElt)
+		return nullptr;
+	CDKMsgElement* pCopy = CDKMsgPoolAllocateElement();
+	if (!pCopy)
+	{
+		CDKSetLastError(pElt, "out of memory");
+		return nullptr;
+	}
+	pCopy->strName = pElt->strName;
+	pCopy->attributes = pElt->attributes;
+	pCopy->content = pElt->content;
+	for (CDKMsgElement* pChild = pElt->pFirstChild; pChild; pChild = pChild->pNext)
+	{
+		CDKMsgElement* pChildCopy = CDKMsgElementCopy(pChild);
+		if (!pChildCopy)
+		{
+			CDKMsgElementFree(pCopy);
+			return nullptr;
+		}
+		CDKMsgElementAppendChild(pCopy, pChildCopy);
+	}
+	return pCopy;
+}
+
+uint32_t CDK_API CDKMsgElementChildCount(CDKMsgElement* pElement, const char* strName)
+{
+	if (!pElement)
+		return 0;
+	if (!strName)
+		return pElement->uChildCount;
+	uint32_t uCount = 0;
+	for (CDKMsgElement* pChild = pElement->pFirstChild; pChild; pChild = pChild->pNext)
+	{
+		if (CDKMsgNameMatches(pChild, strName))
+			uCount++;
+	}
+	return uCount;
+}
+
+CDKMsgElement CDK_API * CDKMsgElementFirstChild(CDKMsgElement* pElement, const char* strName)
+{
+	if (!pElement)
+		return nullptr;
+	for (CDKMsgElement* pChild = pElement->pFirstChild; pChild; pChild = pChild->pNext)
+	{
+		if (CDKMsgNameMatches(pChild, strName))
+			return pChild;
+	}
+	return nullptr;
+}
+
+CDKMsgElement CDK_API * CDKMsgElementNextChild(CDKMsgElement* pElement, CDKMsgElement* pChildElement, const char* strName)
+{
+	if (!pElement || !pChildElement || pChildElement->pParent != pElement)
+		return nullptr;
+	for (CDKMsgElement* pChild = pChildElement->pNext; pChild; pChild = pChild->pNext)
+	{
+		if (CDKMsgNameMatches(pChild, strName))
+			return pChild;
+	}
+	return nullptr;
+}
+
+int32_t CDK_API CDKMsgElementSetContentBinary(CDKMsgElement* pElement, const uint8_t* strContent, uint32_t uContentSize)
+{
+	if (!pElement || (!strContent && uContentSize))
+		return CDK_FAIL;
+	if (CDKMsgIsElementReadOnly(pElement))
+	{
+		CDKSetLastError(pElement, "message is read only");
+		return CDK_FAIL;
+	}
+	try
+	{
+		pElement->content.assign(strContent, strContent + uContentSize);
+	}
+	catch (const std::bad_alloc&)
+	{
+		CDKSetLastError(pElement, "out of memory");
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+uint32_t CDK_API CDKMsgElementContentSize(CDKMsgElement* pElement)
+{
+	return pElement ? (uint32_t)pElement->content.size() : 0;
+}
+
+const uint8_t CDK_API * CDKMsgElementContent(CDKMsgElement* pElement)
+{
+	if (!pElement || pElement->content.empty())
+		return nullptr;
+	return pElement->content.data();
+}
+
+/*!
+	Returns the uIndex-th child of pElement named strName
+*/
+static CDKMsgElement* CDKMsgElementNthChild(CDKMsgElement* pElement, const char* strName, uint32_t uIndex)
+{
+	for (CDKMsgElement* pChild = CDKMsgElementFirstChild(pElement, strName); pChild; pChild = CDKMsgElementNextChild(pElement, pChild, strName))
+	{
+		if (uIndex-- == 0)
+			return pChild;
+	}
+	return nullptr;
+}
+
+int32_t CDK_API CDKMsgElementMerge(CDKMsgElement* pEltDest, CDKMsgElement* pElt, CDKMsgElement** ppEltDiff, int32_t bAddNewStuff)
+{
+	if (ppEltDiff)
+		*ppEltDiff = nullptr;
+	if (!pEltDest || !pElt)
+		return 0;
+	if (CDKMsgIsElementReadOnly(pEltDest))
+	{
+		CDKSetLastError(pEltDest, "message is read only");
+		return 0;
+	}
+
+	CDKMsgElement* pDiff = nullptr;
+	if (ppEltDiff)
+	{
+		pDiff = CDKMsgElementCreate(pEltDest->strName.c_str());
+		*ppEltDiff = pDiff;
+	}
+
+	int32_t bChanged = 0;
+	for (const CDKMsgAttribute& attribute : pElt->attributes)
+	{
+		CDKMsgAttribute* pDestAttribute = CDKMsgElementFindAttribute(pEltDest, attribute.strKey.c_str());
+		if (pDestAttribute ? pDestAttribute->strValue == attribute.strValue : !bAddNewStuff)
+			continue;
+		if (pDestAttribute)
+			pDestAttribute->strValue = attribute.strValue;
+		else
+			pEltDest->attributes.push_back(attribute);
+		if (pDiff)
+			CDKMsgElementSetAttribute(pDiff, attribute.strKey.c_str(), attribute.strValue.c_str());
+		bChanged = 1;
+	}
+
+	if (!pElt->content.empty() && pElt->content != pEltDest->content)
+	{
+		pEltDest->content = pElt->content;
+		if (pDiff)
+			pDiff->content = pElt->content;
+		bChanged = 1;
+	}
+
+	// children are matched by name and rank among the children having the same name
+	for (CDKMsgElement* pChild = pElt->pFirstChild; pChild; pChild = pChild->pNext)
+	{
+		uint32_t uRank = 0;
+		for (CDKMsgElement* pPrev = pChild->pPrev; pPrev; pPrev = pPrev->pPrev)
+		{
+			if (CDKMsgNameMatches(pPrev, pChild->strName.c_str()))
+				uRank++;
+		}
+		CDKMsgElement* pDestChild = CDKMsgElementNthChild(pEltDest, pChild->strName.c_str(), uRank);
+		if (pDestChild)
+		{
+			CDKMsgElement* pChildDiff = nullptr;
+			if (CDKMsgElementMerge(pDestChild, pChild, pDiff ? &pChildDiff : nullptr, bAddNewStuff))
+			{
+				bChanged = 1;
+				if (pChildDiff)
+				{
+					CDKMsgElementAppendChild(pDiff, pChildDiff);
+					pChildDiff = nullptr;
+				}
+			}
+			if (pChildDiff)
+				CDKMsgElementFree(pChildDiff);
+		}
+		else if (bAddNewStuff)
+		{
+			CDKMsgElement* pChildCopy = CDKMsgElementCopy(pChild);
+			if (!pChildCopy)
+				continue;
+			CDKMsgElementAppendChild(pEltDest, pChildCopy);
+			if (pDiff)
+			{
+				CDKMsgElement* pDiffCopy = CDKMsgElementCopy(pChild);
+				if (pDiffCopy)
+					CDKMsgElementAppendChild(pDiff, pDiffCopy);
+			}
+			bChanged = 1;
+		}
+	}
+	return bChanged;
+}
@@ -0,0 +1,228 @@
+/*! \file
+
+CDKMsgPool : per-thread pools of CDKMsg, CDKMsgElement and CDKMsgExportBuffer.
+
+Every thread caches up to <a href="#CDKMsgSetPoolSize">the pool size</a> objects of each kind, without lock.
+Messages often die on another thread than the one that built them (the CDK thread imports them, a consumer
+destroys them) : a thread whose cache is full hands half of it to a shared depot, and a thread whose cache
+is empty takes a batch back from the depot. The depot is only locked once per batch.
+
+Released objects keep their attribute, content and export storage, up to a limit, so that rebuilding or
+exporting a message of the same shape does not allocate.
+
+*/
+
+#include <algorithm>
+#include <new>
+
+#include "CDKPrivate.h"
+
+/*!
+	Default number of objects of each kind cached per thread
+*/
+#define CDK_MSG_POOL_DEFAULT_SIZE 256
+
+/*!
+	The depot keeps up to this number of per-thread pools, extra objects are deleted
+*/
+#define CDK_MSG_POOL_DEPOT_FACTOR 16
+
+/*!
+	Content and attribute storage kept by a released element, larger storage is freed. Every cached element may keep
+	this much : the small contents of the reads are reused, the images are allocated for every message
+*/
+#define CDK_MSG_POOL_MAX_CONTENT (4 * 1024)
+#define CDK_MSG_POOL_MAX_ATTRIBUTES 32
+
+/*!
+	Export buffers cached per thread, at most, and memory kept by a released export buffer
+*/
+#define CDK_MSG_POOL_MAX_EXPORT_BUFFERS 16
+#define CDK_MSG_POOL_MAX_EXPORT_SIZE (4 * 1024 * 1024)
+
+static std::atomic<uint32_t> g_uPoolSize{CDK_MSG_POOL_DEFAULT_SIZE};
+
+/*!
+	Number of objects of a kind cached per thread
+*/
+template <typename T>
+static uint32_t CDKPoolSize()
+{
+	return g_uPoolSize.load(std::memory_order_relaxed);
+}
+
+template <>
+uint32_t CDKPoolSize<CDKMsgExportBuffer>()
+{
+	return std::min(g_uPoolSize.load(std::memory_order_relaxed), (uint32_t)CDK_MSG_POOL_MAX_EXPORT_BUFFERS);
+}
+
+template <typename T>
+struct CDKPoolDepot
+{
+	std::mutex mutex;
+	std::vector<T*> objects;
+	/*! size of objects, read without the mutex by threads with an empty cache */
+	std::atomic<size_t> uCount{0};
+};
+
+/*!
+	The depots are never destroyed : threads may still release objects while the statics are destroyed
+*/
+template <typename T>
+static CDKPoolDepot<T>& CDKPoolGetDepot()
+{
+	static CDKPoolDepot<T>* pDepot = new CDKPoolDepot<T>();
+	return *pDepot;
+}
+
+/*!
+	Moves the objects of a cache beyond uKeep to the depot, and deletes those that do not fit
+*/
+template <typename T>
+static void CDKPoolSpill(std::vector<T*>& objects, size_t uKeep)
+{
+	if (objects.size() <= uKeep)
+		return;
+	CDKPoolDepot<T>& depot = CDKPoolGetDepot<T>();
+	size_t uMax = (size_t)CDKPoolSize<T>() * CDK_MSG_POOL_DEPOT_FACTOR;
+	{
+		std::lock_guard<std::mutex> lock(depot.mutex);
+		while (objects.size() > uKeep && depot.objects.size() < uMax)
+		{
+			depot.objects.push_back(objects.back());
+			objects.pop_back();
+		}
+		depot.uCount.store(depot.objects.size(), std::memory_order_relaxed);
+	}
+	while (objects.size() > uKeep)
+	{
+		delete objects.back();
+		objects.pop_back();
+	}
+}
+
+template <typename T>
+struct CDKPoolCache
+{
+	std::vector<T*> objects;
+
+	~CDKPoolCache() { CDKPoolSpill(objects, 0); }
+
+	T* Take()
+	{
+		if (objects.empty())
+		{
+			uint32_t uSize = CDKPoolSize<T>();
+			CDKPoolDepot<T>& depot = CDKPoolGetDepot<T>();
+			if (uSize == 0 || depot.uCount.load(std::memory_order_relaxed) == 0)
+				return new (std::nothrow) T();
+			objects.reserve(uSize);
+			std::lock_guard<std::mutex> lock(depot.mutex);
+			size_t uBatch = std::min<size_t>(depot.objects.size(), std::max(1u, uSize / 2));
+			objects.insert(objects.end(), depot.objects.end() - uBatch, depot.objects.end());
+			depot.objects.resize(depot.objects.size() - uBatch);
+			depot.uCount.store(depot.objects.size(), std::memory_order_relaxed);
+			if (objects.empty())
+				return new (std::nothrow) T();
+		}
+		T* pObject = objects.back();
+		objects.pop_back();
+		return pObject;
+	}
+
+	void Give(T* pObject)
+	{
+		uint32_t uSize = CDKPoolSize<T>();
+		if (uSize == 0)
+		{
+			CDKPoolSpill(objects, 0);
+			delete pObject;
+			return;
+		}
+		if (objects.size() >= uSize)
+			CDKPoolSpill(objects, uSize / 2);
+		if (objects.capacity() < uSize)
+			objects.reserve(uSize);
+		objects.push_back(pObject);
+	}
+};
+
+static thread_local CDKPoolCache<CDKMsg> t_msgCache;
+static thread_local CDKPoolCache<CDKMsgElement> t_elementCache;
+static thread_local CDKPoolCache<CDKMsgExportBuffer> t_exportCache;
+
+CDKMsg* CDKMsgPoolAllocate()
+{
+	return t_msgCache.Take();
+}
+
+void CDKMsgPoolFree(CDKMsg* pMsg)
+{
+	pMsg->pRoot = nullptr;
+	pMsg->iRefCount.store(1, std::memory_order_relaxed);
+	pMsg->bReadOnly.store(0, std::memory_order_relaxed);
+	pMsg->pUserData = nullptr;
+	pMsg->pCDK = nullptr;
+	pMsg->strLastError[0] = 0;
+	t_msgCache.Give(pMsg);
+}
+
+CDKMsgElement* CDKMsgPoolAllocateElement()
+{
+	return t_elementCache.Take();
+}
+
+void CDKMsgPoolFreeElement(CDKMsgElement* pElement)
+{
+	pElement->strName.clear();
+	if (pElement->attributes.capacity() > CDK_MSG_POOL_MAX_ATTRIBUTES)
+		std::vector<CDKMsgAttribute>().swap(pElement->attributes);
+	else
+		pElement->attributes.clear();
+	if (pElement->content.capacity() > CDK_MSG_POOL_MAX_CONTENT)
+		std::vector<uint8_t>().swap(pElement->content);
+	else
+		pElement->content.clear();
+	pElement->pMsg = nullptr;
+	pElement->pParent = nullptr;
+	pElement->pFirstChild = nullptr;
+	pElement->pLastChild = nullptr;
+	pElement->pPrev = nullptr;
+	pElement->pNext = nullptr;
+	pElement->uChildCount = 0;
+	pElement->strLastError[0] = 0;
+	t_elementCache.Give(pElement);
+}
+
+CDKMsgExportBuffer* CDKMsgPoolAllocateExportBuffer()
+{
+	return t_exportCache.Take();
+}
+
+void CDKMsgPoolFreeExportBuffer(CDKMsgExportBuffer* pBuffer)
+{
+	if (pBuffer->pHeld)
+	{
+		CDKMsgDestroy(pBuffer->pHeld);
+		pBuffer->pHeld = nullptr;
+	}
+	if (pBuffer->data.capacity() > CDK_MSG_POOL_MAX_EXPORT_SIZE)
+		std::vector<uint8_t>().swap(pBuffer->data);
+	pBuffer->refs.clear();
+	pBuffer->segments.clear();
+	pBuffer->uSize = 0;
+	pBuffer->bContiguous = false;
+	pBuffer->strLastError[0] = 0;
+	t_exportCache.Give(pBuffer);
+}
+
+void CDK_API CDKMsgSetPoolSize(uint32_t uSize)
+{
+	g_uPoolSize.store(uSize, std::memory_order_relaxed);
+}
+
+uint32_t CDK_API CDKMsgGetPoolSize()
+{
+	return g_uPoolSize.load(std::memory_order_relaxed);
+}
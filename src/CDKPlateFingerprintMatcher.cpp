@@ -0,0 +1,270 @@
+/*! \file
+
+CDKPlateFingerprintMatcher : reference implementation of the plate fingerprint matcher.
+
+A fingerprint is a sequence of 8 bits symbols describing the plate. Two fingerprints are compared
+with a normalized edit distance : the similarity is 1 - distance / max(length1, length2).<br/>
+The dictionary holds the decision threshold. Without dictionary, the matcher uses a conservative
+threshold and learns the similarity distribution of the pairs it compares. Once enough pairs have
+been seen, the threshold is updated and the dictionary is handed to the save dictionary callback.
+
+Dictionary format (little endian) : 'P' 'F' 'D' '1', float threshold, u32 number of learnt samples.
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
+#include <new>
+
+#include "CDKPrivate.h"
+#include "../include/CDKPlateFingerprintMatcher.h"
+
+#define CDK_FINGERPRINT_DICTIONARY_SIZE 12
+#define CDK_FINGERPRINT_DEFAULT_THRESHOLD 0.9f
+#define CDK_FINGERPRINT_MIN_THRESHOLD 0.6f
+#define CDK_FINGERPRINT_MAX_THRESHOLD 0.9f
+#define CDK_FINGERPRINT_LEARNING_SAMPLES 256
+#define CDK_FINGERPRINT_MAX_SIZE 1024
+
+static const uint8_t g_dictionaryMagic[4] = { 'P', 'F', 'D', '1' };
+
+static CDKTraceHook<PCDKPLATEFINGERPRINTMATCHERTRACEFUNCTION> g_matcherTraceHook;
+static std::atomic<uint8_t> g_matcherTraceLevel{CDK_TRACE_DEBUG};
+
+struct _cdkplatefingerprintmatcher : CDKObject
+{
+	/*! protects the learning state : a matcher may be shared by several threads */
+	std::mutex mutex;
+	bool bStarted = false;
+	float fThreshold = CDK_FINGERPRINT_DEFAULT_THRESHOLD;
+	bool bLearning = true;
+	uint32_t uSamples = 0;
+	double dSum = 0;
+	double dSumSquares = 0;
+
+	PCDKPLATEFINGERPRINTMATCHERSAVEDICTIONARYFUNCTION saveFunction = nullptr;
+	void* pSaveUser = nullptr;
+};
+
+static void CDKPlateFingerprintMatcherTrace(CDKPlateFingerprintMatcher* pMatcher, uint8_t level, const char* strFormat, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void CDKPlateFingerprintMatcherTrace(CDKPlateFingerprintMatcher* pMatcher, uint8_t level, const char* strFormat, ...)
+{
+	if (level > g_matcherTraceLevel.load(std::memory_order_relaxed))
+		return;
+	CDKTraceHook<PCDKPLATEFINGERPRINTMATCHERTRACEFUNCTION>::Slot* pSlot = g_matcherTraceHook.Enter();
+	PCDKPLATEFINGERPRINTMATCHERTRACEFUNCTION traceFunction = pSlot->function.load(std::memory_order_relaxed);
+	if (traceFunction)
+	{
+		char strTrace[256];
+		va_list args;
+		va_start(args, strFormat);
+		vsnprintf(strTrace, sizeof(strTrace), strFormat, args);
+		va_end(args);
+		traceFunction(pMatcher, level, strTrace, pSlot->pUser.load(std::memory_order_relaxed));
+	}
+	g_matcherTraceHook.Leave(pSlot);
+}
+
+static void CDKPlateFingerprintEncodeDictionary(uint8_t* pBuffer, float fThreshold, uint32_t uSamples)
+{
+	memcpy(pBuffer, g_dictionaryMagic, 4);
+	uint32_t uThreshold;
+	memcpy(&uThreshold, &fThreshold, 4);
+	for (int i = 0; i < 4; i++)
+	{
+		pBuffer[4 + i] = (uint8_t)(uThreshold >> (8 * i));
+		pBuffer[8 + i] = (uint8_t)(uSamples >> (8 * i));
+	}
+}
+
+/*!
+	Normalized edit distance similarity, between 0 and 1. The sizes are at most CDK_FINGERPRINT_MAX_SIZE.
+*/
+static float CDKPlateFingerprintSimilarity(const uint8_t* pBuffer1, uint32_t uSize1, const uint8_t* pBuffer2, uint32_t uSize2)
+{
+	uint32_t uMax = uSize1 > uSize2 ? uSize1 : uSize2;
+	if (uMax == 0)
+		return 1.0f;
+	// on the stack : the comparisons of a batch do not allocate
+	uint32_t row[CDK_FINGERPRINT_MAX_SIZE + 1];
+	for (uint32_t j = 0; j <= uSize2; j++)
+		row[j] = j;
+	for (uint32_t i = 1; i <= uSize1; i++)
+	{
+		uint32_t uDiagonal = row[0];
+		row[0] = i;
+		for (uint32_t j = 1; j <= uSize2; j++)
+		{
+			uint32_t uAbove = row[j];
+			uint32_t uCost = uDiagonal + (pBuffer1[i - 1] == pBuffer2[j - 1] ? 0 : 1);
+			uint32_t uInsert = row[j - 1] + 1;
+			uint32_t uDelete = uAbove + 1;
+			row[j] = uCost < uInsert ? (uCost < uDelete ? uCost : uDelete) : (uInsert < uDelete ? uInsert : uDelete);
+			uDiagonal = uAbove;
+		}
+	}
+	return 1.0f - (float)row[uSize2] / (float)uMax;
+}
+
+/*!
+	Records a compared pair during the learning phase. Called with the matcher mutex locked.
+	@returns true if the learning phase has just ended
+*/
+static bool CDKPlateFingerprintLearn(CDKPlateFingerprintMatcher* pMatcher, float fSimilarity)
+{
+	pMatcher->uSamples++;
+	pMatcher->dSum += fSimilarity;
+	pMatcher->dSumSquares += (double)fSimilarity * fSimilarity;
+	if (pMatcher->uSamples < CDK_FINGERPRINT_LEARNING_SAMPLES)
+		return false;
+
+	// most compared pairs are different plates : the threshold is set well above their similarity
+	double dMean = pMatcher->dSum / pMatcher->uSamples;
+	double dVariance = pMatcher->dSumSquares / pMatcher->uSamples - dMean * dMean;
+	float fThreshold = (float)(dMean + 3.0 * sqrt(dVariance > 0 ? dVariance : 0));
+	if (fThreshold < CDK_FINGERPRINT_MIN_THRESHOLD)
+		fThreshold = CDK_FINGERPRINT_MIN_THRESHOLD;
+	if (fThreshold > CDK_FINGERPRINT_MAX_THRESHOLD)
+		fThreshold = CDK_FINGERPRINT_MAX_THRESHOLD;
+	pMatcher->fThreshold = fThreshold;
+	pMatcher->bLearning = false;
+	return true;
+}
+
+void CDK_API CDKPlateFingerprintMatcherSetTraceFunction(PCDKPLATEFINGERPRINTMATCHERTRACEFUNCTION traceFunction, void* pUser)
+{
+	g_matcherTraceHook.Set(traceFunction, pUser);
+}
+
+void CDK_API CDKPlateFingerprintMatcherSetTraceLevel(uint8_t level)
+{
+	g_matcherTraceLevel.store(level, std::memory_order_relaxed);
+}
+
+CDKPlateFingerprintMatcher CDK_API * CDKPlateFingerprintMatcherCreate()
+{
+	CDKPlateFingerprintMatcher* pMatcher = new (std::nothrow) CDKPlateFingerprintMatcher();
+	if (!pMatcher)
+		CDKSetLastError(nullptr, "out of memory");
+	return pMatcher;
+}
+
+void CDK_API CDKPlateFingerprintMatcherDestroy(CDKPlateFingerprintMatcher* pMatcher)
+{
+	delete pMatcher;
+}
+
+int32_t CDK_API CDKPlateFingerprintMatcherSetDictionary(CDKPlateFingerprintMatcher* pMatcher, const uint8_t* pBuffer, uint32_t uSize)
+{
+	if (!pMatcher)
+		return CDK_FAIL;
+	std::lock_guard<std::mutex> lock(pMatcher->mutex);
+	if (pMatcher->bStarted)
+	{
+		CDKSetLastError(pMatcher, "matcher is already started");
+		return CDK_FAIL;
+	}
+	if (!pBuffer || uSize != CDK_FINGERPRINT_DICTIONARY_SIZE || memcmp(pBuffer, g_dictionaryMagic, 4) != 0)
+	{
+		CDKSetLastError(pMatcher, "invalid dictionary");
+		return CDK_FAIL;
+	}
+	uint32_t uThreshold = 0;
+	uint32_t uSamples = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uThreshold |= (uint32_t)pBuffer[4 + i] << (8 * i);
+		uSamples |= (uint32_t)pBuffer[8 + i] << (8 * i);
+	}
+	float fThreshold;
+	memcpy(&fThreshold, &uThreshold, 4);
+	if (!(fThreshold >= CDK_FINGERPRINT_MIN_THRESHOLD && fThreshold <= CDK_FINGERPRINT_MAX_THRESHOLD))
+	{
+		CDKSetLastError(pMatcher, "invalid dictionary threshold");
+		return CDK_FAIL;
+	}
+	pMatcher->fThreshold = fThreshold;
+	pMatcher->uSamples = uSamples;
+	pMatcher->bLearning = false;
+	return CDK_OK;
+}
+
+void CDK_API CDKPlateFingerprintMatcherSetSaveDictionaryCallback(CDKPlateFingerprintMatcher* pMatcher, PCDKPLATEFINGERPRINTMATCHERSAVEDICTIONARYFUNCTION saveFunction, void* pUser)
+{
+	if (!pMatcher)
+		return;
+	std::lock_guard<std::mutex> lock(pMatcher->mutex);
+	pMatcher->saveFunction = saveFunction;
+	pMatcher->pSaveUser = pUser;
+}
+
+int32_t CDK_API CDKPlateFingerprintMatcherStart(CDKPlateFingerprintMatcher* pMatcher)
+{
+	if (!pMatcher)
+		return CDK_FAIL;
+	std::lock_guard<std::mutex> lock(pMatcher->mutex);
+	if (pMatcher->bStarted)
+	{
+		CDKSetLastError(pMatcher, "matcher is already started");
+		return CDK_FAIL;
+	}
+	pMatcher->bStarted = true;
+	CDKPlateFingerprintMatcherTrace(pMatcher, CDK_TRACE_INFO, "matcher started, %s (threshold %.3f)",
+		pMatcher->bLearning ? "learning" : "dictionary loaded", (double)pMatcher->fThreshold);
+	return CDK_OK;
+}
+
+int32_t CDK_API CDKPlateFingerprintMatchEx(CDKPlateFingerprintMatcher* pMatcher, const uint8_t* pBuffer1, uint32_t uSize1, const uint8_t* pBuffer2, uint32_t uSize2, float* pfResult)
+{
+	if (!pMatcher)
+		return -1;
+	if (!pBuffer1 || !pBuffer2 || !uSize1 || !uSize2 || uSize1 > CDK_FINGERPRINT_MAX_SIZE || uSize2 > CDK_FINGERPRINT_MAX_SIZE)
+	{
+		CDKSetLastError(pMatcher, "invalid fingerprint");
+		return -1;
+	}
+
+	float fSimilarity = CDKPlateFingerprintSimilarity(pBuffer1, uSize1, pBuffer2, uSize2);
+	if (pfResult)
+		*pfResult = fSimilarity;
+
+	float fThreshold;
+	bool bSave = false;
+	uint8_t dictionary[CDK_FINGERPRINT_DICTIONARY_SIZE];
+	PCDKPLATEFINGERPRINTMATCHERSAVEDICTIONARYFUNCTION saveFunction = nullptr;
+	void* pSaveUser = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(pMatcher->mutex);
+		if (!pMatcher->bStarted)
+		{
+			CDKSetLastError(pMatcher, "matcher is not started");
+			return -1;
+		}
+		if (pMatcher->bLearning && CDKPlateFingerprintLearn(pMatcher, fSimilarity))
+		{
+			bSave = true;
+			CDKPlateFingerprintEncodeDictionary(dictionary, pMatcher->fThreshold, pMatcher->uSamples);
+			saveFunction = pMatcher->saveFunction;
+			pSaveUser = pMatcher->pSaveUser;
+		}
+		fThreshold = pMatcher->fThreshold;
+	}
+
+	if (bSave)
+	{
+		CDKPlateFingerprintMatcherTrace(pMatcher, CDK_TRACE_INFO, "learning done, threshold %.3f", (double)fThreshold);
+		if (saveFunction && !saveFunction(pMatcher, dictionary, sizeof(dictionary), pSaveUser))
+			CDKPlateFingerprintMatcherTrace(pMatcher, CDK_TRACE_WARNING, "dictionary could not be saved");
+	}
+	return fSimilarity >= fThreshold ? 1 : 0;
+}
+
+int32_t CDK_API CDKPlateFingerprintMatch(CDKPlateFingerprintMatcher* pMatcher, const uint8_t* pBuffer1, uint32_t uSize1, const uint8_t* pBuffer2, uint32_t uSize2)
+{
+	return CDKPlateFingerprintMatchEx(pMatcher, pBuffer1, uSize1, pBuffer2, uSize2, nullptr);
+}
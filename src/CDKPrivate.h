@@ -0,0 +1,376 @@
+/*! \file
+
+CDKPrivate : internal definitions shared by the reference implementation of the CDK.
+This header is not part of the public API.
+
+*/
+
+#ifndef CDKPRIVATE_H
+#define CDKPRIVATE_H
+
+#include <stdint.h>
+#include <stdarg.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/CDK.h"
+#include "../include/CDKMsg.h"
+#include "../include/CDKQueue.h"
+#include "../include/CDKSignature.h"
+
+/*!
+	Size of the last error buffer of every CDK object
+*/
+#define CDK_LAST_ERROR_SIZE 256
+
+/*!
+	Default maximum queue size
+*/
+#define CDK_DEFAULT_MAX_QUEUE_SIZE 128
+
+/*!
+	Trace levels, as documented in <a href="#PCDKTRACEFUNCTION">PCDKTRACEFUNCTION</a>
+*/
+#define CDK_TRACE_CRITICAL	1
+#define CDK_TRACE_ERROR		2
+#define CDK_TRACE_WARNING	4
+#define CDK_TRACE_INFO		6
+#define CDK_TRACE_DEBUG		8
+
+/*!
+	Common header of every object handed out by the CDK. It must stay the first base of every
+	object, so that <a href="#CDKGetLastError">CDKGetLastError</a> can be called with any of them.
+*/
+struct CDKObject
+{
+	char strLastError[CDK_LAST_ERROR_SIZE];
+
+	CDKObject() { strLastError[0] = 0; }
+};
+
+/*!
+	Sets the last error of an object. If pObject is NULL, the error is stored per thread.
+*/
+void CDKSetLastError(void* pObject, const char* strFormat, ...) __attribute__((format(printf, 2, 3)));
+
+/*!
+	Sends a trace to the <a href="#PCDKTRACEFUNCTION">trace callback</a>, if any
+*/
+void CDKTrace(CDK* pCDK, uint8_t level, const char* strFormat, ...) __attribute__((format(printf, 3, 4)));
+
+/*!
+	A trace callback and its user data, replaced as a pair : a trace is sent to the previous pair or to the new one, and
+	Set returns once no thread is in the previous callback, so that its user data can be freed. The pair is held in one
+	of two slots, and a swap waits for the calls counted by the previous slot : the calls starting meanwhile take the new
+	slot, so that a swap never waits for a thread that keeps tracing.
+*/
+template <typename F>
+struct CDKTraceHook
+{
+	struct Slot
+	{
+		std::atomic<F> function{nullptr};
+		std::atomic<void*> pUser{nullptr};
+		/*! calls of the callback running */
+		std::atomic<uint32_t> uCalls{0};
+	};
+
+	Slot slots[2];
+	/*! swaps so far : the current slot is slots[uSwaps & 1] */
+	std::atomic<uint32_t> uSwaps{0};
+	std::mutex mutex;
+
+	/*!
+		Counts a call in the current slot. The callback and its user data can be read until Leave
+	*/
+	Slot* Enter()
+	{
+		for (;;)
+		{
+			uint32_t uSwap = uSwaps.load();
+			Slot* pSlot = &slots[uSwap & 1];
+			pSlot->uCalls.fetch_add(1);
+			// a slot counted before its swap is waited for by Set
+			if (uSwaps.load() == uSwap)
+				return pSlot;
+			pSlot->uCalls.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void Leave(Slot* pSlot)
+	{
+		pSlot->uCalls.fetch_sub(1, std::memory_order_release);
+	}
+
+	/*!
+		Must not be called from the callback
+	*/
+	void Set(F function, void* pUser)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		uint32_t uSwap = uSwaps.load(std::memory_order_relaxed);
+		Slot& next = slots[(uSwap + 1) & 1];
+		// calls that found the slot stale, on their way out
+		while (next.uCalls.load() != 0)
+			std::this_thread::yield();
+		next.function.store(function, std::memory_order_relaxed);
+		next.pUser.store(pUser, std::memory_order_relaxed);
+		uSwaps.store(uSwap + 1);
+		Slot& previous = slots[uSwap & 1];
+		while (previous.uCalls.load() != 0)
+			std::this_thread::yield();
+	}
+};
+
+/*!
+	An attribute of a CDKMsgElement
+*/
+struct CDKMsgAttribute
+{
+	std::string strKey;
+	std::string strValue;
+};
+
+struct _CDKMsgElement : CDKObject
+{
+	std::string strName;
+	std::vector<CDKMsgAttribute> attributes;
+	std::vector<uint8_t> content;
+
+	CDKMsg* pMsg = nullptr;
+	CDKMsgElement* pParent = nullptr;
+	CDKMsgElement* pFirstChild = nullptr;
+	CDKMsgElement* pLastChild = nullptr;
+	CDKMsgElement* pPrev = nullptr;
+	CDKMsgElement* pNext = nullptr;
+	uint32_t uChildCount = 0;
+};
+
+struct _CDKMsg : CDKObject
+{
+	CDKMsgElement* pRoot = nullptr;
+	std::atomic<int32_t> iRefCount{1};
+	std::atomic<int32_t> bReadOnly{0};
+	void* pUserData = nullptr;
+	CDK* pCDK = nullptr;
+};
+
+/*!
+	A segment of an exported message while it is written : either shared with the message, or a range of the buffer,
+	which may still move as it grows
+*/
+struct CDKMsgSegmentRef
+{
+	const uint8_t* pShared;
+	uint32_t uOffset;
+	uint32_t uSize;
+};
+
+struct _CDKMsgExportBuffer : CDKObject
+{
+	/*! only grows : the exported data is the first uSize bytes of a contiguous export */
+	std::vector<uint8_t> data;
+	std::vector<CDKMsgSegmentRef> refs;
+	std::vector<CDKMsgSegment> segments;
+	uint32_t uSize = 0;
+	bool bContiguous = false;
+	/*! read-only message referenced by the segments */
+	CDKMsg* pHeld = nullptr;
+};
+
+/*!
+	Per-thread pools of messages, elements and export buffers (CDKMsgPool.cpp). Objects are reset when released, and
+	taken back by the next CDKMsgCreate / CDKMsgElementCreate of the thread.
+	The allocations return NULL when out of memory only. A freed message must not have a root element any more.
+*/
+CDKMsg* CDKMsgPoolAllocate();
+void CDKMsgPoolFree(CDKMsg* pMsg);
+CDKMsgElement* CDKMsgPoolAllocateElement();
+void CDKMsgPoolFreeElement(CDKMsgElement* pElement);
+CDKMsgExportBuffer* CDKMsgPoolAllocateExportBuffer();
+void CDKMsgPoolFreeExportBuffer(CDKMsgExportBuffer* pBuffer);
+
+/*!
+	Number of features of a parsed signature (CDKSignature.cpp). Signatures of different sizes cannot be compared : the
+	comparison sets the last error of the first signature, which races when it is shared by several threads.
+*/
+uint32_t CDKSignatureFeatureCount(const CDKSignature* pSignature);
+
+/*!
+	A queued message, with the time it was pushed
+*/
+struct CDKQueueEntry
+{
+	CDKMsg* pMsg;
+	std::chrono::steady_clock::time_point pushed;
+};
+
+/*!
+	A cell of a lock-free ring. uSequence tells whether the cell is free for the push at position uSequence,
+	or holds the message pushed at position uSequence - 1
+*/
+struct CDKRingCell
+{
+	std::atomic<uint64_t> uSequence;
+	CDKMsg* pMsg;
+	/*! steady clock time of the push in ns, read by batch waiters while consumers may take the cell */
+	std::atomic<int64_t> iPushed;
+};
+
+/*!
+	Bounded lock-free ring with many producers and many consumers (D. Vyukov's algorithm)
+*/
+struct CDKRing
+{
+	uint64_t uMask = 0;
+	std::vector<CDKRingCell> cells;
+	alignas(64) std::atomic<uint64_t> uPushPos{0};
+	alignas(64) std::atomic<uint64_t> uPopPos{0};
+};
+
+struct _CDKQueue : CDKObject
+{
+	/*! protects the messages of a locked queue, and the waits of both kinds of queue */
+	std::mutex mutex;
+	std::condition_variable cvNewMessage;
+	std::condition_variable cvBatch;
+	std::deque<CDKQueueEntry> messages;
+	/*! messages of a lock-free queue, NULL for a locked queue */
+	CDKRing* pRing = nullptr;
+	/*! counts requested by the threads waiting in CDKQueueWaitForNewMessages, protected by mutex */
+	std::vector<uint32_t> batchCounts;
+	/*! smallest of batchCounts, UINT32_MAX without waiter : pushes notify the waiters when the queue reaches it */
+	std::atomic<uint32_t> uBatchCount{UINT32_MAX};
+	uint32_t uMaxSize = CDK_DEFAULT_MAX_QUEUE_SIZE;
+	std::atomic<uint32_t> uDrops{0};
+
+	std::atomic<uint32_t> uOverflowPolicy{CDK_QUEUE_DROP_NEWEST};
+	std::atomic<uint32_t> uBlockTimeout{0};
+	/*! producers waiting for room, consumers only notify cvSpace when there are some */
+	std::atomic<uint32_t> uBlockedProducers{0};
+	std::condition_variable cvSpace;
+	/*! consumers waiting in a lock-free queue, producers only take the mutex to notify when there are some */
+	std::atomic<uint32_t> uWaiters{0};
+
+	/*! eventfd readable while the queue is not empty, -1 until CDKQueueGetReadyFd is called */
+	std::atomic<int> iReadyFd{-1};
+	/*! whether iReadyFd has been signaled since the last reset */
+	std::atomic<bool> bReadySignaled{false};
+
+	/*! drops per producer, only touched when a message is dropped */
+	std::mutex dropsMutex;
+	std::unordered_map<CDK*, uint32_t> producerDrops;
+
+	/*! read by lock-free producers without the mutex */
+	std::atomic<PCDKQUEUENEWMESSAGECALLBACK> newMessageCallback{nullptr};
+	std::atomic<void*> pNewMessageUser{nullptr};
+
+	/*! number of CDK instances using this queue */
+	std::atomic<uint32_t> uUsers{0};
+};
+
+/*!
+	Pushes a message received by a CDK instance. On success, pbWasEmpty tells whether the queue was empty before the push.
+	@returns CDK_OK on success, CDK_FAIL if the queue is full (the message is then still owned by the caller)
+*/
+int32_t CDKQueuePushInternal(CDKQueue* pQueue, CDKMsg* pMsg, bool* pbWasEmpty);
+
+/*!
+	Forgets the drops of a producer that stops using the queue, so that the drop counters do not grow with every CDK
+	instance ever created, nor are given to a new instance allocated at the same address.
+*/
+void CDKQueueForgetProducer(CDKQueue* pQueue, CDK* pProducer);
+
+/*!
+	A request waiting for its answer. Synchronous requests live on the stack of the waiting thread,
+	asynchronous requests (with a callback) are allocated and owned by the pending list.
+*/
+struct CDKPendingRequest
+{
+	uint32_t uId = 0;
+	CDKMsg* pAnswer = nullptr;
+	bool bDone = false;
+
+	PCDKREQUESTCALLBACK callback = nullptr;
+	void* pUser = nullptr;
+	std::chrono::steady_clock::time_point deadline;
+};
+
+/*!
+	Handle on an asynchronous request. Shared by the application and the pending request, until both release it.
+*/
+struct _CDKRequest : CDKObject
+{
+	std::mutex mutex;
+	std::condition_variable cvDone;
+	bool bDone = false;
+	CDKMsg* pAnswer = nullptr;
+	void* pUser = nullptr;
+	std::atomic<int32_t> iRefCount{2};
+};
+
+/*!
+	Completion queue of a request sent with CDKSendRequestToQueue
+*/
+struct CDKRequestCompletion
+{
+	CDKQueue* pQueue;
+	void* pUser;
+};
+
+struct _cdk : CDKObject
+{
+	/*! queue used when no queue has been set with CDKSetQueue */
+	CDKQueue* pInternalQueue = nullptr;
+	std::atomic<CDKQueue*> pQueue{nullptr};
+	std::atomic<uint32_t> uDrops{0};
+
+	std::string strAddress;
+	uint16_t uPort = 0;
+	uint32_t bSSL = 0;
+	uint32_t uIgnoreSSLErrors = 0;
+	std::atomic<uint32_t> uSSLErrors{0};
+	uint32_t uReconnectDelayMs = 1000;
+	/*! maximum reconnection delay of the exponential backoff, 0 or less than uReconnectDelayMs for a fixed delay */
+	uint32_t uReconnectMaxMs = 0;
+	/*! failed connection attempts since the last connection, used by the connection thread only */
+	uint32_t uReconnectFailures = 0;
+	std::minstd_rand reconnectRandom;
+	uint32_t uConnectTimeoutMs = 3000;
+
+	/*! protects the connection state, the callbacks and the pending requests */
+	std::mutex mutex;
+	std::condition_variable cvState;
+	std::atomic<int32_t> bConnected{0};
+	std::atomic<bool> bStop{false};
+	bool bBound = false;
+	std::thread ioThread;
+
+	/*! socket of the current connection, -1 if not connected */
+	std::atomic<int> iSocket{-1};
+	/*! serializes frame writes on the socket */
+	std::mutex sendMutex;
+
+	std::atomic<uint32_t> uNextRequestId{1};
+	std::vector<CDKPendingRequest*> pendingRequests;
+	/*! earliest deadline of the asynchronous requests (steady clock, ns), INT64_MAX if none : checked without the mutex */
+	std::atomic<int64_t> iNextDeadline{INT64_MAX};
+
+	PCDKSTATECALLBACK stateCallback = nullptr;
+	void* pStateUser = nullptr;
+	PCDKSTATECALLBACK2 stateCallback2 = nullptr;
+	void* pStateUser2 = nullptr;
+	PCDKNEWMESSAGECALLBACK newMessageCallback = nullptr;
+	void* pNewMessageUser = nullptr;
+};
+
+#endif //CDKPRIVATE_H
@@ -0,0 +1,629 @@
+/*! \file
+
+CDKQueue : reference implementation of the message queue.
+
+Two kinds of queue share this API :
+- a locked queue, a deque protected by the queue mutex (<a href="#CDKQueueCreate">CDKQueueCreate</a>)
+- a lock-free queue, a bounded ring (<a href="#CDKQueueCreateLockFree">CDKQueueCreateLockFree</a>). The mutex is then only
+  used by the threads that sleep : consumers waiting for messages and producers waiting for room.
+  The other side only takes it to notify them, when the matching counter tells there are sleepers.
+
+Both can also signal an eventfd (<a href="#CDKQueueGetReadyFd">CDKQueueGetReadyFd</a>). bReadySignaled avoids a write per push :
+the eventfd is written when the flag goes up, and a consumer that empties the queue drains the eventfd, lowers the flag
+and checks the queue again, so that a concurrent push is never left without a signal.
+
+*/
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+#include "CDKPrivate.h"
+
+//---------------------------------------------------------------------------------------------
+// lock-free ring
+//---------------------------------------------------------------------------------------------
+
+static bool CDKRingPush(CDKRing* pRing, CDKMsg* pMsg, int64_t iPushed, bool* pbWasEmpty)
+{
+	uint64_t uPos = pRing->uPushPos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		CDKRingCell& cell = pRing->cells[uPos & pRing->uMask];
+		int64_t iDiff = (int64_t)(cell.uSequence.load(std::memory_order_acquire) - uPos);
+		if (iDiff == 0)
+		{
+			if (pRing->uPushPos.compare_exchange_weak(uPos, uPos + 1, std::memory_order_relaxed))
+			{
+				cell.pMsg = pMsg;
+				cell.iPushed.store(iPushed, std::memory_order_relaxed);
+				cell.uSequence.store(uPos + 1, std::memory_order_release);
+				*pbWasEmpty = pRing->uPopPos.load(std::memory_order_seq_cst) == uPos;
+				return true;
+			}
+		}
+		else if (iDiff < 0)
+			return false;
+		else
+			uPos = pRing->uPushPos.load(std::memory_order_relaxed);
+	}
+}
+
+static CDKMsg* CDKRingPop(CDKRing* pRing)
+{
+	uint64_t uPos = pRing->uPopPos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		CDKRingCell& cell = pRing->cells[uPos & pRing->uMask];
+		int64_t iDiff = (int64_t)(cell.uSequence.load(std::memory_order_acquire) - (uPos + 1));
+		if (iDiff == 0)
+		{
+			if (pRing->uPopPos.compare_exchange_weak(uPos, uPos + 1, std::memory_order_relaxed))
+			{
+				CDKMsg* pMsg = cell.pMsg;
+				cell.uSequence.store(uPos + pRing->uMask + 1, std::memory_order_release);
+				return pMsg;
+			}
+		}
+		else if (iDiff < 0)
+			return nullptr;
+		else
+			uPos = pRing->uPopPos.load(std::memory_order_relaxed);
+	}
+}
+
+/*!
+	Number of messages in the ring, including the pushes in progress
+*/
+static uint32_t CDKRingSize(CDKRing* pRing)
+{
+	uint64_t uPop = pRing->uPopPos.load(std::memory_order_seq_cst);
+	uint64_t uPush = pRing->uPushPos.load(std::memory_order_seq_cst);
+	return uPush > uPop ? (uint32_t)(uPush - uPop) : 0;
+}
+
+//---------------------------------------------------------------------------------------------
+// common
+//---------------------------------------------------------------------------------------------
+
+/*!
+	Registers a consumer that may sleep, so that lock-free producers notify it
+*/
+struct CDKQueueWaiter
+{
+	CDKQueue* pQueue;
+
+	explicit CDKQueueWaiter(CDKQueue* pQueue) : pQueue(pQueue)
+	{
+		pQueue->uWaiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+	~CDKQueueWaiter() { pQueue->uWaiters.fetch_sub(1, std::memory_order_relaxed); }
+};
+
+/*!
+	Registers the batch count of a thread in CDKQueueWaitForNewMessages while it waits. The mutex must be held.
+*/
+struct CDKQueueBatchWaiter
+{
+	CDKQueue* pQueue;
+	uint32_t uCount;
+
+	CDKQueueBatchWaiter(CDKQueue* pQueue, uint32_t uCount) : pQueue(pQueue), uCount(uCount)
+	{
+		pQueue->batchCounts.push_back(uCount);
+		if (uCount < pQueue->uBatchCount.load(std::memory_order_relaxed))
+			pQueue->uBatchCount.store(uCount, std::memory_order_relaxed);
+	}
+	~CDKQueueBatchWaiter()
+	{
+		std::vector<uint32_t>& counts = pQueue->batchCounts;
+		counts.erase(std::find(counts.begin(), counts.end(), uCount));
+		pQueue->uBatchCount.store(counts.empty() ? UINT32_MAX : *std::min_element(counts.begin(), counts.end()), std::memory_order_relaxed);
+	}
+};
+
+/*!
+	Size of the queue. The mutex of a locked queue must be held.
+*/
+static uint32_t CDKQueueSize(CDKQueue* pQueue)
+{
+	return pQueue->pRing ? CDKRingSize(pQueue->pRing) : (uint32_t)pQueue->messages.size();
+}
+
+/*!
+	Push time of the oldest message. The mutex of a locked queue must be held.
+	@returns false if the queue is empty
+*/
+static bool CDKQueueOldest(CDKQueue* pQueue, std::chrono::steady_clock::time_point* pPushed)
+{
+	if (!pQueue->pRing)
+	{
+		if (pQueue->messages.empty())
+			return false;
+		*pPushed = pQueue->messages.front().pushed;
+		return true;
+	}
+	CDKRing* pRing = pQueue->pRing;
+	uint64_t uPos = pRing->uPopPos.load(std::memory_order_seq_cst);
+	CDKRingCell& cell = pRing->cells[uPos & pRing->uMask];
+	if (cell.uSequence.load(std::memory_order_acquire) != uPos + 1)
+		return false;
+	*pPushed = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(cell.iPushed.load(std::memory_order_relaxed)));
+	return true;
+}
+
+static void CDKQueueCountDrop(CDKQueue* pQueue, CDKMsg* pMsg)
+{
+	pQueue->uDrops.fetch_add(1, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(pQueue->dropsMutex);
+	pQueue->producerDrops[pMsg->pCDK]++;
+}
+
+/*!
+	Wakes up the producers waiting for room, if any. Called after pops.
+*/
+static void CDKQueueNotifyProducers(CDKQueue* pQueue)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (pQueue->uBlockedProducers.load(std::memory_order_relaxed) == 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+	}
+	pQueue->cvSpace.notify_all();
+}
+
+/*!
+	Makes the ready fd readable, if it exists. Called after pushes.
+*/
+static void CDKQueueSignalReady(CDKQueue* pQueue)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int iFd = pQueue->iReadyFd.load(std::memory_order_acquire);
+	if (iFd < 0 || pQueue->bReadySignaled.exchange(true))
+		return;
+	uint64_t uValue = 1;
+	ssize_t iWritten = write(iFd, &uValue, sizeof(uValue));
+	(void)iWritten;
+}
+
+/*!
+	Resets the ready fd, if it exists. Called when a pop finds or leaves the queue empty.
+*/
+static void CDKQueueResetReady(CDKQueue* pQueue)
+{
+	int iFd = pQueue->iReadyFd.load(std::memory_order_acquire);
+	if (iFd < 0)
+		return;
+	uint64_t uValue;
+	ssize_t iRead = read(iFd, &uValue, sizeof(uValue));
+	(void)iRead;
+	pQueue->bReadySignaled.store(false, std::memory_order_seq_cst);
+	// a push may have seen the flag still up
+	if (CDKQueueGetQueueSize(pQueue) != 0)
+		CDKQueueSignalReady(pQueue);
+}
+
+static bool CDKQueuePushLocked(CDKQueue* pQueue, CDKMsg* pMsg, bool* pbWasEmpty)
+{
+	CDKMsg* pEvicted = nullptr;
+	bool bBatchReady;
+	auto now = std::chrono::steady_clock::now();
+	{
+		std::unique_lock<std::mutex> lock(pQueue->mutex);
+		if (pQueue->messages.size() >= pQueue->uMaxSize)
+		{
+			uint32_t uPolicy = pQueue->uOverflowPolicy.load(std::memory_order_relaxed);
+			if (uPolicy == CDK_QUEUE_DROP_OLDEST && !pQueue->messages.empty())
+			{
+				pEvicted = pQueue->messages.front().pMsg;
+				pQueue->messages.pop_front();
+			}
+			else if (uPolicy == CDK_QUEUE_BLOCK)
+			{
+				pQueue->uBlockedProducers++;
+				pQueue->cvSpace.wait_for(lock, std::chrono::milliseconds(pQueue->uBlockTimeout.load()),
+					[pQueue] { return pQueue->messages.size() < pQueue->uMaxSize; });
+				pQueue->uBlockedProducers--;
+				now = std::chrono::steady_clock::now();
+			}
+			if (pQueue->messages.size() >= pQueue->uMaxSize)
+				return false;
+		}
+		*pbWasEmpty = pQueue->messages.empty();
+		pQueue->messages.push_back(CDKQueueEntry{ pMsg, now });
+		// at capacity with CDK_QUEUE_DROP_OLDEST, the size does not change any more
+		bBatchReady = pQueue->messages.size() >= pQueue->uBatchCount.load(std::memory_order_relaxed);
+	}
+	if (pEvicted)
+	{
+		CDKQueueCountDrop(pQueue, pEvicted);
+		CDKMsgDestroy(pEvicted);
+	}
+	pQueue->cvNewMessage.notify_one();
+	// batch waiters are only woken up by the first message (to arm their latency timer) and by a complete batch
+	if (bBatchReady || *pbWasEmpty)
+		pQueue->cvBatch.notify_all();
+	return true;
+}
+
+static bool CDKQueuePushLockFree(CDKQueue* pQueue, CDKMsg* pMsg, bool* pbWasEmpty)
+{
+	CDKRing* pRing = pQueue->pRing;
+	int64_t iPushed = std::chrono::steady_clock::now().time_since_epoch().count();
+	std::chrono::steady_clock::time_point deadline;
+	bool bBlocked = false;
+	while (!CDKRingPush(pRing, pMsg, iPushed, pbWasEmpty))
+	{
+		uint32_t uPolicy = pQueue->uOverflowPolicy.load(std::memory_order_relaxed);
+		if (uPolicy == CDK_QUEUE_DROP_OLDEST)
+		{
+			CDKMsg* pEvicted = CDKRingPop(pRing);
+			if (pEvicted)
+			{
+				CDKQueueCountDrop(pQueue, pEvicted);
+				CDKMsgDestroy(pEvicted);
+			}
+			continue;
+		}
+		if (uPolicy != CDK_QUEUE_BLOCK)
+			return false;
+
+		auto now = std::chrono::steady_clock::now();
+		if (!bBlocked)
+		{
+			deadline = now + std::chrono::milliseconds(pQueue->uBlockTimeout.load());
+			bBlocked = true;
+		}
+		if (now >= deadline)
+			return false;
+		pQueue->uBlockedProducers.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		{
+			std::unique_lock<std::mutex> lock(pQueue->mutex);
+			pQueue->cvSpace.wait_until(lock, deadline, [pRing] { return CDKRingSize(pRing) <= pRing->uMask; });
+		}
+		pQueue->uBlockedProducers.fetch_sub(1, std::memory_order_relaxed);
+		iPushed = std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+
+	// the consumers only sleep after registering in uWaiters : no lock at all when they are busy
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (pQueue->uWaiters.load(std::memory_order_relaxed) != 0)
+	{
+		uint32_t uSize = CDKRingSize(pRing);
+		{
+			std::lock_guard<std::mutex> lock(pQueue->mutex);
+		}
+		pQueue->cvNewMessage.notify_one();
+		if (*pbWasEmpty || uSize <= 1 || uSize >= pQueue->uBatchCount.load(std::memory_order_relaxed))
+			pQueue->cvBatch.notify_all();
+	}
+	return true;
+}
+
+int32_t CDKQueuePushInternal(CDKQueue* pQueue, CDKMsg* pMsg, bool* pbWasEmpty)
+{
+	bool bWasEmpty = false;
+	bool bPushed = pQueue->pRing ? CDKQueuePushLockFree(pQueue, pMsg, &bWasEmpty) : CDKQueuePushLocked(pQueue, pMsg, &bWasEmpty);
+	if (!bPushed)
+	{
+		CDKQueueCountDrop(pQueue, pMsg);
+		return CDK_FAIL;
+	}
+	if (bWasEmpty)
+	{
+		PCDKQUEUENEWMESSAGECALLBACK newMessageCallback = pQueue->newMessageCallback.load(std::memory_order_acquire);
+		if (newMessageCallback)
+			newMessageCallback(pQueue, pQueue->pNewMessageUser.load(std::memory_order_relaxed));
+	}
+	CDKQueueSignalReady(pQueue);
+	if (pbWasEmpty)
+		*pbWasEmpty = bWasEmpty;
+	return CDK_OK;
+}
+
+//---------------------------------------------------------------------------------------------
+// API
+//---------------------------------------------------------------------------------------------
+
+CDKQueue CDK_API * CDKQueueCreate()
+{
+	CDKQueue* pQueue = new (std::nothrow) CDKQueue();
+	if (!pQueue)
+		CDKSetLastError(nullptr, "out of memory");
+	return pQueue;
+}
+
+CDKQueue CDK_API * CDKQueueCreateLockFree(uint32_t uCapacity)
+{
+	// the ring needs at least 2 cells to tell a free cell from a full one
+	uint64_t uSize = 2;
+	while (uSize < uCapacity)
+		uSize <<= 1;
+	CDKQueue* pQueue = new (std::nothrow) CDKQueue();
+	CDKRing* pRing = new (std::nothrow) CDKRing();
+	if (!pQueue || !pRing)
+	{
+		delete pQueue;
+		delete pRing;
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	try
+	{
+		pRing->cells = std::vector<CDKRingCell>(uSize);
+	}
+	catch (const std::exception&)
+	{
+		delete pQueue;
+		delete pRing;
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	for (uint64_t i = 0; i < uSize; i++)
+	{
+		pRing->cells[i].uSequence.store(i, std::memory_order_relaxed);
+		pRing->cells[i].pMsg = nullptr;
+		pRing->cells[i].iPushed.store(0, std::memory_order_relaxed);
+	}
+	pRing->uMask = uSize - 1;
+	pQueue->pRing = pRing;
+	pQueue->uMaxSize = (uint32_t)uSize;
+	return pQueue;
+}
+
+int32_t CDK_API CDKQueueDestroy(CDKQueue* pQueue)
+{
+	if (!pQueue)
+		return CDK_FAIL;
+	if (pQueue->uUsers.load() != 0)
+	{
+		CDKSetLastError(pQueue, "queue is used by %u CDK instance(s)", pQueue->uUsers.load());
+		return CDK_FAIL;
+	}
+	for (CDKQueueEntry& entry : pQueue->messages)
+		CDKMsgDestroy(entry.pMsg);
+	if (pQueue->iReadyFd >= 0)
+		close(pQueue->iReadyFd);
+	if (pQueue->pRing)
+	{
+		while (CDKMsg* pMsg = CDKRingPop(pQueue->pRing))
+			CDKMsgDestroy(pMsg);
+		delete pQueue->pRing;
+	}
+	delete pQueue;
+	return CDK_OK;
+}
+
+void CDK_API CDKQueueSetNewMessageCallback(CDKQueue* pQueue, PCDKQUEUENEWMESSAGECALLBACK newMessageCallback, void* pUser)
+{
+	if (!pQueue)
+		return;
+	std::lock_guard<std::mutex> lock(pQueue->mutex);
+	pQueue->pNewMessageUser.store(pUser, std::memory_order_relaxed);
+	pQueue->newMessageCallback.store(newMessageCallback, std::memory_order_release);
+}
+
+uint32_t CDK_API CDKQueueGetMessageDrops(CDKQueue* pQueue)
+{
+	return pQueue ? pQueue->uDrops.load(std::memory_order_relaxed) : 0;
+}
+
+void CDK_API CDKQueueResetMessageDrops(CDKQueue* pQueue)
+{
+	if (!pQueue)
+		return;
+	std::lock_guard<std::mutex> lock(pQueue->dropsMutex);
+	pQueue->uDrops = 0;
+	pQueue->producerDrops.clear();
+}
+
+void CDKQueueForgetProducer(CDKQueue* pQueue, CDK* pProducer)
+{
+	std::lock_guard<std::mutex> lock(pQueue->dropsMutex);
+	pQueue->producerDrops.erase(pProducer);
+}
+
+uint32_t CDK_API CDKQueueGetProducerDrops(CDKQueue* pQueue, CDK* pProducer)
+{
+	if (!pQueue)
+		return 0;
+	std::lock_guard<std::mutex> lock(pQueue->dropsMutex);
+	auto it = pQueue->producerDrops.find(pProducer);
+	return it != pQueue->producerDrops.end() ? it->second : 0;
+}
+
+int32_t CDK_API CDKQueueSetOverflowPolicy(CDKQueue* pQueue, uint32_t uPolicy, uint32_t uBlockTimeout)
+{
+	if (!pQueue)
+		return CDK_FAIL;
+	if (uPolicy > CDK_QUEUE_BLOCK)
+	{
+		CDKSetLastError(pQueue, "unknown overflow policy %u", uPolicy);
+		return CDK_FAIL;
+	}
+	pQueue->uBlockTimeout = uBlockTimeout;
+	pQueue->uOverflowPolicy = uPolicy;
+	// producers already blocked see the new policy after their wait
+	CDKQueueNotifyProducers(pQueue);
+	return CDK_OK;
+}
+
+uint32_t CDK_API CDKQueueGetMaxQueueSize(CDKQueue* pQueue)
+{
+	if (!pQueue)
+		return 0;
+	std::lock_guard<std::mutex> lock(pQueue->mutex);
+	return pQueue->uMaxSize;
+}
+
+void CDK_API CDKQueueSetMaxQueueSize(CDKQueue* pQueue, uint32_t uMax)
+{
+	if (!pQueue)
+		return;
+	if (pQueue->pRing)
+	{
+		CDKSetLastError(pQueue, "the size of a lock-free queue is fixed");
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		pQueue->uMaxSize = uMax;
+	}
+	CDKQueueNotifyProducers(pQueue);
+}
+
+int32_t CDK_API CDKQueueWaitForNewMessage(CDKQueue* pQueue, uint32_t uTimeout)
+{
+	if (!pQueue)
+		return CDK_FAIL;
+	CDKQueueWaiter waiter(pQueue);
+	std::unique_lock<std::mutex> lock(pQueue->mutex);
+	bool bReady = pQueue->cvNewMessage.wait_for(lock, std::chrono::milliseconds(uTimeout),
+		[pQueue] { return CDKQueueSize(pQueue) != 0; });
+	return bReady ? CDK_OK : CDK_FAIL;
+}
+
+int CDK_API CDKQueueGetReadyFd(CDKQueue* pQueue)
+{
+	if (!pQueue)
+		return -1;
+	int iFd = pQueue->iReadyFd.load(std::memory_order_acquire);
+	if (iFd >= 0)
+		return iFd;
+	{
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		iFd = pQueue->iReadyFd.load(std::memory_order_relaxed);
+		if (iFd >= 0)
+			return iFd;
+		iFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (iFd < 0)
+		{
+			CDKSetLastError(pQueue, "eventfd failed: %s", strerror(errno));
+			return -1;
+		}
+		pQueue->iReadyFd.store(iFd, std::memory_order_release);
+	}
+	// messages may have been pushed before the eventfd existed
+	if (CDKQueueGetQueueSize(pQueue) != 0)
+		CDKQueueSignalReady(pQueue);
+	return iFd;
+}
+
+uint32_t CDK_API CDKQueueGetQueueSize(CDKQueue* pQueue)
+{
+	if (!pQueue)
+		return 0;
+	if (pQueue->pRing)
+		return CDKRingSize(pQueue->pRing);
+	std::lock_guard<std::mutex> lock(pQueue->mutex);
+	return (uint32_t)pQueue->messages.size();
+}
+
+int32_t CDK_API CDKQueuePushMessage(CDKQueue* pQueue, CDKMsg* pMsg)
+{
+	if (!pQueue || !pMsg)
+		return CDK_FAIL;
+	if (CDKQueuePushInternal(pQueue, pMsg, nullptr) != CDK_OK)
+	{
+		CDKSetLastError(pQueue, "queue is full");
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+CDKMsg CDK_API * CDKQueuePopMessage(CDKQueue* pQueue)
+{
+	if (!pQueue)
+		return nullptr;
+	CDKMsg* pMsg = nullptr;
+	bool bEmpty;
+	if (pQueue->pRing)
+	{
+		pMsg = CDKRingPop(pQueue->pRing);
+		bEmpty = CDKRingSize(pQueue->pRing) == 0;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		if (!pQueue->messages.empty())
+		{
+			pMsg = pQueue->messages.front().pMsg;
+			pQueue->messages.pop_front();
+		}
+		bEmpty = pQueue->messages.empty();
+	}
+	if (pMsg)
+		CDKQueueNotifyProducers(pQueue);
+	if (bEmpty)
+		CDKQueueResetReady(pQueue);
+	return pMsg;
+}
+
+uint32_t CDK_API CDKQueuePopMessages(CDKQueue* pQueue, CDKMsg** ppMsgs, uint32_t uMax)
+{
+	if (!pQueue || !ppMsgs)
+		return 0;
+	uint32_t uCount = 0;
+	bool bEmpty;
+	if (pQueue->pRing)
+	{
+		while (uCount < uMax && (ppMsgs[uCount] = CDKRingPop(pQueue->pRing)) != nullptr)
+			uCount++;
+		bEmpty = CDKRingSize(pQueue->pRing) == 0;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		uCount = (uint32_t)std::min<size_t>(uMax, pQueue->messages.size());
+		for (uint32_t i = 0; i < uCount; i++)
+			ppMsgs[i] = pQueue->messages[i].pMsg;
+		pQueue->messages.erase(pQueue->messages.begin(), pQueue->messages.begin() + uCount);
+		bEmpty = pQueue->messages.empty();
+	}
+	if (uCount)
+		CDKQueueNotifyProducers(pQueue);
+	if (bEmpty)
+		CDKQueueResetReady(pQueue);
+	return uCount;
+}
+
+int32_t CDK_API CDKQueueWaitForNewMessages(CDKQueue* pQueue, uint32_t uCount, uint32_t uMaxLatency, uint32_t uTimeout)
+{
+	if (!pQueue)
+		return CDK_FAIL;
+	if (uCount == 0)
+		uCount = 1;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(uTimeout);
+	CDKQueueWaiter waiter(pQueue);
+	std::unique_lock<std::mutex> lock(pQueue->mutex);
+	// a full queue is a complete batch
+	uCount = std::max(1u, std::min(uCount, pQueue->uMaxSize));
+	CDKQueueBatchWaiter batchWaiter(pQueue, uCount);
+	for (;;)
+	{
+		if (CDKQueueSize(pQueue) >= uCount)
+			return CDK_OK;
+		auto now = std::chrono::steady_clock::now();
+		auto wakeUp = deadline;
+		std::chrono::steady_clock::time_point oldest;
+		bool bEmpty = !CDKQueueOldest(pQueue, &oldest);
+		if (!bEmpty)
+		{
+			auto batchDeadline = oldest + std::chrono::milliseconds(uMaxLatency);
+			if (now >= batchDeadline)
+				return CDK_OK;
+			wakeUp = std::min(wakeUp, batchDeadline);
+		}
+		if (now >= deadline)
+			return bEmpty ? CDK_FAIL : CDK_OK;
+		pQueue->cvBatch.wait_until(lock, wakeUp);
+	}
+}
@@ -0,0 +1,140 @@
+/*! \file
+
+CDKSignature : reference implementation of the vehicle signatures.
+
+A signature buffer is a vector of 8 bits features. When parsed, the features are centered and
+normalized, so that the comparison score is 10 times the cosine similarity of the two vectors
+(negative similarities give 0). Two unrelated vehicles give scores close to 0.
+
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#include "CDKPrivate.h"
+#include "../include/CDKSignature.h"
+
+/*!
+	Minimum number of features of a signature
+*/
+#define CDK_SIGNATURE_MIN_FEATURES 8
+
+/*!
+	Number of features compared between two checks of the minimum score in CDKSignatureCompareEx
+*/
+#define CDK_SIGNATURE_PRUNE_BLOCK 32
+
+struct _cdksignature : CDKObject
+{
+	/*! centered features, normalized to a unit length */
+	std::vector<float> features;
+};
+
+CDKSignature CDK_API * CDKSignatureCreate(const uint8_t* pBuffer, uint32_t uSize)
+{
+	if (!pBuffer || uSize < CDK_SIGNATURE_MIN_FEATURES)
+	{
+		CDKSetLastError(nullptr, "invalid signature buffer (%u bytes)", uSize);
+		return nullptr;
+	}
+	CDKSignature* pSignature = new (std::nothrow) CDKSignature();
+	if (!pSignature)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	pSignature->features.resize(uSize);
+	double dNorm = 0;
+	for (uint32_t i = 0; i < uSize; i++)
+	{
+		float f = (float)pBuffer[i] - 127.5f;
+		pSignature->features[i] = f;
+		dNorm += (double)f * f;
+	}
+	float fScale = dNorm > 0 ? (float)(1.0 / sqrt(dNorm)) : 0.0f;
+	for (float& f : pSignature->features)
+		f *= fScale;
+	return pSignature;
+}
+
+void CDK_API CDKSignatureDestroy(CDKSignature* pSignature)
+{
+	delete pSignature;
+}
+
+uint32_t CDKSignatureFeatureCount(const CDKSignature* pSignature)
+{
+	return pSignature ? (uint32_t)pSignature->features.size() : 0;
+}
+
+static int32_t CDKSignatureCheck(CDKSignature* pSignature1, CDKSignature* pSignature2)
+{
+	if (!pSignature1 || !pSignature2)
+	{
+		if (pSignature1)
+			CDKSetLastError(pSignature1, "invalid signature");
+		return CDK_FAIL;
+	}
+	if (pSignature1->features.size() != pSignature2->features.size())
+	{
+		CDKSetLastError(pSignature1, "signature sizes differ (%u / %u)",
+			(uint32_t)pSignature1->features.size(), (uint32_t)pSignature2->features.size());
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+static int32_t CDKSignatureScore(float fSimilarity)
+{
+	if (fSimilarity <= 0)
+		return 0;
+	int32_t iScore = (int32_t)lroundf(fSimilarity * 10.0f);
+	return iScore > 10 ? 10 : iScore;
+}
+
+int32_t CDK_API CDKSignatureCompare(CDKSignature* pSignature1, CDKSignature* pSignature2)
+{
+	if (CDKSignatureCheck(pSignature1, pSignature2) != CDK_OK)
+		return -1;
+	const float* p1 = pSignature1->features.data();
+	const float* p2 = pSignature2->features.data();
+	size_t uCount = pSignature1->features.size();
+	float fDot = 0;
+	for (size_t i = 0; i < uCount; i++)
+		fDot += p1[i] * p2[i];
+	return CDKSignatureScore(fDot);
+}
+
+int32_t CDK_API CDKSignatureCompareEx(CDKSignature* pSignature1, CDKSignature* pSignature2, int32_t iMinScoreRequired)
+{
+	if (CDKSignatureCheck(pSignature1, pSignature2) != CDK_OK)
+		return -1;
+	if (iMinScoreRequired <= 0)
+		return CDKSignatureCompare(pSignature1, pSignature2);
+	if (iMinScoreRequired > 10)
+		return 0;
+
+	// For unit vectors, |a-b|^2 = 2 - 2 cos(a,b). The squared distance only grows while features
+	// are accumulated, so the comparison stops as soon as the required score cannot be reached.
+	float fMinSimilarity = ((float)iMinScoreRequired - 0.5f) / 10.0f;
+	float fMaxDistance = 2.0f - 2.0f * fMinSimilarity;
+	const float* p1 = pSignature1->features.data();
+	const float* p2 = pSignature2->features.data();
+	size_t uCount = pSignature1->features.size();
+	float fDistance = 0;
+	for (size_t uBlock = 0; uBlock < uCount; uBlock += CDK_SIGNATURE_PRUNE_BLOCK)
+	{
+		size_t uEnd = uBlock + CDK_SIGNATURE_PRUNE_BLOCK < uCount ? uBlock + CDK_SIGNATURE_PRUNE_BLOCK : uCount;
+		for (size_t i = uBlock; i < uEnd; i++)
+		{
+			float fDiff = p1[i] - p2[i];
+			fDistance += fDiff * fDiff;
+		}
+		if (fDistance > fMaxDistance)
+			return 0;
+	}
+	return CDKSignatureScore(1.0f - fDistance / 2.0f);
+}
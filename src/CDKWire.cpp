@@ -0,0 +1,188 @@
+/*! \file
+
+CDKWire : framing used on the link between a CDK instance and an equipment.
+
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
+#include "CDKPrivate.h"
+#include "CDKWire.h"
+
+/*!
+	Interval at which blocking reads and writes check their stop flag
+*/
+#define CDK_WIRE_POLL_SLICE_MS 100
+
+/*!
+	Maximum number of segments handed to a single sendmsg
+*/
+#define CDK_WIRE_MAX_IOV 64
+
+void CDKWireEncodeHeader(uint8_t* pHeader, uint32_t uPayloadSize, uint32_t uId)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		pHeader[i] = (uint8_t)(uPayloadSize >> (8 * i));
+		pHeader[4 + i] = (uint8_t)(uId >> (8 * i));
+	}
+}
+
+void CDKWireDecodeHeader(const uint8_t* pHeader, uint32_t* puPayloadSize, uint32_t* puId)
+{
+	uint32_t uSize = 0;
+	uint32_t uId = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uSize |= (uint32_t)pHeader[i] << (8 * i);
+		uId |= (uint32_t)pHeader[4 + i] << (8 * i);
+	}
+	*puPayloadSize = uSize;
+	*puId = uId;
+}
+
+int32_t CDKWireEncodeFrame(CDKMsg* pMsg, uint32_t uId, std::vector<uint8_t>& frame)
+{
+	// exported once, straight into a frame of the exact size
+	uint32_t uSize = CDKMsgGetExportSize(pMsg);
+	frame.resize(CDK_WIRE_HEADER_SIZE + uSize);
+	if (CDKMsgExportToBinaryArray(pMsg, frame.data() + CDK_WIRE_HEADER_SIZE, uSize) != (int32_t)uSize)
+		return CDK_FAIL;
+	CDKWireEncodeHeader(frame.data(), uSize, uId);
+	return CDK_OK;
+}
+
+/*!
+	Deadline of a send of at most uTimeoutMs, 0 for no limit
+*/
+static std::chrono::steady_clock::time_point CDKWireDeadline(uint32_t uTimeoutMs)
+{
+	if (uTimeoutMs == 0)
+		return std::chrono::steady_clock::time_point::max();
+	return std::chrono::steady_clock::now() + std::chrono::milliseconds(uTimeoutMs);
+}
+
+/*!
+	Waits until a socket can be written, at most until the deadline. pbStop is checked every CDK_WIRE_POLL_SLICE_MS.
+	@returns CDK_OK when the socket can be written, CDK_FAIL with errno set to ETIMEDOUT or ECANCELED otherwise
+*/
+static int32_t CDKWireWaitWritable(int iSocket, std::chrono::steady_clock::time_point deadline, const std::atomic<bool>* pbStop)
+{
+	for (;;)
+	{
+		if (pbStop && pbStop->load(std::memory_order_relaxed))
+		{
+			errno = ECANCELED;
+			return CDK_FAIL;
+		}
+		int64_t iLeftMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if (iLeftMs <= 0)
+		{
+			errno = ETIMEDOUT;
+			return CDK_FAIL;
+		}
+		struct pollfd pfd = { iSocket, POLLOUT, 0 };
+		int iReady = poll(&pfd, 1, (int)std::min<int64_t>(iLeftMs, CDK_WIRE_POLL_SLICE_MS));
+		if (iReady > 0)
+			return CDK_OK;
+		if (iReady < 0 && errno != EINTR)
+			return CDK_FAIL;
+	}
+}
+
+int32_t CDKWireSendSegments(int iSocket, const uint8_t* pHeader, const CDKMsgSegment* pSegments, uint32_t uSegments,
+	uint32_t uTimeoutMs, const std::atomic<bool>* pbStop)
+{
+	std::chrono::steady_clock::time_point deadline = CDKWireDeadline(uTimeoutMs);
+	// piece i is the header for i = 0, segment i - 1 otherwise
+	auto pieceData = [&](uint32_t i) { return i == 0 ? pHeader : pSegments[i - 1].pData; };
+	auto pieceSize = [&](uint32_t i) { return i == 0 ? (size_t)CDK_WIRE_HEADER_SIZE : (size_t)pSegments[i - 1].uSize; };
+	uint32_t uPieces = uSegments + 1;
+	uint32_t uCurrent = 0;
+	// bytes of the current piece already sent
+	size_t uSkip = 0;
+	struct iovec iov[CDK_WIRE_MAX_IOV];
+	for (;;)
+	{
+		int iCount = 0;
+		for (uint32_t i = uCurrent; i < uPieces && iCount < CDK_WIRE_MAX_IOV; i++)
+		{
+			size_t uOffset = i == uCurrent ? uSkip : 0;
+			if (pieceSize(i) == uOffset)
+				continue;
+			iov[iCount].iov_base = (void*)(pieceData(i) + uOffset);
+			iov[iCount].iov_len = pieceSize(i) - uOffset;
+			iCount++;
+		}
+		if (iCount == 0)
+			return CDK_OK;
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = (size_t)iCount;
+		ssize_t iSent = sendmsg(iSocket, &msg, MSG_NOSIGNAL);
+		if (iSent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && CDKWireWaitWritable(iSocket, deadline, pbStop) == CDK_OK)
+				continue;
+			return CDK_FAIL;
+		}
+		size_t uSent = (size_t)iSent;
+		while (uSent)
+		{
+			size_t uLeft = pieceSize(uCurrent) - uSkip;
+			if (uSent < uLeft)
+			{
+				uSkip += uSent;
+				break;
+			}
+			uSent -= uLeft;
+			uCurrent++;
+			uSkip = 0;
+		}
+	}
+}
+
+int32_t CDKWireRecvAll(int iSocket, uint8_t* pData, uint32_t uSize, uint32_t uTimeoutMs, const std::atomic<bool>* pbStop,
+	CDKWireIdleFunction idle, void* pIdleUser)
+{
+	uint32_t uWaited = 0;
+	while (uSize)
+	{
+		if (pbStop && pbStop->load(std::memory_order_relaxed))
+			return CDK_FAIL;
+		struct pollfd pfd = { iSocket, POLLIN, 0 };
+		int iReady = poll(&pfd, 1, CDK_WIRE_POLL_SLICE_MS);
+		if (iReady < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return CDK_FAIL;
+		}
+		if (iReady == 0)
+		{
+			if (idle)
+				idle(pIdleUser);
+			uWaited += CDK_WIRE_POLL_SLICE_MS;
+			if (uTimeoutMs && uWaited >= uTimeoutMs)
+				return CDK_FAIL;
+			continue;
+		}
+		ssize_t iRead = recv(iSocket, pData, uSize, 0);
+		if (iRead < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+			continue;
+		if (iRead <= 0)
+			return CDK_FAIL;
+		pData += iRead;
+		uSize -= (uint32_t)iRead;
+		uWaited = 0;
+	}
+	return CDK_OK;
+}
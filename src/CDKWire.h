@@ -0,0 +1,74 @@
+/*! \file
+
+CDKWire : framing used on the link between a CDK instance and an equipment.<br/>
+Every frame is a fixed 8 bytes header followed by a CDKMsg exported with <a href="#CDKMsgExportToBinaryArray">CDKMsgExportToBinaryArray</a>.<br/>
+The header holds the payload size and a request identifier, both little endian. The identifier is 0 for asynchronous
+messages (plate reads sent by the equipment, or messages sent with <a href="#CDKSendAsynchronousMessage">CDKSendAsynchronousMessage</a>),
+and is copied from the request into the answer for synchronous requests.
+This header is not part of the public API.
+
+*/
+
+#ifndef CDKWIRE_H
+#define CDKWIRE_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "../include/CDKMsg.h"
+
+/*!
+	Size of a frame header
+*/
+#define CDK_WIRE_HEADER_SIZE 8
+
+/*!
+	Maximum accepted payload size. Bigger frames are considered as a protocol error.
+*/
+#define CDK_WIRE_MAX_PAYLOAD (64u * 1024u * 1024u)
+
+/*!
+	Name of the protocol spoken by the reference implementation, as returned by <a href="#CDKGetDetectedProtocol">CDKGetDetectedProtocol</a>
+*/
+#define CDK_WIRE_PROTOCOL "NPP"
+
+/*!
+	Writes a frame header
+*/
+void CDKWireEncodeHeader(uint8_t* pHeader, uint32_t uPayloadSize, uint32_t uId);
+
+/*!
+	Reads a frame header
+*/
+void CDKWireDecodeHeader(const uint8_t* pHeader, uint32_t* puPayloadSize, uint32_t* puId);
+
+/*!
+	Exports a message as a complete frame (header + payload) in frame.
+	@returns CDK_OK on success
+*/
+int32_t CDKWireEncodeFrame(CDKMsg* pMsg, uint32_t uId, std::vector<uint8_t>& frame);
+
+/*!
+	Writes a frame header followed by the segments of an exported message on a socket, with as few system calls
+	as possible and without copying the segments, in at most uTimeoutMs (0 for no limit). The socket may be non
+	blocking : while it cannot be written, pbStop is checked every 100 ms.
+	@returns CDK_OK on success, CDK_FAIL if the connection is broken, the timeout is reached or *pbStop became true
+*/
+int32_t CDKWireSendSegments(int iSocket, const uint8_t* pHeader, const CDKMsgSegment* pSegments, uint32_t uSegments,
+	uint32_t uTimeoutMs, const std::atomic<bool>* pbStop);
+
+/*!
+	Called by <a href="#CDKWireRecvAll">CDKWireRecvAll</a> while it waits for data, at least every 100 ms
+*/
+typedef void (*CDKWireIdleFunction)(void* pUser);
+
+/*!
+	Reads exactly uSize bytes from a socket, waiting at most uTimeoutMs (0 for no limit) between two chunks. pbStop is checked between two chunks.
+	@returns CDK_OK on success, CDK_FAIL if the connection is broken, the timeout is reached or *pbStop became true
+*/
+int32_t CDKWireRecvAll(int iSocket, uint8_t* pData, uint32_t uSize, uint32_t uTimeoutMs, const std::atomic<bool>* pbStop,
+	CDKWireIdleFunction idle = nullptr, void* pIdleUser = nullptr);
+
+#endif //CDKWIRE_H
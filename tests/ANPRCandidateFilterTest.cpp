@@ -0,0 +1,201 @@
+/*
+	ANPRCandidateFilterTest : the candidates of a blocking index against a scan of every indexed read, counting the
+	distinct q-grams shared with the query, and the evaluation of the filter against the exact matcher.
+*/
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "CDKSimulator.h"
+#include "ANPRCandidateFilter.h"
+#include "ANPRTest.h"
+
+#define ENTRIES 1500
+#define QUERIES 48
+#define SECOND 1000000ll
+
+struct TestReads
+{
+	std::vector<CDKMsg*> messages;
+	/*! entry reads of sensors 0 and 2, one every 10 ms */
+	std::vector<ANPRCandidateRead> entries;
+	/*! exit reads of sensor 1, 20 s after their entry read */
+	std::vector<ANPRCandidateRead> queries;
+};
+
+static std::set<std::string> Grams(uint32_t uGramSize, const ANPRCandidateRead& read)
+{
+	std::set<std::string> grams;
+	uint32_t uLength = std::min(uGramSize, read.uSize);
+	for (uint32_t i = 0; i + uLength <= read.uSize; i++)
+		grams.insert(std::string((const char*)read.pBuffer + i, uLength));
+	return grams;
+}
+
+static bool Eligible(const ANPRCandidateFilterConfig& config, const ANPRCandidateRead& entry, const ANPRCandidateRead& query)
+{
+	int64_t iDelayUs = query.iTimestampUs - entry.iTimestampUs;
+	if (config.iMaxDelayUs && (iDelayUs < config.iMinDelayUs || iDelayUs > config.iMaxDelayUs))
+		return false;
+	return entry.uSensor == 0;
+}
+
+/*!
+	The expected candidates : every eligible live read sharing enough q-grams, from the most shared down, then from the
+	most recent read
+*/
+static std::vector<ANPRCandidate> ScanEntries(const ANPRCandidateFilterConfig& config, const std::vector<ANPRCandidateRead>& entries,
+	size_t uFirstLive, const ANPRCandidateRead& query)
+{
+	std::set<std::string> queryGrams = Grams(config.uGramSize, query);
+	std::vector<ANPRCandidate> candidates;
+	for (size_t i = uFirstLive; i < entries.size(); i++)
+	{
+		if (!Eligible(config, entries[i], query))
+			continue;
+		std::set<std::string> grams = Grams(config.uGramSize, entries[i]);
+		uint32_t uShared = (uint32_t)std::count_if(grams.begin(), grams.end(), [&](const std::string& gram) { return queryGrams.count(gram) != 0; });
+		if (uShared >= config.uMinSharedGrams)
+			candidates.push_back({ entries[i], uShared });
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const ANPRCandidate& a, const ANPRCandidate& b) {
+		return a.uSharedGrams != b.uSharedGrams ? a.uSharedGrams > b.uSharedGrams : a.read.iTimestampUs > b.read.iTimestampUs;
+	});
+	return candidates;
+}
+
+static void CheckQuery(ANPRCandidateFilter* pFilter, const ANPRCandidateFilterConfig& config, const std::vector<ANPRCandidateRead>& entries,
+	size_t uFirstLive, const ANPRCandidateRead& query, uint64_t uMaxCandidates)
+{
+	std::vector<ANPRCandidate> expected = ScanEntries(config, entries, uFirstLive, query);
+	std::vector<ANPRCandidate> candidates(uMaxCandidates);
+	int64_t iCount = ANPRCandidateFilterQuery(pFilter, &query, candidates.data(), uMaxCandidates);
+	if (!ANPR_CHECK(iCount == (int64_t)expected.size()))
+		return;
+	for (size_t i = 0; i < std::min<size_t>(expected.size(), uMaxCandidates); i++)
+	{
+		const ANPRCandidate& candidate = candidates[i];
+		ANPR_CHECK(candidate.read.uId == expected[i].read.uId && candidate.uSharedGrams == expected[i].uSharedGrams);
+		ANPR_CHECK(candidate.read.uSize == expected[i].read.uSize && memcmp(candidate.read.pBuffer, expected[i].read.pBuffer, candidate.read.uSize) == 0);
+	}
+}
+
+static void TestQueries(const TestReads& reads, uint32_t uGramSize, uint32_t uMinSharedGrams)
+{
+	ANPRCandidateFilterConfig config;
+	ANPRCandidateFilterDefaultConfig(&config);
+	config.uGramSize = uGramSize;
+	config.uMinSharedGrams = uMinSharedGrams;
+	config.iMinDelayUs = SECOND;
+	config.iMaxDelayUs = 60 * SECOND;
+	ANPRCandidateFilter* pFilter = ANPRCandidateFilterCreate(&config);
+	if (!ANPR_CHECK(pFilter != nullptr))
+		return;
+	ANPR_CHECK(ANPRCandidateFilterAddRoute(pFilter, 0, 1) == CDK_OK);
+	for (const ANPRCandidateRead& entry : reads.entries)
+		ANPR_CHECK(ANPRCandidateFilterInsert(pFilter, &entry) == CDK_OK);
+	ANPR_CHECK(ANPRCandidateFilterGetReadCount(pFilter) == ENTRIES);
+
+	for (const ANPRCandidateRead& query : reads.queries)
+	{
+		CheckQuery(pFilter, config, reads.entries, 0, query, 4096);
+		CheckQuery(pFilter, config, reads.entries, 0, query, 3);
+	}
+	ANPR_CHECK(ANPRCandidateFilterQuery(pFilter, &reads.queries[0], nullptr, 0) == (int64_t)ScanEntries(config, reads.entries, 0, reads.queries[0]).size());
+
+	// the first half expired
+	ANPR_CHECK(ANPRCandidateFilterExpire(pFilter, reads.entries[ENTRIES / 2].iTimestampUs) == ENTRIES / 2);
+	ANPR_CHECK(ANPRCandidateFilterGetReadCount(pFilter) == ENTRIES - ENTRIES / 2);
+	for (const ANPRCandidateRead& query : reads.queries)
+		CheckQuery(pFilter, config, reads.entries, ENTRIES / 2, query, 4096);
+	ANPRCandidateFilterDestroy(pFilter);
+}
+
+static int32_t SaveDictionary(CDKPlateFingerprintMatcher*, const uint8_t* pBuffer, uint32_t uSize, void* pUser)
+{
+	static_cast<std::vector<uint8_t>*>(pUser)->assign(pBuffer, pBuffer + uSize);
+	return 1;
+}
+
+/*!
+	The pairs, candidates and matches counted by the evaluation, against the exact matcher called on every pair
+*/
+static void TestEvaluate(const TestReads& reads)
+{
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pLearner, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	for (uint32_t i = 0; dictionary.empty() && i < 100 * ENTRIES; i++)
+		CDKPlateFingerprintMatch(pLearner, reads.queries[i % QUERIES].pBuffer, reads.queries[i % QUERIES].uSize,
+			reads.entries[i % ENTRIES].pBuffer, reads.entries[i % ENTRIES].uSize);
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	if (!ANPR_CHECK(!dictionary.empty()))
+		return;
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), (uint32_t)dictionary.size());
+	CDKPlateFingerprintMatcherStart(pMatcher);
+
+	ANPRCandidateFilterConfig config;
+	ANPRCandidateFilterDefaultConfig(&config);
+	config.iMinDelayUs = SECOND;
+	config.iMaxDelayUs = 60 * SECOND;
+	ANPRCandidateFilter* pFilter = ANPRCandidateFilterCreate(&config);
+	ANPRCandidateFilterAddRoute(pFilter, 0, 1);
+	for (const ANPRCandidateRead& entry : reads.entries)
+		ANPRCandidateFilterInsert(pFilter, &entry);
+
+	uint64_t uPairs = 0, uCandidates = 0, uMatches = 0, uMatchesFound = 0;
+	for (const ANPRCandidateRead& query : reads.queries)
+	{
+		std::vector<ANPRCandidate> candidates = ScanEntries(config, reads.entries, 0, query);
+		uCandidates += candidates.size();
+		for (const ANPRCandidateRead& entry : reads.entries)
+		{
+			if (!Eligible(config, entry, query))
+				continue;
+			uPairs++;
+			if (CDKPlateFingerprintMatch(pMatcher, query.pBuffer, query.uSize, entry.pBuffer, entry.uSize) != 1)
+				continue;
+			uMatches++;
+			uMatchesFound += std::any_of(candidates.begin(), candidates.end(), [&](const ANPRCandidate& candidate) { return candidate.read.uId == entry.uId; });
+		}
+	}
+	ANPRCandidateFilterMetrics metrics;
+	ANPR_CHECK(ANPRCandidateFilterEvaluate(pFilter, pMatcher, reads.queries.data(), QUERIES, &metrics) == CDK_OK);
+	ANPR_CHECK(metrics.uQueries == QUERIES && metrics.uPairs == uPairs && metrics.uCandidates == uCandidates);
+	ANPR_CHECK(metrics.uMatches == uMatches && metrics.uMatchesFound == uMatchesFound && uMatches > 0);
+	ANPR_CHECK(metrics.uMinSharedGrams == config.uMinSharedGrams);
+	ANPRCandidateFilterDestroy(pFilter);
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+}
+
+int main()
+{
+	TestReads reads;
+	for (uint32_t i = 0; i < ENTRIES + QUERIES; i++)
+	{
+		bool bQuery = i >= ENTRIES;
+		uint32_t uVehicle = bQuery ? (i - ENTRIES) * (ENTRIES / QUERIES) : i;
+		uint32_t uSensor = bQuery ? 1 : (i % 5 == 4 ? 2 : 0);
+		CDKMsg* pRead = CDKSimulatorBuildRead(uSensor, i, uVehicle, 0, i);
+		CDKMsgElement* pFp = CDKMsgElementFirstChild(CDKMsgChild(pRead), "fingerprint");
+		int64_t iTimestampUs = (int64_t)uVehicle * 10000 + (bQuery ? 20 * SECOND : 0);
+		(bQuery ? reads.queries : reads.entries).push_back({ i, iTimestampUs, uSensor, CDKMsgElementContent(pFp), CDKMsgElementContentSize(pFp) });
+		reads.messages.push_back(pRead);
+	}
+	TestQueries(reads, 1, 1);
+	TestQueries(reads, 2, 4);
+	TestQueries(reads, 3, 2);
+	TestEvaluate(reads);
+	for (CDKMsg* pRead : reads.messages)
+		CDKMsgDestroy(pRead);
+	return ANPRTestResult("ANPRCandidateFilterTest");
+}
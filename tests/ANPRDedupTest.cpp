@@ -0,0 +1,217 @@
+/*
+	ANPRDedupTest : the passages of a de-duplication stage on a fixed sequence of reads, with and without fingerprint
+	confirmation, and when the number of open passages is reached.
+*/
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "CDKSimulator.h"
+#include "ANPRDedup.h"
+#include "ANPRTest.h"
+
+struct TestRead
+{
+	int64_t iTimestampUs;
+	uint32_t uLane;
+	uint32_t uVehicle;
+	uint32_t uReliability;
+	/*! NULL for a read without plate */
+	const char* strPlate;
+};
+
+/*!
+	Three reads of a vehicle on two lanes, one with OCR confusions, and the same plate on a far lane ; a vehicle read
+	once without a character, and a vehicle whose plate differs from it by one character ; a read without plate ; the
+	first plate again after the window
+*/
+static const TestRead g_reads[] = {
+	{ 0, 1, 1, 80, "AB-123-CD" },
+	{ 150000, 2, 1, 90, "AB123CD" },
+	{ 200000, 1, 1, 70, "A8-I23-CD" },
+	{ 300000, 4, 1, 85, "AB123CD" },
+	{ 400000, 1, 2, 60, "XY999ZZ" },
+	{ 500000, 1, 2, 50, "XY99ZZ" },
+	{ 600000, 1, 3, 75, "XY999Z" },
+	{ 700000, 2, 4, 40, nullptr },
+	{ 5000000, 1, 1, 80, "AB123CD" },
+};
+
+struct TestPassages
+{
+	std::vector<ANPRDedupPassage> passages;
+	bool bElements = true;
+};
+
+static void OnPassage(CDKMsg* pMsg, const ANPRDedupPassage* pPassage, void* pUser)
+{
+	TestPassages* pPassages = (TestPassages*)pUser;
+	pPassages->passages.push_back(*pPassage);
+	// the best read carries the passage
+	CDKMsgElement* pElement = CDKMsgElementFirstChild(CDKMsgChild(pMsg), "passage");
+	const char* strReads = pElement ? CDKMsgElementAttributeValue(pElement, "reads") : nullptr;
+	if (!strReads || strtoul(strReads, nullptr, 10) != pPassage->uReads)
+		pPassages->bElements = false;
+	CDKMsgDestroy(pMsg);
+}
+
+static int32_t SaveDictionary(CDKPlateFingerprintMatcher*, const uint8_t* pBuffer, uint32_t uSize, void* pUser)
+{
+	static_cast<std::vector<uint8_t>*>(pUser)->assign(pBuffer, pBuffer + uSize);
+	return 1;
+}
+
+/*!
+	A matcher started with the dictionary learnt on the reads of a few vehicles
+*/
+static CDKPlateFingerprintMatcher* CreateMatcher()
+{
+	std::vector<CDKMsg*> messages;
+	std::vector<ANPRPlateRead> reads;
+	ANPRPlateReadSchema* pSchema = ANPRPlateReadSchemaCreate();
+	for (uint32_t uSeq = 0; uSeq < 256; uSeq++)
+	{
+		CDKMsg* pRead = CDKSimulatorBuildRead(0, uSeq, uSeq % 32, 0, uSeq);
+		ANPRPlateRead read;
+		ANPRPlateReadExtract(pSchema, pRead, &read);
+		messages.push_back(pRead);
+		reads.push_back(read);
+	}
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pLearner, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	for (size_t i = 0; dictionary.empty() && i < 100 * reads.size() * reads.size(); i++)
+	{
+		const ANPRPlateRead& read1 = reads[i % reads.size()];
+		const ANPRPlateRead& read2 = reads[(i / reads.size()) % reads.size()];
+		CDKPlateFingerprintMatch(pLearner, read1.pFingerprint, read1.uFingerprintSize, read2.pFingerprint, read2.uFingerprintSize);
+	}
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	for (CDKMsg* pRead : messages)
+		CDKMsgDestroy(pRead);
+	ANPRPlateReadSchemaDestroy(pSchema);
+
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	ANPR_CHECK(CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), (uint32_t)dictionary.size()) == CDK_OK);
+	CDKPlateFingerprintMatcherStart(pMatcher);
+	return pMatcher;
+}
+
+static void Push(ANPRDedup* pDedup, const ANPRPlateReadSchema* pSchema, const TestRead& testRead, uint32_t uSeq)
+{
+	CDKMsg* pMsg = CDKSimulatorBuildRead(0, uSeq, testRead.uVehicle, 0, 1000 + uSeq);
+	ANPRPlateRead read;
+	ANPRPlateReadExtract(pSchema, pMsg, &read);
+	read.iTimestampUs = testRead.iTimestampUs;
+	read.uLane = testRead.uLane;
+	read.uReliability = testRead.uReliability;
+	if (testRead.strPlate)
+		strcpy(read.strPlate, testRead.strPlate);
+	else
+		read.uFields &= ~(1u << ANPR_PLATE_READ_PLATE);
+	ANPR_CHECK(ANPRDedupPush(pDedup, pMsg, &read) == CDK_OK);
+}
+
+static bool SamePassage(const ANPRDedupPassage& passage, int64_t iFirstTimestampUs, int64_t iLastTimestampUs, uint32_t uReads,
+	uint32_t uConfirmed, uint32_t uLanes, uint32_t uReliability, const char* strPlate)
+{
+	return passage.iFirstTimestampUs == iFirstTimestampUs && passage.iLastTimestampUs == iLastTimestampUs && passage.uReads == uReads
+		&& passage.uConfirmed == uConfirmed && passage.uLanes == uLanes && passage.uReliability == uReliability
+		&& strcmp(passage.strPlate, strPlate) == 0;
+}
+
+static void SortPassages(std::vector<ANPRDedupPassage>& passages)
+{
+	std::sort(passages.begin(), passages.end(), [](const ANPRDedupPassage& a, const ANPRDedupPassage& b) {
+		return a.iFirstTimestampUs < b.iFirstTimestampUs;
+	});
+}
+
+static void TestSequence(const ANPRPlateReadSchema* pSchema, CDKPlateFingerprintMatcher* pMatcher)
+{
+	TestPassages passages;
+	ANPRDedup* pDedup = ANPRDedupCreate(nullptr, pSchema, pMatcher, OnPassage, &passages);
+	if (!ANPR_CHECK(pDedup != nullptr))
+		return;
+	const size_t uReads = sizeof(g_reads) / sizeof(g_reads[0]);
+	for (uint32_t i = 0; i < uReads - 1; i++)
+		Push(pDedup, pSchema, g_reads[i], i);
+	// only the read without plate is out, at once
+	ANPR_CHECK(passages.passages.size() == 1 && passages.passages[0].iFirstTimestampUs == 700000);
+	// the first passages leave the window
+	Push(pDedup, pSchema, g_reads[uReads - 1], uReads - 1);
+	ANPR_CHECK(passages.passages.size() == (pMatcher ? 5u : 6u));
+	ANPR_CHECK(ANPRDedupFlush(pDedup, INT64_MAX) == 1);
+
+	std::vector<ANPRDedupPassage>& result = passages.passages;
+	SortPassages(result);
+	ANPR_CHECK(passages.bElements);
+	if (!ANPR_CHECK(result.size() == (pMatcher ? 6u : 7u)))
+	{
+		ANPRDedupDestroy(pDedup);
+		return;
+	}
+	size_t i = 0;
+	ANPR_CHECK(SamePassage(result[i++], 0, 200000, 3, 0, (1u << 1) | (1u << 2), 90, "AB123CD"));
+	ANPR_CHECK(SamePassage(result[i++], 300000, 300000, 1, 0, 1u << 4, 85, "AB123CD"));
+	if (pMatcher)
+		ANPR_CHECK(SamePassage(result[i++], 400000, 500000, 2, 1, 1u << 1, 60, "XY999ZZ"));
+	else
+	{
+		ANPR_CHECK(SamePassage(result[i++], 400000, 400000, 1, 0, 1u << 1, 60, "XY999ZZ"));
+		ANPR_CHECK(SamePassage(result[i++], 500000, 500000, 1, 0, 1u << 1, 50, "XY99ZZ"));
+	}
+	ANPR_CHECK(SamePassage(result[i++], 600000, 600000, 1, 0, 1u << 1, 75, "XY999Z"));
+	ANPR_CHECK(result[i++].uReads == 1);
+	ANPR_CHECK(SamePassage(result[i++], 5000000, 5000000, 1, 0, 1u << 1, 80, "AB123CD"));
+
+	ANPRDedupStats stats;
+	ANPRDedupGetStats(pDedup, &stats);
+	ANPR_CHECK(stats.uReads == uReads && stats.uPassages == result.size() && stats.uDuplicates == uReads - result.size());
+	ANPR_CHECK(stats.uConfirmed == (pMatcher ? 1u : 0u) && stats.uForced == 0 && stats.uOpen == 0);
+	ANPRDedupDestroy(pDedup);
+}
+
+/*!
+	With two open passages at most, a third plate closes the oldest passage before its window is over
+*/
+static void TestMaxPassages(const ANPRPlateReadSchema* pSchema)
+{
+	TestPassages passages;
+	ANPRDedupConfig config;
+	ANPRDedupDefaultConfig(&config);
+	config.uMaxPassages = 2;
+	ANPRDedup* pDedup = ANPRDedupCreate(&config, pSchema, nullptr, OnPassage, &passages);
+	if (!ANPR_CHECK(pDedup != nullptr))
+		return;
+	Push(pDedup, pSchema, { 0, 1, 1, 80, "AA111AA" }, 0);
+	Push(pDedup, pSchema, { 100000, 1, 2, 80, "BB222BB" }, 1);
+	Push(pDedup, pSchema, { 200000, 1, 1, 80, "AA111AA" }, 2);
+	ANPR_CHECK(passages.passages.empty());
+	Push(pDedup, pSchema, { 700000, 1, 3, 80, "CC333CC" }, 3);
+	if (ANPR_CHECK(passages.passages.size() == 1))
+		ANPR_CHECK(SamePassage(passages.passages[0], 0, 200000, 2, 0, 1u << 1, 80, "AA111AA"));
+	ANPR_CHECK(ANPRDedupFlush(pDedup, INT64_MAX) == 2);
+	ANPRDedupStats stats;
+	ANPRDedupGetStats(pDedup, &stats);
+	ANPR_CHECK(stats.uForced == 1 && stats.uPassages == 3);
+	ANPRDedupDestroy(pDedup);
+}
+
+int main()
+{
+	ANPRPlateReadSchema* pSchema = ANPRPlateReadSchemaCreate();
+	CDKPlateFingerprintMatcher* pMatcher = CreateMatcher();
+	TestSequence(pSchema, pMatcher);
+	TestSequence(pSchema, nullptr);
+	TestMaxPassages(pSchema);
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+	ANPRPlateReadSchemaDestroy(pSchema);
+	return ANPRTestResult("ANPRDedupTest");
+}
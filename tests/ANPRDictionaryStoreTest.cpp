@@ -0,0 +1,199 @@
+/*
+	ANPRDictionaryStoreTest : the versions of the dictionaries saved in a store, seen by another mapping and after a
+	reopening, the saves of several processes, and the matchers attached to a site.
+*/
+
+#include <stdint.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "CDKSimulator.h"
+#include "ANPRDictionaryStore.h"
+#include "ANPRTest.h"
+
+#define SAVES 40
+
+static std::vector<uint8_t> Dictionary(uint32_t uSeed, uint32_t uSize)
+{
+	std::vector<uint8_t> dictionary(uSize);
+	for (uint32_t i = 0; i < uSize; i++)
+		dictionary[i] = (uint8_t)(uSeed * 31 + i * 7);
+	return dictionary;
+}
+
+static bool HasDictionary(ANPRDictionaryStore* pStore, const char* strSite, const std::vector<uint8_t>& expected, uint64_t uExpectedVersion)
+{
+	std::vector<uint8_t> dictionary(64 * 1024);
+	uint32_t uSize = 0;
+	uint64_t uVersion = 0;
+	if (ANPRDictionaryStoreGet(pStore, strSite, dictionary.data(), (uint32_t)dictionary.size(), &uSize, &uVersion) != CDK_OK)
+		return false;
+	dictionary.resize(uSize);
+	return dictionary == expected && uVersion == uExpectedVersion;
+}
+
+static void TestVersions(const std::string& strDirectory)
+{
+	std::string strPath = strDirectory + "/versions.store";
+	ANPRDictionaryStore* pStore = ANPRDictionaryStoreOpen(strPath.c_str());
+	if (!ANPR_CHECK(pStore != nullptr))
+		return;
+	uint8_t buffer[16];
+	uint32_t uSize;
+	ANPR_CHECK(ANPRDictionaryStoreGet(pStore, "north", buffer, sizeof(buffer), &uSize, nullptr) == CDK_FAIL);
+
+	std::vector<uint8_t> north1 = Dictionary(1, 3000);
+	std::vector<uint8_t> south1 = Dictionary(2, 1000);
+	std::vector<uint8_t> north2 = Dictionary(3, 5000);
+	ANPR_CHECK(ANPRDictionaryStoreSave(pStore, "north", north1.data(), (uint32_t)north1.size()) == CDK_OK);
+	// another mapping of the store, in this process or another one
+	ANPRDictionaryStore* pReader = ANPRDictionaryStoreOpen(strPath.c_str());
+	if (!ANPR_CHECK(pReader != nullptr))
+	{
+		ANPRDictionaryStoreClose(pStore);
+		return;
+	}
+	ANPR_CHECK(HasDictionary(pReader, "north", north1, 1));
+	ANPR_CHECK(ANPRDictionaryStoreSave(pStore, "south", south1.data(), (uint32_t)south1.size()) == CDK_OK);
+	ANPR_CHECK(ANPRDictionaryStoreSave(pStore, "north", north2.data(), (uint32_t)north2.size()) == CDK_OK);
+	ANPR_CHECK(HasDictionary(pStore, "north", north2, 2));
+	ANPR_CHECK(HasDictionary(pReader, "north", north2, 2));
+	ANPR_CHECK(HasDictionary(pReader, "south", south1, 1));
+
+	// a buffer too small, a site name too long
+	ANPR_CHECK(ANPRDictionaryStoreGet(pReader, "north", buffer, sizeof(buffer), &uSize, nullptr) == CDK_FAIL);
+	std::string strLongSite(ANPR_DICTIONARY_STORE_MAX_SITE + 1, 's');
+	ANPR_CHECK(ANPRDictionaryStoreSave(pStore, strLongSite.c_str(), north1.data(), (uint32_t)north1.size()) == CDK_FAIL);
+	ANPRDictionaryStoreClose(pReader);
+	ANPRDictionaryStoreClose(pStore);
+
+	pStore = ANPRDictionaryStoreOpen(strPath.c_str());
+	if (!ANPR_CHECK(pStore != nullptr))
+		return;
+	ANPR_CHECK(HasDictionary(pStore, "north", north2, 2));
+	ANPR_CHECK(HasDictionary(pStore, "south", south1, 1));
+	ANPRDictionaryStoreClose(pStore);
+
+	// a file that is not a store
+	std::string strOther = strDirectory + "/other.store";
+	FILE* pFile = fopen(strOther.c_str(), "w");
+	fputs("not a dictionary store\n", pFile);
+	fclose(pFile);
+	ANPR_CHECK(ANPRDictionaryStoreOpen(strOther.c_str()) == nullptr);
+}
+
+/*!
+	Processes saving the dictionaries of their sites at the same time : no save is lost
+*/
+static void TestProcesses(const std::string& strDirectory)
+{
+	std::string strPath = strDirectory + "/processes.store";
+	const char* sites[] = { "east", "west", "central" };
+	std::vector<pid_t> children;
+	for (uint32_t uSite = 0; uSite < 3; uSite++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			ANPRDictionaryStore* pStore = ANPRDictionaryStoreOpen(strPath.c_str());
+			int iFailures = pStore ? 0 : 1;
+			for (uint32_t uSave = 0; pStore && uSave < SAVES; uSave++)
+			{
+				std::vector<uint8_t> dictionary = Dictionary(uSite * SAVES + uSave, 500 + uSave);
+				iFailures += ANPRDictionaryStoreSave(pStore, sites[uSite], dictionary.data(), (uint32_t)dictionary.size()) != CDK_OK;
+			}
+			ANPRDictionaryStoreClose(pStore);
+			_exit(iFailures ? EXIT_FAILURE : EXIT_SUCCESS);
+		}
+		children.push_back(pid);
+	}
+	for (pid_t pid : children)
+	{
+		int iStatus = 0;
+		ANPR_CHECK(waitpid(pid, &iStatus, 0) == pid && WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == EXIT_SUCCESS);
+	}
+	ANPRDictionaryStore* pStore = ANPRDictionaryStoreOpen(strPath.c_str());
+	if (!ANPR_CHECK(pStore != nullptr))
+		return;
+	for (uint32_t uSite = 0; uSite < 3; uSite++)
+		ANPR_CHECK(HasDictionary(pStore, sites[uSite], Dictionary(uSite * SAVES + SAVES - 1, 500 + SAVES - 1), SAVES));
+	ANPRDictionaryStoreClose(pStore);
+}
+
+/*!
+	A first matcher of a site learns its dictionary into the store, and the next one starts from it
+*/
+static void TestAttachMatcher(const std::string& strDirectory)
+{
+	std::string strPath = strDirectory + "/matchers.store";
+	ANPRDictionaryStore* pStore = ANPRDictionaryStoreOpen(strPath.c_str());
+	if (!ANPR_CHECK(pStore != nullptr))
+		return;
+	std::vector<CDKMsg*> reads;
+	std::vector<CDKMsgElement*> fingerprints;
+	for (uint32_t uSeq = 0; uSeq < 128; uSeq++)
+	{
+		reads.push_back(CDKSimulatorBuildRead(0, uSeq, uSeq % 16, 0, uSeq));
+		fingerprints.push_back(CDKMsgElementFirstChild(CDKMsgChild(reads.back()), "fingerprint"));
+	}
+	auto match = [&](CDKPlateFingerprintMatcher* pMatcher, size_t i, size_t j) {
+		return CDKPlateFingerprintMatch(pMatcher, CDKMsgElementContent(fingerprints[i]), CDKMsgElementContentSize(fingerprints[i]),
+			CDKMsgElementContent(fingerprints[j]), CDKMsgElementContentSize(fingerprints[j]));
+	};
+
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	ANPR_CHECK(ANPRDictionaryStoreAttachMatcher(pStore, "north", pLearner) == 0);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	std::vector<uint8_t> dictionary(64 * 1024);
+	uint32_t uSize = 0;
+	for (size_t k = 0; k < 100 * reads.size() * reads.size(); k++)
+	{
+		match(pLearner, k % reads.size(), (k / reads.size()) % reads.size());
+		if (ANPRDictionaryStoreGet(pStore, "north", dictionary.data(), (uint32_t)dictionary.size(), &uSize, nullptr) == CDK_OK)
+			break;
+	}
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	if (!ANPR_CHECK(uSize > 0))
+	{
+		ANPRDictionaryStoreClose(pStore);
+		return;
+	}
+	dictionary.resize(uSize);
+
+	// a matcher attached to the site, and a matcher given the saved dictionary, take the same decisions
+	CDKPlateFingerprintMatcher* pAttached = CDKPlateFingerprintMatcherCreate();
+	ANPR_CHECK(ANPRDictionaryStoreAttachMatcher(pStore, "north", pAttached) == 1);
+	ANPR_CHECK(CDKPlateFingerprintMatcherStart(pAttached) == CDK_OK);
+	CDKPlateFingerprintMatcher* pGiven = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetDictionary(pGiven, dictionary.data(), (uint32_t)dictionary.size());
+	CDKPlateFingerprintMatcherStart(pGiven);
+	uint32_t uMatches = 0;
+	for (size_t i = 0; i < reads.size(); i++)
+		for (size_t j = 0; j < reads.size(); j++)
+		{
+			int32_t iResult = match(pAttached, i, j);
+			ANPR_CHECK(iResult == match(pGiven, i, j));
+			uMatches += iResult == 1;
+		}
+	ANPR_CHECK(uMatches >= reads.size());
+	CDKPlateFingerprintMatcherDestroy(pAttached);
+	CDKPlateFingerprintMatcherDestroy(pGiven);
+	for (CDKMsg* pRead : reads)
+		CDKMsgDestroy(pRead);
+	ANPRDictionaryStoreClose(pStore);
+}
+
+int main()
+{
+	std::string strDirectory = ANPRTestCreateDirectory("ANPRDictionaryStoreTest");
+	TestVersions(strDirectory);
+	TestProcesses(strDirectory);
+	TestAttachMatcher(strDirectory);
+	ANPRTestRemoveDirectory(strDirectory);
+	return ANPRTestResult("ANPRDictionaryStoreTest");
+}
@@ -0,0 +1,190 @@
+/*
+	ANPRFanoutTest : the messages pushed from several threads and handed to every consumer, in the order of their
+	producer, a consumer left behind by a slow callback, and the drops of a full consumer queue.
+*/
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "ANPRFanout.h"
+#include "ANPRTest.h"
+
+#define CONSUMERS 3
+#define PRODUCERS 2
+#define MESSAGES 2000
+
+struct TestDelivery
+{
+	uint32_t uProducer;
+	uint32_t uSeq;
+	CDKMsg* pMsg;
+	bool bReadOnly;
+};
+
+struct TestConsumer
+{
+	std::mutex mutex;
+	std::vector<TestDelivery> deliveries;
+	/*! the callback waits while set */
+	std::atomic<bool> bHold{false};
+};
+
+static CDKMsg* BuildMessage(uint32_t uProducer, uint32_t uSeq)
+{
+	CDKMsg* pMsg = CDKMsgCreate();
+	CDKMsgElement* pRoot = CDKMsgElementCreate("test");
+	CDKMsgElementSetAttributeUInt(pRoot, "producer", uProducer);
+	CDKMsgElementSetAttributeUInt(pRoot, "seq", uSeq);
+	CDKMsgSetChild(pMsg, pRoot);
+	return pMsg;
+}
+
+static void Consume(CDKMsg* pMsg, uint32_t uConsumer, void* pUser)
+{
+	TestConsumer* pConsumers = (TestConsumer*)pUser;
+	TestConsumer& consumer = pConsumers[uConsumer];
+	while (consumer.bHold.load())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CDKMsgElement* pRoot = CDKMsgChild(pMsg);
+	TestDelivery delivery = { (uint32_t)atoi(CDKMsgElementAttributeValue(pRoot, "producer")),
+		(uint32_t)atoi(CDKMsgElementAttributeValue(pRoot, "seq")), pMsg, CDKMsgIsReadOnly(pMsg) != 0 };
+	std::lock_guard<std::mutex> lock(consumer.mutex);
+	consumer.deliveries.push_back(delivery);
+}
+
+static bool WaitDelivered(ANPRFanout* pFanout, uint32_t uConsumer, uint64_t uCount)
+{
+	ANPRFanoutConsumerStats stats;
+	for (int i = 0; i < 10000; i++)
+	{
+		ANPRFanoutGetConsumerStats(pFanout, uConsumer, &stats);
+		if (stats.uDelivered >= uCount)
+			return stats.uDelivered == uCount;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+/*!
+	Every consumer gets every message, in the order of its producer, as the same read-only message : the last consumer
+	still holds it while the first ones are done. The last consumer is held back and does not delay the others.
+*/
+static void TestDeliver()
+{
+	ANPRFanout* pFanout = ANPRFanoutCreate(nullptr);
+	if (!ANPR_CHECK(pFanout != nullptr))
+		return;
+	TestConsumer consumers[CONSUMERS];
+	for (uint32_t i = 0; i < CONSUMERS; i++)
+		ANPR_CHECK(ANPRFanoutAddConsumer(pFanout, Consume, consumers) == (int32_t)i);
+	ANPR_CHECK(ANPRFanoutStart(pFanout) == CDK_OK);
+	ANPR_CHECK(ANPRFanoutAddConsumer(pFanout, Consume, consumers) == -1);
+	consumers[CONSUMERS - 1].bHold = true;
+
+	std::atomic<uint32_t> uFailures{0};
+	std::vector<std::thread> producers;
+	for (uint32_t p = 0; p < PRODUCERS; p++)
+		producers.emplace_back([&, p] {
+			for (uint32_t uSeq = 0; uSeq < MESSAGES; uSeq++)
+				uFailures += ANPRFanoutPush(pFanout, BuildMessage(p, uSeq)) != CDK_OK;
+		});
+	for (std::thread& producer : producers)
+		producer.join();
+	ANPR_CHECK(uFailures.load() == 0);
+	for (uint32_t i = 0; i < CONSUMERS - 1; i++)
+		ANPR_CHECK(WaitDelivered(pFanout, i, PRODUCERS * MESSAGES));
+	ANPRFanoutConsumerStats stats;
+	ANPR_CHECK(ANPRFanoutGetConsumerStats(pFanout, CONSUMERS - 1, &stats) == CDK_OK);
+	ANPR_CHECK(stats.uDelivered == 0 && stats.uDrops == 0);
+	consumers[CONSUMERS - 1].bHold = false;
+	ANPR_CHECK(WaitDelivered(pFanout, CONSUMERS - 1, PRODUCERS * MESSAGES));
+	ANPRFanoutStop(pFanout);
+
+	// the message of every producer and sequence, as seen by the first consumer
+	std::vector<CDKMsg*> messages(PRODUCERS * MESSAGES);
+	for (uint32_t i = 0; i < CONSUMERS; i++)
+	{
+		TestConsumer& consumer = consumers[i];
+		if (!ANPR_CHECK(consumer.deliveries.size() == PRODUCERS * MESSAGES))
+			continue;
+		uint32_t uNextSeq[PRODUCERS] = {};
+		for (const TestDelivery& delivery : consumer.deliveries)
+		{
+			if (!ANPR_CHECK(delivery.uProducer < PRODUCERS && delivery.uSeq == uNextSeq[delivery.uProducer]))
+				break;
+			uNextSeq[delivery.uProducer]++;
+			CDKMsg*& pMsg = messages[delivery.uProducer * MESSAGES + delivery.uSeq];
+			if (i == 0)
+				pMsg = delivery.pMsg;
+			ANPR_CHECK(delivery.pMsg == pMsg && delivery.bReadOnly);
+		}
+	}
+	ANPR_CHECK(ANPRFanoutGetConsumerStats(pFanout, CONSUMERS, &stats) == CDK_FAIL);
+	ANPRFanoutDestroy(pFanout);
+}
+
+/*!
+	A full queue drops the message for its consumer only, and the messages queued while the stage is stopped are
+	delivered at the next start or released with the stage
+*/
+static void TestFullQueue()
+{
+	ANPRFanoutConfig config;
+	ANPRFanoutDefaultConfig(&config);
+	config.uMaxQueueSize = 8;
+	config.uBatchSize = 3;
+	ANPRFanout* pFanout = ANPRFanoutCreate(&config);
+	if (!ANPR_CHECK(pFanout != nullptr))
+		return;
+	TestConsumer consumers[2];
+	ANPR_CHECK(ANPRFanoutAddConsumer(pFanout, Consume, consumers) == 0);
+	ANPR_CHECK(ANPRFanoutAddConsumer(pFanout, Consume, consumers) == 1);
+	// the first consumer takes the messages, the queue of the second one fills up
+	ANPR_CHECK(ANPRFanoutStart(pFanout) == CDK_OK);
+	consumers[1].bHold = true;
+	uint32_t uFailures = 0;
+	for (uint32_t uSeq = 0; uSeq < 20; uSeq++)
+	{
+		// the second consumer holds at most one message in its callback
+		ANPR_CHECK(WaitDelivered(pFanout, 0, uSeq));
+		uFailures += ANPRFanoutPush(pFanout, BuildMessage(0, uSeq)) != CDK_OK;
+	}
+	ANPR_CHECK(WaitDelivered(pFanout, 0, 20));
+	ANPRFanoutConsumerStats stats;
+	ANPRFanoutGetConsumerStats(pFanout, 1, &stats);
+	ANPR_CHECK(stats.uDrops == uFailures && uFailures > 0 && stats.uQueued + uFailures <= 20);
+	consumers[1].bHold = false;
+	ANPR_CHECK(WaitDelivered(pFanout, 1, 20 - uFailures));
+	ANPRFanoutStop(pFanout);
+	for (size_t i = 1; i < consumers[1].deliveries.size(); i++)
+		ANPR_CHECK(consumers[1].deliveries[i].uSeq > consumers[1].deliveries[i - 1].uSeq);
+
+	// queued while stopped, delivered at the next start
+	for (uint32_t uSeq = 20; uSeq < 25; uSeq++)
+		ANPR_CHECK(ANPRFanoutPush(pFanout, BuildMessage(0, uSeq)) == CDK_OK);
+	ANPRFanoutGetConsumerStats(pFanout, 0, &stats);
+	ANPR_CHECK(stats.uQueued == 5 && stats.uDelivered == 20);
+	ANPR_CHECK(ANPRFanoutStart(pFanout) == CDK_OK);
+	ANPR_CHECK(WaitDelivered(pFanout, 0, 25));
+	ANPR_CHECK(WaitDelivered(pFanout, 1, 25 - uFailures));
+	ANPRFanoutStop(pFanout);
+	// released with the stage
+	for (uint32_t uSeq = 25; uSeq < 30; uSeq++)
+		ANPRFanoutPush(pFanout, BuildMessage(0, uSeq));
+	ANPRFanoutDestroy(pFanout);
+}
+
+int main()
+{
+	TestDeliver();
+	TestFullQueue();
+	return ANPRTestResult("ANPRFanoutTest");
+}
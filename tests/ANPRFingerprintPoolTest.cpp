@@ -0,0 +1,122 @@
+/*
+	ANPRFingerprintPoolTest : the match matrix and the list of matching pairs of a matcher pool, on one thread and on
+	several, against CDKPlateFingerprintMatch called by one matcher given the same dictionary.
+*/
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "CDKSimulator.h"
+#include "ANPRFingerprintPool.h"
+#include "ANPRTest.h"
+
+#define ENTRIES 200
+#define EXITS 24
+
+static int32_t SaveDictionary(CDKPlateFingerprintMatcher*, const uint8_t* pBuffer, uint32_t uSize, void* pUser)
+{
+	static_cast<std::vector<uint8_t>*>(pUser)->assign(pBuffer, pBuffer + uSize);
+	return 1;
+}
+
+static void TestBatches(const std::vector<ANPRFingerprint>& exits, const std::vector<ANPRFingerprint>& entries,
+	const std::vector<uint8_t>& dictionary, uint32_t uThreads)
+{
+	// the serial results
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	ANPR_CHECK(CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), (uint32_t)dictionary.size()) == CDK_OK);
+	ANPR_CHECK(CDKPlateFingerprintMatcherStart(pMatcher) == CDK_OK);
+	std::vector<int8_t> expected(exits.size() * entries.size());
+	std::vector<ANPRFingerprintPair> expectedPairs;
+	uint64_t uErrors = 0;
+	for (uint32_t uRow = 0; uRow < exits.size(); uRow++)
+		for (uint32_t uColumn = 0; uColumn < entries.size(); uColumn++)
+		{
+			int32_t iResult = CDKPlateFingerprintMatch(pMatcher, exits[uRow].pBuffer, exits[uRow].uSize,
+				entries[uColumn].pBuffer, entries[uColumn].uSize);
+			expected[uRow * entries.size() + uColumn] = (int8_t)iResult;
+			if (iResult == 1)
+				expectedPairs.push_back({ uRow, uColumn });
+			uErrors += iResult < 0;
+		}
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+	// every exit matches its entry, and the empty fingerprint is an error
+	ANPR_CHECK(expectedPairs.size() >= EXITS);
+	ANPR_CHECK(uErrors == EXITS);
+
+	ANPRFingerprintPoolConfig config;
+	ANPRFingerprintPoolDefaultConfig(&config);
+	config.uThreads = uThreads;
+	ANPRFingerprintPool* pPool = ANPRFingerprintPoolCreate(&config, dictionary.data(), (uint32_t)dictionary.size());
+	if (!ANPR_CHECK(pPool != nullptr))
+		return;
+
+	std::vector<int8_t> matrix(expected.size(), 2);
+	ANPR_CHECK(ANPRFingerprintPoolMatchMatrix(pPool, exits.data(), (uint32_t)exits.size(), entries.data(), (uint32_t)entries.size(),
+		matrix.data()) == CDK_OK);
+	ANPR_CHECK(matrix == expected);
+
+	std::vector<ANPRFingerprintPair> pairs(expectedPairs.size() + 4);
+	int64_t iPairs = ANPRFingerprintPoolMatchList(pPool, exits.data(), (uint32_t)exits.size(), entries.data(), (uint32_t)entries.size(),
+		pairs.data(), pairs.size());
+	if (ANPR_CHECK(iPairs == (int64_t)expectedPairs.size()))
+		for (size_t i = 0; i < expectedPairs.size(); i++)
+			ANPR_CHECK(pairs[i].uRow == expectedPairs[i].uRow && pairs[i].uColumn == expectedPairs[i].uColumn);
+
+	// the pairs beyond uMaxPairs are counted, not stored
+	std::vector<ANPRFingerprintPair> firstPairs(5, ANPRFingerprintPair{ UINT32_MAX, UINT32_MAX });
+	ANPR_CHECK(ANPRFingerprintPoolMatchList(pPool, exits.data(), (uint32_t)exits.size(), entries.data(), (uint32_t)entries.size(),
+		firstPairs.data(), 4) == (int64_t)expectedPairs.size());
+	for (size_t i = 0; i < 4; i++)
+		ANPR_CHECK(firstPairs[i].uRow == expectedPairs[i].uRow && firstPairs[i].uColumn == expectedPairs[i].uColumn);
+	ANPR_CHECK(firstPairs[4].uRow == UINT32_MAX);
+	ANPR_CHECK(ANPRFingerprintPoolMatchList(pPool, exits.data(), (uint32_t)exits.size(), entries.data(), (uint32_t)entries.size(),
+		nullptr, 0) == (int64_t)expectedPairs.size());
+
+	ANPRFingerprintPoolStats stats;
+	ANPR_CHECK(ANPRFingerprintPoolGetStats(pPool, &stats) == CDK_OK);
+	ANPR_CHECK(stats.uBatches == 4 && stats.uCompared == 4 * expected.size() && stats.uErrors == 4 * uErrors);
+	ANPRFingerprintPoolDestroy(pPool);
+}
+
+int main()
+{
+	// exit reads of every 8th vehicle of the entries, and an empty fingerprint
+	std::vector<CDKMsg*> reads;
+	std::vector<ANPRFingerprint> entries;
+	std::vector<ANPRFingerprint> exits;
+	for (uint32_t i = 0; i < ENTRIES + EXITS; i++)
+	{
+		bool bExit = i >= ENTRIES;
+		CDKMsg* pRead = CDKSimulatorBuildRead(bExit ? 1 : 0, i, bExit ? (i - ENTRIES) * 8 : i, 0, i);
+		CDKMsgElement* pFp = CDKMsgElementFirstChild(CDKMsgChild(pRead), "fingerprint");
+		(bExit ? exits : entries).push_back({ CDKMsgElementContent(pFp), CDKMsgElementContentSize(pFp) });
+		reads.push_back(pRead);
+	}
+	const uint8_t empty[1] = { 0 };
+	entries.push_back({ empty, 0 });
+
+	// the dictionary learnt by a first matcher
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pLearner, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	for (uint32_t i = 0; dictionary.empty() && i < 100 * ENTRIES * EXITS; i++)
+		CDKPlateFingerprintMatch(pLearner, exits[i % EXITS].pBuffer, exits[i % EXITS].uSize,
+			entries[(i / EXITS) % ENTRIES].pBuffer, entries[(i / EXITS) % ENTRIES].uSize);
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+
+	if (ANPR_CHECK(!dictionary.empty()))
+	{
+		TestBatches(exits, entries, dictionary, 1);
+		TestBatches(exits, entries, dictionary, 3);
+	}
+
+	for (CDKMsg* pRead : reads)
+		CDKMsgDestroy(pRead);
+	return ANPRTestResult("ANPRFingerprintPoolTest");
+}
@@ -0,0 +1,165 @@
+/*
+	ANPRFleetTest : a fleet of simulated sensors on the loopback interface bound a few at a time, the ready-set when
+	the sensors are connected, disconnected and reconnected, and a sensor that never connects.
+*/
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKSimulator.h"
+#include "ANPRFleet.h"
+#include "ANPRTest.h"
+
+#define SENSORS 6
+#define MAX_CONNECTS 2
+
+struct TestStates
+{
+	std::mutex mutex;
+	std::vector<CDK*> connected;
+	std::vector<CDK*> disconnected;
+};
+
+static void OnState(CDK* pCDK, int32_t bConnected, uint32_t, void* pUser)
+{
+	TestStates* pStates = (TestStates*)pUser;
+	std::lock_guard<std::mutex> lock(pStates->mutex);
+	(bConnected ? pStates->connected : pStates->disconnected).push_back(pCDK);
+}
+
+/*!
+	The sensors whose state callback reported a connection or a disconnection, once uCount of them did. The fleet
+	calls the callback after its ready-set is updated.
+*/
+static std::vector<CDK*> WaitStates(TestStates& states, bool bConnected, size_t uCount, CDK* pIgnored)
+{
+	std::vector<CDK*> cdks;
+	for (int i = 0; i < 5000 && cdks.size() < uCount; i++)
+	{
+		if (i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::lock_guard<std::mutex> lock(states.mutex);
+		cdks = bConnected ? states.connected : states.disconnected;
+		cdks.erase(std::remove(cdks.begin(), cdks.end(), pIgnored), cdks.end());
+	}
+	std::sort(cdks.begin(), cdks.end());
+	return cdks;
+}
+
+static std::vector<CDK*> GetReady(ANPRFleet* pFleet)
+{
+	CDK* ready[SENSORS + 1];
+	std::vector<CDK*> cdks(ready, ready + ANPRFleetGetReady(pFleet, ready, SENSORS + 1));
+	std::sort(cdks.begin(), cdks.end());
+	return cdks;
+}
+
+/*!
+	Waits until the fleet counters satisfy a condition
+*/
+template<typename Condition> static bool WaitStats(ANPRFleet* pFleet, Condition condition)
+{
+	ANPRFleetStats stats;
+	for (int i = 0; i < 5000; i++)
+	{
+		ANPRFleetGetStats(pFleet, &stats);
+		if (condition(stats))
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+static void TestFleet(uint16_t uBasePort)
+{
+	CDKSimulatorConfig simulatorConfig;
+	CDKSimulatorDefaultConfig(&simulatorConfig);
+	simulatorConfig.uSensors = SENSORS;
+	simulatorConfig.uBasePort = uBasePort;
+	simulatorConfig.dRate = 1;
+	simulatorConfig.uJpegMin = simulatorConfig.uJpegMax = 0;
+	CDKSimulator* pSimulator = CDKSimulatorCreate(&simulatorConfig);
+	if (!ANPR_CHECK(pSimulator != nullptr && CDKSimulatorStart(pSimulator) == CDK_OK))
+	{
+		CDKSimulatorDestroy(pSimulator);
+		return;
+	}
+
+	ANPRFleetConfig config;
+	ANPRFleetDefaultConfig(&config);
+	config.uMaxConcurrentConnects = MAX_CONNECTS;
+	config.uConnectTimeout = 300;
+	config.uReconnectMin = 50;
+	config.uReconnectMax = 200;
+	TestStates states;
+	ANPRFleet* pFleet = ANPRFleetCreate(&config, OnState, &states);
+	if (!ANPR_CHECK(pFleet != nullptr))
+	{
+		CDKSimulatorDestroy(pSimulator);
+		return;
+	}
+	std::vector<CDK*> cdks;
+	for (uint32_t i = 0; i < SENSORS; i++)
+	{
+		cdks.push_back(CDKCreate());
+		ANPR_CHECK(ANPRFleetAdd(pFleet, cdks.back(), "127.0.0.1", (uint16_t)(uBasePort + i), 0) == CDK_OK);
+	}
+	ANPR_CHECK(ANPRFleetAdd(pFleet, cdks[0], "127.0.0.1", uBasePort, 0) == CDK_FAIL);
+	// nothing listens on the port following the simulated sensors
+	CDK* pClosed = CDKCreate();
+	ANPR_CHECK(ANPRFleetAdd(pFleet, pClosed, "", (uint16_t)(uBasePort + SENSORS), 0) == CDK_FAIL);
+	ANPR_CHECK(ANPRFleetAdd(pFleet, pClosed, "127.0.0.1", (uint16_t)(uBasePort + SENSORS), 0) == CDK_OK);
+	std::vector<CDK*> expected = cdks;
+	std::sort(expected.begin(), expected.end());
+
+	// at most MAX_CONNECTS first connections in flight
+	ANPR_CHECK(ANPRFleetStart(pFleet) == CDK_OK);
+	ANPR_CHECK(ANPRFleetStart(pFleet) == CDK_FAIL);
+	ANPRFleetStats stats;
+	uint32_t uMaxConnecting = 0;
+	ANPR_CHECK(WaitStats(pFleet, [&](const ANPRFleetStats& current) {
+		uMaxConnecting = std::max(uMaxConnecting, current.uConnecting);
+		return current.uConnected == SENSORS;
+	}));
+	ANPR_CHECK(uMaxConnecting <= MAX_CONNECTS);
+	ANPR_CHECK(ANPRFleetWaitForReady(pFleet, SENSORS, 5000) == CDK_OK);
+	ANPR_CHECK(ANPRFleetWaitForReady(pFleet, SENSORS + 1, 200) == CDK_FAIL);
+	ANPR_CHECK(GetReady(pFleet) == expected);
+	// the first attempt of the closed sensor times out and frees its slot
+	ANPR_CHECK(WaitStats(pFleet, [](const ANPRFleetStats& current) { return current.uConnecting == 0; }));
+	ANPRFleetGetStats(pFleet, &stats);
+	ANPR_CHECK(stats.uSensors == SENSORS + 1 && stats.uBound == SENSORS + 1 && stats.uConnected == SENSORS);
+	ANPR_CHECK(stats.uDisconnections == 0 && stats.uSSLErrorSensors == 0);
+	ANPR_CHECK(WaitStates(states, true, SENSORS, pClosed) == expected);
+
+	// the sensors go away, then come back
+	CDKSimulatorStop(pSimulator);
+	ANPR_CHECK(WaitStats(pFleet, [](const ANPRFleetStats& current) { return current.uConnected == 0; }));
+	ANPRFleetGetStats(pFleet, &stats);
+	ANPR_CHECK(stats.uDisconnections == SENSORS && GetReady(pFleet).empty());
+	ANPR_CHECK(CDKSimulatorStart(pSimulator) == CDK_OK);
+	ANPR_CHECK(ANPRFleetWaitForReady(pFleet, SENSORS, 5000) == CDK_OK);
+	ANPR_CHECK(GetReady(pFleet) == expected);
+	ANPR_CHECK(WaitStates(states, false, SENSORS, pClosed) == expected);
+	ANPR_CHECK(WaitStates(states, true, 2 * SENSORS, pClosed).size() == 2 * SENSORS);
+
+	ANPRFleetDestroy(pFleet);
+	for (CDK* pCDK : cdks)
+		CDKDestroy(pCDK);
+	CDKDestroy(pClosed);
+	CDKSimulatorDestroy(pSimulator);
+}
+
+int main()
+{
+	// a port range of its own, so that several runs do not collide
+	TestFleet((uint16_t)(20000 + (getpid() % 2000) * 8));
+	return ANPRTestResult("ANPRFleetTest");
+}
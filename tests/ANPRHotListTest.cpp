@@ -0,0 +1,164 @@
+/*
+	ANPRHotListTest : the exact and one-edit lookups of a hot-list index against a scan of every plate with
+	ANPRPlateReadTextDistance, and the reload of a rebuilt index.
+*/
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "CDK.h"
+#include "ANPRHotList.h"
+#include "ANPRTest.h"
+
+#define PLATES 20000
+
+static uint32_t g_uRandom = 12345;
+
+static uint32_t Random(uint32_t uRange)
+{
+	g_uRandom = g_uRandom * 1103515245u + 12345u;
+	return (g_uRandom >> 8) % uRange;
+}
+
+/*!
+	Plates of 5 to 7 characters over a small alphabet, so that many plates are one character apart
+*/
+static std::string RandomPlate()
+{
+	static const char strAlphabet[] = "ABCEHKMX0125";
+	std::string strPlate(5 + Random(3), ' ');
+	for (char& c : strPlate)
+		c = strAlphabet[Random(sizeof(strAlphabet) - 1)];
+	return strPlate;
+}
+
+typedef std::tuple<uint32_t, uint64_t, uint32_t, std::string> TestMatch;
+
+/*!
+	The expected matches : every plate whose normalized text is close enough
+*/
+static std::vector<TestMatch> ScanPlates(const std::vector<std::string>& texts, const std::vector<ANPRHotListEntry>& entries,
+	const std::string& strPlate, uint32_t uMaxDistance)
+{
+	char strText[ANPR_PLATE_READ_MAX_PLATE];
+	std::vector<TestMatch> matches;
+	if (ANPRPlateReadNormalize(strPlate.c_str(), strText) == 0)
+		return matches;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (texts[i].empty())
+			continue;
+		uint32_t uDistance = ANPRPlateReadTextDistance(strText, texts[i].c_str());
+		if (uDistance <= uMaxDistance)
+			matches.emplace_back(entries[i].uList, entries[i].uTag, uDistance, entries[i].strPlate);
+	}
+	return matches;
+}
+
+static void CheckLookup(ANPRHotList* pHotList, const std::vector<std::string>& texts, const std::vector<ANPRHotListEntry>& entries,
+	const std::string& strPlate, uint32_t uMaxDistance)
+{
+	std::vector<TestMatch> expected = ScanPlates(texts, entries, strPlate, uMaxDistance);
+	ANPRHotListMatch matches[ANPR_HOT_LIST_MAX_MATCHES];
+	int32_t iMatches = ANPRHotListLookup(pHotList, strPlate.c_str(), uMaxDistance, matches, ANPR_HOT_LIST_MAX_MATCHES);
+	if (!ANPR_CHECK(iMatches == (int32_t)std::min<size_t>(expected.size(), ANPR_HOT_LIST_MAX_MATCHES)))
+		return;
+	std::vector<TestMatch> found;
+	for (int32_t i = 0; i < iMatches; i++)
+	{
+		found.emplace_back(matches[i].uList, matches[i].uTag, matches[i].uDistance, matches[i].strPlate);
+		// the identical texts first
+		ANPR_CHECK(i == 0 || matches[i].uDistance >= matches[i - 1].uDistance);
+	}
+	std::sort(expected.begin(), expected.end());
+	std::sort(found.begin(), found.end());
+	if (expected.size() <= ANPR_HOT_LIST_MAX_MATCHES)
+		ANPR_CHECK(found == expected);
+	else
+		ANPR_CHECK(std::includes(expected.begin(), expected.end(), found.begin(), found.end()));
+
+	// fewer matches asked
+	if (expected.size() > 1)
+	{
+		uint32_t uExact = (uint32_t)std::count_if(expected.begin(), expected.end(), [](const TestMatch& match) { return std::get<2>(match) == 0; });
+		ANPR_CHECK(ANPRHotListLookup(pHotList, strPlate.c_str(), uMaxDistance, matches, 1) == 1);
+		ANPR_CHECK(matches[0].uDistance == (uExact ? 0u : 1u));
+	}
+}
+
+static void TestLookups(const std::string& strDirectory)
+{
+	std::vector<std::string> plates;
+	std::vector<ANPRHotListEntry> entries;
+	for (uint32_t i = 0; i < PLATES; i++)
+		plates.push_back(RandomPlate());
+	// a plate in two lists, written differently, and a plate without letter nor digit
+	plates.push_back(plates[7]);
+	plates.push_back("AB-123-CD");
+	plates.push_back("A8 I23 CD");
+	plates.push_back("--");
+	std::vector<std::string> texts;
+	for (size_t i = 0; i < plates.size(); i++)
+	{
+		char strText[ANPR_PLATE_READ_MAX_PLATE];
+		ANPRPlateReadNormalize(plates[i].c_str(), strText);
+		texts.push_back(strText);
+		entries.push_back({ plates[i].c_str(), (uint32_t)(i % 3), 1000000 + i });
+	}
+
+	std::string strPath = strDirectory + "/hot.lst";
+	if (!ANPR_CHECK(ANPRHotListBuild(strPath.c_str(), entries.data(), (uint32_t)entries.size(), 1) == CDK_OK))
+		return;
+	ANPRHotList* pHotList = ANPRHotListOpen(strPath.c_str());
+	if (!ANPR_CHECK(pHotList != nullptr))
+		return;
+	ANPRHotListInfo info;
+	ANPRHotListGetInfo(pHotList, &info);
+	ANPR_CHECK(info.uEntries == entries.size() - 1 && info.uMaxDistance == 1 && info.uGeneration == 1);
+
+	// the plates of the lists, one edit away from them, and random plates
+	std::vector<std::string> queries = { "AB123CD", "ab.123.cd", "AB12CD", "XAB123CD", "--", "" };
+	for (uint32_t i = 0; i < 300; i++)
+	{
+		std::string strPlate = plates[Random(PLATES)];
+		queries.push_back(strPlate);
+		std::string strEdited = strPlate;
+		strEdited[Random((uint32_t)strEdited.size())] = 'Z';
+		queries.push_back(strEdited);
+		queries.push_back(strPlate.substr(0, 2) + strPlate.substr(3));
+		queries.push_back(strPlate.substr(0, 3) + "7" + strPlate.substr(3));
+		queries.push_back(RandomPlate());
+	}
+	for (const std::string& strPlate : queries)
+	{
+		CheckLookup(pHotList, texts, entries, strPlate, 0);
+		CheckLookup(pHotList, texts, entries, strPlate, 1);
+	}
+
+	// a new version of the lists, with a single plate, and an index without one-edit keys
+	ANPRHotListEntry newEntry = { "NEW1", 9, 42 };
+	ANPR_CHECK(ANPRHotListReload(pHotList) == 0);
+	ANPR_CHECK(ANPRHotListBuild(strPath.c_str(), &newEntry, 1, 0) == CDK_OK);
+	ANPR_CHECK(ANPRHotListReload(pHotList) == 1);
+	ANPR_CHECK(ANPRHotListReload(pHotList) == 0);
+	ANPRHotListGetInfo(pHotList, &info);
+	ANPR_CHECK(info.uEntries == 1 && info.uMaxDistance == 0 && info.uGeneration == 2);
+	ANPRHotListMatch matches[ANPR_HOT_LIST_MAX_MATCHES];
+	ANPR_CHECK(ANPRHotListLookup(pHotList, "AB123CD", 1, matches, ANPR_HOT_LIST_MAX_MATCHES) == 0);
+	ANPR_CHECK(ANPRHotListLookup(pHotList, "NEWI", 1, matches, ANPR_HOT_LIST_MAX_MATCHES) == 1);
+	ANPR_CHECK(matches[0].uList == 9 && matches[0].uTag == 42 && matches[0].uDistance == 0 && strcmp(matches[0].strPlate, "NEW1") == 0);
+	ANPR_CHECK(ANPRHotListLookup(pHotList, "NEW12", 1, matches, ANPR_HOT_LIST_MAX_MATCHES) == 0);
+	ANPRHotListClose(pHotList);
+}
+
+int main()
+{
+	std::string strDirectory = ANPRTestCreateDirectory("ANPRHotListTest");
+	TestLookups(strDirectory);
+	ANPRTestRemoveDirectory(strDirectory);
+	return ANPRTestResult("ANPRHotListTest");
+}
@@ -0,0 +1,185 @@
+/*
+	ANPRIngestTest : the reads of simulated sensors on the loopback interface drained by the workers of an ingestion
+	engine, in the order of every sensor, with the user data of their source, and the detach, attach and restart of
+	a running engine.
+*/
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKSimulator.h"
+#include "ANPRIngest.h"
+#include "ANPRTest.h"
+
+#define SENSORS 4
+#define WORKERS 3
+
+struct TestRead
+{
+	uint32_t uSensor;
+	uint64_t uSeq;
+	CDK* pSource;
+	uint32_t uWorker;
+};
+
+struct TestSource
+{
+	uint32_t uIndex;
+	/*! reads received with this user data */
+	std::vector<TestRead> reads;
+};
+
+struct TestIngest
+{
+	std::mutex mutex;
+	TestSource sources[SENSORS];
+	/*! the user data of a sensor attached again */
+	TestSource reattached;
+	/*! reads queued before their sensor was detached, delivered without user data */
+	TestSource detached;
+	std::atomic<uint64_t> uCallbacks{0};
+};
+
+static void OnMessage(CDKMsg* pMsg, CDK* pSource, void* pSourceUser, uint32_t uWorker, void* pUser)
+{
+	TestIngest* pTest = (TestIngest*)pUser;
+	CDKMsgElement* pRoot = CDKMsgChild(pMsg);
+	TestRead read = { (uint32_t)atoi(CDKMsgElementAttributeValue(pRoot, "sensor")),
+		(uint64_t)atoll(CDKMsgElementAttributeValue(pRoot, "seq")), pSource, uWorker };
+	CDKMsgDestroy(pMsg);
+	{
+		std::lock_guard<std::mutex> lock(pTest->mutex);
+		(pSourceUser ? (TestSource*)pSourceUser : &pTest->detached)->reads.push_back(read);
+	}
+	pTest->uCallbacks++;
+}
+
+static size_t CountReads(TestIngest& test, TestSource& source)
+{
+	std::lock_guard<std::mutex> lock(test.mutex);
+	return source.reads.size();
+}
+
+static bool WaitReads(TestIngest& test, TestSource& source, size_t uCount)
+{
+	for (int i = 0; i < 10000; i++)
+	{
+		if (CountReads(test, source) >= uCount)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+/*!
+	The reads of a source come from its sensor, in order, and are drained by a single worker
+*/
+static void CheckSource(const TestSource& source, CDK* pCDK)
+{
+	for (size_t i = 0; i < source.reads.size(); i++)
+	{
+		const TestRead& read = source.reads[i];
+		ANPR_CHECK(read.uSensor == source.uIndex && read.pSource == pCDK && read.uWorker == source.reads[0].uWorker);
+		ANPR_CHECK(i == 0 || read.uSeq > source.reads[i - 1].uSeq);
+	}
+}
+
+static void TestIngestReads(uint16_t uBasePort)
+{
+	CDKSimulatorConfig simulatorConfig;
+	CDKSimulatorDefaultConfig(&simulatorConfig);
+	simulatorConfig.uSensors = SENSORS;
+	simulatorConfig.uBasePort = uBasePort;
+	simulatorConfig.dRate = 400;
+	simulatorConfig.uBurst = 4;
+	simulatorConfig.uJpegMin = simulatorConfig.uJpegMax = 0;
+	CDKSimulator* pSimulator = CDKSimulatorCreate(&simulatorConfig);
+	if (!ANPR_CHECK(pSimulator != nullptr && CDKSimulatorStart(pSimulator) == CDK_OK))
+	{
+		CDKSimulatorDestroy(pSimulator);
+		return;
+	}
+
+	ANPRIngestConfig config;
+	ANPRIngestDefaultConfig(&config);
+	config.uWorkers = WORKERS;
+	config.uBatchSize = 8;
+	TestIngest test;
+	ANPRIngest* pIngest = ANPRIngestCreate(&config, OnMessage, &test);
+	if (!ANPR_CHECK(pIngest != nullptr))
+	{
+		CDKSimulatorDestroy(pSimulator);
+		return;
+	}
+	std::vector<CDK*> cdks;
+	for (uint32_t i = 0; i < SENSORS; i++)
+	{
+		test.sources[i].uIndex = i;
+		cdks.push_back(CDKCreate());
+		ANPR_CHECK(ANPRIngestAttach(pIngest, cdks[i], &test.sources[i]) == CDK_OK);
+	}
+	ANPR_CHECK(ANPRIngestAttach(pIngest, cdks[0], &test.sources[0]) == CDK_FAIL);
+	ANPRIngestStats stats;
+	ANPRIngestGetStats(pIngest, &stats);
+	ANPR_CHECK(stats.uSources == SENSORS && stats.uWorkers == WORKERS && stats.uQueues == WORKERS);
+	ANPR_CHECK(ANPRIngestStart(pIngest) == CDK_OK);
+	ANPR_CHECK(ANPRIngestStart(pIngest) == CDK_FAIL);
+	for (uint32_t i = 0; i < SENSORS; i++)
+		ANPR_CHECK(CDKBind(cdks[i], "127.0.0.1", (uint16_t)(uBasePort + i), "reconnect=100") == CDK_OK);
+	for (uint32_t i = 0; i < SENSORS; i++)
+		ANPR_CHECK(WaitReads(test, test.sources[i], 100));
+
+	// a detached sensor uses its own queue again, and is attached again with another user data
+	uint32_t uLast = SENSORS - 1;
+	ANPR_CHECK(ANPRIngestDetach(pIngest, cdks[uLast]) == CDK_OK);
+	ANPR_CHECK(ANPRIngestDetach(pIngest, cdks[uLast]) == CDK_FAIL);
+	size_t uDetachedReads = CountReads(test, test.sources[uLast]);
+	ANPR_CHECK(CDKWaitForNewMessage(cdks[uLast], 5000) == CDK_OK);
+	CDKMsg* pMsg = CDKPopMessage(cdks[uLast]);
+	ANPR_CHECK(pMsg && (uint32_t)atoi(CDKMsgElementAttributeValue(CDKMsgChild(pMsg), "sensor")) == uLast);
+	CDKMsgDestroy(pMsg);
+	test.reattached.uIndex = uLast;
+	ANPR_CHECK(ANPRIngestAttach(pIngest, cdks[uLast], &test.reattached) == CDK_OK);
+	ANPR_CHECK(WaitReads(test, test.reattached, 100));
+	ANPR_CHECK(CountReads(test, test.sources[uLast]) == uDetachedReads);
+
+	// the counters are kept across a restart
+	ANPRIngestStop(pIngest);
+	ANPRIngestGetStats(pIngest, &stats);
+	ANPR_CHECK(stats.uProcessed == test.uCallbacks.load());
+	size_t uStoppedReads = CountReads(test, test.sources[0]);
+	ANPR_CHECK(ANPRIngestStart(pIngest) == CDK_OK);
+	ANPR_CHECK(WaitReads(test, test.sources[0], uStoppedReads + 100));
+
+	for (CDK* pCDK : cdks)
+		CDKUnbind(pCDK);
+	ANPRIngestStop(pIngest);
+	ANPRIngestGetStats(pIngest, &stats);
+	ANPR_CHECK(stats.uProcessed == test.uCallbacks.load() && stats.uQueueDrops == 0);
+	for (uint32_t i = 0; i < SENSORS; i++)
+		CheckSource(test.sources[i], cdks[i]);
+	CheckSource(test.reattached, cdks[uLast]);
+	for (const TestRead& read : test.detached.reads)
+		ANPR_CHECK(read.uSensor == uLast && read.pSource == cdks[uLast]);
+	ANPR_CHECK(test.reattached.reads[0].uSeq > test.sources[uLast].reads.back().uSeq);
+	ANPRIngestDestroy(pIngest);
+	for (CDK* pCDK : cdks)
+		CDKDestroy(pCDK);
+	CDKSimulatorDestroy(pSimulator);
+}
+
+int main()
+{
+	// a port range of its own, so that several runs do not collide
+	TestIngestReads((uint16_t)(20000 + (getpid() % 2000) * 8));
+	return ANPRTestResult("ANPRIngestTest");
+}
@@ -0,0 +1,286 @@
+/*
+	ANPRJournalTest : records written and read back, and the recovery of a journal cut or corrupted by a crash.
+
+	A crash is simulated on a closed journal by removing the index of its last segment, so that the segment is scanned as
+	after a crash, then by truncating or corrupting its records.
+*/
+
+#include <dirent.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "ANPRJournal.h"
+#include "ANPRTest.h"
+
+#define RECORDS 200
+#define SENSORS 4
+
+/*!
+	A read with its number as attribute and a content of a size depending on it
+*/
+static CDKMsg* CreateRead(uint32_t uNumber)
+{
+	CDKMsg* pMsg = CDKMsgCreate();
+	CDKMsgElement* pRoot = CDKMsgElementCreate("anpr");
+	CDKMsgSetChild(pMsg, pRoot);
+	CDKMsgElementSetAttributeUInt(pRoot, "number", uNumber);
+	std::vector<uint8_t> content(16 + (uNumber * 37) % 300);
+	for (size_t i = 0; i < content.size(); i++)
+		content[i] = (uint8_t)(uNumber + i);
+	CDKMsgElementSetContentBinary(pRoot, content.data(), (uint32_t)content.size());
+	return pMsg;
+}
+
+static int64_t TimestampOf(uint32_t uNumber)
+{
+	// not in append order within a sensor
+	return 1000000 + (int64_t)((uNumber * 7919) % RECORDS) * 1000;
+}
+
+static ANPRJournal* OpenJournal(const std::string& strDirectory)
+{
+	ANPRJournalConfig config;
+	ANPRJournalDefaultConfig(&config);
+	config.strDirectory = strDirectory.c_str();
+	config.uSegmentSize = 8192;
+	config.uSyncPolicy = ANPR_JOURNAL_SYNC_NONE;
+	return ANPRJournalCreate(&config);
+}
+
+static void Append(ANPRJournal* pJournal, uint32_t uFirst, uint32_t uCount)
+{
+	for (uint32_t uNumber = uFirst; uNumber < uFirst + uCount; uNumber++)
+	{
+		CDKMsg* pMsg = CreateRead(uNumber);
+		ANPR_CHECK(ANPRJournalAppend(pJournal, pMsg, uNumber % SENSORS, TimestampOf(uNumber), uNumber) == CDK_OK);
+		CDKMsgDestroy(pMsg);
+	}
+}
+
+/*!
+	Checks that record uRecord holds read uNumber
+*/
+static bool CheckRecord(ANPRJournalReader* pReader, uint64_t uRecord, uint32_t uNumber)
+{
+	ANPRJournalRecord record;
+	if (!ANPR_CHECK(ANPRJournalReaderGetRecord(pReader, uRecord, &record) == CDK_OK))
+		return false;
+	bool bOk = ANPR_CHECK(record.uSensor == uNumber % SENSORS && record.iTimestampUs == TimestampOf(uNumber) &&
+		record.iSeq == (int64_t)uNumber);
+	CDKMsg* pExpected = CreateRead(uNumber);
+	std::vector<uint8_t> expected(CDKMsgGetExportSize(pExpected));
+	CDKMsgExportToBinaryArray(pExpected, expected.data(), (uint32_t)expected.size());
+	CDKMsgDestroy(pExpected);
+	bOk = ANPR_CHECK(record.uSize == expected.size() && memcmp(record.pData, expected.data(), expected.size()) == 0) && bOk;
+	CDKMsg* pMsg = CDKMsgCreate();
+	bOk = ANPR_CHECK(ANPRJournalReaderImport(pReader, uRecord, pMsg) == CDK_OK) && bOk;
+	const char* strNumber = CDKMsgElementAttributeValue(CDKMsgChild(pMsg), "number");
+	bOk = ANPR_CHECK(strNumber && strtoul(strNumber, nullptr, 10) == uNumber) && bOk;
+	CDKMsgDestroy(pMsg);
+	return bOk;
+}
+
+static std::vector<std::string> ListFiles(const std::string& strDirectory, const char* strExtension)
+{
+	std::vector<std::string> files;
+	DIR* pDir = opendir(strDirectory.c_str());
+	while (struct dirent* pEntry = pDir ? readdir(pDir) : nullptr)
+	{
+		std::string strName = pEntry->d_name;
+		if (strName.size() > 4 && strName.compare(strName.size() - 4, 4, strExtension) == 0)
+			files.push_back(strDirectory + "/" + strName);
+	}
+	if (pDir)
+		closedir(pDir);
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string& strPath)
+{
+	std::vector<uint8_t> data;
+	FILE* pFile = fopen(strPath.c_str(), "rb");
+	if (!pFile)
+		return data;
+	uint8_t buffer[4096];
+	size_t uRead;
+	while ((uRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+		data.insert(data.end(), buffer, buffer + uRead);
+	fclose(pFile);
+	return data;
+}
+
+static void WriteFile(const std::string& strPath, const std::vector<uint8_t>& data)
+{
+	FILE* pFile = fopen(strPath.c_str(), "wb");
+	if (pFile)
+	{
+		fwrite(data.data(), 1, data.size(), pFile);
+		fclose(pFile);
+	}
+}
+
+/*!
+	Offsets of the records of a segment, from their 40 bytes headers : size of the message first, padded to 8 bytes
+*/
+static std::vector<size_t> RecordOffsets(const std::vector<uint8_t>& segment)
+{
+	std::vector<size_t> offsets;
+	size_t uOffset = 16;
+	while (uOffset + 40 <= segment.size())
+	{
+		uint32_t uSize;
+		memcpy(&uSize, segment.data() + uOffset, sizeof(uSize));
+		offsets.push_back(uOffset);
+		uOffset += 40 + ((uSize + 7u) & ~7u);
+	}
+	return offsets;
+}
+
+static int32_t CountScanned(const ANPRJournalRecord*, void* pUser)
+{
+	(*(uint64_t*)pUser)++;
+	return 1;
+}
+
+static void TestReadBack(const std::string& strDirectory)
+{
+	ANPRJournal* pJournal = OpenJournal(strDirectory);
+	if (!ANPR_CHECK(pJournal != nullptr))
+		return;
+	Append(pJournal, 0, RECORDS);
+	ANPR_CHECK(ANPRJournalFlush(pJournal) == CDK_OK);
+	ANPRJournalStats stats;
+	ANPRJournalGetStats(pJournal, &stats);
+	ANPR_CHECK(stats.uAppended == RECORDS && stats.uDurable == RECORDS && stats.uSegments > 1);
+	ANPRJournalDestroy(pJournal);
+	ANPR_CHECK(ListFiles(strDirectory, ".idx").size() == ListFiles(strDirectory, ".jnl").size());
+
+	ANPRJournalReader* pReader = ANPRJournalReaderCreate(strDirectory.c_str());
+	if (!ANPR_CHECK(pReader != nullptr))
+		return;
+	ANPR_CHECK(ANPRJournalReaderGetRecordCount(pReader) == RECORDS);
+	for (uint32_t uNumber = 0; uNumber < RECORDS; uNumber++)
+		CheckRecord(pReader, uNumber, uNumber);
+
+	// the scan of a sensor against a scan of every record
+	for (uint32_t uSensor = 0; uSensor < SENSORS; uSensor++)
+	{
+		int64_t iFromUs = TimestampOf(0) + 20000;
+		int64_t iToUs = TimestampOf(0) + 120000;
+		uint64_t uExpected = 0;
+		for (uint32_t uNumber = uSensor; uNumber < RECORDS; uNumber += SENSORS)
+			uExpected += TimestampOf(uNumber) >= iFromUs && TimestampOf(uNumber) <= iToUs;
+		uint64_t uScanned = 0;
+		ANPR_CHECK(ANPRJournalReaderScan(pReader, uSensor, iFromUs, iToUs, CountScanned, &uScanned) == uExpected);
+		ANPR_CHECK(uScanned == uExpected);
+	}
+	ANPRJournalReaderDestroy(pReader);
+}
+
+/*!
+	The last segment without index, cut in the middle of its last record : the record is ignored, and a new journal
+	appends after the complete records
+*/
+static void TestTruncation(const std::string& strDirectory)
+{
+	std::string strSegment = ListFiles(strDirectory, ".jnl").back();
+	std::string strIndex = strSegment.substr(0, strSegment.size() - 4) + ".idx";
+	ANPR_CHECK(unlink(strIndex.c_str()) == 0);
+	std::vector<uint8_t> segment = ReadFile(strSegment);
+	std::vector<size_t> offsets = RecordOffsets(segment);
+	if (!ANPR_CHECK(!offsets.empty()))
+		return;
+	segment.resize(offsets.back() + 40 + 5);
+	WriteFile(strSegment, segment);
+
+	ANPRJournalReader* pReader = ANPRJournalReaderCreate(strDirectory.c_str());
+	ANPR_CHECK(ANPRJournalReaderGetRecordCount(pReader) == RECORDS - 1);
+	ANPR_CHECK(CheckRecord(pReader, RECORDS - 2, RECORDS - 2));
+	ANPRJournalRecord record;
+	ANPR_CHECK(ANPRJournalReaderGetRecord(pReader, RECORDS - 1, &record) == CDK_FAIL);
+	ANPRJournalReaderDestroy(pReader);
+
+	// the lost record is appended again, after the complete ones
+	ANPRJournal* pJournal = OpenJournal(strDirectory);
+	if (!ANPR_CHECK(pJournal != nullptr))
+		return;
+	Append(pJournal, RECORDS - 1, 1);
+	ANPRJournalDestroy(pJournal);
+	pReader = ANPRJournalReaderCreate(strDirectory.c_str());
+	ANPR_CHECK(ANPRJournalReaderGetRecordCount(pReader) == RECORDS);
+	ANPR_CHECK(CheckRecord(pReader, RECORDS - 1, RECORDS - 1));
+	ANPRJournalReaderDestroy(pReader);
+}
+
+/*!
+	A record whose header reached the disk and whose message did not : the scan stops at it
+*/
+static void TestCorruptPayload(const std::string& strDirectory)
+{
+	std::vector<std::string> segments = ListFiles(strDirectory, ".jnl");
+	std::string strSegment = segments[segments.size() - 2];
+	std::string strIndex = strSegment.substr(0, strSegment.size() - 4) + ".idx";
+	ANPR_CHECK(unlink(strIndex.c_str()) == 0);
+	std::vector<uint8_t> segment = ReadFile(strSegment);
+	std::vector<size_t> offsets = RecordOffsets(segment);
+	size_t uCorrupt = offsets.size() / 2;
+	segment[offsets[uCorrupt] + 40 + 3] ^= 0x5A;
+	WriteFile(strSegment, segment);
+
+	uint64_t uFirstRecord = strtoull(strSegment.c_str() + strSegment.size() - 24, nullptr, 10);
+	ANPRJournalReader* pReader = ANPRJournalReaderCreate(strDirectory.c_str());
+	ANPRJournalRecord record;
+	ANPR_CHECK(CheckRecord(pReader, uFirstRecord + uCorrupt - 1, (uint32_t)(uFirstRecord + uCorrupt - 1)));
+	ANPR_CHECK(ANPRJournalReaderGetRecord(pReader, uFirstRecord + uCorrupt, &record) == CDK_FAIL);
+	// the next segment has its own index
+	ANPR_CHECK(ANPRJournalReaderGetRecordCount(pReader) == RECORDS);
+	ANPR_CHECK(CheckRecord(pReader, RECORDS - 1, RECORDS - 1));
+	ANPRJournalReaderDestroy(pReader);
+}
+
+/*!
+	An index pointing past its segment, with the expected size : it is ignored and the segment is scanned
+*/
+static void TestCorruptIndex(const std::string& strDirectory)
+{
+	ANPRJournal* pJournal = OpenJournal(strDirectory);
+	if (!ANPR_CHECK(pJournal != nullptr))
+		return;
+	Append(pJournal, 0, RECORDS);
+	ANPRJournalDestroy(pJournal);
+
+	std::string strIndex = ListFiles(strDirectory, ".idx").front();
+	std::vector<uint8_t> index = ReadFile(strIndex);
+	uint32_t uOffset = 0x7FFFFFF0u;
+	// the offsets follow the 32 bytes header
+	memcpy(index.data() + 32 + sizeof(uint32_t), &uOffset, sizeof(uOffset));
+	WriteFile(strIndex, index);
+
+	ANPRJournalReader* pReader = ANPRJournalReaderCreate(strDirectory.c_str());
+	for (uint32_t uNumber = 0; uNumber < 4; uNumber++)
+		CheckRecord(pReader, uNumber, uNumber);
+	uint64_t uScanned = 0;
+	ANPRJournalReaderScan(pReader, ANPR_JOURNAL_ANY_SENSOR, INT64_MIN, INT64_MAX, CountScanned, &uScanned);
+	ANPR_CHECK(uScanned == ANPRJournalReaderGetRecordCount(pReader));
+	ANPRJournalReaderDestroy(pReader);
+}
+
+int main()
+{
+	std::string strDirectory = ANPRTestCreateDirectory("ANPRJournalTest");
+	TestReadBack(strDirectory);
+	TestTruncation(strDirectory);
+	TestCorruptPayload(strDirectory);
+	ANPRTestRemoveDirectory(strDirectory);
+	strDirectory = ANPRTestCreateDirectory("ANPRJournalTest");
+	TestCorruptIndex(strDirectory);
+	ANPRTestRemoveDirectory(strDirectory);
+	return ANPRTestResult("ANPRJournalTest");
+}
@@ -0,0 +1,234 @@
+/*
+	ANPRSectionJoinTest : the matches of a section join engine on a fixed sequence of reads over two chained sections,
+	with the close texts confirmed by the fingerprints or by the signatures, and when the window is full.
+*/
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "CDKSimulator.h"
+#include "ANPRSectionJoin.h"
+#include "ANPRTest.h"
+
+#define SECOND 1000000ll
+
+struct TestRead
+{
+	uint32_t uSensor;
+	int64_t iTimestampUs;
+	uint32_t uVehicle;
+	const char* strPlate;
+};
+
+struct TestMatch
+{
+	uint64_t uExitId;
+	uint64_t uEntryId;
+	uint32_t uSection;
+	uint32_t uMethod;
+	double dSpeedKmh;
+	uint32_t bOverLimit;
+};
+
+/*!
+	Sections 10 -> 11 (1 km, limited to 90 km/h) and 11 -> 12 (2 km), a 100 s window. The reads are identified by
+	their index
+*/
+static const TestRead g_reads[] = {
+	{ 10, 0, 1, "AB123CD" },
+	{ 10, 10 * SECOND, 1, "AB123CD" },
+	{ 10, 20 * SECOND, 2, "XY999ZZ" },
+	{ 10, 25 * SECOND, 3, "QQ777QQ" },
+	// the newest entry read first, then the older one, then none left
+	{ 11, 50 * SECOND, 1, "AB-123-CD" },
+	{ 11, 55 * SECOND, 1, "AB123CD" },
+	{ 11, 60 * SECOND, 1, "AB123CD" },
+	// one character missing, same vehicle
+	{ 11, 70 * SECOND, 2, "XY99ZZ" },
+	// one character missing, another vehicle
+	{ 11, 75 * SECOND, 5, "QQ777Q" },
+	// the second section, from the last exit read of the first one
+	{ 12, 100 * SECOND, 1, "AB123CD" },
+	// every entry read left the window
+	{ 12, 700 * SECOND, 2, "XY999ZZ" },
+	// over the limit of the first section
+	{ 10, 710 * SECOND, 6, "FA5T1" },
+	{ 11, 720 * SECOND, 6, "FAST1" },
+};
+
+static void OnMatch(const ANPRSectionMatch* pMatch, void* pUser)
+{
+	static_cast<std::vector<ANPRSectionMatch>*>(pUser)->push_back(*pMatch);
+}
+
+static int32_t SaveDictionary(CDKPlateFingerprintMatcher*, const uint8_t* pBuffer, uint32_t uSize, void* pUser)
+{
+	static_cast<std::vector<uint8_t>*>(pUser)->assign(pBuffer, pBuffer + uSize);
+	return 1;
+}
+
+/*!
+	A matcher started with the dictionary learnt on the reads of a few vehicles
+*/
+static CDKPlateFingerprintMatcher* CreateMatcher(const ANPRPlateReadSchema* pSchema)
+{
+	std::vector<CDKMsg*> messages;
+	std::vector<ANPRPlateRead> reads;
+	for (uint32_t uSeq = 0; uSeq < 256; uSeq++)
+	{
+		CDKMsg* pRead = CDKSimulatorBuildRead(0, uSeq, uSeq % 32, 0, uSeq);
+		ANPRPlateRead read;
+		ANPRPlateReadExtract(pSchema, pRead, &read);
+		messages.push_back(pRead);
+		reads.push_back(read);
+	}
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pLearner, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	for (size_t i = 0; dictionary.empty() && i < 100 * reads.size() * reads.size(); i++)
+	{
+		const ANPRPlateRead& read1 = reads[i % reads.size()];
+		const ANPRPlateRead& read2 = reads[(i / reads.size()) % reads.size()];
+		CDKPlateFingerprintMatch(pLearner, read1.pFingerprint, read1.uFingerprintSize, read2.pFingerprint, read2.uFingerprintSize);
+	}
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	for (CDKMsg* pRead : messages)
+		CDKMsgDestroy(pRead);
+
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	ANPR_CHECK(CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), (uint32_t)dictionary.size()) == CDK_OK);
+	CDKPlateFingerprintMatcherStart(pMatcher);
+	return pMatcher;
+}
+
+static int32_t Push(ANPRSectionJoin* pJoin, const ANPRPlateReadSchema* pSchema, const TestRead& testRead, uint64_t uId)
+{
+	CDKMsg* pMsg = CDKSimulatorBuildRead(0, uId, testRead.uVehicle, 0, 1000 + (uint32_t)uId);
+	ANPRPlateRead read;
+	ANPRPlateReadExtract(pSchema, pMsg, &read);
+	read.uFields |= (1u << ANPR_PLATE_READ_PLATE) | (1u << ANPR_PLATE_READ_SENSOR) | (1u << ANPR_PLATE_READ_TIMESTAMP);
+	read.uSensor = testRead.uSensor;
+	read.iTimestampUs = testRead.iTimestampUs;
+	strcpy(read.strPlate, testRead.strPlate);
+	int32_t iResult = ANPRSectionJoinPush(pJoin, &read, uId);
+	CDKMsgDestroy(pMsg);
+	return iResult;
+}
+
+static void TestSequence(const ANPRPlateReadSchema* pSchema, CDKPlateFingerprintMatcher* pMatcher)
+{
+	std::vector<ANPRSectionMatch> matches;
+	ANPRSectionJoinConfig config;
+	ANPRSectionJoinDefaultConfig(&config);
+	config.iWindowUs = 100 * SECOND;
+	ANPRSectionJoin* pJoin = ANPRSectionJoinCreate(&config, pMatcher, OnMatch, &matches);
+	if (!ANPR_CHECK(pJoin != nullptr))
+		return;
+	ANPR_CHECK(ANPRSectionJoinAddSection(pJoin, 10, 11, 1000, 90) == 0);
+	ANPR_CHECK(ANPRSectionJoinAddSection(pJoin, 11, 12, 2000, 0) == 1);
+	ANPR_CHECK(ANPRSectionJoinAddSection(pJoin, 10, 11, 500, 0) == -1);
+
+	uint32_t uConfirmed = pMatcher ? ANPR_SECTION_MATCH_FINGERPRINT : ANPR_SECTION_MATCH_SIGNATURE;
+	const TestMatch expected[] = {
+		{ 4, 1, 0, ANPR_SECTION_MATCH_TEXT, 90, 0 },
+		{ 5, 0, 0, ANPR_SECTION_MATCH_TEXT, 1000 / 55.0 * 3.6, 0 },
+		{ 7, 2, 0, uConfirmed, 72, 0 },
+		{ 9, 6, 1, ANPR_SECTION_MATCH_TEXT, 180, 0 },
+		{ 12, 11, 0, ANPR_SECTION_MATCH_TEXT, 360, 1 },
+	};
+	size_t uMatches = 0;
+	const size_t uReads = sizeof(g_reads) / sizeof(g_reads[0]);
+	for (uint64_t uId = 0; uId < uReads; uId++)
+	{
+		bool bMatch = uMatches < sizeof(expected) / sizeof(expected[0]) && expected[uMatches].uExitId == uId;
+		ANPR_CHECK(Push(pJoin, pSchema, g_reads[uId], uId) == (bMatch ? 1 : 0));
+		uMatches += bMatch;
+	}
+	ANPR_CHECK(ANPRSectionJoinAddSection(pJoin, 12, 13, 1000, 0) == -1);
+
+	if (ANPR_CHECK(matches.size() == uMatches))
+		for (size_t i = 0; i < uMatches; i++)
+		{
+			const ANPRSectionMatch& match = matches[i];
+			ANPR_CHECK(match.uExitId == expected[i].uExitId && match.uEntryId == expected[i].uEntryId);
+			ANPR_CHECK(match.uSection == expected[i].uSection && match.uMethod == expected[i].uMethod);
+			ANPR_CHECK(match.dSpeedKmh > expected[i].dSpeedKmh - 1e-6 && match.dSpeedKmh < expected[i].dSpeedKmh + 1e-6);
+			ANPR_CHECK(match.bOverLimit == expected[i].bOverLimit);
+			ANPR_CHECK(match.iEntryTimestampUs == g_reads[match.uEntryId].iTimestampUs && match.iExitTimestampUs == g_reads[match.uExitId].iTimestampUs);
+			ANPR_CHECK(strcmp(match.strEntryPlate, g_reads[match.uEntryId].strPlate) == 0 && strcmp(match.strExitPlate, g_reads[match.uExitId].strPlate) == 0);
+		}
+
+	ANPRSectionJoinStats stats;
+	ANPRSectionJoinGetStats(pJoin, &stats);
+	ANPR_CHECK(stats.uExits == 8 && stats.uTextMatches == 4 && stats.uOverLimit == 1);
+	ANPR_CHECK((pMatcher ? stats.uFingerprintMatches : stats.uSignatureMatches) == 1);
+	ANPR_CHECK(stats.uComparisons >= 2);
+	// the entry reads 3, 4, 5, 7 and 8 expired unjoined ; 11, joined, and 12 are still in the window
+	ANPR_CHECK(stats.uExpired == 5 && stats.uEvicted == 0 && stats.uWindowEntries == 2);
+	ANPRSectionJoinDestroy(pJoin);
+}
+
+/*!
+	With two entry reads at most, a third one evicts the oldest
+*/
+static void TestMaxEntries(const ANPRPlateReadSchema* pSchema)
+{
+	std::vector<ANPRSectionMatch> matches;
+	ANPRSectionJoinConfig config;
+	ANPRSectionJoinDefaultConfig(&config);
+	config.uMaxEntries = 2;
+	ANPRSectionJoin* pJoin = ANPRSectionJoinCreate(&config, nullptr, OnMatch, &matches);
+	if (!ANPR_CHECK(pJoin != nullptr))
+		return;
+	ANPR_CHECK(ANPRSectionJoinAddSection(pJoin, 1, 2, 1000, 0) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 1, 0, 1, "AA111AA" }, 0) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 1, SECOND, 2, "BB222BB" }, 1) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 1, 2 * SECOND, 3, "CC333CC" }, 2) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 2, 30 * SECOND, 1, "AA111AA" }, 3) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 2, 31 * SECOND, 2, "BB222BB" }, 4) == 1);
+	ANPR_CHECK(matches.size() == 1 && matches[0].uEntryId == 1);
+	ANPRSectionJoinStats stats;
+	ANPRSectionJoinGetStats(pJoin, &stats);
+	ANPR_CHECK(stats.uEvicted == 1 && stats.uWindowEntries == 2);
+	ANPRSectionJoinDestroy(pJoin);
+}
+
+/*!
+	Texts longer than usual plates, one character apart near their end : the keys of every character are kept
+*/
+static void TestLongTexts(const ANPRPlateReadSchema* pSchema)
+{
+	std::vector<ANPRSectionMatch> matches;
+	ANPRSectionJoin* pJoin = ANPRSectionJoinCreate(nullptr, nullptr, OnMatch, &matches);
+	if (!ANPR_CHECK(pJoin != nullptr))
+		return;
+	ANPR_CHECK(ANPRSectionJoinAddSection(pJoin, 1, 2, 1000, 0) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 1, 0, 7, "ABCDEFHKLMNPRT2" }, 0) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 1, SECOND, 8, "ABCDEFHKLMNPRT5" }, 1) == 0);
+	ANPR_CHECK(Push(pJoin, pSchema, { 2, 30 * SECOND, 7, "ABCDEFHKLMNPRT" }, 2) == 1);
+	ANPR_CHECK(Push(pJoin, pSchema, { 2, 31 * SECOND, 8, "ABCDEFHKLMNPR5" }, 3) == 1);
+	if (ANPR_CHECK(matches.size() == 2))
+	{
+		ANPR_CHECK(matches[0].uEntryId == 0 && matches[0].uMethod == ANPR_SECTION_MATCH_SIGNATURE);
+		ANPR_CHECK(matches[1].uEntryId == 1 && matches[1].uMethod == ANPR_SECTION_MATCH_SIGNATURE);
+	}
+	ANPRSectionJoinDestroy(pJoin);
+}
+
+int main()
+{
+	ANPRPlateReadSchema* pSchema = ANPRPlateReadSchemaCreate();
+	CDKPlateFingerprintMatcher* pMatcher = CreateMatcher(pSchema);
+	TestSequence(pSchema, pMatcher);
+	TestSequence(pSchema, nullptr);
+	TestMaxEntries(pSchema);
+	TestLongTexts(pSchema);
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+	ANPRPlateReadSchemaDestroy(pSchema);
+	return ANPRTestResult("ANPRSectionJoinTest");
+}
@@ -0,0 +1,171 @@
+/*
+	ANPRSignatureCacheTest : the comparisons through a signature cache against CDKSignatureCompareEx, from several
+	threads, and the eviction order of a cache holding three signatures.
+*/
+
+#include <stdint.h>
+
+#include <thread>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKSignature.h"
+#include "CDKSimulator.h"
+#include "ANPRSignatureCache.h"
+#include "ANPRTest.h"
+
+#define SIGNATURES 48
+#define THREADS 4
+
+static std::vector<uint8_t> BuildSignature(uint64_t uSeq, uint32_t uVehicle)
+{
+	CDKMsg* pRead = CDKSimulatorBuildRead(0, uSeq, uVehicle, 0, (uint32_t)uSeq);
+	CDKMsgElement* pSig = CDKMsgElementFirstChild(CDKMsgChild(pRead), "signature");
+	const uint8_t* pContent = CDKMsgElementContent(pSig);
+	std::vector<uint8_t> signature(pContent, pContent + CDKMsgElementContentSize(pSig));
+	CDKMsgDestroy(pRead);
+	return signature;
+}
+
+/*!
+	Every pair compared through a shared cache, on several threads, gives the score of the parsed signatures
+*/
+static void TestCompare(const std::vector<std::vector<uint8_t>>& buffers)
+{
+	std::vector<CDKSignature*> signatures;
+	for (const std::vector<uint8_t>& buffer : buffers)
+		signatures.push_back(CDKSignatureCreate(buffer.data(), (uint32_t)buffer.size()));
+	std::vector<int32_t> expected(buffers.size() * buffers.size());
+	for (size_t i = 0; i < buffers.size(); i++)
+		for (size_t j = 0; j < buffers.size(); j++)
+			expected[i * buffers.size() + j] = CDKSignatureCompareEx(signatures[i], signatures[j], 0);
+	for (CDKSignature* pSignature : signatures)
+		CDKSignatureDestroy(pSignature);
+
+	// a budget of about a third of the signatures, so that they are evicted and parsed again
+	ANPRSignatureCacheConfig config;
+	ANPRSignatureCacheDefaultConfig(&config);
+	config.uShards = 2;
+	config.uMaxBytes = 16 * (64 + buffers[0].size() * (1 + sizeof(float)) + 256);
+	ANPRSignatureCache* pCache = ANPRSignatureCacheCreate(&config);
+	if (!ANPR_CHECK(pCache != nullptr))
+		return;
+	// every thread compares every pair, in its own order
+	const size_t steps[THREADS] = { 1, 5, 7, 11 };
+	std::vector<int32_t> scores[THREADS];
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < THREADS; t++)
+		threads.emplace_back([&, t] {
+			scores[t].resize(expected.size());
+			for (size_t k = 0; k < expected.size(); k++)
+			{
+				size_t uPair = (k * steps[t] + t) % expected.size();
+				const std::vector<uint8_t>& buffer1 = buffers[uPair / buffers.size()];
+				const std::vector<uint8_t>& buffer2 = buffers[uPair % buffers.size()];
+				scores[t][uPair] = ANPRSignatureCacheCompare(pCache, buffer1.data(), (uint32_t)buffer1.size(),
+					buffer2.data(), (uint32_t)buffer2.size(), 0);
+			}
+		});
+	for (std::thread& thread : threads)
+		thread.join();
+	for (uint32_t t = 0; t < THREADS; t++)
+		ANPR_CHECK(scores[t] == expected);
+
+	ANPRSignatureCacheStats stats;
+	ANPR_CHECK(ANPRSignatureCacheGetStats(pCache, &stats) == CDK_OK);
+	ANPR_CHECK(stats.uHits + stats.uMisses == 2 * THREADS * expected.size() && stats.uHits > 0 && stats.uEvictions > 0);
+	ANPR_CHECK(stats.uBytes <= config.uMaxBytes);
+
+	// buffers of different sizes are not compared, and the cached signature is left untouched
+	const std::vector<uint8_t>& buffer = buffers[0];
+	ANPRSignatureCacheEntry* pEntry;
+	CDKSignature* pSignature = ANPRSignatureCacheAcquire(pCache, buffer.data(), (uint32_t)buffer.size(), &pEntry);
+	ANPR_CHECK(ANPRSignatureCacheCompare(pCache, buffer.data(), (uint32_t)buffer.size(), buffer.data(), (uint32_t)buffer.size() / 2, 0) == -1);
+	ANPR_CHECK(pSignature && CDKGetLastError(pSignature)[0] == 0 && CDKGetLastError(pCache)[0] != 0);
+	ANPRSignatureCacheRelease(pCache, pEntry);
+	ANPRSignatureCacheDestroy(pCache);
+}
+
+static CDKSignature* Acquire(ANPRSignatureCache* pCache, const std::vector<uint8_t>& buffer, ANPRSignatureCacheEntry** ppEntry)
+{
+	// a copy of the buffer : the cache is keyed by the content
+	std::vector<uint8_t> copy = buffer;
+	return ANPRSignatureCacheAcquire(pCache, copy.data(), (uint32_t)copy.size(), ppEntry);
+}
+
+/*!
+	The least recently released signature is evicted first, and the acquired ones are neither evicted nor destroyed
+*/
+static void TestEviction(const std::vector<std::vector<uint8_t>>& buffers)
+{
+	ANPRSignatureCacheConfig config;
+	ANPRSignatureCacheDefaultConfig(&config);
+	config.uShards = 1;
+	ANPRSignatureCache* pCache = ANPRSignatureCacheCreate(&config);
+	if (!ANPR_CHECK(pCache != nullptr))
+		return;
+	ANPRSignatureCacheEntry* pEntry;
+	ANPR_CHECK(Acquire(pCache, buffers[0], &pEntry) != nullptr);
+	ANPRSignatureCacheRelease(pCache, pEntry);
+	ANPRSignatureCacheStats stats;
+	ANPRSignatureCacheGetStats(pCache, &stats);
+	uint64_t uEntryBytes = stats.uBytes;
+	ANPRSignatureCacheDestroy(pCache);
+
+	config.uMaxBytes = 3 * uEntryBytes;
+	pCache = ANPRSignatureCacheCreate(&config);
+	if (!ANPR_CHECK(pCache != nullptr))
+		return;
+	const std::vector<uint8_t>& a = buffers[0];
+	const std::vector<uint8_t>& b = buffers[1];
+	const std::vector<uint8_t>& c = buffers[2];
+	const std::vector<uint8_t>& d = buffers[3];
+	ANPR_CHECK(a.size() == b.size() && a.size() == c.size() && a.size() == d.size());
+	CDKSignature* pA = Acquire(pCache, a, &pEntry);
+	ANPRSignatureCacheRelease(pCache, pEntry);
+	for (const std::vector<uint8_t>* pBuffer : { &b, &c })
+	{
+		Acquire(pCache, *pBuffer, &pEntry);
+		ANPRSignatureCacheRelease(pCache, pEntry);
+	}
+	// a is used again : b is the least recently used
+	ANPR_CHECK(Acquire(pCache, a, &pEntry) == pA);
+	ANPRSignatureCacheRelease(pCache, pEntry);
+	Acquire(pCache, d, &pEntry);
+	ANPRSignatureCacheRelease(pCache, pEntry);
+	ANPRSignatureCacheGetStats(pCache, &stats);
+	ANPR_CHECK(stats.uHits == 1 && stats.uMisses == 4 && stats.uEvictions == 1 && stats.uEntries == 3);
+	Acquire(pCache, b, &pEntry);
+	ANPRSignatureCacheRelease(pCache, pEntry);
+	ANPR_CHECK(Acquire(pCache, a, &pEntry) == pA);
+	ANPRSignatureCacheRelease(pCache, pEntry);
+	ANPRSignatureCacheGetStats(pCache, &stats);
+	ANPR_CHECK(stats.uHits == 2 && stats.uMisses == 5 && stats.uEvictions == 2 && stats.uBytes == 3 * uEntryBytes);
+
+	// the budget held by acquired signatures : a fourth one is parsed but not cached, and stays valid until released
+	ANPRSignatureCacheEntry* held[3];
+	CDKSignature* pHeld = nullptr;
+	for (size_t i = 0; i < 3; i++)
+		pHeld = Acquire(pCache, buffers[4 + i], &held[i]);
+	ANPRSignatureCacheEntry* pUncached;
+	CDKSignature* pSignature = Acquire(pCache, buffers[7], &pUncached);
+	ANPRSignatureCacheGetStats(pCache, &stats);
+	ANPR_CHECK(stats.uUncached == 1 && stats.uEntries == 3);
+	ANPR_CHECK(pSignature && CDKSignatureCompareEx(pSignature, pSignature, 0) == 10);
+	ANPR_CHECK(pHeld && CDKSignatureCompareEx(pHeld, pHeld, 0) == 10);
+	ANPRSignatureCacheRelease(pCache, pUncached);
+	for (ANPRSignatureCacheEntry* pHeldEntry : held)
+		ANPRSignatureCacheRelease(pCache, pHeldEntry);
+	ANPRSignatureCacheDestroy(pCache);
+}
+
+int main()
+{
+	std::vector<std::vector<uint8_t>> buffers;
+	for (uint32_t i = 0; i < SIGNATURES; i++)
+		buffers.push_back(BuildSignature(i, i % (SIGNATURES / 3)));
+	TestCompare(buffers);
+	TestEviction(buffers);
+	return ANPRTestResult("ANPRSignatureCacheTest");
+}
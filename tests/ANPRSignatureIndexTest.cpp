@@ -0,0 +1,152 @@
+/*
+	ANPRSignatureIndexTest : the queries of a signature index, on one thread and on several, against a serial scan of
+	every signature with CDKSignatureCompare.
+*/
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKSignature.h"
+#include "CDKSimulator.h"
+#include "ANPRSignatureIndex.h"
+#include "ANPRTest.h"
+
+#define VEHICLES 60
+#define READS 6
+
+struct TestSignature
+{
+	CDKSignature* pSignature;
+	uint64_t uId;
+	int64_t iTimestampUs;
+};
+
+/*!
+	The signature buffer of a read of a vehicle
+*/
+static std::vector<uint8_t> BuildSignature(uint64_t uSeq, uint32_t uVehicle)
+{
+	CDKMsg* pRead = CDKSimulatorBuildRead(0, uSeq, uVehicle, 0, (uint32_t)uSeq);
+	CDKMsgElement* pSig = CDKMsgElementFirstChild(CDKMsgChild(pRead), "signature");
+	const uint8_t* pContent = CDKMsgElementContent(pSig);
+	std::vector<uint8_t> signature(pContent, pContent + CDKMsgElementContentSize(pSig));
+	CDKMsgDestroy(pRead);
+	return signature;
+}
+
+static bool Better(const ANPRSignatureMatch& a, const ANPRSignatureMatch& b)
+{
+	if (a.iScore != b.iScore)
+		return a.iScore > b.iScore;
+	if (a.iTimestampUs != b.iTimestampUs)
+		return a.iTimestampUs > b.iTimestampUs;
+	return a.uId > b.uId;
+}
+
+/*!
+	The expected results : every live signature of the range compared, sorted, and cut to uK
+*/
+static std::vector<ANPRSignatureMatch> SerialQuery(const std::vector<TestSignature>& signatures, size_t uFirstLive,
+	CDKSignature* pSignature, uint32_t uK, int32_t iMinScore, int64_t iFromUs, int64_t iToUs)
+{
+	std::vector<ANPRSignatureMatch> matches;
+	for (size_t i = uFirstLive; i < signatures.size(); i++)
+	{
+		const TestSignature& signature = signatures[i];
+		if ((iFromUs && signature.iTimestampUs < iFromUs) || (iToUs && signature.iTimestampUs >= iToUs))
+			continue;
+		int32_t iScore = CDKSignatureCompare(pSignature, signature.pSignature);
+		if (iScore >= iMinScore)
+			matches.push_back({ signature.uId, signature.iTimestampUs, iScore });
+	}
+	std::sort(matches.begin(), matches.end(), Better);
+	if (matches.size() > uK)
+		matches.resize(uK);
+	return matches;
+}
+
+static void CheckQuery(ANPRSignatureIndex* pIndex, const std::vector<TestSignature>& signatures, size_t uFirstLive,
+	CDKSignature* pSignature, uint32_t uK, int32_t iMinScore, int64_t iFromUs, int64_t iToUs)
+{
+	std::vector<ANPRSignatureMatch> expected = SerialQuery(signatures, uFirstLive, pSignature, uK, iMinScore, iFromUs, iToUs);
+	std::vector<ANPRSignatureMatch> matches(uK);
+	int32_t iCount = ANPRSignatureIndexQuery(pIndex, pSignature, uK, iMinScore, iFromUs, iToUs, matches.data());
+	if (!ANPR_CHECK(iCount == (int32_t)expected.size()))
+		return;
+	for (int32_t i = 0; i < iCount; i++)
+		ANPR_CHECK(matches[i].uId == expected[i].uId && matches[i].iTimestampUs == expected[i].iTimestampUs
+			&& matches[i].iScore == expected[i].iScore);
+}
+
+static void TestQueries(uint32_t uThreads)
+{
+	ANPRSignatureIndexConfig config;
+	ANPRSignatureIndexDefaultConfig(&config);
+	config.uThreads = uThreads;
+	ANPRSignatureIndex* pIndex = ANPRSignatureIndexCreate(&config);
+	if (!ANPR_CHECK(pIndex != nullptr))
+		return;
+
+	std::vector<TestSignature> signatures;
+	for (uint32_t uRead = 0; uRead < READS; uRead++)
+		for (uint32_t uVehicle = 0; uVehicle < VEHICLES; uVehicle++)
+		{
+			uint64_t uSeq = (uint64_t)uRead * VEHICLES + uVehicle;
+			std::vector<uint8_t> signature = BuildSignature(uSeq, uVehicle);
+			ANPR_CHECK(ANPRSignatureIndexInsert(pIndex, signature.data(), (uint32_t)signature.size(), uSeq, (int64_t)uSeq * 10000) == CDK_OK);
+			signatures.push_back({ CDKSignatureCreate(signature.data(), (uint32_t)signature.size()), uSeq, (int64_t)uSeq * 10000 });
+		}
+	int64_t iLastUs = signatures.back().iTimestampUs;
+
+	// known vehicles, and a vehicle never inserted
+	for (uint32_t uVehicle : { 0u, 7u, VEHICLES - 1u, VEHICLES + 5u })
+	{
+		std::vector<uint8_t> query = BuildSignature(100000 + uVehicle, uVehicle);
+		CDKSignature* pQuery = CDKSignatureCreate(query.data(), (uint32_t)query.size());
+		// every read of a known vehicle is found
+		if (uVehicle < VEHICLES)
+			ANPR_CHECK(SerialQuery(signatures, 0, pQuery, 10, 8, 0, 0).size() >= READS);
+		for (uint32_t uK : { 1u, 3u, 10u })
+			for (int32_t iMinScore : { 1, 5, 8 })
+			{
+				CheckQuery(pIndex, signatures, 0, pQuery, uK, iMinScore, 0, 0);
+				CheckQuery(pIndex, signatures, 0, pQuery, uK, iMinScore, iLastUs / 3, 0);
+				CheckQuery(pIndex, signatures, 0, pQuery, uK, iMinScore, iLastUs / 4, iLastUs / 2);
+			}
+		CDKSignatureDestroy(pQuery);
+	}
+
+	// the first reads expired
+	ANPR_CHECK(ANPRSignatureIndexExpire(pIndex, 2 * VEHICLES * 10000) == 2 * VEHICLES);
+	std::vector<uint8_t> query = BuildSignature(100000, 3);
+	CDKSignature* pQuery = CDKSignatureCreate(query.data(), (uint32_t)query.size());
+	CheckQuery(pIndex, signatures, 2 * VEHICLES, pQuery, 10, 1, 0, 0);
+	CheckQuery(pIndex, signatures, 2 * VEHICLES, pQuery, 10, 1, iLastUs / 4, 0);
+	CDKSignatureDestroy(pQuery);
+
+	// a signature of another size is compared with none, and the query signature is left untouched
+	pQuery = CDKSignatureCreate(query.data(), (uint32_t)query.size() / 2);
+	std::vector<ANPRSignatureMatch> matches(10);
+	ANPR_CHECK(ANPRSignatureIndexQuery(pIndex, pQuery, 10, 1, 0, 0, matches.data()) == 0);
+	ANPR_CHECK(CDKGetLastError(pQuery)[0] == 0);
+	CDKSignatureDestroy(pQuery);
+
+	ANPRSignatureIndexStats stats;
+	ANPR_CHECK(ANPRSignatureIndexGetStats(pIndex, &stats) == CDK_OK);
+	ANPR_CHECK(stats.uSignatures == (READS - 2) * VEHICLES && stats.uInserted == READS * VEHICLES && stats.uExpired == 2 * VEHICLES);
+
+	ANPRSignatureIndexDestroy(pIndex);
+	for (TestSignature& signature : signatures)
+		CDKSignatureDestroy(signature.pSignature);
+}
+
+int main()
+{
+	TestQueries(1);
+	TestQueries(4);
+	return ANPRTestResult("ANPRSignatureIndexTest");
+}
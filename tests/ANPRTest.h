@@ -0,0 +1,64 @@
+/*
+	ANPRTest : checks of the test programs.
+
+	A test program calls ANPR_CHECK for every expectation, and returns ANPRTestResult() from main : ctest reports the
+	program as failed if any check failed. A failed check prints its file, line and expression, and the test goes on.
+*/
+
+#ifndef ANPRTEST_H
+#define ANPRTEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+static int g_iTestChecks = 0;
+static int g_iTestFailures = 0;
+
+#define ANPR_CHECK(condition) ANPRTestCheck((condition), #condition, __FILE__, __LINE__)
+
+static inline bool ANPRTestCheck(bool bCondition, const char* strCondition, const char* strFile, int iLine)
+{
+	g_iTestChecks++;
+	if (!bCondition)
+	{
+		g_iTestFailures++;
+		fprintf(stderr, "%s:%d: check failed: %s\n", strFile, iLine, strCondition);
+	}
+	return bCondition;
+}
+
+/*!
+	Prints the number of checks and failures, and returns the exit code of the test program
+*/
+static inline int ANPRTestResult(const char* strName)
+{
+	printf("%s: %d checks, %d failed\n", strName, g_iTestChecks, g_iTestFailures);
+	return g_iTestFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*!
+	Creates an empty temporary directory, removed by ANPRTestRemoveDirectory
+*/
+static inline std::string ANPRTestCreateDirectory(const char* strName)
+{
+	std::string strTemplate = std::string("/tmp/") + strName + ".XXXXXX";
+	if (!mkdtemp(&strTemplate[0]))
+	{
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+	return strTemplate;
+}
+
+static inline void ANPRTestRemoveDirectory(const std::string& strDirectory)
+{
+	std::string strCommand = "rm -rf '" + strDirectory + "'";
+	if (system(strCommand.c_str()) != 0)
+		fprintf(stderr, "cannot remove %s\n", strDirectory.c_str());
+}
+
+#endif //ANPRTEST_H
@@ -0,0 +1,130 @@
+/*
+	ANPRTraceSinkTest : the traces written by a sink, and the destruction and replacement of installed sinks while
+	other threads are tracing.
+*/
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../src/CDKPrivate.h"
+#include "ANPRTraceSink.h"
+#include "ANPRTest.h"
+
+#define THREADS 4
+
+struct TestLines
+{
+	std::mutex mutex;
+	std::vector<ANPRTraceLine> lines;
+};
+
+static void WriteLines(const ANPRTraceLine* pLines, uint32_t uLines, void* pUser)
+{
+	TestLines* pTestLines = (TestLines*)pUser;
+	std::lock_guard<std::mutex> lock(pTestLines->mutex);
+	pTestLines->lines.insert(pTestLines->lines.end(), pLines, pLines + uLines);
+}
+
+static void CountLines(const ANPRTraceLine*, uint32_t uLines, void* pUser)
+{
+	((std::atomic<uint64_t>*)pUser)->fetch_add(uLines);
+}
+
+/*!
+	Every trace of the SDK and of the application is written once, in time order, and none is kept after destruction
+*/
+static void TestWrite()
+{
+	ANPRTraceSinkConfig config;
+	ANPRTraceSinkDefaultConfig(&config);
+	config.uMaxLinesPerSecond = 0;
+	TestLines lines;
+	ANPRTraceSink* pSink = ANPRTraceSinkCreate(&config, WriteLines, &lines);
+	if (!ANPR_CHECK(pSink != nullptr))
+		return;
+	ANPRTraceSinkInstall(pSink);
+	for (int i = 0; i < 300; i++)
+		CDKTrace(nullptr, CDK_TRACE_INFO, "cdk %d", i);
+	for (int i = 0; i < 200; i++)
+		ANPRTraceSinkWrite(pSink, CDK_TRACE_INFO, "application %d", i);
+	// above the level of the sink
+	CDKTrace(nullptr, CDK_TRACE_DEBUG, "debug");
+	ANPRTraceSinkWrite(pSink, CDK_TRACE_DEBUG, "debug");
+	ANPRTraceSinkStats stats;
+	ANPRTraceSinkGetStats(pSink, &stats);
+	ANPR_CHECK(stats.uLines == 500 && stats.uDroppedFull == 0 && stats.uDroppedRate == 0 && stats.uRings == 1);
+	ANPRTraceSinkDestroy(pSink);
+	// not installed any more
+	CDKTrace(nullptr, CDK_TRACE_INFO, "after");
+
+	if (!ANPR_CHECK(lines.lines.size() == 500))
+		return;
+	for (size_t i = 0; i < lines.lines.size(); i++)
+	{
+		const ANPRTraceLine& line = lines.lines[i];
+		char strExpected[64];
+		if (i < 300)
+			snprintf(strExpected, sizeof(strExpected), "cdk %d", (int)i);
+		else
+			snprintf(strExpected, sizeof(strExpected), "application %d", (int)i - 300);
+		ANPR_CHECK(strcmp(line.strText, strExpected) == 0 && line.uLength == strlen(strExpected));
+		ANPR_CHECK(line.uSource == (i < 300 ? ANPR_TRACE_SOURCE_CDK : ANPR_TRACE_SOURCE_APPLICATION) && line.level == CDK_TRACE_INFO);
+		ANPR_CHECK(i == 0 || line.iTimeUs >= lines.lines[i - 1].iTimeUs);
+	}
+}
+
+/*!
+	Sinks installed, replaced and destroyed while threads trace without pause : a trace being copied when its sink is
+	destroyed must not reach the freed sink
+*/
+static void TestShutdown()
+{
+	std::atomic<bool> bStop{false};
+	std::atomic<uint64_t> uTraced{0};
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREADS; i++)
+		threads.emplace_back([&] {
+			while (!bStop.load())
+			{
+				CDKTrace(nullptr, CDK_TRACE_INFO, "trace %d", 42);
+				uTraced++;
+			}
+		});
+
+	std::atomic<uint64_t> uWritten{0};
+	for (int i = 0; i < 60; i++)
+	{
+		ANPRTraceSink* pFirst = ANPRTraceSinkCreate(nullptr, CountLines, &uWritten);
+		if (!ANPR_CHECK(pFirst != nullptr))
+			break;
+		ANPRTraceSinkInstall(pFirst);
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+		if (i & 1)
+		{
+			// replaced, then destroyed while the next one is installed
+			ANPRTraceSink* pSecond = ANPRTraceSinkCreate(nullptr, CountLines, &uWritten);
+			ANPRTraceSinkInstall(pSecond);
+			ANPRTraceSinkDestroy(pFirst);
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			ANPRTraceSinkDestroy(pSecond);
+		}
+		else
+			ANPRTraceSinkDestroy(pFirst);
+	}
+	bStop = true;
+	for (std::thread& thread : threads)
+		thread.join();
+	ANPR_CHECK(uWritten.load() > 0 && uWritten.load() <= uTraced.load());
+}
+
+int main()
+{
+	TestWrite();
+	TestShutdown();
+	return ANPRTestResult("ANPRTraceSinkTest");
+}
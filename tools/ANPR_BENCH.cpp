@@ -0,0 +1,1159 @@
+/*
+	ANPR_BENCH : micro-benchmarks of the CDK hot paths.
+
+	Every benchmark is calibrated to run at least --min-time seconds, then repeated --repetitions
+	times. The median and minimum time per operation, and the number of heap allocations per
+	operation, are written as JSON, so that two runs (or two SDK versions) can be compared with a diff.
+
+	ANPR_BENCH [--filter substring] [--repetitions N] [--min-time seconds] [--out file.json]
+*/
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKQueue.h"
+#include "CDKSignature.h"
+#include "CDKPlateFingerprintMatcher.h"
+#include "CDKSimulator.h"
+#include "ANPRCandidateFilter.h"
+#include "ANPRDedup.h"
+#include "ANPRDictionaryStore.h"
+#include "ANPRFingerprintPool.h"
+#include "ANPRHotList.h"
+#include "ANPRJournal.h"
+#include "ANPRPlateRead.h"
+#include "ANPRSectionJoin.h"
+#include "ANPRSignatureCache.h"
+#include "ANPRSignatureIndex.h"
+#include "ANPRTraceSink.h"
+
+//---------------------------------------------------------------------------------------------
+// allocation counting
+//---------------------------------------------------------------------------------------------
+
+static std::atomic<uint64_t> g_uAllocations{0};
+
+void* operator new(size_t uSize)
+{
+	g_uAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(uSize ? uSize : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t uSize, const std::nothrow_t&) noexcept
+{
+	g_uAllocations.fetch_add(1, std::memory_order_relaxed);
+	return malloc(uSize ? uSize : 1);
+}
+
+void* operator new[](size_t uSize)
+{
+	return operator new(uSize);
+}
+
+void* operator new[](size_t uSize, const std::nothrow_t& nothrow) noexcept
+{
+	return operator new(uSize, nothrow);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+//---------------------------------------------------------------------------------------------
+// harness
+//---------------------------------------------------------------------------------------------
+
+struct BenchResult
+{
+	std::string strName;
+	uint64_t uIterations;
+	double dMedianNs;
+	double dMinNs;
+	double dAllocsPerOp;
+	double dBytesPerOp;
+};
+
+struct BenchOptions
+{
+	std::string strFilter;
+	uint32_t uRepetitions = 5;
+	double dMinTime = 0.2;
+};
+
+static BenchOptions g_options;
+static std::vector<BenchResult> g_results;
+
+/*!
+	Runs op(uIterations) and returns the elapsed time in ns. op performs uIterations operations.
+*/
+typedef std::function<void(uint64_t uIterations)> BenchFunction;
+
+static double BenchTime(const BenchFunction& op, uint64_t uIterations)
+{
+	auto start = std::chrono::steady_clock::now();
+	op(uIterations);
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Bench(const char* strName, double dBytesPerOp, const BenchFunction& op)
+{
+	if (!g_options.strFilter.empty() && strstr(strName, g_options.strFilter.c_str()) == nullptr)
+		return;
+
+	// calibration : double the iterations until the run is long enough
+	uint64_t uIterations = 1;
+	double dMinNs = g_options.dMinTime * 1e9;
+	for (;;)
+	{
+		double dElapsed = BenchTime(op, uIterations);
+		if (dElapsed >= dMinNs || uIterations >= (1ull << 40))
+			break;
+		uint64_t uNext = dElapsed > 0 ? (uint64_t)((double)uIterations * dMinNs * 1.2 / dElapsed) : uIterations * 10;
+		uIterations = std::max(uIterations * 2, std::min(uNext, uIterations * 100));
+	}
+
+	std::vector<double> perOp;
+	uint64_t uAllocations = 0;
+	for (uint32_t i = 0; i < g_options.uRepetitions; i++)
+	{
+		uint64_t uBefore = g_uAllocations.load();
+		perOp.push_back(BenchTime(op, uIterations) / (double)uIterations);
+		uAllocations += g_uAllocations.load() - uBefore;
+	}
+	std::sort(perOp.begin(), perOp.end());
+
+	BenchResult result;
+	result.strName = strName;
+	result.uIterations = uIterations;
+	result.dMedianNs = perOp[perOp.size() / 2];
+	result.dMinNs = perOp.front();
+	result.dAllocsPerOp = (double)uAllocations / ((double)uIterations * g_options.uRepetitions);
+	result.dBytesPerOp = dBytesPerOp;
+	g_results.push_back(result);
+	fprintf(stderr, "%-40s %12.1f ns/op %8.2f allocs/op\n", strName, result.dMedianNs, result.dAllocsPerOp);
+}
+
+static void WriteJson(FILE* pFile)
+{
+	char strFullVersion[256];
+	CDKGetFullVersion(strFullVersion);
+	fprintf(pFile, "{\n  \"cdk_version\": \"%s\",\n  \"cdk_full_version\": \"%s\",\n", CDKGetVersion(), strFullVersion);
+	fprintf(pFile, "  \"repetitions\": %u,\n  \"benchmarks\": [\n", g_options.uRepetitions);
+	for (size_t i = 0; i < g_results.size(); i++)
+	{
+		const BenchResult& r = g_results[i];
+		fprintf(pFile, "    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, "
+			"\"allocs_per_op\": %.3f, \"bytes_per_op\": %.0f }%s\n", r.strName.c_str(), (unsigned long long)r.uIterations,
+			r.dMedianNs, r.dMinNs, r.dAllocsPerOp, r.dBytesPerOp, i + 1 < g_results.size() ? "," : "");
+	}
+	fprintf(pFile, "  ]\n}\n");
+}
+
+//---------------------------------------------------------------------------------------------
+// benchmarks
+//---------------------------------------------------------------------------------------------
+
+static volatile uintptr_t g_uSink;
+
+static CDKMsg* BuildSmallMessage()
+{
+	CDKMsg* pMsg = CDKMsgCreate();
+	CDKMsgElement* pRoot = CDKMsgElementCreate("triggerOn");
+	CDKMsgSetChild(pMsg, pRoot);
+	CDKMsgElementSetAttribute(pRoot, "cameraId", "0");
+	CDKMsgElementSetAttributeUInt(pRoot, "timeout", 1000);
+	CDKMsgElement* pChild = CDKMsgElementCreate("config");
+	CDKMsgElementAddChild(pRoot, pChild);
+	CDKMsgElementSetAttributeBool(pChild, "enabled", 1);
+	return pMsg;
+}
+
+static void BenchMessages()
+{
+	Bench("msg_create_destroy", 0, [](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKMsg* pMsg = BuildSmallMessage();
+			g_uSink = (uintptr_t)pMsg;
+			CDKMsgDestroy(pMsg);
+		}
+	});
+
+	// 4 threads building messages at once : allocator contention without the per-thread pools
+	auto buildParallel = [](uint64_t uIterations) {
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++)
+		{
+			threads.emplace_back([uIterations] {
+				for (uint64_t i = 0; i < uIterations / 4; i++)
+					CDKMsgDestroy(BuildSmallMessage());
+			});
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+	};
+	Bench("msg_create_destroy_4threads", 0, buildParallel);
+	uint32_t uPoolSize = CDKMsgGetPoolSize();
+	CDKMsgSetPoolSize(0);
+	Bench("msg_create_destroy_nopool", 0, [](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			CDKMsgDestroy(BuildSmallMessage());
+	});
+	Bench("msg_create_destroy_4threads_nopool", 0, buildParallel);
+	CDKMsgSetPoolSize(uPoolSize);
+
+	CDKMsg* pRead = CDKSimulatorBuildRead(1, 1, 1234, 40 * 1024, 77);
+	std::vector<uint8_t> buffer(1024 * 1024);
+	int32_t iSize = CDKMsgExportToBinaryArray(pRead, buffer.data(), (uint32_t)buffer.size());
+
+	Bench("msg_export_binary_40k", iSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKMsgExportToBinaryArray(pRead, buffer.data(), (uint32_t)buffer.size());
+	});
+
+	Bench("msg_export_size_40k", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = CDKMsgGetExportSize(pRead);
+	});
+
+	Bench("msg_export_buffer_40k", iSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKMsgExportBuffer* pBuffer = CDKMsgExportToBuffer(pRead);
+			g_uSink = (uintptr_t)CDKMsgExportBufferGetData(pBuffer);
+			CDKMsgExportBufferDestroy(pBuffer);
+		}
+	});
+
+	Bench("msg_export_segments_40k", iSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKMsgExportBuffer* pBuffer = CDKMsgExportToSegments(pRead, 0);
+			const CDKMsgSegment* pSegments = nullptr;
+			g_uSink = CDKMsgExportBufferGetSegments(pBuffer, &pSegments);
+			CDKMsgExportBufferDestroy(pBuffer);
+		}
+	});
+
+	Bench("msg_import_binary_40k", iSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKMsg* pMsg = CDKMsgCreate();
+			g_uSink = (uintptr_t)CDKMsgImportFromBinaryArray(pMsg, buffer.data(), (uint32_t)iSize);
+			CDKMsgDestroy(pMsg);
+		}
+	});
+
+	CDKMsg* pSmall = BuildSmallMessage();
+	std::vector<uint8_t> smallBuffer(4096);
+	int32_t iSmallSize = CDKMsgExportToBinaryArray(pSmall, smallBuffer.data(), (uint32_t)smallBuffer.size());
+	Bench("msg_export_binary_small", iSmallSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKMsgExportToBinaryArray(pSmall, smallBuffer.data(), (uint32_t)smallBuffer.size());
+	});
+	Bench("msg_import_binary_small", iSmallSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKMsg* pMsg = CDKMsgCreate();
+			g_uSink = (uintptr_t)CDKMsgImportFromBinaryArray(pMsg, smallBuffer.data(), (uint32_t)iSmallSize);
+			CDKMsgDestroy(pMsg);
+		}
+	});
+	CDKMsgDestroy(pSmall);
+
+	CDKMsgElement* pDecision = CDKMsgElementFirstChild(CDKMsgChild(pRead), "decision");
+	Bench("msg_attribute_value_first", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKMsgElementAttributeValue(pDecision, "plate");
+	});
+	Bench("msg_attribute_value_last", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKMsgElementAttributeValue(pDecision, "TimestampUs");
+	});
+	Bench("msg_attribute_value_missing", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKMsgElementAttributeValue(pDecision, "country");
+	});
+
+	// plate, reliability, lane and timestamp : lookups and text parsing, or one pass with a compiled schema
+	Bench("plate_read_lookup", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKMsgElement* pElement = CDKMsgElementFirstChild(CDKMsgChild(pRead), "decision");
+			const char* strPlate = CDKMsgElementAttributeValue(pElement, "plate");
+			uint32_t uReliability = (uint32_t)strtoul(CDKMsgElementAttributeValue(pElement, "reliability"), nullptr, 10);
+			uint32_t uLane = (uint32_t)strtoul(CDKMsgElementAttributeValue(pElement, "lane"), nullptr, 10);
+			int64_t iTimestamp = strtoll(CDKMsgElementAttributeValue(pElement, "timestampUs"), nullptr, 10);
+			g_uSink = (uintptr_t)strPlate + uReliability + uLane + (uintptr_t)iTimestamp;
+		}
+	});
+	ANPRPlateReadSchema* pSchema = ANPRPlateReadSchemaCreate();
+	for (uint32_t uField = ANPR_PLATE_READ_SENSOR; uField < ANPR_PLATE_READ_FIELDS; uField++)
+	{
+		if (uField != ANPR_PLATE_READ_TIMESTAMP)
+			ANPRPlateReadSchemaSetPath(pSchema, uField, nullptr);
+	}
+	Bench("plate_read_extract", 0, [&](uint64_t uIterations) {
+		ANPRPlateRead read;
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			ANPRPlateReadExtract(pSchema, pRead, &read);
+			g_uSink = (uintptr_t)read.strPlate[0] + read.uReliability + read.uLane + (uintptr_t)read.iTimestampUs;
+		}
+	});
+	ANPRPlateReadSchemaDestroy(pSchema);
+	pSchema = ANPRPlateReadSchemaCreate();
+	Bench("plate_read_extract_all", 0, [&](uint64_t uIterations) {
+		ANPRPlateRead read;
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			ANPRPlateReadExtract(pSchema, pRead, &read);
+			g_uSink = read.uFields;
+		}
+	});
+	ANPRPlateReadSchemaDestroy(pSchema);
+
+	Bench("msg_copy_40k", iSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			CDKMsgDestroy(CDKMsgCopy(pRead));
+	});
+
+	// hand a read to 4 consumers : one copy each, or one shared read-only message
+	Bench("msg_fanout4_copy_40k", iSize, [&](uint64_t uIterations) {
+		CDKMsg* consumers[4];
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			for (CDKMsg*& pConsumer : consumers)
+				pConsumer = CDKMsgCopy(pRead);
+			for (CDKMsg* pConsumer : consumers)
+				CDKMsgDestroy(pConsumer);
+		}
+	});
+	Bench("msg_fanout4_addref_40k", iSize, [&](uint64_t uIterations) {
+		CDKMsg* pShared = CDKMsgCopy(pRead);
+		CDKMsgSetReadOnly(pShared, 1);
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			for (int j = 0; j < 4; j++)
+				CDKMsgAddRef(pShared);
+			for (int j = 0; j < 4; j++)
+				CDKMsgDestroy(pShared);
+		}
+		CDKMsgDestroy(pShared);
+	});
+	CDKMsgDestroy(pRead);
+}
+
+/*!
+	uProducers threads push a message uIterations times in total while uConsumers threads pop them, uBatch at a time
+*/
+static void QueueContention(uint64_t uIterations, uint32_t uProducers, uint32_t uConsumers, uint32_t uBatch, bool bLockFree)
+{
+	CDKQueue* pQueue = bLockFree ? CDKQueueCreateLockFree(1024) : CDKQueueCreate();
+	CDKQueueSetMaxQueueSize(pQueue, 1024);
+	CDKMsg* pMsg = BuildSmallMessage();
+	std::atomic<uint64_t> uPopped{0};
+	std::vector<std::thread> threads;
+	for (uint32_t p = 0; p < uProducers; p++)
+	{
+		threads.emplace_back([&, p] {
+			uint64_t uCount = uIterations / uProducers + (p < uIterations % uProducers ? 1 : 0);
+			for (uint64_t i = 0; i < uCount; i++)
+			{
+				while (CDKQueuePushMessage(pQueue, pMsg) != CDK_OK)
+					std::this_thread::yield();
+			}
+		});
+	}
+	for (uint32_t c = 0; c < uConsumers; c++)
+	{
+		threads.emplace_back([&] {
+			std::vector<CDKMsg*> batch(uBatch);
+			while (uPopped.load(std::memory_order_relaxed) < uIterations)
+			{
+				uint32_t uCount = uBatch > 1 ? CDKQueuePopMessages(pQueue, batch.data(), uBatch) : (CDKQueuePopMessage(pQueue) ? 1 : 0);
+				if (uCount)
+					uPopped.fetch_add(uCount, std::memory_order_relaxed);
+				else
+					CDKQueueWaitForNewMessage(pQueue, 1);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	CDKMsgDestroy(pMsg);
+	CDKQueueDestroy(pQueue);
+}
+
+/*!
+	Reading a journal of 256 reads of 40 KB from 4 sensors, mapped in memory
+*/
+static void BenchJournal()
+{
+	char strDirectory[] = "/tmp/ANPR_BENCH_XXXXXX";
+	if (!mkdtemp(strDirectory))
+		return;
+	ANPRJournalConfig config;
+	ANPRJournalDefaultConfig(&config);
+	config.strDirectory = strDirectory;
+	config.uSyncPolicy = ANPR_JOURNAL_SYNC_NONE;
+	ANPRJournal* pJournal = ANPRJournalCreate(&config);
+	CDKMsg* pRead = CDKSimulatorBuildRead(1, 1, 1234, 40 * 1024, 77);
+	const uint32_t uRecords = 256;
+	for (uint32_t i = 0; i < uRecords; i++)
+		ANPRJournalAppend(pJournal, pRead, i % 4, 1000000 + i, i);
+	ANPRJournalDestroy(pJournal);
+	ANPRJournalReader* pReader = ANPRJournalReaderCreate(strDirectory);
+	ANPRJournalRecord first;
+	ANPRJournalRecord last;
+	ANPRJournalReaderGetRecord(pReader, 0, &first);
+	ANPRJournalReaderGetRecord(pReader, uRecords - 1, &last);
+
+	Bench("journal_import_40k", first.uSize, [&](uint64_t uIterations) {
+		CDKMsg* pMsg = CDKMsgCreate();
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRJournalReaderImport(pReader, i % uRecords, pMsg);
+		CDKMsgDestroy(pMsg);
+	});
+	Bench("journal_seek_appended", 0, [&](uint64_t uIterations) {
+		int64_t iSpan = last.iAppendedUs - first.iAppendedUs + 1;
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRJournalReaderSeekAppended(pReader, first.iAppendedUs + (int64_t)(i * 7919) % iSpan);
+	});
+	Bench("journal_scan_sensor_16", 0, [&](uint64_t uIterations) {
+		auto count = [](const ANPRJournalRecord*, void*) -> int32_t { return 1; };
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRJournalReaderScan(pReader, (uint32_t)i % 4, 1000000 + 64, 1000000 + 127, count, nullptr);
+	});
+
+	ANPRJournalReaderDestroy(pReader);
+	CDKMsgDestroy(pRead);
+	std::error_code error;
+	std::filesystem::remove_all(strDirectory, error);
+}
+
+static void BenchQueuePushPop(const char* strName, CDKQueue* pQueue)
+{
+	CDKMsg* pMsg = BuildSmallMessage();
+	Bench(strName, 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKQueuePushMessage(pQueue, pMsg);
+			g_uSink = (uintptr_t)CDKQueuePopMessage(pQueue);
+		}
+	});
+	CDKMsgDestroy(pMsg);
+	CDKQueueDestroy(pQueue);
+}
+
+static void BenchQueues()
+{
+	BenchQueuePushPop("queue_push_pop_single_thread", CDKQueueCreate());
+	BenchQueuePushPop("queue_lockfree_push_pop_single_thread", CDKQueueCreateLockFree(128));
+	// every pop empties the queue, and resets the ready fd
+	CDKQueue* pReadyQueue = CDKQueueCreate();
+	CDKQueueGetReadyFd(pReadyQueue);
+	BenchQueuePushPop("queue_ready_fd_push_pop_single_thread", pReadyQueue);
+
+	CDKQueue* pQueue = CDKQueueCreate();
+	CDKMsg* pMsg = BuildSmallMessage();
+	std::vector<CDKMsg*> batch(64);
+	Bench("queue_push64_pop_batch64_single_thread", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i += 64)
+		{
+			for (int j = 0; j < 64; j++)
+				CDKQueuePushMessage(pQueue, pMsg);
+			g_uSink = CDKQueuePopMessages(pQueue, batch.data(), 64);
+		}
+	});
+	CDKMsgDestroy(pMsg);
+	CDKQueueDestroy(pQueue);
+
+	Bench("queue_push_pop_1p_1c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 1, 1, 1, false); });
+	Bench("queue_push_pop_4p_1c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 4, 1, 1, false); });
+	Bench("queue_push_pop_8p_2c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 8, 2, 1, false); });
+	Bench("queue_push_pop_batch64_4p_1c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 4, 1, 64, false); });
+	Bench("queue_push_pop_batch64_8p_2c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 8, 2, 64, false); });
+	Bench("queue_lockfree_push_pop_1p_1c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 1, 1, 1, true); });
+	Bench("queue_lockfree_push_pop_4p_1c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 4, 1, 1, true); });
+	Bench("queue_lockfree_push_pop_8p_2c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 8, 2, 1, true); });
+	Bench("queue_lockfree_push_pop_batch64_8p_2c", 0, [](uint64_t uIterations) { QueueContention(uIterations, 8, 2, 64, true); });
+}
+
+static void BenchSignatures()
+{
+	CDKMsg* pRead1 = CDKSimulatorBuildRead(0, 0, 1, 0, 1);
+	CDKMsg* pRead2 = CDKSimulatorBuildRead(0, 1, 1, 0, 2);
+	CDKMsg* pRead3 = CDKSimulatorBuildRead(0, 2, 2, 0, 3);
+	CDKMsgElement* pSig1 = CDKMsgElementFirstChild(CDKMsgChild(pRead1), "signature");
+	CDKMsgElement* pSig2 = CDKMsgElementFirstChild(CDKMsgChild(pRead2), "signature");
+	CDKMsgElement* pSig3 = CDKMsgElementFirstChild(CDKMsgChild(pRead3), "signature");
+
+	Bench("signature_create_destroy", CDKMsgElementContentSize(pSig1), [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			CDKSignatureDestroy(CDKSignatureCreate(CDKMsgElementContent(pSig1), CDKMsgElementContentSize(pSig1)));
+	});
+
+	CDKSignature* pSame1 = CDKSignatureCreate(CDKMsgElementContent(pSig1), CDKMsgElementContentSize(pSig1));
+	CDKSignature* pSame2 = CDKSignatureCreate(CDKMsgElementContent(pSig2), CDKMsgElementContentSize(pSig2));
+	CDKSignature* pOther = CDKSignatureCreate(CDKMsgElementContent(pSig3), CDKMsgElementContentSize(pSig3));
+	Bench("signature_compare_same_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKSignatureCompare(pSame1, pSame2);
+	});
+	Bench("signature_compare_other_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKSignatureCompare(pSame1, pOther);
+	});
+	Bench("signature_compare_ex7_same_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKSignatureCompareEx(pSame1, pSame2, 7);
+	});
+	Bench("signature_compare_ex7_other_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKSignatureCompareEx(pSame1, pOther, 7);
+	});
+	CDKSignatureDestroy(pSame1);
+	CDKSignatureDestroy(pSame2);
+	CDKSignatureDestroy(pOther);
+
+	// the same buffers compared again : parsed every time, or once through the cache
+	Bench("signature_create_compare_same_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			CDKSignature* p1 = CDKSignatureCreate(CDKMsgElementContent(pSig1), CDKMsgElementContentSize(pSig1));
+			CDKSignature* p2 = CDKSignatureCreate(CDKMsgElementContent(pSig2), CDKMsgElementContentSize(pSig2));
+			g_uSink = (uintptr_t)CDKSignatureCompare(p1, p2);
+			CDKSignatureDestroy(p1);
+			CDKSignatureDestroy(p2);
+		}
+	});
+	ANPRSignatureCache* pCache = ANPRSignatureCacheCreate(nullptr);
+	Bench("signature_cache_compare_same_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRSignatureCacheCompare(pCache, CDKMsgElementContent(pSig1), CDKMsgElementContentSize(pSig1),
+				CDKMsgElementContent(pSig2), CDKMsgElementContentSize(pSig2), 0);
+	});
+	ANPRSignatureCacheDestroy(pCache);
+
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherStart(pMatcher);
+	CDKMsgElement* pFp1 = CDKMsgElementFirstChild(CDKMsgChild(pRead1), "fingerprint");
+	CDKMsgElement* pFp2 = CDKMsgElementFirstChild(CDKMsgChild(pRead2), "fingerprint");
+	CDKMsgElement* pFp3 = CDKMsgElementFirstChild(CDKMsgChild(pRead3), "fingerprint");
+	Bench("fingerprint_match_same_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKPlateFingerprintMatch(pMatcher, CDKMsgElementContent(pFp1), CDKMsgElementContentSize(pFp1),
+				CDKMsgElementContent(pFp2), CDKMsgElementContentSize(pFp2));
+	});
+	Bench("fingerprint_match_other_vehicle", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)CDKPlateFingerprintMatch(pMatcher, CDKMsgElementContent(pFp1), CDKMsgElementContentSize(pFp1),
+				CDKMsgElementContent(pFp3), CDKMsgElementContentSize(pFp3));
+	});
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+
+	CDKMsgDestroy(pRead1);
+	CDKMsgDestroy(pRead2);
+	CDKMsgDestroy(pRead3);
+}
+
+/*!
+	Adds the signatures of uVehicles vehicles seen uReads times each to a signature index, one read every 10 ms
+*/
+static void FillSignatureIndex(ANPRSignatureIndex* pIndex, uint32_t uVehicles, uint32_t uReads)
+{
+	for (uint32_t uRead = 0; uRead < uReads; uRead++)
+		for (uint32_t uVehicle = 0; uVehicle < uVehicles; uVehicle++)
+		{
+			uint64_t uSeq = (uint64_t)uRead * uVehicles + uVehicle;
+			CDKMsg* pRead = CDKSimulatorBuildRead(0, uSeq, uVehicle, 0, (uint32_t)uSeq);
+			CDKMsgElement* pSig = CDKMsgElementFirstChild(CDKMsgChild(pRead), "signature");
+			ANPRSignatureIndexInsert(pIndex, CDKMsgElementContent(pSig), CDKMsgElementContentSize(pSig), uSeq, (int64_t)uSeq * 10000);
+			CDKMsgDestroy(pRead);
+		}
+}
+
+static void BenchSignatureIndex()
+{
+	// 100k live signatures : 10k vehicles seen 10 times
+	const uint32_t uVehicles = 10000;
+	ANPRSignatureIndex* pIndex = ANPRSignatureIndexCreate(nullptr);
+	ANPRSignatureIndexConfig serialConfig;
+	ANPRSignatureIndexDefaultConfig(&serialConfig);
+	serialConfig.uThreads = 1;
+	ANPRSignatureIndex* pSerial = ANPRSignatureIndexCreate(&serialConfig);
+	FillSignatureIndex(pIndex, uVehicles, 10);
+	FillSignatureIndex(pSerial, uVehicles, 10);
+
+	// a vehicle of the index, and a vehicle never seen
+	CDKMsg* pKnown = CDKSimulatorBuildRead(1, 0, 1234, 0, 4321);
+	CDKMsg* pUnknown = CDKSimulatorBuildRead(1, 0, uVehicles + 1, 0, 4321);
+	CDKMsgElement* pKnownSig = CDKMsgElementFirstChild(CDKMsgChild(pKnown), "signature");
+	CDKMsgElement* pUnknownSig = CDKMsgElementFirstChild(CDKMsgChild(pUnknown), "signature");
+	CDKSignature* pKnownSignature = CDKSignatureCreate(CDKMsgElementContent(pKnownSig), CDKMsgElementContentSize(pKnownSig));
+	CDKSignature* pUnknownSignature = CDKSignatureCreate(CDKMsgElementContent(pUnknownSig), CDKMsgElementContentSize(pUnknownSig));
+	ANPRSignatureMatch matches[10];
+
+	Bench("signature_index_query_100k_top10", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRSignatureIndexQuery(pIndex, pKnownSignature, 10, 5, 0, 0, matches);
+	});
+	Bench("signature_index_query_100k_top10_unknown", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRSignatureIndexQuery(pIndex, pUnknownSignature, 10, 5, 0, 0, matches);
+	});
+	Bench("signature_index_query_100k_top10_1thread", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRSignatureIndexQuery(pSerial, pKnownSignature, 10, 5, 0, 0, matches);
+	});
+	Bench("signature_index_query_100k_last_minute", 0, [&](uint64_t uIterations) {
+		// the last 6000 reads
+		int64_t iToUs = (int64_t)uVehicles * 10 * 10000;
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRSignatureIndexQuery(pIndex, pKnownSignature, 10, 5, iToUs - 60000000, iToUs, matches);
+	});
+	ANPRSignatureIndexDestroy(pSerial);
+	ANPRSignatureIndexDestroy(pIndex);
+
+	// insertion into a full window : every insertion expires the oldest signature
+	ANPRSignatureIndexConfig windowConfig;
+	ANPRSignatureIndexDefaultConfig(&windowConfig);
+	windowConfig.iWindowUs = 1000000;
+	ANPRSignatureIndex* pWindow = ANPRSignatureIndexCreate(&windowConfig);
+	const uint8_t* pBuffer = CDKMsgElementContent(pKnownSig);
+	uint32_t uSize = CDKMsgElementContentSize(pKnownSig);
+	uint64_t uSeq = 0;
+	Bench("signature_index_insert_windowed", uSize, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++, uSeq++)
+			ANPRSignatureIndexInsert(pWindow, pBuffer, uSize, uSeq, (int64_t)uSeq * 100);
+	});
+	ANPRSignatureIndexDestroy(pWindow);
+
+	CDKSignatureDestroy(pKnownSignature);
+	CDKSignatureDestroy(pUnknownSignature);
+	CDKMsgDestroy(pKnown);
+	CDKMsgDestroy(pUnknown);
+}
+
+static int32_t SaveDictionary(CDKPlateFingerprintMatcher*, const uint8_t* pBuffer, uint32_t uSize, void* pUser)
+{
+	static_cast<std::vector<uint8_t>*>(pUser)->assign(pBuffer, pBuffer + uSize);
+	return 1;
+}
+
+static void BenchFingerprintPool()
+{
+	// a toll plaza : 64 exit reads matched against the 1024 entry reads
+	const uint32_t uEntries = 1024;
+	const uint32_t uExits = 64;
+	std::vector<CDKMsg*> reads;
+	std::vector<ANPRFingerprint> entries;
+	std::vector<ANPRFingerprint> exits;
+	for (uint32_t i = 0; i < uEntries + uExits; i++)
+	{
+		bool bExit = i >= uEntries;
+		CDKMsg* pRead = CDKSimulatorBuildRead(bExit ? 1 : 0, i, bExit ? (i - uEntries) * 16 : i, 0, i);
+		CDKMsgElement* pFp = CDKMsgElementFirstChild(CDKMsgChild(pRead), "fingerprint");
+		(bExit ? exits : entries).push_back({ CDKMsgElementContent(pFp), CDKMsgElementContentSize(pFp) });
+		reads.push_back(pRead);
+	}
+
+	// the dictionary learnt by a first matcher, given to every matcher of the pool
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pMatcher, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pMatcher);
+	for (uint32_t i = 0; dictionary.empty() && i < uEntries * uExits; i++)
+		CDKPlateFingerprintMatch(pMatcher, exits[i % uExits].pBuffer, exits[i % uExits].uSize, entries[i / uExits].pBuffer, entries[i / uExits].uSize);
+
+	std::vector<int8_t> matrix(uEntries * uExits);
+	Bench("fingerprint_batch_64x1024_one_matcher", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			for (uint32_t uRow = 0; uRow < uExits; uRow++)
+				for (uint32_t uColumn = 0; uColumn < uEntries; uColumn++)
+					matrix[uRow * uEntries + uColumn] = (int8_t)CDKPlateFingerprintMatch(pMatcher, exits[uRow].pBuffer, exits[uRow].uSize,
+						entries[uColumn].pBuffer, entries[uColumn].uSize);
+	});
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+
+	ANPRFingerprintPool* pPool = ANPRFingerprintPoolCreate(nullptr, dictionary.data(), (uint32_t)dictionary.size());
+	Bench("fingerprint_batch_64x1024_pool_matrix", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRFingerprintPoolMatchMatrix(pPool, exits.data(), uExits, entries.data(), uEntries, matrix.data());
+	});
+	std::vector<ANPRFingerprintPair> pairs(uExits * 4);
+	Bench("fingerprint_batch_64x1024_pool_list", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRFingerprintPoolMatchList(pPool, exits.data(), uExits, entries.data(), uEntries, pairs.data(), pairs.size());
+	});
+	ANPRFingerprintPoolDestroy(pPool);
+
+	for (CDKMsg* pRead : reads)
+		CDKMsgDestroy(pRead);
+}
+
+static void BenchCandidateFilter()
+{
+	// 20k entry reads, one every 10 ms, and exit reads of some of these vehicles 10 s later
+	const uint32_t uEntries = 20000;
+	const uint32_t uExits = 64;
+	std::vector<CDKMsg*> messages;
+	std::vector<ANPRCandidateRead> entries;
+	std::vector<ANPRCandidateRead> exits;
+	for (uint32_t i = 0; i < uEntries + uExits; i++)
+	{
+		bool bExit = i >= uEntries;
+		uint32_t uVehicle = bExit ? (i - uEntries) * (uEntries / uExits) : i;
+		CDKMsg* pRead = CDKSimulatorBuildRead(bExit ? 1 : 0, i, uVehicle, 0, i);
+		CDKMsgElement* pFp = CDKMsgElementFirstChild(CDKMsgChild(pRead), "fingerprint");
+		int64_t iTimestampUs = (int64_t)uVehicle * 10000 + (bExit ? 10000000 : 0);
+		(bExit ? exits : entries).push_back({ i, iTimestampUs, bExit ? 1u : 0u, CDKMsgElementContent(pFp), CDKMsgElementContentSize(pFp) });
+		messages.push_back(pRead);
+	}
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pLearner, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	for (uint32_t i = 0; dictionary.empty() && i < uEntries; i++)
+		CDKPlateFingerprintMatch(pLearner, exits[i % uExits].pBuffer, exits[i % uExits].uSize, entries[i].pBuffer, entries[i].uSize);
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), (uint32_t)dictionary.size());
+	CDKPlateFingerprintMatcherStart(pMatcher);
+
+	ANPRCandidateFilter* pFilter = ANPRCandidateFilterCreate(nullptr);
+	ANPRCandidateFilterAddRoute(pFilter, 0, 1);
+	for (const ANPRCandidateRead& entry : entries)
+		ANPRCandidateFilterInsert(pFilter, &entry);
+	ANPRCandidateFilterMetrics metrics;
+	if (ANPRCandidateFilterCalibrate(pFilter, pMatcher, exits.data(), uExits, 0.99, &metrics) == CDK_OK)
+		fprintf(stderr, "candidate filter: min_shared_grams=%u recall=%.4f precision=%.4f reduction=%.4f (%llu candidates for %llu pairs)\n",
+			metrics.uMinSharedGrams, metrics.dRecall, metrics.dPrecision, metrics.dReduction,
+			(unsigned long long)metrics.uCandidates, (unsigned long long)metrics.uPairs);
+
+	std::vector<ANPRCandidate> candidates(64);
+	Bench("candidate_filter_query_20k", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRCandidateFilterQuery(pFilter, &exits[i % uExits], candidates.data(), candidates.size());
+	});
+	Bench("candidate_filter_query_match_20k", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			const ANPRCandidateRead& exit = exits[i % uExits];
+			int64_t iCount = ANPRCandidateFilterQuery(pFilter, &exit, candidates.data(), candidates.size());
+			for (int64_t j = 0; j < std::min<int64_t>(iCount, (int64_t)candidates.size()); j++)
+				g_uSink = (uintptr_t)CDKPlateFingerprintMatch(pMatcher, exit.pBuffer, exit.uSize, candidates[j].read.pBuffer, candidates[j].read.uSize);
+		}
+	});
+	ANPRCandidateFilterDestroy(pFilter);
+
+	ANPRCandidateFilter* pWindow = ANPRCandidateFilterCreate(nullptr);
+	uint64_t uInserted = 0;
+	Bench("candidate_filter_insert_expire", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++, uInserted++)
+		{
+			ANPRCandidateRead entry = entries[uInserted % uEntries];
+			entry.iTimestampUs = (int64_t)uInserted * 10000;
+			ANPRCandidateFilterInsert(pWindow, &entry);
+			// 20k reads kept
+			if (uInserted % 1024 == 0)
+				ANPRCandidateFilterExpire(pWindow, entry.iTimestampUs - (int64_t)uEntries * 10000);
+		}
+	});
+	ANPRCandidateFilterDestroy(pWindow);
+
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+	for (CDKMsg* pRead : messages)
+		CDKMsgDestroy(pRead);
+}
+
+static void BenchDictionaryStore()
+{
+	char strDirectory[] = "/tmp/ANPR_BENCH_XXXXXX";
+	if (!mkdtemp(strDirectory))
+		return;
+	std::string strPath = std::string(strDirectory) + "/dictionaries";
+
+	// a dictionary learnt on a first site, and saved by its matcher
+	ANPRDictionaryStore* pStore = ANPRDictionaryStoreOpen(strPath.c_str());
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	ANPRDictionaryStoreAttachMatcher(pStore, "plaza-north", pLearner);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	CDKMsg* pRead1 = CDKSimulatorBuildRead(0, 0, 1, 0, 1);
+	CDKMsg* pRead2 = CDKSimulatorBuildRead(0, 1, 2, 0, 2);
+	CDKMsgElement* pFp1 = CDKMsgElementFirstChild(CDKMsgChild(pRead1), "fingerprint");
+	CDKMsgElement* pFp2 = CDKMsgElementFirstChild(CDKMsgChild(pRead2), "fingerprint");
+	for (int i = 0; i < 1024; i++)
+		CDKPlateFingerprintMatch(pLearner, CDKMsgElementContent(pFp1), CDKMsgElementContentSize(pFp1), CDKMsgElementContent(pFp2), CDKMsgElementContentSize(pFp2));
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	ANPRDictionaryStoreClose(pStore);
+
+	// cold start of a matcher : store mapped, dictionary given, matcher started
+	Bench("dictionary_store_cold_start", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			ANPRDictionaryStore* pColdStore = ANPRDictionaryStoreOpen(strPath.c_str());
+			CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+			g_uSink = (uintptr_t)ANPRDictionaryStoreAttachMatcher(pColdStore, "plaza-north", pMatcher);
+			CDKPlateFingerprintMatcherStart(pMatcher);
+			CDKPlateFingerprintMatcherDestroy(pMatcher);
+			ANPRDictionaryStoreClose(pColdStore);
+		}
+	});
+	pStore = ANPRDictionaryStoreOpen(strPath.c_str());
+	uint8_t dictionary[64];
+	uint32_t uSize;
+	Bench("dictionary_store_get", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			g_uSink = (uintptr_t)ANPRDictionaryStoreGet(pStore, "plaza-north", dictionary, sizeof(dictionary), &uSize, nullptr);
+	});
+	ANPRDictionaryStoreClose(pStore);
+
+	CDKMsgDestroy(pRead1);
+	CDKMsgDestroy(pRead2);
+	std::error_code error;
+	std::filesystem::remove_all(strDirectory, error);
+}
+
+static void OnPassage(CDKMsg* pMsg, const ANPRDedupPassage*, void*)
+{
+	CDKMsgDestroy(pMsg);
+}
+
+static void BenchDedup()
+{
+	// a vehicle every 100 ms, read 1 to 3 times 150 ms apart on two adjacent lanes, one read out of 5 of the
+	// third ones missing a character
+	const uint32_t uVehicles = 4096;
+	const int64_t iVehicleUs = 100000;
+	std::vector<CDKMsg*> messages;
+	std::vector<ANPRPlateRead> reads;
+	ANPRPlateReadSchema* pSchema = ANPRPlateReadSchemaCreate();
+	for (uint32_t uVehicle = 0; uVehicle < uVehicles; uVehicle++)
+	{
+		for (uint32_t k = 0; k <= uVehicle % 3; k++)
+		{
+			uint32_t uSeq = (uint32_t)messages.size();
+			CDKMsg* pRead = CDKSimulatorBuildRead(uVehicle % 4, uSeq, uVehicle, 0, uSeq);
+			CDKMsgSetReadOnly(pRead, 1);
+			ANPRPlateRead read;
+			ANPRPlateReadExtract(pSchema, pRead, &read);
+			read.iTimestampUs = (int64_t)uVehicle * iVehicleUs + k * 150000;
+			read.uLane = 1 + uVehicle % 4 + k % 2;
+			if (k == 2 && uVehicle % 5 == 0)
+				memmove(read.strPlate + 4, read.strPlate + 5, strlen(read.strPlate + 5) + 1);
+			messages.push_back(pRead);
+			reads.push_back(read);
+		}
+	}
+
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pLearner, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	for (size_t i = 1; dictionary.empty() && i < reads.size(); i++)
+		CDKPlateFingerprintMatch(pLearner, reads[i - 1].pFingerprint, reads[i - 1].uFingerprintSize, reads[i].pFingerprint, reads[i].uFingerprintSize);
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), (uint32_t)dictionary.size());
+	CDKPlateFingerprintMatcherStart(pMatcher);
+
+	ANPRDedup* pDedup = ANPRDedupCreate(nullptr, pSchema, pMatcher, OnPassage, nullptr);
+	uint64_t uPushed = 0;
+	Bench("dedup_push", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++, uPushed++)
+		{
+			ANPRPlateRead read = reads[uPushed % reads.size()];
+			read.iTimestampUs += (int64_t)(uPushed / reads.size()) * uVehicles * iVehicleUs;
+			CDKMsg* pRead = messages[uPushed % reads.size()];
+			CDKMsgAddRef(pRead);
+			g_uSink = (uintptr_t)ANPRDedupPush(pDedup, pRead, &read);
+		}
+	});
+	ANPRDedupFlush(pDedup, INT64_MAX);
+	ANPRDedupStats stats;
+	ANPRDedupGetStats(pDedup, &stats);
+	fprintf(stderr, "dedup: %llu reads, %llu passages, ratio=%.4f (expected %.4f), %llu confirmed by %llu comparisons, latency avg=%llu us max=%llu us\n",
+		(unsigned long long)stats.uReads, (unsigned long long)stats.uPassages, stats.dDedupRatio,
+		1 - (double)uVehicles / (double)reads.size(), (unsigned long long)stats.uConfirmed, (unsigned long long)stats.uComparisons,
+		(unsigned long long)stats.uLatencyAvgUs, (unsigned long long)stats.uLatencyMaxUs);
+	ANPRDedupDestroy(pDedup);
+
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+	ANPRPlateReadSchemaDestroy(pSchema);
+	for (CDKMsg* pRead : messages)
+		CDKMsgDestroy(pRead);
+}
+
+struct SectionJoinBench
+{
+	uint64_t uMatches = 0;
+	uint64_t uWrong = 0;
+};
+
+static void OnSectionMatch(const ANPRSectionMatch* pMatch, void* pUser)
+{
+	SectionJoinBench* pBench = (SectionJoinBench*)pUser;
+	pBench->uMatches++;
+	if (pMatch->uEntryId != (pMatch->uExitId & 0xFFFFFFFF))
+		pBench->uWrong++;
+}
+
+static void BenchSectionJoin()
+{
+	// a 5 km section : a vehicle enters every 10 ms and drives at 80 to 140 km/h, one exit read out of 20 misses a character
+	const uint32_t uVehicles = 20000;
+	const int64_t iVehicleUs = 10000;
+	const double dLengthM = 5000;
+	struct TimedRead
+	{
+		ANPRPlateRead read;
+		uint64_t uId;
+	};
+	std::vector<CDKMsg*> messages;
+	std::vector<TimedRead> reads;
+	ANPRPlateReadSchema* pSchema = ANPRPlateReadSchemaCreate();
+	for (uint32_t uVehicle = 0; uVehicle < uVehicles; uVehicle++)
+	{
+		double dSpeedKmh = 80 + (double)(uVehicle * 7919 % 61);
+		for (uint32_t uSensor = 0; uSensor < 2; uSensor++)
+		{
+			CDKMsg* pRead = CDKSimulatorBuildRead(uSensor, uVehicle, uVehicle, 0, uVehicle * 2 + uSensor);
+			TimedRead timed;
+			ANPRPlateReadExtract(pSchema, pRead, &timed.read);
+			timed.read.iTimestampUs = (int64_t)uVehicle * iVehicleUs + (uSensor ? (int64_t)(dLengthM / (dSpeedKmh / 3.6) * 1e6) : 0);
+			timed.uId = uVehicle | ((uint64_t)uSensor << 32);
+			if (uSensor && uVehicle % 20 == 0)
+				memmove(timed.read.strPlate + 4, timed.read.strPlate + 5, strlen(timed.read.strPlate + 5) + 1);
+			messages.push_back(pRead);
+			reads.push_back(timed);
+		}
+	}
+	std::sort(reads.begin(), reads.end(), [](const TimedRead& a, const TimedRead& b) { return a.read.iTimestampUs < b.read.iTimestampUs; });
+	int64_t iPeriodUs = reads.back().read.iTimestampUs + 1000000;
+
+	std::vector<uint8_t> dictionary;
+	CDKPlateFingerprintMatcher* pLearner = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetSaveDictionaryCallback(pLearner, SaveDictionary, &dictionary);
+	CDKPlateFingerprintMatcherStart(pLearner);
+	for (size_t i = 1; dictionary.empty() && i < reads.size(); i++)
+		CDKPlateFingerprintMatch(pLearner, reads[i - 1].read.pFingerprint, reads[i - 1].read.uFingerprintSize, reads[i].read.pFingerprint, reads[i].read.uFingerprintSize);
+	CDKPlateFingerprintMatcherDestroy(pLearner);
+	CDKPlateFingerprintMatcher* pMatcher = CDKPlateFingerprintMatcherCreate();
+	CDKPlateFingerprintMatcherSetDictionary(pMatcher, dictionary.data(), (uint32_t)dictionary.size());
+	CDKPlateFingerprintMatcherStart(pMatcher);
+
+	SectionJoinBench bench;
+	ANPRSectionJoin* pJoin = ANPRSectionJoinCreate(nullptr, pMatcher, OnSectionMatch, &bench);
+	ANPRSectionJoinAddSection(pJoin, 0, 1, dLengthM, 130);
+	uint64_t uPushed = 0;
+	Bench("section_join_push", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++, uPushed++)
+		{
+			const TimedRead& timed = reads[uPushed % reads.size()];
+			ANPRPlateRead read = timed.read;
+			read.iTimestampUs += (int64_t)(uPushed / reads.size()) * iPeriodUs;
+			g_uSink = (uintptr_t)ANPRSectionJoinPush(pJoin, &read, timed.uId);
+		}
+	});
+	ANPRSectionJoinStats stats;
+	ANPRSectionJoinGetStats(pJoin, &stats);
+	fprintf(stderr, "section join: %llu exits, %llu joined (%llu text, %llu fingerprint), %llu wrong, %llu over limit, exit avg=%llu ns max=%llu ns\n",
+		(unsigned long long)stats.uExits, (unsigned long long)bench.uMatches, (unsigned long long)stats.uTextMatches,
+		(unsigned long long)stats.uFingerprintMatches, (unsigned long long)bench.uWrong, (unsigned long long)stats.uOverLimit,
+		(unsigned long long)stats.uExitAvgNs, (unsigned long long)stats.uExitMaxNs);
+	ANPRSectionJoinDestroy(pJoin);
+
+	CDKPlateFingerprintMatcherDestroy(pMatcher);
+	ANPRPlateReadSchemaDestroy(pSchema);
+	for (CDKMsg* pRead : messages)
+		CDKMsgDestroy(pRead);
+}
+
+static void BenchHotList()
+{
+	char strDirectory[] = "/tmp/ANPR_BENCH_XXXXXX";
+	if (!mkdtemp(strDirectory))
+		return;
+	std::string strPath = std::string(strDirectory) + "/hotlist";
+
+	// the plates of the even vehicles of 2M on a list, read by the sensors with their OCR confusions
+	const uint32_t uListed = 1000000;
+	const uint32_t uReads = 4096;
+	std::vector<std::array<char, 16>> plates(uListed);
+	std::vector<ANPRHotListEntry> entries(uListed);
+	for (uint32_t i = 0; i < uListed; i++)
+	{
+		CDKSimulatorVehiclePlate(i * 2, plates[i].data());
+		entries[i] = { plates[i].data(), 1 + i % 3, i * 2 };
+	}
+	auto start = std::chrono::steady_clock::now();
+	if (ANPRHotListBuild(strPath.c_str(), entries.data(), uListed, 1) != CDK_OK)
+	{
+		fprintf(stderr, "hot-list: %s\n", CDKGetLastError(nullptr));
+		return;
+	}
+	double dBuildS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	ANPRHotList* pHotList = ANPRHotListOpen(strPath.c_str());
+
+	std::vector<ANPRPlateRead> reads(uReads);
+	ANPRPlateReadSchema* pSchema = ANPRPlateReadSchemaCreate();
+	for (uint32_t i = 0; i < uReads; i++)
+	{
+		CDKMsg* pRead = CDKSimulatorBuildRead(0, i, (i * 7919) % (uListed * 2), 0, i);
+		ANPRPlateReadExtract(pSchema, pRead, &reads[i]);
+		CDKMsgDestroy(pRead);
+	}
+	ANPRPlateReadSchemaDestroy(pSchema);
+
+	ANPRHotListMatch matches[8];
+	for (uint32_t uDistance = 0; uDistance <= 1; uDistance++)
+	{
+		uint64_t uLookups = 0;
+		Bench(uDistance ? "hotlist_lookup" : "hotlist_lookup_exact", 0, [&](uint64_t uIterations) {
+			for (uint64_t i = 0; i < uIterations; i++, uLookups++)
+				g_uSink = (uintptr_t)ANPRHotListLookup(pHotList, reads[uLookups % uReads].strPlate, uDistance, matches, 8);
+		});
+		uint32_t uHits = 0;
+		uint32_t uMissed = 0;
+		uint32_t uWrong = 0;
+		for (uint32_t i = 0; i < uReads; i++)
+		{
+			uint32_t uVehicle = (i * 7919) % (uListed * 2);
+			int32_t iMatches = ANPRHotListLookup(pHotList, reads[i].strPlate, uDistance, matches, 8);
+			bool bFound = false;
+			for (int32_t m = 0; m < iMatches; m++)
+				bFound = bFound || matches[m].uTag == uVehicle;
+			uHits += bFound;
+			uMissed += uVehicle % 2 == 0 && !bFound;
+			uWrong += iMatches > (int32_t)bFound;
+		}
+		fprintf(stderr, "hot-list distance %u: %u reads, %u listed found, %u listed missed, %u reads with other matches\n",
+			uDistance, uReads, uHits, uMissed, uWrong);
+	}
+	ANPRHotListInfo info;
+	ANPRHotListGetInfo(pHotList, &info);
+	fprintf(stderr, "hot-list: %u plates, %u keys, %llu MB, built in %.2f s\n", info.uEntries, info.uKeys,
+		(unsigned long long)(info.uBytes >> 20), dBuildS);
+	ANPRHotListClose(pHotList);
+
+	std::error_code error;
+	std::filesystem::remove_all(strDirectory, error);
+}
+
+static void OnTraceLines(const ANPRTraceLine*, uint32_t uLines, void* pUser)
+{
+	*(uint64_t*)pUser += uLines;
+}
+
+static void BenchTraceSink()
+{
+	// a DEBUG trace of the network threads, written synchronously to a file, then through the sink
+	int iFd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	Bench("trace_sync_write", 0, [&](uint64_t uIterations) {
+		char strTrace[512];
+		for (uint64_t i = 0; i < uIterations; i++)
+		{
+			int iLength = snprintf(strTrace, sizeof(strTrace), "%s:%u request %u timeout", "192.168.1.20", 10001, (uint32_t)i);
+			g_uSink = (uintptr_t)write(iFd, strTrace, (size_t)iLength);
+		}
+	});
+	close(iFd);
+
+	ANPRTraceSinkConfig config;
+	ANPRTraceSinkDefaultConfig(&config);
+	config.uLevel = 8;
+	config.uMaxLinesPerSecond = 0;
+	uint64_t uWritten = 0;
+	ANPRTraceSink* pSink = ANPRTraceSinkCreate(&config, OnTraceLines, &uWritten);
+	Bench("trace_sink_write", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			ANPRTraceSinkWrite(pSink, 8, "%s:%u request %u timeout", "192.168.1.20", 10001, (uint32_t)i);
+	});
+	ANPRTraceSinkSetLevel(pSink, 6);
+	Bench("trace_sink_filtered", 0, [&](uint64_t uIterations) {
+		for (uint64_t i = 0; i < uIterations; i++)
+			ANPRTraceSinkWrite(pSink, 8, "%s:%u request %u timeout", "192.168.1.20", 10001, (uint32_t)i);
+	});
+	ANPRTraceSinkStats stats;
+	ANPRTraceSinkGetStats(pSink, &stats);
+	ANPRTraceSinkDestroy(pSink);
+	fprintf(stderr, "trace sink: %llu lines, %llu dropped (ring full), %llu batches, %llu written\n",
+		(unsigned long long)stats.uLines, (unsigned long long)stats.uDroppedFull, (unsigned long long)stats.uBatches,
+		(unsigned long long)uWritten);
+}
+
+int main(int argc, char** argv)
+{
+	const char* strOut = nullptr;
+	static const struct option options[] = {
+		{ "filter", required_argument, nullptr, 'f' },
+		{ "repetitions", required_argument, nullptr, 'r' },
+		{ "min-time", required_argument, nullptr, 't' },
+		{ "out", required_argument, nullptr, 'o' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+	int iOption;
+	while ((iOption = getopt_long(argc, argv, "f:r:t:o:h", options, nullptr)) != -1)
+	{
+		switch (iOption)
+		{
+		case 'f': g_options.strFilter = optarg; break;
+		case 'r': g_options.uRepetitions = (uint32_t)std::max(1, atoi(optarg)); break;
+		case 't': g_options.dMinTime = atof(optarg); break;
+		case 'o': strOut = optarg; break;
+		default:
+			printf("usage: ANPR_BENCH [--filter substring] [--repetitions N] [--min-time seconds] [--out file.json]\n");
+			return iOption == 'h' ? 0 : 1;
+		}
+	}
+
+	BenchMessages();
+	BenchJournal();
+	BenchQueues();
+	BenchSignatures();
+	BenchSignatureIndex();
+	BenchFingerprintPool();
+	BenchCandidateFilter();
+	BenchDictionaryStore();
+	BenchDedup();
+	BenchSectionJoin();
+	BenchHotList();
+	BenchTraceSink();
+
+	FILE* pFile = strOut ? fopen(strOut, "w") : stdout;
+	if (!pFile)
+	{
+		fprintf(stderr, "cannot open %s\n", strOut);
+		return 1;
+	}
+	WriteJson(pFile);
+	if (pFile != stdout)
+		fclose(pFile);
+	return 0;
+}
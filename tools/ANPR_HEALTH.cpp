@@ -0,0 +1,158 @@
+/*
+	ANPR_HEALTH : health polling of a fleet of sensors from a single thread, with the C++20 coroutine façade (CDKCoro.h).
+
+	Every sensor has two coroutines : one sends a status request every --interval ms and waits for its answer,
+	the other consumes the plate reads. They are all driven by one executor, whatever the number of sensors.
+
+	ANPR_HEALTH --sensors 500 --interval 200 --duration 10
+		runs against simulated sensors on loopback (ANPR_SIM)
+*/
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "CDKCoro.h"
+#include "CDKSimulator.h"
+
+struct HealthStats
+{
+	uint64_t uAnswers = 0;
+	uint64_t uFailures = 0;
+	uint64_t uReads = 0;
+	double dTotalLatencyMs = 0;
+	double dMaxLatencyMs = 0;
+};
+
+static cdk::Task<> PollStatus(cdk::Executor& executor, cdk::Client& client, uint32_t uIntervalMs, HealthStats& stats)
+{
+	cdk::Msg request(CDKMsgCreate());
+	CDKMsgSetChild(request.get(), CDKMsgElementCreate("getCurrentStatus"));
+	for (;;)
+	{
+		auto start = std::chrono::steady_clock::now();
+		cdk::Msg answer = co_await client.request(request.get(), 2000);
+		double dLatencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (answer)
+		{
+			stats.uAnswers++;
+			stats.dTotalLatencyMs += dLatencyMs;
+			stats.dMaxLatencyMs = std::max(stats.dMaxLatencyMs, dLatencyMs);
+		}
+		else
+			stats.uFailures++;
+		co_await executor.sleep_for(std::chrono::milliseconds(uIntervalMs));
+	}
+}
+
+static cdk::Task<> ConsumeReads(cdk::Client& client, HealthStats& stats)
+{
+	for (;;)
+	{
+		cdk::Msg read = co_await client.next_message();
+		if (!read)
+			co_return;
+		stats.uReads++;
+	}
+}
+
+static cdk::Task<> StopAfter(cdk::Executor& executor, uint32_t uSeconds)
+{
+	co_await executor.sleep_for(std::chrono::seconds(uSeconds));
+	executor.stop();
+}
+
+static void Usage()
+{
+	printf("usage: ANPR_HEALTH [options]\n"
+		"  --sensors N      number of simulated sensors (100)\n"
+		"  --port P         port of the first sensor (10001)\n"
+		"  --rate R         reads per second and per sensor (1)\n"
+		"  --interval I     status request interval per sensor, in ms (1000)\n"
+		"  --duration D     duration in seconds (10)\n");
+}
+
+int main(int argc, char** argv)
+{
+	CDKSimulatorConfig config;
+	CDKSimulatorDefaultConfig(&config);
+	config.uSensors = 100;
+	config.dRate = 1;
+	config.uJpegMin = 2048;
+	config.uJpegMax = 4096;
+	uint32_t uIntervalMs = 1000;
+	uint32_t uDuration = 10;
+
+	static const struct option options[] = {
+		{ "sensors", required_argument, nullptr, 'n' },
+		{ "port", required_argument, nullptr, 'p' },
+		{ "rate", required_argument, nullptr, 'r' },
+		{ "interval", required_argument, nullptr, 'i' },
+		{ "duration", required_argument, nullptr, 'd' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+	int iOption;
+	while ((iOption = getopt_long(argc, argv, "n:p:r:i:d:h", options, nullptr)) != -1)
+	{
+		switch (iOption)
+		{
+		case 'n': config.uSensors = (uint32_t)atoi(optarg); break;
+		case 'p': config.uBasePort = (uint16_t)atoi(optarg); break;
+		case 'r': config.dRate = atof(optarg); break;
+		case 'i': uIntervalMs = (uint32_t)atoi(optarg); break;
+		case 'd': uDuration = (uint32_t)atoi(optarg); break;
+		default: Usage(); return iOption == 'h' ? 0 : 1;
+		}
+	}
+
+	CDKSimulator* pSimulator = CDKSimulatorCreate(&config);
+	if (!pSimulator || CDKSimulatorStart(pSimulator) != CDK_OK)
+	{
+		fprintf(stderr, "cannot start simulator: %s\n", CDKGetLastError(pSimulator));
+		CDKSimulatorDestroy(pSimulator);
+		return 1;
+	}
+
+	std::vector<CDK*> cdks(config.uSensors);
+	uint32_t uConnected = 0;
+	for (uint32_t i = 0; i < config.uSensors; i++)
+	{
+		cdks[i] = CDKCreate();
+		CDKBind(cdks[i], "127.0.0.1", (uint16_t)(config.uBasePort + i), "reconnect=200");
+	}
+	for (CDK* pCDK : cdks)
+		uConnected += CDKWaitForConnection(pCDK, 5000) == CDK_OK ? 1 : 0;
+	printf("%u/%u CDK connected, 1 executor thread\n", uConnected, config.uSensors);
+
+	HealthStats stats;
+	{
+		cdk::Executor executor;
+		std::vector<cdk::Client> clients;
+		clients.reserve(cdks.size());
+		for (CDK* pCDK : cdks)
+		{
+			clients.emplace_back(executor, pCDK);
+			executor.spawn(PollStatus(executor, clients.back(), uIntervalMs, stats));
+			executor.spawn(ConsumeReads(clients.back(), stats));
+		}
+		executor.spawn(StopAfter(executor, uDuration));
+		auto start = std::chrono::steady_clock::now();
+		executor.run();
+		double dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// the pending requests are completed by the unbind, before the executor is destroyed
+		for (CDK* pCDK : cdks)
+			CDKDestroy(pCDK);
+		printf("total: sensors=%u answers=%" PRIu64 " failures=%" PRIu64 " requests/s=%.0f avg_request_ms=%.3f max_request_ms=%.3f reads=%" PRIu64 "\n",
+			config.uSensors, stats.uAnswers, stats.uFailures, (double)stats.uAnswers / dElapsed,
+			stats.uAnswers ? stats.dTotalLatencyMs / (double)stats.uAnswers : 0.0, stats.dMaxLatencyMs, stats.uReads);
+	}
+	CDKSimulatorDestroy(pSimulator);
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+	ANPR_REPLAY : replay of a recorded journal into a CDKQueue drained by a pool of workers.
+
+	ANPR_REPLAY --journal /tmp/journal
+		replays the journal with its recorded timing, and reports every second the messages pushed and
+		consumed, the queue drops and how long the oldest queued message has been waiting (consumer lag)
+	ANPR_REPLAY --journal /tmp/journal --speed 10 --workers 2 --work-us 300
+		10 times faster, into 2 workers spending 300 us per message : the consumer lag shows whether
+		2 workers keep up with 10 times the recorded traffic
+	ANPR_REPLAY --journal /tmp/journal --speed 0 --workers 0
+		as fast as possible, one worker per core
+*/
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKQueue.h"
+#include "ANPRJournal.h"
+#include "ANPRReplay.h"
+
+struct Worker
+{
+	/*! written by the worker only, on its own cache line */
+	alignas(64) std::atomic<uint64_t> uConsumed{0};
+	std::atomic<uint64_t> uBytes{0};
+};
+
+static std::atomic<bool> g_bInterrupted{false};
+
+static void OnSignal(int)
+{
+	g_bInterrupted = true;
+}
+
+static void Usage()
+{
+	printf("usage: ANPR_REPLAY --journal DIR [options]\n"
+		"  --journal DIR    journal to replay\n"
+		"  --speed S        1 for the recorded timing, N for N times faster, 0 for as fast as possible (1)\n"
+		"  --from-us T      first record appended at or after T, in us since the epoch (first record)\n"
+		"  --count N        number of records replayed, 0 for all (0)\n"
+		"  --loops L        number of times the records are replayed (1)\n"
+		"  --workers W      workers draining the queue, 0 for one per core (1)\n"
+		"  --work-us U      time a worker spends on every message, in us (0)\n"
+		"  --queue-size Q   maximum size of the queue (4096)\n"
+		"  --batch N        messages taken by a worker at once (64)\n"
+		"  --locked         use a locked queue instead of a lock-free queue\n"
+		"  --overflow P     newest, oldest or block[:ms] : what a full queue drops (newest)\n");
+}
+
+static void WorkerThread(CDKQueue* pQueue, Worker* pWorker, uint32_t uBatch, uint32_t uWorkUs, const std::atomic<bool>* pbStop)
+{
+	std::vector<CDKMsg*> batch(uBatch);
+	while (!pbStop->load(std::memory_order_relaxed))
+	{
+		if (CDKQueueWaitForNewMessages(pQueue, uBatch, 0, 100) != CDK_OK)
+			continue;
+		uint32_t uCount = CDKQueuePopMessages(pQueue, batch.data(), uBatch);
+		uint64_t uBytes = 0;
+		for (uint32_t i = 0; i < uCount; i++)
+		{
+			CDKMsgElement* pJpeg = CDKMsgElementFirstChild(CDKMsgChild(batch[i]), "jpeg");
+			uBytes += CDKMsgElementContentSize(pJpeg);
+			if (uWorkUs)
+			{
+				// stands for the processing of a read
+				auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(uWorkUs);
+				while (std::chrono::steady_clock::now() < until)
+					;
+			}
+			CDKMsgDestroy(batch[i]);
+		}
+		pWorker->uBytes.fetch_add(uBytes, std::memory_order_relaxed);
+		pWorker->uConsumed.fetch_add(uCount, std::memory_order_relaxed);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* strJournal = nullptr;
+	ANPRReplayConfig replayConfig;
+	ANPRReplayDefaultConfig(&replayConfig);
+	int64_t iFromUs = 0;
+	uint32_t uWorkers = 1;
+	uint32_t uWorkUs = 0;
+	uint32_t uQueueSize = 4096;
+	uint32_t uBatch = 64;
+	bool bLockFree = true;
+	uint32_t uOverflowPolicy = CDK_QUEUE_DROP_NEWEST;
+	uint32_t uBlockTimeout = 0;
+
+	static const struct option options[] = {
+		{ "journal", required_argument, nullptr, 'j' },
+		{ "speed", required_argument, nullptr, 's' },
+		{ "from-us", required_argument, nullptr, 'f' },
+		{ "count", required_argument, nullptr, 'c' },
+		{ "loops", required_argument, nullptr, 'L' },
+		{ "workers", required_argument, nullptr, 'w' },
+		{ "work-us", required_argument, nullptr, 'u' },
+		{ "queue-size", required_argument, nullptr, 'q' },
+		{ "batch", required_argument, nullptr, 'B' },
+		{ "locked", no_argument, nullptr, 'l' },
+		{ "overflow", required_argument, nullptr, 'o' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+	int iOption;
+	while ((iOption = getopt_long(argc, argv, "j:s:f:c:L:w:u:q:B:lo:h", options, nullptr)) != -1)
+	{
+		switch (iOption)
+		{
+		case 'j': strJournal = optarg; break;
+		case 's': replayConfig.dSpeed = atof(optarg); break;
+		case 'f': iFromUs = strtoll(optarg, nullptr, 10); break;
+		case 'c': replayConfig.uRecordCount = strtoull(optarg, nullptr, 10); break;
+		case 'L': replayConfig.uLoops = (uint32_t)atoi(optarg); break;
+		case 'w': uWorkers = (uint32_t)atoi(optarg); break;
+		case 'u': uWorkUs = (uint32_t)atoi(optarg); break;
+		case 'q': uQueueSize = (uint32_t)atoi(optarg); break;
+		case 'B': uBatch = std::max(1, atoi(optarg)); break;
+		case 'l': bLockFree = false; break;
+		case 'o':
+			if (strcmp(optarg, "newest") == 0)
+				uOverflowPolicy = CDK_QUEUE_DROP_NEWEST;
+			else if (strcmp(optarg, "oldest") == 0)
+				uOverflowPolicy = CDK_QUEUE_DROP_OLDEST;
+			else if (strncmp(optarg, "block", 5) == 0)
+			{
+				uOverflowPolicy = CDK_QUEUE_BLOCK;
+				uBlockTimeout = optarg[5] == ':' ? (uint32_t)atoi(optarg + 6) : 1000;
+			}
+			else
+			{
+				Usage();
+				return 1;
+			}
+			break;
+		default: Usage(); return iOption == 'h' ? 0 : 1;
+		}
+	}
+	if (!strJournal)
+	{
+		Usage();
+		return 1;
+	}
+	if (uWorkers == 0)
+		uWorkers = std::max(1u, std::thread::hardware_concurrency());
+
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+
+	ANPRJournalReader* pReader = ANPRJournalReaderCreate(strJournal);
+	if (!pReader)
+	{
+		fprintf(stderr, "cannot open journal: %s\n", CDKGetLastError(nullptr));
+		return 1;
+	}
+	if (iFromUs)
+		replayConfig.uFirstRecord = ANPRJournalReaderSeekAppended(pReader, iFromUs);
+	CDKQueue* pQueue = bLockFree ? CDKQueueCreateLockFree(uQueueSize) : CDKQueueCreate();
+	if (!bLockFree)
+		CDKQueueSetMaxQueueSize(pQueue, uQueueSize);
+	CDKQueueSetOverflowPolicy(pQueue, uOverflowPolicy, uBlockTimeout);
+	ANPRReplay* pReplay = ANPRReplayCreate(&replayConfig, pReader, pQueue);
+	if (!pReplay)
+	{
+		fprintf(stderr, "cannot create replay: %s\n", CDKGetLastError(nullptr));
+		return 1;
+	}
+	uint64_t uRecords = ANPRJournalReaderGetRecordCount(pReader);
+	printf("journal %s: %" PRIu64 " records, replaying from record %" PRIu64 " at %s, %u worker(s)\n", strJournal, uRecords,
+		std::min(replayConfig.uFirstRecord, uRecords), replayConfig.dSpeed > 0 ? "recorded timing" : "maximum speed", uWorkers);
+	if (replayConfig.dSpeed > 0 && replayConfig.dSpeed != 1)
+		printf("speed x%.1f\n", replayConfig.dSpeed);
+	fflush(stdout);
+
+	std::atomic<bool> bStop{false};
+	std::vector<Worker> workers(uWorkers);
+	std::vector<std::thread> threads;
+	for (Worker& worker : workers)
+		threads.emplace_back(WorkerThread, pQueue, &worker, uBatch, uWorkUs, &bStop);
+	auto consumed = [&] {
+		uint64_t uConsumed = 0;
+		for (Worker& worker : workers)
+			uConsumed += worker.uConsumed.load(std::memory_order_relaxed);
+		return uConsumed;
+	};
+
+	ANPRReplayStart(pReplay);
+	ANPRReplayStats stats;
+	uint64_t uLastPushed = 0;
+	uint64_t uLastConsumed = 0;
+	int64_t iMaxLagUs = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t uSecond = 1; !g_bInterrupted; uSecond++)
+	{
+		int64_t iWaitMs = std::chrono::duration_cast<std::chrono::milliseconds>(start + std::chrono::seconds(uSecond) - std::chrono::steady_clock::now()).count();
+		bool bDone = ANPRReplayWait(pReplay, (uint32_t)std::max<int64_t>(iWaitMs, 0)) == CDK_OK;
+		if (bDone)
+			std::this_thread::sleep_until(start + std::chrono::seconds(uSecond));
+		ANPRReplayGetStats(pReplay, &stats);
+		uint64_t uConsumed = consumed();
+		iMaxLagUs = std::max(iMaxLagUs, stats.iConsumerLagUs);
+		printf("t=%us pushed/s=%" PRIu64 " consumed/s=%" PRIu64 " drops=%" PRIu64 " queued=%u consumer_lag_ms=%.1f schedule_lag_ms=%.1f\n",
+			uSecond, stats.uPushed - uLastPushed, uConsumed - uLastConsumed, stats.uDrops, stats.uQueued,
+			(double)stats.iConsumerLagUs / 1000.0, (double)stats.iScheduleLagUs / 1000.0);
+		fflush(stdout);
+		uLastPushed = stats.uPushed;
+		uLastConsumed = uConsumed;
+		// every record pushed, and consumed or dropped
+		if (bDone && stats.uQueued == 0)
+			break;
+	}
+	ANPRReplayStop(pReplay);
+	ANPRReplayGetStats(pReplay, &stats);
+	double dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double dReplay = (double)stats.iElapsedUs / 1e6;
+	bStop = true;
+	for (std::thread& thread : threads)
+		thread.join();
+	uint64_t uBytes = 0;
+	for (Worker& worker : workers)
+		uBytes += worker.uBytes.load();
+
+	printf("total: pushed=%" PRIu64 " refused=%" PRIu64 " drops=%" PRIu64 " import_errors=%" PRIu64 " consumed=%" PRIu64
+		" replay_s=%.3f push_msgs/s=%.0f consume_msgs/s=%.0f jpeg_MB/s=%.1f max_consumer_lag_ms=%.1f\n",
+		stats.uPushed, stats.uRefused, stats.uDrops, stats.uImportErrors, consumed(), dReplay,
+		dReplay > 0 ? (double)stats.uPushed / dReplay : 0.0, (double)consumed() / dElapsed, (double)uBytes / dElapsed / 1e6,
+		(double)iMaxLagUs / 1000.0);
+
+	ANPRReplayDestroy(pReplay);
+	// messages left by an interruption
+	while (CDKMsg* pMsg = CDKQueuePopMessage(pQueue))
+		CDKMsgDestroy(pMsg);
+	CDKQueueDestroy(pQueue);
+	ANPRJournalReaderDestroy(pReader);
+	return 0;
+}
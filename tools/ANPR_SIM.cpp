@@ -0,0 +1,561 @@
+/*
+	ANPR_SIM : simulated SURVISION sensors on loopback, with an optional in-process load test.
+
+	ANPR_SIM --sensors 100 --rate 5 --serve
+		only serves the simulated sensors, until interrupted
+	ANPR_SIM --sensors 100 --rate 5 --duration 10
+		also binds one CDK per sensor, drains them through the ingestion engine and reports
+		sustained msgs/s, pop latency and message drops every second
+	ANPR_SIM --sensors 1000 --rate 1 --epoll
+		same, but the CDK queues are drained by a single thread waiting on their ready fds with epoll
+	ANPR_SIM --sensors 500 --unreachable 20 --connects 64
+		the fleet is bound by the connection supervisor, with sensors that never answer : the load test
+		starts as soon as the reachable sensors are connected
+	ANPR_SIM --sensors 100 --rate 10 --fanout 4
+		every message is shared with 4 consumers through the zero-copy fan-out stage
+	ANPR_SIM --sensors 100 --rate 10 --journal /tmp/journal --journal-sync group
+		every message is appended to a journal, read back through the mapped segments at the end
+*/
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "CDK.h"
+#include "CDKMsg.h"
+#include "CDKQueue.h"
+#include "CDKSimulator.h"
+#include "ANPRFanout.h"
+#include "ANPRFleet.h"
+#include "ANPRIngest.h"
+#include "ANPRJournal.h"
+#include "ANPRPlateRead.h"
+
+/*!
+	Log-linear latency histogram : 8 buckets per power of 2, in microseconds
+*/
+struct LatencyHistogram
+{
+	static const int SUB_BUCKETS = 8;
+	static const int BUCKETS = 40 * SUB_BUCKETS;
+	std::atomic<uint64_t> buckets[BUCKETS];
+
+	LatencyHistogram() { Reset(); }
+
+	void Reset()
+	{
+		for (std::atomic<uint64_t>& bucket : buckets)
+			bucket.store(0, std::memory_order_relaxed);
+	}
+
+	static int Index(uint64_t uValue)
+	{
+		if (uValue < SUB_BUCKETS)
+			return (int)uValue;
+		int iLog = 63 - __builtin_clzll(uValue);
+		int iSub = (int)((uValue >> (iLog - 3)) & (SUB_BUCKETS - 1));
+		int iIndex = (iLog - 2) * SUB_BUCKETS + iSub;
+		return iIndex < BUCKETS ? iIndex : BUCKETS - 1;
+	}
+
+	static uint64_t Value(int iIndex)
+	{
+		if (iIndex < SUB_BUCKETS)
+			return (uint64_t)iIndex;
+		int iLog = iIndex / SUB_BUCKETS + 2;
+		int iSub = iIndex % SUB_BUCKETS;
+		return ((uint64_t)(SUB_BUCKETS + iSub)) << (iLog - 3);
+	}
+
+	void Add(uint64_t uValue) { buckets[Index(uValue)].fetch_add(1, std::memory_order_relaxed); }
+
+	uint64_t Percentile(double dPercentile) const
+	{
+		uint64_t uTotal = 0;
+		for (const std::atomic<uint64_t>& bucket : buckets)
+			uTotal += bucket.load(std::memory_order_relaxed);
+		if (uTotal == 0)
+			return 0;
+		uint64_t uRank = (uint64_t)ceil(dPercentile / 100.0 * (double)uTotal);
+		uint64_t uSeen = 0;
+		for (int i = 0; i < BUCKETS; i++)
+		{
+			uSeen += buckets[i].load(std::memory_order_relaxed);
+			if (uSeen >= uRank)
+				return Value(i);
+		}
+		return Value(BUCKETS - 1);
+	}
+};
+
+struct LoadTest
+{
+	LatencyHistogram latency;
+	/*! messages processed by the epoll loop */
+	std::atomic<uint64_t> uProcessed{0};
+	/*! consumers every message is shared with, if any */
+	ANPRFanout* pFanout = nullptr;
+	/*! journal every message is appended to, if any */
+	ANPRJournal* pJournal = nullptr;
+	ANPRPlateReadSchema* pJournalSchema = nullptr;
+	std::atomic<bool> bStop{false};
+};
+
+static std::atomic<bool> g_bInterrupted{false};
+
+static void OnSignal(int)
+{
+	g_bInterrupted = true;
+}
+
+static void Usage()
+{
+	printf("usage: ANPR_SIM [options]\n"
+		"  --sensors N      number of simulated sensors (1)\n"
+		"  --port P         port of the first sensor (10001)\n"
+		"  --rate R         reads per second and per sensor (10)\n"
+		"  --burst B        reads sent back to back (1)\n"
+		"  --jpeg-min S     minimum picture size in bytes (20480)\n"
+		"  --jpeg-max S     maximum picture size in bytes (61440)\n"
+		"  --vehicles V     distinct vehicles in circulation (10000)\n"
+		"  --serve          only serve the sensors, until interrupted\n"
+		"  --duration D     load test duration in seconds (10)\n"
+		"  --workers W      ingestion workers of the load test, 0 for one per core (0)\n"
+		"  --queue-size Q   maximum size of each shared queue (4096)\n"
+		"  --batch N        messages taken by a worker at once (64)\n"
+		"  --batch-latency L time a message may wait for a batch to fill, in ms (0)\n"
+		"  --locked         use locked queues instead of lock-free queues\n"
+		"  --overflow P     newest, oldest or block[:ms] : what a full queue drops (newest)\n"
+		"  --epoll          drain the CDK queues from a single epoll thread instead of the ingestion engine\n"
+		"  --connects C     first connections in flight during the fleet startup (32)\n"
+		"  --unreachable U  sensors added to the fleet on an address that never answers (0)\n"
+		"  --fanout F       consumers every message is shared with, without copy (0)\n"
+		"  --journal DIR    append every message to a journal in DIR\n"
+		"  --journal-sync S none, group or interval[:ms] : when the journal is synchronized to disk (group)\n");
+}
+
+static int64_t LatencyOf(CDKMsg* pMsg)
+{
+	CDKMsgElement* pDecision = CDKMsgElementFirstChild(CDKMsgChild(pMsg), "decision");
+	const char* strTimestamp = CDKMsgElementAttributeValue(pDecision, "timestampUs");
+	if (!strTimestamp)
+		return -1;
+	return CDKSimulatorNowUs() - strtoll(strTimestamp, nullptr, 10);
+}
+
+static void OnMessage(CDKMsg* pMsg, CDK*, void*, uint32_t, void* pUser)
+{
+	LoadTest* pTest = (LoadTest*)pUser;
+	int64_t iLatency = LatencyOf(pMsg);
+	if (iLatency >= 0)
+		pTest->latency.Add((uint64_t)iLatency);
+	if (pTest->pJournal)
+	{
+		ANPRPlateRead read;
+		ANPRPlateReadExtract(pTest->pJournalSchema, pMsg, &read);
+		if (ANPRJournalAppend(pTest->pJournal, pMsg, read.uSensor, read.iTimestampUs, read.iSeq) != CDK_OK)
+			fprintf(stderr, "journal: %s\n", CDKGetLastError(pTest->pJournal));
+	}
+	if (pTest->pFanout)
+		ANPRFanoutPush(pTest->pFanout, pMsg);
+	else
+		CDKMsgDestroy(pMsg);
+}
+
+/*!
+	Fan-out consumer : reads the picture, as an archive or a journal would
+*/
+static void OnSharedMessage(CDKMsg* pMsg, uint32_t, void*)
+{
+	CDKMsgElement* pJpeg = CDKMsgElementFirstChild(CDKMsgChild(pMsg), "jpeg");
+	uint32_t uSize = CDKMsgElementContentSize(pJpeg);
+	volatile uint8_t uSink = uSize ? CDKMsgElementContent(pJpeg)[uSize - 1] : 0;
+	(void)uSink;
+}
+
+/*!
+	Drains every CDK from a single thread : their ready fds are multiplexed with epoll
+*/
+static void EpollLoop(const std::vector<CDK*>* pCDKs, LoadTest* pTest)
+{
+	int iEpoll = epoll_create1(EPOLL_CLOEXEC);
+	for (CDK* pCDK : *pCDKs)
+	{
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.ptr = pCDK;
+		if (epoll_ctl(iEpoll, EPOLL_CTL_ADD, CDKGetReadyFd(pCDK), &event) != 0)
+			fprintf(stderr, "cannot watch the ready fd of %s:%u\n", CDKGetAddress(pCDK), CDKGetPort(pCDK));
+	}
+	std::vector<epoll_event> events(256);
+	while (!pTest->bStop.load(std::memory_order_relaxed))
+	{
+		int iCount = epoll_wait(iEpoll, events.data(), (int)events.size(), 100);
+		for (int i = 0; i < iCount; i++)
+		{
+			CDK* pCDK = (CDK*)events[i].data.ptr;
+			// the fd stays readable until the queue is empty
+			while (CDKMsg* pMsg = CDKPopMessage(pCDK))
+			{
+				OnMessage(pMsg, pCDK, nullptr, 0, pTest);
+				pTest->uProcessed.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+	close(iEpoll);
+}
+
+int main(int argc, char** argv)
+{
+	CDKSimulatorConfig config;
+	CDKSimulatorDefaultConfig(&config);
+	bool bServe = false;
+	uint32_t uDuration = 10;
+	uint32_t uWorkers = 0;
+	uint32_t uQueueSize = 4096;
+	uint32_t uBatch = 64;
+	uint32_t uBatchLatency = 0;
+	uint32_t bLockFree = 1;
+	uint32_t uOverflowPolicy = CDK_QUEUE_DROP_NEWEST;
+	uint32_t uBlockTimeout = 0;
+	bool bEpoll = false;
+	ANPRFleetConfig fleetConfig;
+	ANPRFleetDefaultConfig(&fleetConfig);
+	fleetConfig.uReconnectMin = 200;
+	uint32_t uUnreachable = 0;
+	uint32_t uFanout = 0;
+	ANPRJournalConfig journalConfig;
+	ANPRJournalDefaultConfig(&journalConfig);
+
+	static const struct option options[] = {
+		{ "sensors", required_argument, nullptr, 'n' },
+		{ "port", required_argument, nullptr, 'p' },
+		{ "rate", required_argument, nullptr, 'r' },
+		{ "burst", required_argument, nullptr, 'b' },
+		{ "jpeg-min", required_argument, nullptr, 'j' },
+		{ "jpeg-max", required_argument, nullptr, 'J' },
+		{ "vehicles", required_argument, nullptr, 'v' },
+		{ "serve", no_argument, nullptr, 's' },
+		{ "duration", required_argument, nullptr, 'd' },
+		{ "workers", required_argument, nullptr, 'w' },
+		{ "queue-size", required_argument, nullptr, 'q' },
+		{ "batch", required_argument, nullptr, 'B' },
+		{ "batch-latency", required_argument, nullptr, 'L' },
+		{ "locked", no_argument, nullptr, 'l' },
+		{ "overflow", required_argument, nullptr, 'o' },
+		{ "epoll", no_argument, nullptr, 'e' },
+		{ "connects", required_argument, nullptr, 'c' },
+		{ "unreachable", required_argument, nullptr, 'u' },
+		{ "fanout", required_argument, nullptr, 'f' },
+		{ "journal", required_argument, nullptr, 'j' + 256 },
+		{ "journal-sync", required_argument, nullptr, 'S' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+	int iOption;
+	while ((iOption = getopt_long(argc, argv, "n:p:r:b:j:J:v:sd:w:q:B:L:lo:ec:u:f:S:h", options, nullptr)) != -1)
+	{
+		switch (iOption)
+		{
+		case 'n': config.uSensors = (uint32_t)atoi(optarg); break;
+		case 'p': config.uBasePort = (uint16_t)atoi(optarg); break;
+		case 'r': config.dRate = atof(optarg); break;
+		case 'b': config.uBurst = (uint32_t)atoi(optarg); break;
+		case 'j': config.uJpegMin = (uint32_t)atoi(optarg); break;
+		case 'J': config.uJpegMax = (uint32_t)atoi(optarg); break;
+		case 'v': config.uVehicles = (uint32_t)atoi(optarg); break;
+		case 's': bServe = true; break;
+		case 'd': uDuration = (uint32_t)atoi(optarg); break;
+		case 'w': uWorkers = (uint32_t)atoi(optarg); break;
+		case 'q': uQueueSize = (uint32_t)atoi(optarg); break;
+		case 'B': uBatch = (uint32_t)atoi(optarg); break;
+		case 'L': uBatchLatency = (uint32_t)atoi(optarg); break;
+		case 'l': bLockFree = 0; break;
+		case 'e': bEpoll = true; break;
+		case 'c': fleetConfig.uMaxConcurrentConnects = (uint32_t)atoi(optarg); break;
+		case 'u': uUnreachable = (uint32_t)atoi(optarg); break;
+		case 'f': uFanout = (uint32_t)atoi(optarg); break;
+		case 'j' + 256: journalConfig.strDirectory = optarg; break;
+		case 'S':
+			if (strcmp(optarg, "none") == 0)
+				journalConfig.uSyncPolicy = ANPR_JOURNAL_SYNC_NONE;
+			else if (strcmp(optarg, "group") == 0)
+				journalConfig.uSyncPolicy = ANPR_JOURNAL_SYNC_GROUP;
+			else if (strncmp(optarg, "interval", 8) == 0)
+			{
+				journalConfig.uSyncPolicy = ANPR_JOURNAL_SYNC_INTERVAL;
+				if (optarg[8] == ':')
+					journalConfig.uSyncInterval = (uint32_t)atoi(optarg + 9);
+			}
+			else
+			{
+				Usage();
+				return 1;
+			}
+			break;
+		case 'o':
+			if (strcmp(optarg, "newest") == 0)
+				uOverflowPolicy = CDK_QUEUE_DROP_NEWEST;
+			else if (strcmp(optarg, "oldest") == 0)
+				uOverflowPolicy = CDK_QUEUE_DROP_OLDEST;
+			else if (strncmp(optarg, "block", 5) == 0)
+			{
+				uOverflowPolicy = CDK_QUEUE_BLOCK;
+				uBlockTimeout = optarg[5] == ':' ? (uint32_t)atoi(optarg + 6) : 1000;
+			}
+			else
+			{
+				Usage();
+				return 1;
+			}
+			break;
+		default: Usage(); return iOption == 'h' ? 0 : 1;
+		}
+	}
+	if (config.uJpegMax < config.uJpegMin)
+		config.uJpegMax = config.uJpegMin;
+
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+
+	CDKSimulator* pSimulator = CDKSimulatorCreate(&config);
+	if (!pSimulator || CDKSimulatorStart(pSimulator) != CDK_OK)
+	{
+		fprintf(stderr, "cannot start simulator: %s\n", CDKGetLastError(pSimulator));
+		CDKSimulatorDestroy(pSimulator);
+		return 1;
+	}
+	printf("%u simulated sensor(s) on 127.0.0.1:%u-%u, %.1f reads/s each, bursts of %u\n", config.uSensors,
+		config.uBasePort, config.uBasePort + config.uSensors - 1, config.dRate, config.uBurst);
+	fflush(stdout);
+
+	if (bServe)
+	{
+		while (!g_bInterrupted)
+			sleep(1);
+		CDKSimulatorDestroy(pSimulator);
+		return 0;
+	}
+
+	// load test : every CDK is attached to the ingestion engine, drained by a fixed worker pool,
+	// or keeps its own queue, drained by the epoll thread
+	LoadTest test;
+	ANPRIngestConfig ingestConfig;
+	ANPRIngestDefaultConfig(&ingestConfig);
+	ingestConfig.uWorkers = uWorkers;
+	ingestConfig.uMaxQueueSize = uQueueSize;
+	ingestConfig.uBatchSize = uBatch;
+	ingestConfig.uBatchLatency = uBatchLatency;
+	ingestConfig.bLockFree = bLockFree;
+	ingestConfig.uOverflowPolicy = uOverflowPolicy;
+	ingestConfig.uBlockTimeout = uBlockTimeout;
+	if (uFanout)
+	{
+		test.pFanout = ANPRFanoutCreate(nullptr);
+		for (uint32_t i = 0; i < uFanout; i++)
+			ANPRFanoutAddConsumer(test.pFanout, OnSharedMessage, nullptr);
+		ANPRFanoutStart(test.pFanout);
+	}
+	if (journalConfig.strDirectory)
+	{
+		test.pJournal = ANPRJournalCreate(&journalConfig);
+		if (!test.pJournal)
+		{
+			fprintf(stderr, "cannot open journal: %s\n", CDKGetLastError(nullptr));
+			CDKSimulatorDestroy(pSimulator);
+			return 1;
+		}
+		// sensor, sequence number and timestamp only
+		test.pJournalSchema = ANPRPlateReadSchemaCreate();
+		for (uint32_t uField = 0; uField < ANPR_PLATE_READ_FIELDS; uField++)
+		{
+			if (uField != ANPR_PLATE_READ_SENSOR && uField != ANPR_PLATE_READ_SEQ && uField != ANPR_PLATE_READ_TIMESTAMP)
+				ANPRPlateReadSchemaSetPath(test.pJournalSchema, uField, nullptr);
+		}
+	}
+	ANPRIngest* pIngest = ANPRIngestCreate(&ingestConfig, OnMessage, &test);
+	// the fleet is bound in the background : messages flow as soon as the first sensors are connected
+	ANPRFleet* pFleet = ANPRFleetCreate(&fleetConfig, nullptr, nullptr);
+	std::vector<CDK*> cdks(config.uSensors);
+	for (uint32_t i = 0; i < config.uSensors; i++)
+	{
+		cdks[i] = CDKCreate();
+		if (bEpoll)
+			CDKSetMaxQueueSize(cdks[i], uQueueSize);
+		else
+			ANPRIngestAttach(pIngest, cdks[i], nullptr);
+		ANPRFleetAdd(pFleet, cdks[i], "127.0.0.1", (uint16_t)(config.uBasePort + i), 0);
+	}
+	// TEST-NET-1 (RFC 5737) : connection attempts time out
+	std::vector<CDK*> unreachable(uUnreachable);
+	for (uint32_t i = 0; i < uUnreachable; i++)
+	{
+		unreachable[i] = CDKCreate();
+		ANPRFleetAdd(pFleet, unreachable[i], "192.0.2.1", (uint16_t)(config.uBasePort + i), 0);
+	}
+	ANPRIngestStats ingestStats;
+	std::thread epollThread;
+	if (bEpoll)
+		epollThread = std::thread(EpollLoop, &cdks, &test);
+	else
+		ANPRIngestStart(pIngest);
+	auto fleetStart = std::chrono::steady_clock::now();
+	ANPRFleetStart(pFleet);
+	ANPRFleetWaitForReady(pFleet, 1, 5000);
+	double dFirstReadyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fleetStart).count();
+	ANPRFleetWaitForReady(pFleet, config.uSensors, 5000);
+	double dReadyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fleetStart).count();
+	ANPRFleetStats fleetStats;
+	ANPRFleetGetStats(pFleet, &fleetStats);
+	uint32_t uConnected = fleetStats.uConnected;
+	if (bEpoll)
+		printf("%u/%u CDK connected, first after %.1f ms, all after %.1f ms, 1 epoll thread\n", uConnected, fleetStats.uSensors, dFirstReadyMs, dReadyMs);
+	else
+	{
+		ANPRIngestGetStats(pIngest, &ingestStats);
+		printf("%u/%u CDK connected, first after %.1f ms, all after %.1f ms, %u worker(s), %u queue(s)\n", uConnected, fleetStats.uSensors,
+			dFirstReadyMs, dReadyMs, ingestStats.uWorkers, ingestStats.uQueues);
+	}
+	fflush(stdout);
+	auto getStats = [&] {
+		ANPRIngestGetStats(pIngest, &ingestStats);
+		if (bEpoll)
+		{
+			ingestStats.uProcessed = test.uProcessed.load();
+			ingestStats.uQueueDrops = 0;
+			for (CDK* pCDK : cdks)
+				ingestStats.uQueueDrops += CDKGetMessageDrops(pCDK);
+		}
+	};
+
+	uint64_t uLastPopped = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t uSecond = 1; uSecond <= uDuration && !g_bInterrupted; uSecond++)
+	{
+		std::this_thread::sleep_until(start + std::chrono::seconds(uSecond));
+		getStats();
+		uint64_t uTotal = ingestStats.uProcessed;
+		uint32_t uDrops = ingestStats.uQueueDrops;
+		CDKSimulatorStats stats;
+		CDKSimulatorGetStats(pSimulator, &stats);
+		printf("t=%us msgs/s=%" PRIu64 " pop_p50_us=%" PRIu64 " pop_p99_us=%" PRIu64 " drops=%u sim_backlog_drops=%" PRIu64 "\n",
+			uSecond, uTotal - uLastPopped, test.latency.Percentile(50), test.latency.Percentile(99), uDrops, stats.uReadsDropped);
+		fflush(stdout);
+		uLastPopped = uTotal;
+		test.latency.Reset();
+	}
+	double dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// synchronous request round trip, once per sensor
+	CDKMsg* pRequest = CDKMsgCreate();
+	CDKMsgSetChild(pRequest, CDKMsgElementCreate("getCurrentStatus"));
+	auto requestStart = std::chrono::steady_clock::now();
+	uint32_t uAnswers = 0;
+	for (CDK* pCDK : cdks)
+	{
+		CDKMsg* pAnswer = CDKSendRequest(pCDK, pRequest, 2000);
+		if (pAnswer)
+			uAnswers++;
+		CDKMsgDestroy(pAnswer);
+	}
+	double dRequestMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requestStart).count();
+
+	// pipelined sweep : every request is in flight at the same time
+	auto sweepStart = std::chrono::steady_clock::now();
+	std::vector<CDKRequest*> requests;
+	for (CDK* pCDK : cdks)
+		requests.push_back(CDKSendRequestAsync(pCDK, pRequest, 2000, nullptr));
+	uint32_t uSweepAnswers = 0;
+	for (CDKRequest* pPending : requests)
+	{
+		if (CDKRequestWait(pPending, 2000) == CDK_OK)
+		{
+			CDKMsg* pAnswer = CDKRequestTakeAnswer(pPending);
+			uSweepAnswers += pAnswer ? 1 : 0;
+			CDKMsgDestroy(pAnswer);
+		}
+		CDKRequestDestroy(pPending);
+	}
+	double dSweepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sweepStart).count();
+	CDKMsgDestroy(pRequest);
+
+	getStats();
+	test.bStop = true;
+	if (epollThread.joinable())
+		epollThread.join();
+	uint32_t uMaxSensorDrops = 0;
+	for (CDK* pCDK : cdks)
+		uMaxSensorDrops = std::max(uMaxSensorDrops, bEpoll ? CDKGetMessageDrops(pCDK) : ANPRIngestGetSourceDrops(pIngest, pCDK));
+	ANPRFleetDestroy(pFleet);
+	for (CDK* pCDK : unreachable)
+		CDKDestroy(pCDK);
+	ANPRIngestDestroy(pIngest);
+	uint64_t uFanoutDelivered = 0;
+	uint32_t uFanoutDrops = 0;
+	for (uint32_t i = 0; i < uFanout; i++)
+	{
+		ANPRFanoutConsumerStats consumerStats;
+		ANPRFanoutGetConsumerStats(test.pFanout, i, &consumerStats);
+		uFanoutDelivered += consumerStats.uDelivered;
+		uFanoutDrops += consumerStats.uDrops;
+	}
+	ANPRFanoutDestroy(test.pFanout);
+	ANPRJournalStats journalStats = {};
+	if (test.pJournal)
+	{
+		ANPRJournalFlush(test.pJournal);
+		ANPRJournalGetStats(test.pJournal, &journalStats);
+		ANPRJournalDestroy(test.pJournal);
+		ANPRPlateReadSchemaDestroy(test.pJournalSchema);
+	}
+	uint32_t uCDKDrops = 0;
+	for (CDK* pCDK : cdks)
+	{
+		uCDKDrops += CDKGetMessageDrops(pCDK);
+		CDKDestroy(pCDK);
+	}
+
+	CDKSimulatorStats stats;
+	CDKSimulatorGetStats(pSimulator, &stats);
+	CDKSimulatorDestroy(pSimulator);
+	printf("total: sensors=%u reads_sent=%" PRIu64 " popped=%" PRIu64 " msgs/s=%.0f MB/s=%.1f cdk_drops=%u queue_drops=%u max_sensor_drops=%u requests=%u/%u avg_request_ms=%.3f sweep=%u/%u sweep_ms=%.3f\n",
+		config.uSensors, stats.uReadsSent, ingestStats.uProcessed, (double)ingestStats.uProcessed / dElapsed,
+		(double)stats.uBytesSent / dElapsed / 1e6, uCDKDrops, ingestStats.uQueueDrops, uMaxSensorDrops, uAnswers, (uint32_t)cdks.size(),
+		cdks.empty() ? 0.0 : dRequestMs / (double)cdks.size(), uSweepAnswers, (uint32_t)cdks.size(), dSweepMs);
+	if (uFanout)
+		printf("fanout: consumers=%u delivered=%" PRIu64 " drops=%u\n", uFanout, uFanoutDelivered, uFanoutDrops);
+	if (journalConfig.strDirectory)
+	{
+		// read back : every record of the first sensor, found through the segment indexes and imported in place
+		ANPRJournalReader* pReader = ANPRJournalReaderCreate(journalConfig.strDirectory);
+		uint64_t uImported = 0;
+		auto import = [](const ANPRJournalRecord* pRecord, void* pUser) -> int32_t {
+			CDKMsg* pMsg = CDKMsgCreate();
+			if (CDKMsgImportFromBinaryArray(pMsg, pRecord->pData, pRecord->uSize) == CDK_OK)
+				(*(uint64_t*)pUser)++;
+			CDKMsgDestroy(pMsg);
+			return 1;
+		};
+		auto scanStart = std::chrono::steady_clock::now();
+		uint64_t uScanned = ANPRJournalReaderScan(pReader, 0, INT64_MIN, INT64_MAX, import, &uImported);
+		double dScanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanStart).count();
+		printf("journal: appended=%" PRIu64 " durable=%" PRIu64 " MB=%.1f MB/s=%.1f groups=%" PRIu64 " syncs=%" PRIu64 " segments=%u records=%" PRIu64
+			" sensor0=%" PRIu64 "/%" PRIu64 " scan_ms=%.3f\n", journalStats.uAppended, journalStats.uDurable, (double)journalStats.uBytes / 1e6,
+			(double)journalStats.uBytes / dElapsed / 1e6, journalStats.uGroups, journalStats.uSyncs, journalStats.uSegments,
+			ANPRJournalReaderGetRecordCount(pReader), uImported, uScanned, dScanMs);
+		ANPRJournalReaderDestroy(pReader);
+	}
+	return 0;
+}
@@ -0,0 +1,629 @@
+/*! \file
+
+CDKSimulator : simulates SURVISION equipments on the loopback interface.
+
+*/
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <new>
+
+#include "../src/CDKPrivate.h"
+#include "../src/CDKWire.h"
+#include "CDKSimulator.h"
+
+#define CDK_SIMULATOR_SIGNATURE_SIZE 128
+#define CDK_SIMULATOR_NOISE_POOL (1u << 20)
+#define CDK_SIMULATOR_MAX_EVENTS 64
+
+/*!
+	A CDK connected to a simulated sensor
+*/
+struct CDKSimulatorConnection
+{
+	int iSocket = -1;
+	uint32_t uSensor = 0;
+	std::vector<uint8_t> input;
+	std::vector<uint8_t> output;
+	size_t uOutputPos = 0;
+	bool bWantWrite = false;
+};
+
+struct CDKSimulatorSensor
+{
+	int iListenSocket = -1;
+	uint64_t uSeq = 0;
+	std::chrono::steady_clock::time_point nextBurst;
+	std::vector<CDKSimulatorConnection*> connections;
+};
+
+struct _cdksimulator : CDKObject
+{
+	CDKSimulatorConfig config;
+	std::vector<CDKSimulatorSensor> sensors;
+	int iEpoll = -1;
+	std::thread thread;
+	std::atomic<bool> bStop{false};
+	uint32_t uRandom = 0;
+
+	std::mutex statsMutex;
+	CDKSimulatorStats stats;
+};
+
+//---------------------------------------------------------------------------------------------
+// read generation
+//---------------------------------------------------------------------------------------------
+
+static uint64_t CDKSimulatorMix(uint64_t u)
+{
+	u += 0x9E3779B97F4A7C15ull;
+	u = (u ^ (u >> 30)) * 0xBF58476D1CE4E5B9ull;
+	u = (u ^ (u >> 27)) * 0x94D049BB133111EBull;
+	return u ^ (u >> 31);
+}
+
+static uint32_t CDKSimulatorNext(uint32_t& uState)
+{
+	uState ^= uState << 13;
+	uState ^= uState >> 17;
+	uState ^= uState << 5;
+	return uState;
+}
+
+static const uint8_t* CDKSimulatorNoisePool()
+{
+	static std::vector<uint8_t> pool;
+	static std::once_flag once;
+	std::call_once(once, [] {
+		pool.resize(CDK_SIMULATOR_NOISE_POOL);
+		uint32_t uState = 0x1234567;
+		for (uint8_t& b : pool)
+			b = (uint8_t)CDKSimulatorNext(uState);
+	});
+	return pool.data();
+}
+
+void CDKSimulatorVehiclePlate(uint32_t uVehicle, char* strPlate)
+{
+	// French SIV format : AB-123-CD
+	uint64_t u = CDKSimulatorMix(uVehicle);
+	strPlate[0] = (char)('A' + u % 26); u /= 26;
+	strPlate[1] = (char)('A' + u % 26); u /= 26;
+	strPlate[2] = '-';
+	strPlate[3] = (char)('0' + u % 10); u /= 10;
+	strPlate[4] = (char)('0' + u % 10); u /= 10;
+	strPlate[5] = (char)('0' + u % 10); u /= 10;
+	strPlate[6] = '-';
+	strPlate[7] = (char)('A' + u % 26); u /= 26;
+	strPlate[8] = (char)('A' + u % 26);
+	strPlate[9] = 0;
+}
+
+/*!
+	Replaces a character by one it is often confused with by OCR engines
+*/
+static char CDKSimulatorConfuse(char c)
+{
+	switch (c)
+	{
+	case 'O': return '0';
+	case '0': return 'O';
+	case 'B': return '8';
+	case '8': return 'B';
+	case 'I': return '1';
+	case '1': return 'I';
+	case 'S': return '5';
+	case '5': return 'S';
+	case 'Z': return '2';
+	case '2': return 'Z';
+	case 'G': return '6';
+	case '6': return 'G';
+	case 'D': return '0';
+	default: return c;
+	}
+}
+
+int64_t CDKSimulatorNowUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+CDKMsg* CDKSimulatorBuildRead(uint32_t uSensor, uint64_t uSeq, uint32_t uVehicle, uint32_t uJpegSize, uint32_t uNoise)
+{
+	char strPlate[16];
+	CDKSimulatorVehiclePlate(uVehicle, strPlate);
+	uint32_t uState = uNoise | 1;
+	// one read out of 16 has an OCR confusion
+	if ((CDKSimulatorNext(uState) & 15) == 0)
+	{
+		size_t uPos = CDKSimulatorNext(uState) % 9;
+		strPlate[uPos] = CDKSimulatorConfuse(strPlate[uPos]);
+	}
+
+	CDKMsg* pMsg = CDKMsgCreate();
+	CDKMsgElement* pRoot = CDKMsgElementCreate("anpr");
+	CDKMsgElement* pDecision = CDKMsgElementCreate("decision");
+	CDKMsgElement* pFingerprint = CDKMsgElementCreate("fingerprint");
+	CDKMsgElement* pSignature = CDKMsgElementCreate("signature");
+	if (!pMsg || !pRoot || !pDecision || !pFingerprint || !pSignature)
+	{
+		CDKMsgDestroy(pMsg);
+		CDKMsgElementDestroy(pRoot);
+		CDKMsgElementDestroy(pDecision);
+		CDKMsgElementDestroy(pFingerprint);
+		CDKMsgElementDestroy(pSignature);
+		return nullptr;
+	}
+	CDKMsgSetChild(pMsg, pRoot);
+	CDKMsgElementSetAttributeUInt(pRoot, "sensor", uSensor);
+	CDKMsgElementSetAttributeInt64(pRoot, "seq", (int64_t)uSeq);
+
+	int64_t iNowUs = CDKSimulatorNowUs();
+	CDKMsgElementAddChild(pRoot, pDecision);
+	CDKMsgElementSetAttribute(pDecision, "plate", strPlate);
+	CDKMsgElementSetAttributeUInt(pDecision, "reliability", 70 + CDKSimulatorNext(uState) % 30);
+	CDKMsgElementSetAttributeUInt(pDecision, "lane", 1 + uSensor % 4);
+	CDKMsgElementSetAttributeInt64(pDecision, "date", iNowUs / 1000);
+	CDKMsgElementSetAttributeInt64(pDecision, "timestampUs", iNowUs);
+
+	// fingerprint : two symbols per plate character of the real plate, plus a vehicle specific tail
+	char strRealPlate[16];
+	CDKSimulatorVehiclePlate(uVehicle, strRealPlate);
+	uint8_t fingerprint[24];
+	uint64_t uVehicleHash = CDKSimulatorMix(uVehicle ^ 0xF1F1F1F1u);
+	for (int i = 0; i < 9; i++)
+	{
+		fingerprint[2 * i] = (uint8_t)(strRealPlate[i] * 7);
+		fingerprint[2 * i + 1] = (uint8_t)(strRealPlate[i] * 13 + i);
+	}
+	for (int i = 18; i < 24; i++)
+		fingerprint[i] = (uint8_t)(uVehicleHash >> (8 * (i - 18)));
+	if ((CDKSimulatorNext(uState) & 3) == 0)
+		fingerprint[CDKSimulatorNext(uState) % 24] ^= 0x5A;
+	CDKMsgElementAddChild(pRoot, pFingerprint);
+	CDKMsgElementSetContentBinary(pFingerprint, fingerprint, sizeof(fingerprint));
+
+	// signature : vehicle specific features with small read to read noise
+	uint8_t signature[CDK_SIMULATOR_SIGNATURE_SIZE];
+	uint32_t uVehicleState = (uint32_t)uVehicleHash | 1;
+	for (uint8_t& b : signature)
+	{
+		int iValue = (int)(CDKSimulatorNext(uVehicleState) & 0xFF) + (int)(CDKSimulatorNext(uState) % 21) - 10;
+		b = (uint8_t)(iValue < 0 ? 0 : (iValue > 255 ? 255 : iValue));
+	}
+	CDKMsgElementAddChild(pRoot, pSignature);
+	CDKMsgElementSetContentBinary(pSignature, signature, sizeof(signature));
+
+	if (uJpegSize >= 4)
+	{
+		CDKMsgElement* pJpeg = CDKMsgElementCreate("jpeg");
+		if (pJpeg)
+		{
+			static thread_local std::vector<uint8_t> jpeg;
+			jpeg.resize(uJpegSize);
+			const uint8_t* pPool = CDKSimulatorNoisePool();
+			uint32_t uOffset = CDKSimulatorNext(uState) % CDK_SIMULATOR_NOISE_POOL;
+			for (uint32_t uPos = 0; uPos < uJpegSize; )
+			{
+				uint32_t uChunk = std::min(uJpegSize - uPos, CDK_SIMULATOR_NOISE_POOL - uOffset);
+				memcpy(jpeg.data() + uPos, pPool + uOffset, uChunk);
+				uPos += uChunk;
+				uOffset = 0;
+			}
+			jpeg[0] = 0xFF;
+			jpeg[1] = 0xD8;
+			jpeg[uJpegSize - 2] = 0xFF;
+			jpeg[uJpegSize - 1] = 0xD9;
+			CDKMsgElementAddChild(pRoot, pJpeg);
+			CDKMsgElementSetContentBinary(pJpeg, jpeg.data(), uJpegSize);
+		}
+	}
+	return pMsg;
+}
+
+//---------------------------------------------------------------------------------------------
+// event loop
+//---------------------------------------------------------------------------------------------
+
+static void CDKSimulatorClose(CDKSimulator* pSimulator, CDKSimulatorConnection* pConnection)
+{
+	CDKSimulatorSensor& sensor = pSimulator->sensors[pConnection->uSensor];
+	sensor.connections.erase(std::remove(sensor.connections.begin(), sensor.connections.end(), pConnection), sensor.connections.end());
+	epoll_ctl(pSimulator->iEpoll, EPOLL_CTL_DEL, pConnection->iSocket, nullptr);
+	close(pConnection->iSocket);
+	delete pConnection;
+	std::lock_guard<std::mutex> lock(pSimulator->statsMutex);
+	pSimulator->stats.uConnections--;
+}
+
+/*!
+	Sends as much pending output as possible
+	@returns false if the connection is broken
+*/
+static bool CDKSimulatorFlush(CDKSimulator* pSimulator, CDKSimulatorConnection* pConnection)
+{
+	while (pConnection->uOutputPos < pConnection->output.size())
+	{
+		ssize_t iSent = send(pConnection->iSocket, pConnection->output.data() + pConnection->uOutputPos,
+			pConnection->output.size() - pConnection->uOutputPos, MSG_NOSIGNAL);
+		if (iSent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return false;
+			break;
+		}
+		pConnection->uOutputPos += (size_t)iSent;
+	}
+	if (pConnection->uOutputPos == pConnection->output.size())
+	{
+		pConnection->output.clear();
+		pConnection->uOutputPos = 0;
+	}
+	bool bWantWrite = !pConnection->output.empty();
+	if (bWantWrite != pConnection->bWantWrite)
+	{
+		struct epoll_event event;
+		event.events = EPOLLIN | (bWantWrite ? (uint32_t)EPOLLOUT : 0u);
+		event.data.ptr = pConnection;
+		epoll_ctl(pSimulator->iEpoll, EPOLL_CTL_MOD, pConnection->iSocket, &event);
+		pConnection->bWantWrite = bWantWrite;
+	}
+	return true;
+}
+
+static bool CDKSimulatorQueueFrame(CDKSimulator* pSimulator, CDKSimulatorConnection* pConnection, const std::vector<uint8_t>& frame)
+{
+	if (pConnection->output.size() - pConnection->uOutputPos + frame.size() > pSimulator->config.uMaxBacklog)
+		return false;
+	pConnection->output.insert(pConnection->output.end(), frame.begin(), frame.end());
+	return true;
+}
+
+static void CDKSimulatorAnswer(CDKSimulator* pSimulator, CDKSimulatorConnection* pConnection, uint32_t uId, const uint8_t* pPayload, uint32_t uSize)
+{
+	CDKMsg* pRequest = CDKMsgCreate();
+	if (!pRequest)
+		return;
+	if (CDKMsgImportFromBinaryArray(pRequest, pPayload, uSize) != CDK_OK)
+	{
+		CDKMsgDestroy(pRequest);
+		return;
+	}
+	if (uId == 0)
+	{
+		CDKMsgDestroy(pRequest);
+		std::lock_guard<std::mutex> lock(pSimulator->statsMutex);
+		pSimulator->stats.uAsynchronousReceived++;
+		return;
+	}
+
+	// the answer echoes the request root element, with a status
+	CDKMsgElement* pRoot = CDKMsgChild(pRequest);
+	if (!pRoot)
+	{
+		pRoot = CDKMsgElementCreate("answer");
+		CDKMsgSetChild(pRequest, pRoot);
+	}
+	CDKMsgElementSetAttribute(pRoot, "status", "ok");
+	CDKMsgElementSetAttributeUInt(pRoot, "sensor", pConnection->uSensor);
+	std::vector<uint8_t> frame;
+	if (CDKWireEncodeFrame(pRequest, uId, frame) == CDK_OK)
+	{
+		// answers are never dropped
+		pConnection->output.insert(pConnection->output.end(), frame.begin(), frame.end());
+	}
+	CDKMsgDestroy(pRequest);
+	std::lock_guard<std::mutex> lock(pSimulator->statsMutex);
+	pSimulator->stats.uRequestsAnswered++;
+}
+
+/*!
+	Reads incoming frames
+	@returns false if the connection is closed
+*/
+static bool CDKSimulatorRead(CDKSimulator* pSimulator, CDKSimulatorConnection* pConnection)
+{
+	uint8_t buffer[16384];
+	for (;;)
+	{
+		ssize_t iRead = recv(pConnection->iSocket, buffer, sizeof(buffer), 0);
+		if (iRead < 0 && errno == EINTR)
+			continue;
+		if (iRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (iRead <= 0)
+			return false;
+		pConnection->input.insert(pConnection->input.end(), buffer, buffer + iRead);
+	}
+
+	size_t uPos = 0;
+	while (pConnection->input.size() - uPos >= CDK_WIRE_HEADER_SIZE)
+	{
+		uint32_t uSize;
+		uint32_t uId;
+		CDKWireDecodeHeader(pConnection->input.data() + uPos, &uSize, &uId);
+		if (uSize > CDK_WIRE_MAX_PAYLOAD)
+			return false;
+		if (pConnection->input.size() - uPos - CDK_WIRE_HEADER_SIZE < uSize)
+			break;
+		CDKSimulatorAnswer(pSimulator, pConnection, uId, pConnection->input.data() + uPos + CDK_WIRE_HEADER_SIZE, uSize);
+		uPos += CDK_WIRE_HEADER_SIZE + uSize;
+	}
+	pConnection->input.erase(pConnection->input.begin(), pConnection->input.begin() + uPos);
+	return CDKSimulatorFlush(pSimulator, pConnection);
+}
+
+static void CDKSimulatorAccept(CDKSimulator* pSimulator, uint32_t uSensor)
+{
+	for (;;)
+	{
+		int iSocket = accept4(pSimulator->sensors[uSensor].iListenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (iSocket < 0)
+			return;
+		int iOne = 1;
+		setsockopt(iSocket, IPPROTO_TCP, TCP_NODELAY, &iOne, sizeof(iOne));
+		CDKSimulatorConnection* pConnection = new (std::nothrow) CDKSimulatorConnection();
+		if (!pConnection)
+		{
+			close(iSocket);
+			return;
+		}
+		pConnection->iSocket = iSocket;
+		pConnection->uSensor = uSensor;
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = pConnection;
+		epoll_ctl(pSimulator->iEpoll, EPOLL_CTL_ADD, iSocket, &event);
+		pSimulator->sensors[uSensor].connections.push_back(pConnection);
+		std::lock_guard<std::mutex> lock(pSimulator->statsMutex);
+		pSimulator->stats.uConnections++;
+	}
+}
+
+static void CDKSimulatorSendBurst(CDKSimulator* pSimulator, uint32_t uSensor)
+{
+	CDKSimulatorSensor& sensor = pSimulator->sensors[uSensor];
+	const CDKSimulatorConfig& config = pSimulator->config;
+	uint64_t uSent = 0;
+	uint64_t uBytes = 0;
+	uint64_t uDropped = 0;
+	std::vector<uint8_t> frame;
+	for (uint32_t i = 0; i < config.uBurst; i++)
+	{
+		uint32_t uNoise = CDKSimulatorNext(pSimulator->uRandom);
+		uint32_t uVehicle = CDKSimulatorNext(pSimulator->uRandom) % config.uVehicles;
+		uint32_t uJpegSize = config.uJpegMin;
+		if (config.uJpegMax > config.uJpegMin)
+			uJpegSize += CDKSimulatorNext(pSimulator->uRandom) % (config.uJpegMax - config.uJpegMin);
+		CDKMsg* pMsg = CDKSimulatorBuildRead(uSensor, sensor.uSeq++, uVehicle, uJpegSize, uNoise);
+		if (!pMsg)
+			continue;
+		bool bEncoded = CDKWireEncodeFrame(pMsg, 0, frame) == CDK_OK;
+		CDKMsgDestroy(pMsg);
+		if (!bEncoded)
+			continue;
+		for (CDKSimulatorConnection* pConnection : sensor.connections)
+		{
+			if (CDKSimulatorQueueFrame(pSimulator, pConnection, frame))
+			{
+				uSent++;
+				uBytes += frame.size();
+			}
+			else
+				uDropped++;
+		}
+	}
+	std::vector<CDKSimulatorConnection*> broken;
+	for (CDKSimulatorConnection* pConnection : sensor.connections)
+	{
+		if (!CDKSimulatorFlush(pSimulator, pConnection))
+			broken.push_back(pConnection);
+	}
+	for (CDKSimulatorConnection* pConnection : broken)
+		CDKSimulatorClose(pSimulator, pConnection);
+
+	std::lock_guard<std::mutex> lock(pSimulator->statsMutex);
+	pSimulator->stats.uReadsSent += uSent;
+	pSimulator->stats.uBytesSent += uBytes;
+	pSimulator->stats.uReadsDropped += uDropped;
+}
+
+static void CDKSimulatorThread(CDKSimulator* pSimulator)
+{
+	const CDKSimulatorConfig& config = pSimulator->config;
+	auto burstInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(config.dRate > 0 ? config.uBurst / config.dRate : 3600.0));
+	auto now = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < pSimulator->sensors.size(); i++)
+	{
+		// spread the sensors over the first interval
+		pSimulator->sensors[i].nextBurst = now + burstInterval * i / pSimulator->sensors.size();
+	}
+
+	struct epoll_event events[CDK_SIMULATOR_MAX_EVENTS];
+	while (!pSimulator->bStop.load(std::memory_order_relaxed))
+	{
+		now = std::chrono::steady_clock::now();
+		auto nextDeadline = now + std::chrono::milliseconds(100);
+		for (uint32_t uSensor = 0; uSensor < pSimulator->sensors.size(); uSensor++)
+		{
+			CDKSimulatorSensor& sensor = pSimulator->sensors[uSensor];
+			if (sensor.nextBurst <= now)
+			{
+				if (!sensor.connections.empty())
+					CDKSimulatorSendBurst(pSimulator, uSensor);
+				sensor.nextBurst += burstInterval;
+				// do not try to catch up more than one second of delay
+				if (sensor.nextBurst + std::chrono::seconds(1) < now)
+					sensor.nextBurst = now + burstInterval;
+			}
+			nextDeadline = std::min(nextDeadline, sensor.nextBurst);
+		}
+
+		int iTimeoutMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(nextDeadline - std::chrono::steady_clock::now()).count();
+		int iCount = epoll_wait(pSimulator->iEpoll, events, CDK_SIMULATOR_MAX_EVENTS, iTimeoutMs > 0 ? iTimeoutMs : 0);
+		for (int i = 0; i < iCount; i++)
+		{
+			// listening sockets carry their sensor index, connections carry their address
+			uint64_t uData = events[i].data.u64;
+			if (uData < pSimulator->sensors.size())
+			{
+				CDKSimulatorAccept(pSimulator, (uint32_t)uData);
+				continue;
+			}
+			CDKSimulatorConnection* pConnection = (CDKSimulatorConnection*)events[i].data.ptr;
+			bool bOk = true;
+			if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+				bOk = CDKSimulatorRead(pSimulator, pConnection);
+			if (bOk && (events[i].events & EPOLLOUT))
+				bOk = CDKSimulatorFlush(pSimulator, pConnection);
+			if (!bOk)
+				CDKSimulatorClose(pSimulator, pConnection);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------
+// API
+//---------------------------------------------------------------------------------------------
+
+void CDKSimulatorDefaultConfig(CDKSimulatorConfig* pConfig)
+{
+	pConfig->uSensors = 1;
+	pConfig->uBasePort = 10001;
+	pConfig->dRate = 10.0;
+	pConfig->uBurst = 1;
+	pConfig->uJpegMin = 20 * 1024;
+	pConfig->uJpegMax = 60 * 1024;
+	pConfig->uVehicles = 10000;
+	pConfig->uMaxBacklog = 16 * 1024 * 1024;
+	pConfig->uSeed = 42;
+}
+
+CDKSimulator* CDKSimulatorCreate(const CDKSimulatorConfig* pConfig)
+{
+	if (!pConfig || pConfig->uSensors == 0 || pConfig->uBurst == 0 || pConfig->uVehicles == 0
+		|| pConfig->uJpegMax < pConfig->uJpegMin || (uint32_t)pConfig->uBasePort + pConfig->uSensors > 65536)
+	{
+		CDKSetLastError(nullptr, "invalid simulator configuration");
+		return nullptr;
+	}
+	CDKSimulator* pSimulator = new (std::nothrow) CDKSimulator();
+	if (!pSimulator)
+	{
+		CDKSetLastError(nullptr, "out of memory");
+		return nullptr;
+	}
+	pSimulator->config = *pConfig;
+	pSimulator->uRandom = pConfig->uSeed | 1;
+	memset(&pSimulator->stats, 0, sizeof(pSimulator->stats));
+	return pSimulator;
+}
+
+void CDKSimulatorDestroy(CDKSimulator* pSimulator)
+{
+	if (!pSimulator)
+		return;
+	CDKSimulatorStop(pSimulator);
+	delete pSimulator;
+}
+
+int32_t CDKSimulatorStart(CDKSimulator* pSimulator)
+{
+	if (!pSimulator)
+		return CDK_FAIL;
+	if (pSimulator->iEpoll >= 0)
+	{
+		CDKSetLastError(pSimulator, "simulator is already started");
+		return CDK_FAIL;
+	}
+	pSimulator->iEpoll = epoll_create1(EPOLL_CLOEXEC);
+	if (pSimulator->iEpoll < 0)
+	{
+		CDKSetLastError(pSimulator, "epoll_create1 failed: %s", strerror(errno));
+		return CDK_FAIL;
+	}
+
+	pSimulator->sensors.resize(pSimulator->config.uSensors);
+	for (uint32_t uSensor = 0; uSensor < pSimulator->config.uSensors; uSensor++)
+	{
+		uint16_t uPort = (uint16_t)(pSimulator->config.uBasePort + uSensor);
+		int iSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		int iOne = 1;
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(uPort);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (iSocket < 0 || setsockopt(iSocket, SOL_SOCKET, SO_REUSEADDR, &iOne, sizeof(iOne)) != 0
+			|| bind(iSocket, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(iSocket, 16) != 0)
+		{
+			CDKSetLastError(pSimulator, "cannot listen on port %u: %s", uPort, strerror(errno));
+			if (iSocket >= 0)
+				close(iSocket);
+			CDKSimulatorStop(pSimulator);
+			return CDK_FAIL;
+		}
+		pSimulator->sensors[uSensor].iListenSocket = iSocket;
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = uSensor;
+		epoll_ctl(pSimulator->iEpoll, EPOLL_CTL_ADD, iSocket, &event);
+	}
+
+	pSimulator->bStop = false;
+	try
+	{
+		pSimulator->thread = std::thread(CDKSimulatorThread, pSimulator);
+	}
+	catch (const std::system_error& e)
+	{
+		CDKSetLastError(pSimulator, "cannot start simulator thread: %s", e.what());
+		CDKSimulatorStop(pSimulator);
+		return CDK_FAIL;
+	}
+	return CDK_OK;
+}
+
+void CDKSimulatorStop(CDKSimulator* pSimulator)
+{
+	if (!pSimulator)
+		return;
+	pSimulator->bStop = true;
+	if (pSimulator->thread.joinable())
+		pSimulator->thread.join();
+	for (CDKSimulatorSensor& sensor : pSimulator->sensors)
+	{
+		while (!sensor.connections.empty())
+			CDKSimulatorClose(pSimulator, sensor.connections.back());
+		if (sensor.iListenSocket >= 0)
+			close(sensor.iListenSocket);
+	}
+	pSimulator->sensors.clear();
+	if (pSimulator->iEpoll >= 0)
+		close(pSimulator->iEpoll);
+	pSimulator->iEpoll = -1;
+}
+
+void CDKSimulatorGetStats(CDKSimulator* pSimulator, CDKSimulatorStats* pStats)
+{
+	if (!pSimulator || !pStats)
+		return;
+	std::lock_guard<std::mutex> lock(pSimulator->statsMutex);
+	*pStats = pSimulator->stats;
+}
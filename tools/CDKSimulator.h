@@ -0,0 +1,130 @@
+/*! \file
+
+CDKSimulator : simulates SURVISION equipments on the loopback interface, for load testing without cameras.<br/>
+Each virtual sensor listens on its own port, pushes plate reads to every connected CDK at the configured rate
+and answers synchronous requests immediately. All sensors are served by a single thread.
+
+*/
+
+#ifndef CDKSIMULATOR_H
+#define CDKSIMULATOR_H
+
+#include <stdint.h>
+
+#include "CDK.h"
+
+#ifdef __cplusplus
+extern "C"	{
+#endif
+
+/*! <summary>struct</summary>
+	A set of simulated equipments
+*/
+typedef struct _cdksimulator CDKSimulator;
+
+/*! <summary>struct</summary>
+	Configuration of a simulator
+*/
+typedef struct
+{
+	/*! number of simulated sensors */
+	uint32_t uSensors;
+	/*! port of the first sensor, the next sensors use the following ports */
+	uint16_t uBasePort;
+	/*! plate reads per second, per sensor */
+	double dRate;
+	/*! reads sent back to back in a burst. The bursts are spaced so that the average rate is dRate */
+	uint32_t uBurst;
+	/*! minimum and maximum size of the JPEG picture attached to each read, in bytes */
+	uint32_t uJpegMin;
+	uint32_t uJpegMax;
+	/*! number of distinct vehicles in circulation. Each read picks one of them */
+	uint32_t uVehicles;
+	/*! maximum number of bytes waiting to be sent on a connection. Reads are dropped beyond that */
+	uint32_t uMaxBacklog;
+	/*! seed of the pseudo random generator */
+	uint32_t uSeed;
+} CDKSimulatorConfig;
+
+/*! <summary>struct</summary>
+	Simulator counters
+*/
+typedef struct
+{
+	uint64_t uReadsSent;
+	uint64_t uBytesSent;
+	uint64_t uReadsDropped;
+	uint64_t uRequestsAnswered;
+	uint64_t uAsynchronousReceived;
+	uint32_t uConnections;
+} CDKSimulatorStats;
+
+/*!
+	Fills a configuration with default values : 1 sensor on port 10001, 10 reads/s, bursts of 1, 20 to 60 kB pictures.
+	@param[out] pConfig the configuration
+*/
+void CDKSimulatorDefaultConfig(CDKSimulatorConfig* pConfig);
+
+/*!
+	Creates a simulator. Use <a href="#CDKSimulatorDestroy">CDKSimulatorDestroy</a> to destroy it.
+	@param[in] pConfig the configuration, copied
+	@returns the simulator or NULL if there was an error
+*/
+CDKSimulator* CDKSimulatorCreate(const CDKSimulatorConfig* pConfig);
+
+/*!
+	Stops and destroys a simulator
+*/
+void CDKSimulatorDestroy(CDKSimulator* pSimulator);
+
+/*!
+	Opens the sensors ports and starts sending reads.
+	@returns CDK_OK on success. In case of failure, use <a href="#CDKGetLastError">CDKGetLastError</a> for more details
+*/
+int32_t CDKSimulatorStart(CDKSimulator* pSimulator);
+
+/*!
+	Closes every connection and the sensors ports
+*/
+void CDKSimulatorStop(CDKSimulator* pSimulator);
+
+/*!
+	Returns the simulator counters
+*/
+void CDKSimulatorGetStats(CDKSimulator* pSimulator, CDKSimulatorStats* pStats);
+
+/*!
+	Builds a plate read as sent by a simulated sensor :
+	<pre>
+	anpr sensor= seq=
+	  decision plate= reliability= lane= date= timestampUs=
+	  fingerprint (binary content)
+	  signature (binary content)
+	  jpeg (binary content)
+	</pre>
+	date is in ms since epoch, timestampUs is the CLOCK_REALTIME time in microseconds at which the read was built.
+	The same vehicle always gives close fingerprints and signatures ; the plate text is sometimes altered by an OCR confusion.
+	@param[in] uSensor sensor index
+	@param[in] uSeq sequence number of the read for this sensor
+	@param[in] uVehicle vehicle index
+	@param[in] uJpegSize size of the picture (0 for no picture)
+	@param[in] uNoise pseudo random value used for read to read variations
+	@returns the message (has to be destroyed by the application), or NULL on failure
+*/
+CDKMsg* CDKSimulatorBuildRead(uint32_t uSensor, uint64_t uSeq, uint32_t uVehicle, uint32_t uJpegSize, uint32_t uNoise);
+
+/*!
+	Writes the plate text of a vehicle, as read without OCR error, in strPlate (at least 16 bytes)
+*/
+void CDKSimulatorVehiclePlate(uint32_t uVehicle, char* strPlate);
+
+/*!
+	Returns the current CLOCK_REALTIME time in microseconds, as used by the timestampUs attribute
+*/
+int64_t CDKSimulatorNowUs();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CDKSIMULATOR_H